@@ -0,0 +1,182 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <random>
+#include <string>
+#include "json.hpp"
+
+// Client-side admission control for a fleet that starts all at once. Each
+// service the handshake calls has a "not before" time, set from 429/503
+// replies (their Retry-After, or a backoff of our own without one) and from
+// the "retry_after" hint in the backend's JSON replies. Calls wait it out
+// (or fail if it is far off) instead of adding to the herd. The times are
+// kept on disk so a relaunch honours them too.
+//
+// No Win32 dependency; clocks are wall-clock milliseconds (admission_now_ms)
+// and may be supplied by the caller, which is how the herd simulation runs
+// in virtual time. Thread-safe: replies are recorded on Offload threads.
+
+enum class AdmissionService { Backend, IpCheck, ProxyCheck };
+
+// What a reply said about coming back: the HTTP status (0 = no reply) and
+// the Retry-After header ("" if absent)
+struct ReplyStatus {
+    int status = 0;
+    std::string retry_after;
+};
+
+inline int64_t admission_now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+// Seconds to wait from a Retry-After value: delta-seconds or an IMF-fixdate
+// ("Wed, 21 Oct 2015 07:28:00 GMT"); -1 if it is neither
+inline double parse_retry_after(const std::string& value, int64_t now_ms) {
+    size_t digits = value.find_first_not_of("0123456789");
+    if (!value.empty() && digits == std::string::npos) return std::strtod(value.c_str(), nullptr);
+    char weekday[4] = {}, month[4] = {};
+    int day = 0, year = 0, hour = 0, minute = 0, second = 0;
+    if (std::sscanf(value.c_str(), "%3s, %d %3s %d %d:%d:%d GMT", weekday, &day, month, &year, &hour, &minute,
+                    &second) != 7) {
+        return -1;
+    }
+    static const char* months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    int m = 0;
+    while (m < 12 && std::string(month) != months[m]) ++m;
+    if (m == 12) return -1;
+    // Days since 1970-01-01 (proleptic Gregorian)
+    int y = year - (m < 2);
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (m + (m > 1 ? -2 : 10)) + 2) / 5 + day - 1;
+    int64_t days = (int64_t)era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+    int64_t at_ms = ((days * 24 + hour) * 60 + minute) * 60000ll + second * 1000ll;
+    return std::max(0.0, (at_ms - now_ms) / 1000.0);
+}
+
+class Admission {
+public:
+    static constexpr double MAX_HOLD_S = 3600;          // longer holds are cut to this
+    static constexpr double BACKOFF_BASE_S = 2;         // 429/503 without Retry-After: 2, 4, 8 .. s
+    static constexpr double BACKOFF_CAP_S = 300;
+
+    Admission() : rng_(std::random_device{}()) {}
+
+    // Keeps the holds in `path` ("" = this run only) and loads the ones an
+    // earlier run left
+    void open(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        path_ = path;
+        for (auto& s : services_) s = Service();
+        if (path_.empty()) return;
+        std::ifstream in(path_, std::ios::binary);
+        if (!in) return;
+        std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        nlohmann::json j = nlohmann::json::parse(text, nullptr, false);
+        if (!j.is_object()) return;
+        for (int i = 0; i < SERVICE_COUNT; ++i) {
+            const char* name = service_name((AdmissionService)i);
+            if (!j.contains(name) || !j[name].is_object()) continue;
+            services_[i].not_before_ms = j[name].value("not_before", (int64_t)0);
+            services_[i].strikes = j[name].value("strikes", 0u);
+        }
+    }
+
+    // Milliseconds to hold a call to `service`; 0 = go
+    double hold_ms(AdmissionService service, int64_t now_ms = admission_now_ms()) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return (double)std::max<int64_t>(0, services_[(int)service].not_before_ms - now_ms);
+    }
+
+    // The IP probes only serve a registration, so they also wait for the backend
+    double network_hold_ms(int64_t now_ms = admission_now_ms()) const {
+        return std::max({hold_ms(AdmissionService::Backend, now_ms), hold_ms(AdmissionService::IpCheck, now_ms),
+                         hold_ms(AdmissionService::ProxyCheck, now_ms)});
+    }
+
+    // Records a reply from `service`: 429 and 503 hold it, anything else
+    // that came back ends its run of backoffs
+    void on_reply(AdmissionService service, const ReplyStatus& reply, int64_t now_ms = admission_now_ms()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Service& s = services_[(int)service];
+        if (reply.status != 429 && reply.status != 503) {
+            if (reply.status != 0 && s.strikes != 0) {
+                s.strikes = 0;
+                save();
+            }
+            return;
+        }
+        double hold_s = parse_retry_after(reply.retry_after, now_ms);
+        if (hold_s < 0) {
+            double ceiling = std::min(BACKOFF_CAP_S, BACKOFF_BASE_S * std::pow(2.0, std::min(s.strikes, 20u)));
+            hold_s = std::uniform_real_distribution<double>(ceiling / 2, ceiling)(rng_);
+        }
+        ++s.strikes;
+        hold(s, hold_s, now_ms);
+    }
+
+    // The backend's {"retry_after": <seconds>} hint, in any JSON reply
+    void on_backend_reply(const std::string& body, int64_t now_ms = admission_now_ms()) {
+        if (body.empty() || body[0] != '{') return;
+        nlohmann::json j = nlohmann::json::parse(body, nullptr, false);
+        if (!j.is_object() || !j.contains("retry_after") || !j["retry_after"].is_number()) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        hold(services_[(int)AdmissionService::Backend], j["retry_after"].get<double>(), now_ms);
+    }
+
+    // A uniform delay in [0, window_ms) for a client's first call
+    double start_jitter_ms(double window_ms) {
+        if (window_ms <= 0) return 0;
+        std::lock_guard<std::mutex> lock(mutex_);
+        return std::uniform_real_distribution<double>(0, window_ms)(rng_);
+    }
+
+    static const char* service_name(AdmissionService service) {
+        switch (service) {
+            case AdmissionService::Backend: return "backend";
+            case AdmissionService::IpCheck: return "ipcheck";
+            case AdmissionService::ProxyCheck: return "proxycheck";
+        }
+        return "unknown";
+    }
+
+private:
+    static constexpr int SERVICE_COUNT = 3;
+
+    struct Service {
+        int64_t not_before_ms = 0;
+        unsigned strikes = 0;  // 429/503 replies in a row
+    };
+
+    // Holds only ever move later; a shorter hint does not shorten a hold
+    void hold(Service& s, double hold_s, int64_t now_ms) {
+        if (!(hold_s > 0)) return;
+        int64_t until = now_ms + (int64_t)(std::min(hold_s, MAX_HOLD_S) * 1000);
+        if (until <= s.not_before_ms) return;
+        s.not_before_ms = until;
+        save();
+    }
+
+    void save() const {
+        if (path_.empty()) return;
+        nlohmann::json j = nlohmann::json::object();
+        for (int i = 0; i < SERVICE_COUNT; ++i) {
+            j[service_name((AdmissionService)i)] = {{"not_before", services_[i].not_before_ms},
+                                                    {"strikes", services_[i].strikes}};
+        }
+        std::ofstream out(path_, std::ios::binary | std::ios::trunc);
+        out << j.dump();
+    }
+
+    mutable std::mutex mutex_;
+    std::string path_;
+    Service services_[SERVICE_COUNT];
+    std::mt19937 rng_;
+};
@@ -0,0 +1,448 @@
+#pragma once
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <openssl/evp.h>
+#include <zlib.h>
+
+// Static assets of the login shell, packed into one read-only blob that is
+// either compiled into the binary (asset_pack_data.h, see tools/asset_pack_tool)
+// or shipped next to it. Blobs are content-addressed: identical files are
+// stored once and keyed by the SHA-256 of their contents, which also serves as
+// the ETag. Blobs are gzip-compressed unless that does not make them smaller.
+//
+// Layout (little-endian):
+//   header   "MKAP" | u32 version | u32 entry_count | u32 blob_count | u32 strings_size
+//   entries  entry_count x { u32 path_off, u32 path_len, u32 type_off, u32 type_len, u32 blob }
+//            sorted by path, so lookups are a binary search over the pack itself
+//   blobs    blob_count x { u32 data_off, u32 stored_size, u32 raw_size, u32 encoding, u8 sha256[32] }
+//   strings  paths and content types
+//   data     blob contents, data_off is relative to the start of this section
+namespace AssetPackFormat {
+    constexpr char MAGIC[4] = {'M', 'K', 'A', 'P'};
+    constexpr uint32_t VERSION = 1;
+    constexpr size_t HEADER_SIZE = 20;
+    constexpr size_t ENTRY_SIZE = 20;
+    constexpr size_t BLOB_SIZE = 48;
+    constexpr uint32_t ENCODING_IDENTITY = 0;
+    constexpr uint32_t ENCODING_GZIP = 1;
+
+    inline uint32_t read_u32(const unsigned char* p) {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+
+    inline void write_u32(std::string& out, uint32_t v) {
+        for (int i = 0; i < 4; ++i) out.push_back((char)((v >> (8 * i)) & 0xff));
+    }
+}
+
+inline bool sha256_digest(const void* data, size_t len, unsigned char out[32]) {
+    unsigned int out_len = 0;
+    return EVP_Digest(data, len, out, &out_len, EVP_sha256(), nullptr) == 1 && out_len == 32;
+}
+
+inline std::string hex_encode(const unsigned char* data, size_t len) {
+    static const char HEX[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(len * 2);
+    for (size_t i = 0; i < len; ++i) {
+        out.push_back(HEX[data[i] >> 4]);
+        out.push_back(HEX[data[i] & 0x0f]);
+    }
+    return out;
+}
+
+// gzip (RFC 1952) so the stored bytes are also valid with Content-Encoding: gzip
+inline bool gzip_compress(const std::string& in, std::string& out, int level = 9) {
+    z_stream zs = {};
+    if (deflateInit2(&zs, level, Z_DEFLATED, 16 + MAX_WBITS, 9, Z_DEFAULT_STRATEGY) != Z_OK) return false;
+    out.resize(deflateBound(&zs, (uLong)in.size()) + 32);
+    zs.next_in = (Bytef*)in.data();
+    zs.avail_in = (uInt)in.size();
+    zs.next_out = (Bytef*)&out[0];
+    zs.avail_out = (uInt)out.size();
+    int rc = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return rc == Z_STREAM_END;
+}
+
+inline bool gzip_decompress(const unsigned char* in, size_t len, size_t raw_size, std::string& out) {
+    z_stream zs = {};
+    if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK) return false;
+    out.resize(raw_size);
+    zs.next_in = (Bytef*)in;
+    zs.avail_in = (uInt)len;
+    zs.next_out = (Bytef*)(raw_size ? &out[0] : nullptr);
+    zs.avail_out = (uInt)raw_size;
+    int rc = inflate(&zs, Z_FINISH);
+    bool ok = rc == Z_STREAM_END && zs.total_out == raw_size;
+    inflateEnd(&zs);
+    return ok;
+}
+
+// Read-only view of a pack. The bytes must outlive the AssetPack unless they
+// were loaded with load_file().
+class AssetPack {
+public:
+    struct Asset {
+        std::string path;
+        std::string content_type;
+        const unsigned char* data = nullptr;  // stored bytes
+        uint32_t stored_size = 0;
+        uint32_t raw_size = 0;
+        bool gzip = false;
+        uint32_t blob = 0;
+        const unsigned char* sha256 = nullptr;
+
+        std::string etag() const { return "\"" + hex_encode(sha256, 32) + "\""; }
+    };
+
+    // Validates the header and tables; the data itself is checked by verify().
+    bool load(const unsigned char* data, size_t size, std::string& error) {
+        using namespace AssetPackFormat;
+        data_ = nullptr;
+        if (size < HEADER_SIZE || memcmp(data, MAGIC, 4) != 0) return fail(error, "not an asset pack");
+        if (read_u32(data + 4) != VERSION) return fail(error, "unsupported asset pack version");
+        entry_count_ = read_u32(data + 8);
+        blob_count_ = read_u32(data + 12);
+        uint64_t strings_size = read_u32(data + 16);
+        uint64_t entries_end = HEADER_SIZE + (uint64_t)entry_count_ * ENTRY_SIZE;
+        uint64_t blobs_end = entries_end + (uint64_t)blob_count_ * BLOB_SIZE;
+        if (blobs_end + strings_size > size) return fail(error, "truncated asset pack");
+        entries_ = data + HEADER_SIZE;
+        blobs_ = data + entries_end;
+        strings_ = data + blobs_end;
+        strings_size_ = strings_size;
+        payload_ = strings_ + strings_size;
+        payload_size_ = size - (blobs_end + strings_size);
+
+        for (uint32_t i = 0; i < entry_count_; ++i) {
+            const unsigned char* e = entries_ + (size_t)i * ENTRY_SIZE;
+            if ((uint64_t)read_u32(e) + read_u32(e + 4) > strings_size_
+                || (uint64_t)read_u32(e + 8) + read_u32(e + 12) > strings_size_
+                || read_u32(e + 16) >= blob_count_) {
+                return fail(error, "corrupt asset pack entry");
+            }
+            if (i > 0 && !(path_at(i - 1) < path_at(i))) return fail(error, "asset pack entries not sorted");
+        }
+        for (uint32_t i = 0; i < blob_count_; ++i) {
+            const unsigned char* b = blobs_ + (size_t)i * BLOB_SIZE;
+            if ((uint64_t)read_u32(b) + read_u32(b + 4) > payload_size_ || read_u32(b + 12) > ENCODING_GZIP) {
+                return fail(error, "corrupt asset pack blob");
+            }
+        }
+        data_ = data;
+        return true;
+    }
+
+    // A path, not a narrow string, so non-ASCII file names open on Windows too.
+    bool load_file(const std::filesystem::path& path, std::string& error) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return fail(error, "cannot open the asset pack file");
+        owned_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        return load((const unsigned char*)owned_.data(), owned_.size(), error);
+    }
+
+    bool loaded() const { return data_ != nullptr; }
+    size_t size() const { return data_ ? entry_count_ : 0; }
+    size_t blob_count() const { return data_ ? blob_count_ : 0; }
+
+    // `path` is relative to the pack root, without a leading slash.
+    bool find(const std::string& path, Asset& out) const {
+        if (!data_) return false;
+        uint32_t lo = 0, hi = entry_count_;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            int cmp = compare_path(mid, path);
+            if (cmp == 0) {
+                out = at(mid);
+                return true;
+            }
+            if (cmp < 0) lo = mid + 1;
+            else hi = mid;
+        }
+        return false;
+    }
+
+    Asset at(size_t index) const {
+        using namespace AssetPackFormat;
+        const unsigned char* e = entries_ + index * ENTRY_SIZE;
+        Asset a;
+        a.path = path_at((uint32_t)index);
+        a.content_type.assign((const char*)strings_ + read_u32(e + 8), read_u32(e + 12));
+        a.blob = read_u32(e + 16);
+        const unsigned char* b = blobs_ + (size_t)a.blob * BLOB_SIZE;
+        a.data = payload_ + read_u32(b);
+        a.stored_size = read_u32(b + 4);
+        a.raw_size = read_u32(b + 8);
+        a.gzip = read_u32(b + 12) == ENCODING_GZIP;
+        a.sha256 = b + 16;
+        return a;
+    }
+
+    // Original file contents
+    bool read(const Asset& asset, std::string& out) const {
+        if (!asset.gzip) {
+            out.assign((const char*)asset.data, asset.stored_size);
+            return true;
+        }
+        return gzip_decompress(asset.data, asset.stored_size, asset.raw_size, out);
+    }
+
+    // Decompresses every blob and checks it against its SHA-256.
+    bool verify(std::string& error) const {
+        if (!data_) return fail(error, "no asset pack loaded");
+        std::vector<bool> checked(blob_count_, false);
+        std::string contents;
+        for (uint32_t i = 0; i < entry_count_; ++i) {
+            Asset a = at(i);
+            if (checked[a.blob]) continue;
+            unsigned char digest[32];
+            if (!read(a, contents) || !sha256_digest(contents.data(), contents.size(), digest)
+                || memcmp(digest, a.sha256, 32) != 0) {
+                return fail(error, "asset " + a.path + " does not match its hash");
+            }
+            checked[a.blob] = true;
+        }
+        return true;
+    }
+
+private:
+    // Same ordering as std::string::compare, without building a string
+    int compare_path(uint32_t index, const std::string& path) const {
+        const unsigned char* e = entries_ + (size_t)index * AssetPackFormat::ENTRY_SIZE;
+        const char* stored = (const char*)strings_ + AssetPackFormat::read_u32(e);
+        size_t len = AssetPackFormat::read_u32(e + 4);
+        int cmp = memcmp(stored, path.data(), std::min(len, path.size()));
+        if (cmp != 0) return cmp;
+        return len < path.size() ? -1 : (len > path.size() ? 1 : 0);
+    }
+
+    std::string path_at(uint32_t index) const {
+        const unsigned char* e = entries_ + (size_t)index * AssetPackFormat::ENTRY_SIZE;
+        return std::string((const char*)strings_ + AssetPackFormat::read_u32(e), AssetPackFormat::read_u32(e + 4));
+    }
+
+    static bool fail(std::string& error, const std::string& message) {
+        error = message;
+        return false;
+    }
+
+    const unsigned char* data_ = nullptr;
+    const unsigned char* entries_ = nullptr;
+    const unsigned char* blobs_ = nullptr;
+    const unsigned char* strings_ = nullptr;
+    const unsigned char* payload_ = nullptr;
+    uint64_t strings_size_ = 0;
+    uint64_t payload_size_ = 0;
+    uint32_t entry_count_ = 0;
+    uint32_t blob_count_ = 0;
+    std::string owned_;
+};
+
+// Maps request URLs under a prefix onto a pack and keeps the verified,
+// decompressed contents of every blob served so far. Used from one thread.
+class AssetServer {
+public:
+    bool open(const unsigned char* data, size_t size, const std::string& url_prefix, std::string& error) {
+        prefix_ = url_prefix;
+        return pack_.load(data, size, error);
+    }
+
+    bool open_file(const std::filesystem::path& path, const std::string& url_prefix, std::string& error) {
+        prefix_ = url_prefix;
+        return pack_.load_file(path, error);
+    }
+
+    bool enabled() const { return pack_.loaded() && !prefix_.empty(); }
+    const std::string& url_prefix() const { return prefix_; }
+    const AssetPack& pack() const { return pack_; }
+
+    // Pack path for `url`, or "" if the URL is outside the prefix. Query and
+    // fragment are ignored and %XX escapes decoded, as pack paths are stored
+    // unescaped (UTF-8); a trailing '/' maps to index.html.
+    std::string path_for(const std::string& url) const {
+        if (prefix_.empty() || url.compare(0, prefix_.size(), prefix_) != 0) return "";
+        size_t end = url.find_first_of("?#", prefix_.size());
+        std::string path = percent_decode(url.substr(prefix_.size(), end == std::string::npos ? end : end - prefix_.size()));
+        if (path.empty() || path.back() == '/') path += "index.html";
+        return path;
+    }
+
+    // Original contents of the asset behind `url`, checked against its hash
+    // the first time its blob is used. Returns nullptr when the request should
+    // go to the network instead (unknown path or a damaged blob).
+    const std::string* lookup(const std::string& url, AssetPack::Asset& asset) {
+        std::string path = path_for(url);
+        if (path.empty() || !pack_.find(path, asset)) {
+            ++misses_;
+            return nullptr;
+        }
+        auto cached = contents_.find(asset.blob);
+        if (cached != contents_.end()) {
+            ++hits_;
+            return &cached->second;
+        }
+        if (damaged_.count(asset.blob)) {
+            ++misses_;
+            return nullptr;
+        }
+        std::string contents;
+        unsigned char digest[32];
+        if (!pack_.read(asset, contents) || !sha256_digest(contents.data(), contents.size(), digest)
+            || memcmp(digest, asset.sha256, 32) != 0) {
+            damaged_[asset.blob] = true;
+            ++misses_;
+            return nullptr;
+        }
+        ++hits_;
+        return &(contents_[asset.blob] = std::move(contents));
+    }
+
+    uint64_t hits() const { return hits_; }
+    uint64_t misses() const { return misses_; }
+
+private:
+    // %XX escapes decoded; a '%' without two hex digits stays as it is
+    static std::string percent_decode(const std::string& text) {
+        auto hex = [](char c) {
+            return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        };
+        std::string out;
+        out.reserve(text.size());
+        for (size_t i = 0; i < text.size(); ++i) {
+            int high = text[i] == '%' && i + 2 < text.size() ? hex(text[i + 1]) : -1;
+            int low = high >= 0 ? hex(text[i + 2]) : -1;
+            if (low < 0) {
+                out += text[i];
+                continue;
+            }
+            out += (char)(high * 16 + low);
+            i += 2;
+        }
+        return out;
+    }
+
+    AssetPack pack_;
+    std::string prefix_;
+    std::map<uint32_t, std::string> contents_;
+    std::map<uint32_t, bool> damaged_;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+};
+
+// Builds a pack in memory. Files with identical contents share one blob.
+class AssetPackWriter {
+public:
+    void add(const std::string& path, const std::string& content_type, const std::string& contents) {
+        unsigned char digest[32];
+        sha256_digest(contents.data(), contents.size(), digest);
+        std::string key((const char*)digest, 32);
+        auto it = blob_index_.find(key);
+        uint32_t blob;
+        if (it != blob_index_.end()) {
+            blob = it->second;
+        } else {
+            Blob b;
+            memcpy(b.sha256, digest, 32);
+            b.raw_size = (uint32_t)contents.size();
+            std::string packed;
+            if (gzip_compress(contents, packed) && packed.size() < contents.size()) {
+                b.encoding = AssetPackFormat::ENCODING_GZIP;
+                b.data = std::move(packed);
+            } else {
+                b.encoding = AssetPackFormat::ENCODING_IDENTITY;
+                b.data = contents;
+            }
+            blob = (uint32_t)blobs_.size();
+            blobs_.push_back(std::move(b));
+            blob_index_[key] = blob;
+        }
+        entries_[path] = {content_type, blob};
+    }
+
+    size_t blob_count() const { return blobs_.size(); }
+
+    std::string build() const {
+        using namespace AssetPackFormat;
+        std::string strings, table, blob_table, payload;
+        for (const auto& entry : entries_) {
+            write_u32(table, (uint32_t)strings.size());
+            write_u32(table, (uint32_t)entry.first.size());
+            strings += entry.first;
+            write_u32(table, (uint32_t)strings.size());
+            write_u32(table, (uint32_t)entry.second.content_type.size());
+            strings += entry.second.content_type;
+            write_u32(table, entry.second.blob);
+        }
+        for (const auto& b : blobs_) {
+            write_u32(blob_table, (uint32_t)payload.size());
+            write_u32(blob_table, (uint32_t)b.data.size());
+            write_u32(blob_table, b.raw_size);
+            write_u32(blob_table, b.encoding);
+            blob_table.append((const char*)b.sha256, 32);
+            payload += b.data;
+        }
+        std::string out(MAGIC, 4);
+        write_u32(out, VERSION);
+        write_u32(out, (uint32_t)entries_.size());
+        write_u32(out, (uint32_t)blobs_.size());
+        write_u32(out, (uint32_t)strings.size());
+        return out + table + blob_table + strings + payload;
+    }
+
+private:
+    struct Blob {
+        unsigned char sha256[32];
+        uint32_t raw_size = 0;
+        uint32_t encoding = 0;
+        std::string data;
+    };
+    struct Entry {
+        std::string content_type;
+        uint32_t blob;
+    };
+
+    std::map<std::string, Entry> entries_;  // sorted by path, as the format requires
+    std::vector<Blob> blobs_;
+    std::map<std::string, uint32_t> blob_index_;
+};
+
+// Content type for a file name, by extension
+inline std::string asset_content_type(const std::string& path) {
+    static const struct { const char* ext; const char* type; } TYPES[] = {
+        {".html", "text/html; charset=utf-8"},
+        {".htm", "text/html; charset=utf-8"},
+        {".css", "text/css; charset=utf-8"},
+        {".js", "text/javascript; charset=utf-8"},
+        {".mjs", "text/javascript; charset=utf-8"},
+        {".json", "application/json"},
+        {".svg", "image/svg+xml"},
+        {".png", "image/png"},
+        {".jpg", "image/jpeg"},
+        {".jpeg", "image/jpeg"},
+        {".gif", "image/gif"},
+        {".webp", "image/webp"},
+        {".ico", "image/x-icon"},
+        {".woff", "font/woff"},
+        {".woff2", "font/woff2"},
+        {".ttf", "font/ttf"},
+        {".txt", "text/plain; charset=utf-8"},
+    };
+    size_t dot = path.rfind('.');
+    if (dot != std::string::npos) {
+        std::string ext = path.substr(dot);
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)tolower(c); });
+        for (const auto& t : TYPES) {
+            if (ext == t.ext) return t.type;
+        }
+    }
+    return "application/octet-stream";
+}
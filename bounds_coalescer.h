@@ -0,0 +1,82 @@
+#pragma once
+
+// What the host should push to the WebView2 controller
+struct BoundsUpdate {
+    bool resize = false;  // put_Bounds(0, 0, width, height)
+    int width = 0;
+    int height = 0;
+    bool rescale = false;  // put_RasterizationScale(scale)
+    double scale = 1.0;
+};
+
+// Folds bursts of WM_SIZE / WM_DPICHANGED into at most one controller update
+// per frame. Each event returns when the host should call flush(): 0 = now,
+// a positive delay = set a timer for that long, -1 = a flush is already
+// scheduled and will pick this event up. flush() reports only what changed
+// since the last update actually pushed.
+//
+// No Win32 dependency; times are milliseconds on any monotonic clock.
+class BoundsCoalescer {
+public:
+    explicit BoundsCoalescer(double frame_ms = 16.0) : frame_ms_(frame_ms) {}
+
+    double on_resize(int width, int height, double now_ms) {
+        pending_width_ = width;
+        pending_height_ = height;
+        return schedule(now_ms);
+    }
+
+    double on_scale(double scale, double now_ms) {
+        pending_scale_ = scale;
+        return schedule(now_ms);
+    }
+
+    // Fills `update` with the changes since the last flush; false if none.
+    bool flush(double now_ms, BoundsUpdate& update) {
+        scheduled_ = false;
+        update = BoundsUpdate();
+        if (pending_width_ >= 0 && (pending_width_ != width_ || pending_height_ != height_)) {
+            update.resize = true;
+            update.width = width_ = pending_width_;
+            update.height = height_ = pending_height_;
+        }
+        if (pending_scale_ > 0 && pending_scale_ != scale_) {
+            update.rescale = true;
+            update.scale = scale_ = pending_scale_;
+        }
+        if (!update.resize && !update.rescale) return false;
+        last_flush_ms_ = now_ms;
+        ++updates_;
+        return true;
+    }
+
+    // Forgets what was pushed, so the next flush reports the full state
+    // (e.g. for a controller created after the window was sized).
+    void invalidate() {
+        width_ = height_ = -1;
+        scale_ = 0;
+    }
+
+    bool scheduled() const { return scheduled_; }
+    unsigned long long events() const { return events_; }
+    unsigned long long updates() const { return updates_; }
+
+private:
+    double schedule(double now_ms) {
+        ++events_;
+        if (scheduled_) return -1;
+        scheduled_ = true;
+        double due = last_flush_ms_ < 0 ? now_ms : last_flush_ms_ + frame_ms_;
+        return due > now_ms ? due - now_ms : 0;
+    }
+
+    double frame_ms_;
+    int pending_width_ = -1, pending_height_ = -1;
+    double pending_scale_ = 0;
+    int width_ = -1, height_ = -1;
+    double scale_ = 0;
+    bool scheduled_ = false;
+    double last_flush_ms_ = -1;
+    unsigned long long events_ = 0;
+    unsigned long long updates_ = 0;
+};
@@ -18,6 +18,7 @@ echo Cleaned bin directory
 REM Compile the program
 echo Compiling...
 C:\msys64\ucrt64\bin\g++.exe ^
+    -std=c++20 ^
     -O2 ^
     -s ^
     -static-libgcc ^
@@ -30,6 +31,7 @@ C:\msys64\ucrt64\bin\g++.exe ^
     -lwininet ^
     -lssl ^
     -lcrypto ^
+    -lz ^
     -lbcrypt ^
     -lcrypt32 ^
     -lgdi32 ^
@@ -75,6 +77,9 @@ if %ERRORLEVEL% EQU 0 (
     if exist "C:\msys64\ucrt64\bin\libcrypto-3-x64.dll" (
         copy "C:\msys64\ucrt64\bin\libcrypto-3-x64.dll" ".\bin\" >nul 2>&1
     )
+    if exist "C:\msys64\ucrt64\bin\zlib1.dll" (
+        copy "C:\msys64\ucrt64\bin\zlib1.dll" ".\bin\" >nul 2>&1
+    )
     
     REM Clean up WebView2 cache directories (not needed for distribution)
     rd /S /Q ".\bin\*.WebView2" 2>nul
@@ -100,6 +100,7 @@ if ($Static) {
     Write-Host "Using static linking (single executable)..." -ForegroundColor Cyan
     $compileCommand = @(
         "C:\msys64\ucrt64\bin\g++.exe"
+        "-std=c++20"  # coroutines (task.h)
         "-O2"  # Optimization for release
         "-s"   # Strip symbols for smaller size
         "-mwindows"  # Windows subsystem (no console window)
@@ -116,6 +117,7 @@ if ($Static) {
         "-Wl,-Bstatic"
         "-lssl"
         "-lcrypto"
+        "-lz"
         "-Wl,-Bdynamic"
         "-lbcrypt"
         "-lcrypt32"
@@ -129,6 +131,7 @@ if ($Static) {
     Write-Host "Using optimized linking (OpenSSL embedded, WebView2 dynamic)..." -ForegroundColor Cyan
     $compileCommand = @(
         "C:\msys64\ucrt64\bin\g++.exe"
+        "-std=c++20"  # coroutines (task.h)
         "-O2"  # Optimization for release
         "-s"   # Strip symbols for smaller size
         "-mwindows"  # Windows subsystem (no console window)
@@ -144,6 +147,7 @@ if ($Static) {
         "-Wl,-Bstatic"
         "-lssl"
         "-lcrypto"
+        "-lz"
         "-Wl,-Bdynamic"
         "-lbcrypt"
         "-lcrypt32"
@@ -157,6 +161,7 @@ if ($Static) {
     Write-Host "Using dynamic linking (with DLLs)..." -ForegroundColor Cyan
     $compileCommand = @(
         "C:\msys64\ucrt64\bin\g++.exe"
+        "-std=c++20"  # coroutines (task.h)
         "-O2"  # Optimization for release
         "-s"   # Strip symbols for smaller size
         "-mwindows"  # Windows subsystem (no console window)
@@ -171,6 +176,7 @@ if ($Static) {
         "-lwininet"
         "-lssl"
         "-lcrypto"
+        "-lz"
         "-lbcrypt"
         "-lcrypt32"
         "-lgdi32"
@@ -264,6 +270,7 @@ if ($LASTEXITCODE -eq 0) {
         $opensslDlls = @(
             "libssl-3-x64.dll"
             "libcrypto-3-x64.dll"
+            "zlib1.dll"
         )
         
         Write-Host "Copying OpenSSL DLLs..." -ForegroundColor Yellow
@@ -0,0 +1,105 @@
+#pragma once
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <openssl/evp.h>
+
+// Canonical machine identity for backend indexing. The raw identifiers vary
+// in ways that do not mean a different machine (padding, case, the order WMI
+// lists disks in, firmware placeholders), so they are normalized first:
+//
+//   - each identifier is trimmed (ASCII whitespace and NULs) and lower-cased
+//   - firmware placeholders ("To Be Filled By O.E.M.", all-zero or all-F
+//     UUIDs, ...) count as missing
+//   - disk serials: all of them, normalized, without blanks or duplicates,
+//     sorted
+//
+// and joined as "v1|uuid=<uuid>|guid=<machine guid>|serials=<s1>,<s2>". The
+// SHA-256 of that string is the digest; its first 8 bytes (big-endian) are a
+// 64-bit key for hash tables. A machine with no identifier left has no
+// identity: canonical_fingerprint_known() is false, and its key would be the
+// same (e678733b4e87dec7) on every such machine. Test vectors are in
+// tools/canonical_fingerprint_test.cpp.
+
+// Trimmed and lower-cased; "" for firmware placeholders
+inline std::string normalize_identifier(const std::string& raw) {
+    size_t begin = 0, end = raw.size();
+    auto blank = [](char c) { return c == '\0' || std::isspace((unsigned char)c); };
+    while (begin < end && blank(raw[begin])) ++begin;
+    while (end > begin && blank(raw[end - 1])) --end;
+    std::string id = raw.substr(begin, end - begin);
+    for (auto& c : id) c = (char)std::tolower((unsigned char)c);
+
+    static const char* const PLACEHOLDERS[] = {
+        "to be filled by o.e.m.", "default string", "system serial number", "not applicable", "not specified",
+        "none", "n/a", "0",
+    };
+    for (const char* placeholder : PLACEHOLDERS) {
+        if (id == placeholder) return "";
+    }
+    // 00000000-0000-... and ffffffff-ffff-...: firmware that never set a UUID
+    if (id.size() >= 8 && (id.find_first_not_of("0-") == std::string::npos || id.find_first_not_of("f-") == std::string::npos)) {
+        return "";
+    }
+    return id;
+}
+
+inline std::string canonical_fingerprint(const std::string& uuid, const std::string& machine_guid,
+                                         const std::vector<std::string>& serials) {
+    std::vector<std::string> normalized;
+    for (const auto& serial : serials) {
+        std::string s = normalize_identifier(serial);
+        if (!s.empty()) normalized.push_back(s);
+    }
+    std::sort(normalized.begin(), normalized.end());
+    normalized.erase(std::unique(normalized.begin(), normalized.end()), normalized.end());
+
+    std::string canonical = "v1|uuid=" + normalize_identifier(uuid) + "|guid=" + normalize_identifier(machine_guid) + "|serials=";
+    for (size_t i = 0; i < normalized.size(); ++i) {
+        if (i) canonical += ",";
+        canonical += normalized[i];
+    }
+    return canonical;
+}
+
+// False when every identifier was blank or a placeholder
+inline bool canonical_fingerprint_known(const std::string& canonical) {
+    return canonical != "v1|uuid=|guid=|serials=";
+}
+
+struct FingerprintId {
+    unsigned char digest[32] = {};
+    uint64_t key = 0;  // digest[0..7], big-endian
+
+    // Unpadded base64url (43 characters)
+    std::string digest_text() const {
+        static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+        std::string out;
+        for (size_t i = 0; i < sizeof(digest); i += 3) {
+            uint32_t n = (uint32_t)digest[i] << 16;
+            if (i + 1 < sizeof(digest)) n |= (uint32_t)digest[i + 1] << 8;
+            if (i + 2 < sizeof(digest)) n |= digest[i + 2];
+            size_t chars = i + 2 < sizeof(digest) ? 4 : i + 1 < sizeof(digest) ? 3 : 2;
+            for (size_t c = 0; c < chars; ++c) out += alphabet[(n >> (18 - 6 * c)) & 0x3f];
+        }
+        return out;
+    }
+
+    // 16 hex digits
+    std::string key_text() const {
+        static const char hex[] = "0123456789abcdef";
+        std::string out(16, '0');
+        for (int i = 0; i < 16; ++i) out[i] = hex[(key >> (60 - 4 * i)) & 0xf];
+        return out;
+    }
+};
+
+inline FingerprintId fingerprint_id(const std::string& canonical) {
+    FingerprintId id;
+    unsigned int len = 0;
+    EVP_Digest(canonical.data(), canonical.size(), id.digest, &len, EVP_sha256(), nullptr);
+    for (int i = 0; i < 8; ++i) id.key = (id.key << 8) | id.digest[i];
+    return id;
+}
@@ -1,5 +1,7 @@
 #pragma once
 #include "config.h"
+#include "url_filter.h"
+#include <cstdio>
 #include <iostream>
 #include <string>
 
@@ -12,25 +14,54 @@ namespace ConfigUtils {
         std::cout << "  Name: " << config->get_app_name() << std::endl;
         std::cout << "  Version: " << config->get_app_version() << std::endl;
         std::cout << "  Window: " << config->get_window_width() << "x" << config->get_window_height() << std::endl;
+        char background[8];
+        snprintf(background, sizeof(background), "#%06X", config->get_background_color() & 0xFFFFFF);
+        std::cout << "  Background: " << background << std::endl;
+        std::cout << "  Per-Monitor DPI: " << (config->is_per_monitor_dpi() ? "YES" : "NO") << std::endl;
         std::cout << "  DCID: " << config->get_dcid() << std::endl;
+        std::cout << "  Resident Mode: " << (config->is_resident_mode() ? "YES" : "NO");
+        if (config->is_resident_mode()) std::cout << " (fingerprint refresh every " << config->get_resident_refresh_minutes() << " min)";
+        std::cout << std::endl;
+        std::cout << "  Max Sessions: " << config->get_max_sessions()
+                  << (config->should_isolate_sessions() ? " (isolated profiles)" : " (shared profile)") << std::endl;
+        std::cout << "  Idle Memory Trim: ";
+        if (config->get_idle_trim_minutes() > 0) std::cout << "after " << config->get_idle_trim_minutes() << " min" << std::endl;
+        else std::cout << "OFF" << std::endl;
         
         std::cout << "\nURLs:" << std::endl;
         std::cout << "  IP Check: " << config->get_ipcheck_url() << std::endl;
         std::cout << "  Proxy Check: " << config->get_proxycheck_url() << std::endl;
         std::cout << "  Backend: " << config->get_backend_url() << std::endl;
         std::cout << "  Login: " << config->get_login_base_url() << std::endl;
+        std::cout << "  Asset Prefix: " << (config->get_asset_url_prefix().empty() ? "(off)" : config->get_asset_url_prefix())
+                  << " [pack: " << config->get_asset_pack_file() << "]" << std::endl;
         
         std::cout << "\nSecurity:" << std::endl;
         std::cout << "  DevTools Disabled: " << (config->should_disable_devtools() ? "YES" : "NO") << std::endl;
         std::cout << "  Context Menu Disabled: " << (config->should_disable_context_menu() ? "YES" : "NO") << std::endl;
         std::cout << "  Text Selection Disabled: " << (config->should_disable_text_selection() ? "YES" : "NO") << std::endl;
         std::cout << "  Copy/Paste Disabled: " << (config->should_disable_copy_paste() ? "YES" : "NO") << std::endl;
+        std::cout << "  Token Cache: " << (config->get_token_cache_file().empty() ? "OFF" : config->get_token_cache_file()) << std::endl;
+        std::cout << "  Delta Registrations: " << (config->get_registration_state_file().empty() ? "OFF" : config->get_registration_state_file()) << std::endl;
+        std::cout << "  Offline Queue: " << (config->get_offline_queue_file().empty() ? "OFF" : config->get_offline_queue_file() + " (" + std::to_string(config->get_offline_queue_max_kb()) + " KB)") << std::endl;
+        std::cout << "  Batch Endpoint: " << (config->get_backend_batch_url().empty() ? "OFF" : config->get_backend_batch_url()) << std::endl;
+        std::cout << "  Start Jitter: " << config->get_start_jitter_ms() << " ms" << std::endl;
+        std::cout << "  Admission State: " << (config->get_admission_state_file().empty() ? "this run only" : config->get_admission_state_file()) << std::endl;
+        std::cout << "  Endpoint State: " << (config->get_endpoint_state_file().empty() ? "this run only" : config->get_endpoint_state_file())
+                  << (config->should_pin_backend_shard() ? " (backend pinned by fingerprint)" : "") << std::endl;
+        std::cout << "  HTTP Client: " << (config->get_tls_session_cache_file().empty() ? "WinINet" : "portable, TLS sessions in " + config->get_tls_session_cache_file())
+                  << (config->should_use_tls_early_data() && !config->get_tls_session_cache_file().empty() ? " (early data)" : "") << std::endl;
+        UrlFilter url_filter;
+        std::string filter_error;
+        if (!url_filter.load(config->get_url_filter_rules(), filter_error)) std::cout << "  URL Filter: INVALID (" << filter_error << ")" << std::endl;
+        else std::cout << "  URL Filter: " << (url_filter.empty() ? "OFF" : std::to_string(url_filter.size()) + " rules") << std::endl;
         
         std::cout << "\nDebug:" << std::endl;
         std::cout << "  Console Output: " << (config->is_debug_enabled() ? "ENABLED" : "DISABLED") << std::endl;
         std::cout << "  Log Server Responses: " << (config->should_log_server_responses() ? "YES" : "NO") << std::endl;
         std::cout << "  Log System Info: " << (config->should_log_system_info() ? "YES" : "NO") << std::endl;
         std::cout << "  Log Encrypted Data: " << (config->should_log_encrypted_data() ? "YES" : "NO") << std::endl;
+        std::cout << "  Log Timings: " << (config->should_log_timings() ? "YES" : "NO") << std::endl;
         
         std::cout << "\nNetwork:" << std::endl;
         std::cout << "  User Agent: " << config->get_user_agent() << std::endl;
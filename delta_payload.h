@@ -0,0 +1,80 @@
+#pragma once
+#include <string>
+#include <openssl/evp.h>
+#include "json.hpp"
+
+// Registrations sent as a delta against the last registration the backend
+// acknowledged. Most fields never change between launches, so a repeat
+// registration is usually only "regdate" (and the IP when it moved):
+//
+//   full   {"ip": ..., "hwid": ..., ..., "version": ...}
+//   delta  {"base": "<payload_hash of the acknowledged registration>",
+//           "delta": {"regdate": "..."}}
+//
+// The backend answers
+//   {"status": "accepted", "randkey": ..., "ack": "<payload_hash of the merged registration>"}
+// or, when it does not hold `base` (any more),
+//   {"status": "send_full"}
+// and the client sends the full registration instead. A client only sends
+// deltas after an "ack", so backends without delta support never get one.
+//
+// Shared by the client and the reference backend (server/).
+
+// 128-bit SHA-256 prefix (hex) of the registration's canonical JSON (object
+// keys sorted, no whitespace), so both sides hash the same bytes.
+inline std::string payload_hash(const nlohmann::json& registration) {
+    std::string canonical = registration.dump();
+    unsigned char hash[EVP_MAX_MD_SIZE];
+    unsigned int len = 0;
+    if (!EVP_Digest(canonical.data(), canonical.size(), hash, &len, EVP_sha256(), nullptr)) return "";
+    static const char hex[] = "0123456789abcdef";
+    std::string out;
+    for (unsigned int i = 0; i < 16 && i < len; ++i) {
+        out += hex[hash[i] >> 4];
+        out += hex[hash[i] & 0x0f];
+    }
+    return out;
+}
+
+// The fields of `full` that are new or differ from `base`
+inline nlohmann::json changed_fields(const nlohmann::json& full, const nlohmann::json& base) {
+    nlohmann::json changed = nlohmann::json::object();
+    for (auto it = full.begin(); it != full.end(); ++it) {
+        auto old = base.find(it.key());
+        if (old == base.end() || *old != it.value()) changed[it.key()] = it.value();
+    }
+    return changed;
+}
+
+// A delta cannot remove a field: a registration without one of the base's
+// fields (say "fpdigest", which older builds sent) goes in full
+inline bool keeps_fields(const nlohmann::json& full, const nlohmann::json& base) {
+    if (!base.is_object()) return false;
+    for (auto it = base.begin(); it != base.end(); ++it) {
+        if (!full.contains(it.key())) return false;
+    }
+    return true;
+}
+
+inline nlohmann::json delta_message(const nlohmann::json& full, const nlohmann::json& acknowledged) {
+    return {{"base", payload_hash(acknowledged)}, {"delta", changed_fields(full, acknowledged)}};
+}
+
+inline bool is_delta_message(const nlohmann::json& message) {
+    return message.is_object() && message.contains("base") && message["base"].is_string() && message.contains("delta") &&
+           message["delta"].is_object();
+}
+
+// Backend side: `base` with the message's delta applied
+inline nlohmann::json apply_delta(const nlohmann::json& base, const nlohmann::json& message) {
+    nlohmann::json full = base;
+    for (auto it = message["delta"].begin(); it != message["delta"].end(); ++it) full[it.key()] = it.value();
+    return full;
+}
+
+// Client side: the backend does not hold the base of our delta
+inline bool backend_wants_full(const std::string& reply) {
+    if (reply.empty() || reply[0] != '{') return false;
+    nlohmann::json j = nlohmann::json::parse(reply, nullptr, false);
+    return j.is_object() && j.value("status", "") == "send_full";
+}
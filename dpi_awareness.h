@@ -0,0 +1,53 @@
+#pragma once
+#include <windows.h>
+
+#ifndef DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2
+#define DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2 ((HANDLE)-4)
+#endif
+#ifndef WM_DPICHANGED
+#define WM_DPICHANGED 0x02E0
+#endif
+
+enum class DpiMode { Unaware, System, PerMonitor, PerMonitorV2 };
+
+// Makes the process per-monitor DPI aware, using the best API the running
+// Windows has: SetProcessDpiAwarenessContext (10 1703+), SetProcessDpiAwareness
+// (8.1+), else system-aware. The calls are looked up at runtime so the
+// binary still starts on older systems. Must run before any window exists.
+inline DpiMode enable_per_monitor_dpi() {
+    using SetContextFn = BOOL(WINAPI*)(HANDLE);
+    using SetAwarenessFn = HRESULT(WINAPI*)(int);
+    HMODULE user32 = GetModuleHandleW(L"user32.dll");
+    auto set_context = user32 ? (SetContextFn)(void*)GetProcAddress(user32, "SetProcessDpiAwarenessContext") : nullptr;
+    if (set_context && set_context(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2)) return DpiMode::PerMonitorV2;
+
+    HMODULE shcore = LoadLibraryW(L"shcore.dll");
+    auto set_awareness = shcore ? (SetAwarenessFn)(void*)GetProcAddress(shcore, "SetProcessDpiAwareness") : nullptr;
+    if (set_awareness && SUCCEEDED(set_awareness(2 /* PROCESS_PER_MONITOR_DPI_AWARE */))) return DpiMode::PerMonitor;
+
+    return SetProcessDPIAware() ? DpiMode::System : DpiMode::Unaware;
+}
+
+inline const char* dpi_mode_name(DpiMode mode) {
+    switch (mode) {
+    case DpiMode::PerMonitorV2: return "per-monitor v2";
+    case DpiMode::PerMonitor: return "per-monitor";
+    case DpiMode::System: return "system";
+    default: return "unaware";
+    }
+}
+
+// DPI of the monitor showing `hwnd` (GetDpiForWindow, Windows 10 1607+), or
+// the system DPI. 96 = 100 %.
+inline UINT window_dpi(HWND hwnd) {
+    using GetDpiFn = UINT(WINAPI*)(HWND);
+    static auto get_dpi = (GetDpiFn)(void*)GetProcAddress(GetModuleHandleW(L"user32.dll"), "GetDpiForWindow");
+    UINT dpi = get_dpi && hwnd ? get_dpi(hwnd) : 0;
+    if (dpi) return dpi;
+    HDC screen = GetDC(nullptr);
+    dpi = (UINT)GetDeviceCaps(screen, LOGPIXELSX);
+    ReleaseDC(nullptr, screen);
+    return dpi ? dpi : 96;
+}
+
+inline int scale_for_dpi(int value, UINT dpi) { return MulDiv(value, (int)dpi, 96); }
@@ -32,8 +32,17 @@ inline std::string base64_encode(const std::string& data) {
     return encoded;
 }
 
-// Encrypt using RSA OAEP + SHA-256 and base64-encode output (from string)
-inline std::string encrypt_data_from_key_string(const nlohmann::json& data, const std::string& public_key_content) {
+// Largest plaintext one RSA-OAEP-SHA256 block holds: the key size less two
+// digests and two bytes (190 bytes at 2048 bits, 318 at 3072)
+inline size_t oaep_sha256_capacity(EVP_PKEY* key) {
+    int size = EVP_PKEY_get_size(key);
+    return size > 66 ? (size_t)size - 66 : 0;
+}
+
+// Encrypt using RSA OAEP + SHA-256 and base64-encode output (from string).
+// Data larger than one block is refused with the reason in `error`.
+inline std::string encrypt_data_from_key_string(const nlohmann::json& data, const std::string& public_key_content,
+                                                std::string* error = nullptr) {
     std::string data_str = data.dump();
 
     BIO* bio = BIO_new_mem_buf(public_key_content.data(), (int)public_key_content.size());
@@ -41,7 +50,20 @@ inline std::string encrypt_data_from_key_string(const nlohmann::json& data, cons
 
     EVP_PKEY* pubkey = PEM_read_bio_PUBKEY(bio, nullptr, nullptr, nullptr);
     BIO_free(bio);
-    if (!pubkey) return "";
+    if (!pubkey) {
+        if (error) *error = "public key is not a PEM public key";
+        return "";
+    }
+
+    size_t capacity = oaep_sha256_capacity(pubkey);
+    if (data_str.size() > capacity) {
+        if (error) {
+            *error = "data is " + std::to_string(data_str.size()) + " bytes; the public key's RSA-OAEP limit is " +
+                     std::to_string(capacity);
+        }
+        EVP_PKEY_free(pubkey);
+        return "";
+    }
 
     EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new(pubkey, nullptr);
     if (!ctx) {
@@ -87,9 +109,8 @@ inline std::string encrypt_data_from_key_string(const nlohmann::json& data, cons
 }
 
 // Encrypt using RSA OAEP + SHA-256 and base64-encode output (from file)
-inline std::string encrypt_data(const nlohmann::json& data, const std::string& public_key_path) {
-    std::string data_str = data.dump();
+inline std::string encrypt_data(const nlohmann::json& data, const std::string& public_key_path, std::string* error = nullptr) {
     std::string pubkey_str = read_file(public_key_path);
-    
-    return encrypt_data_from_key_string(data, pubkey_str);
+
+    return encrypt_data_from_key_string(data, pubkey_str, error);
 }
\ No newline at end of file
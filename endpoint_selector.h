@@ -0,0 +1,243 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+#include "json.hpp"
+
+// Mirror selection for IPCHECK_URL, PROXYCHECK_URL, BACKEND_URL and
+// BACKEND_BATCH_URL, each of which may list several mirrors. Every call
+// records its mirror's latency and whether it answered; mirrors are tried
+// cheapest first (EWMA latency plus a cost per error), now and then another
+// one is tried first to notice when it has become faster, and one that
+// failed several times in a row goes to the back for a while. The figures
+// are kept on disk so the next launch starts with them.
+//
+// With pinning, the order is instead a rendezvous hash of the machine's
+// fpkey (canonical_fingerprint.h) over the mirrors: a machine keeps its
+// backend shard, and adding or removing a shard moves only the machines of
+// that shard.
+//
+// No Win32 dependency; clocks are wall-clock milliseconds and may be
+// supplied by the caller (tools/endpoint_sim.cpp runs in virtual time).
+// Thread-safe: calls are recorded on Offload threads.
+
+// The mirrors of a config value: URLs separated by spaces, commas or newlines
+inline std::vector<std::string> split_endpoint_list(const std::string& list) {
+    std::vector<std::string> urls;
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t start = list.find_first_not_of(" ,\t\r\n", pos);
+        if (start == std::string::npos) break;
+        size_t end = list.find_first_of(" ,\t\r\n", start);
+        if (end == std::string::npos) end = list.size();
+        std::string url = list.substr(start, end - start);
+        if (std::find(urls.begin(), urls.end(), url) == urls.end()) urls.push_back(url);
+        pos = end;
+    }
+    return urls;
+}
+
+// The first mirror of a list ("" if none); for callers without a selector
+inline std::string first_endpoint(const std::string& list) {
+    std::vector<std::string> urls = split_endpoint_list(list);
+    return urls.empty() ? std::string() : urls[0];
+}
+
+inline int64_t endpoint_now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+// What one call to a mirror came to
+enum class EndpointResult {
+    Ok,      // answered
+    Failed,  // no reply or a server error: the next mirror is tried
+    Busy     // 429/503: left to admission.h; other mirrors are not tried
+};
+
+class EndpointSelector {
+public:
+    static constexpr double ALPHA = 0.2;              // weight of a new sample in the EWMAs
+    static constexpr double ERROR_COST_MS = 5000;     // an error rate of 1 costs like this much latency
+    static constexpr double EXPLORE = 0.05;           // share of calls that try another mirror first
+    static constexpr unsigned DOWN_AFTER = 3;         // failures in a row that send a mirror to the back ..
+    static constexpr int64_t DOWN_FOR_MS = 60 * 1000;  // .. for this long
+    static constexpr int64_t FORGET_AFTER_MS = 30ll * 24 * 3600 * 1000;  // unused mirrors are dropped from the file
+
+    struct Stats {
+        double latency_ms = 0;  // EWMA over the calls that answered
+        double error_rate = 0;  // EWMA of failures (1) and answers (0)
+        unsigned samples = 0;
+        unsigned failures = 0;  // in a row
+        int64_t last_ms = 0;    // last call
+    };
+
+    EndpointSelector() : rng_(std::random_device{}()) {}
+
+    // Keeps the figures in `path` ("" = this run only) and loads the ones an
+    // earlier run left
+    void open(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        path_ = path;
+        stats_.clear();
+        shard_key_ = 0;
+        if (path_.empty()) return;
+        std::ifstream in(path_, std::ios::binary);
+        if (!in) return;
+        std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        nlohmann::json j = nlohmann::json::parse(text, nullptr, false);
+        if (!j.is_object()) return;
+        shard_key_ = std::strtoull(j.value("shard_key", "").c_str(), nullptr, 16);
+        if (!j.contains("endpoints") || !j["endpoints"].is_object()) return;
+        for (auto& [url, e] : j["endpoints"].items()) {
+            if (!e.is_object()) continue;
+            Stats s;
+            s.latency_ms = e.value("latency_ms", 0.0);
+            s.error_rate = std::clamp(e.value("error_rate", 0.0), 0.0, 1.0);
+            s.samples = e.value("samples", 0u);
+            s.failures = e.value("failures", 0u);
+            s.last_ms = e.value("last", (int64_t)0);
+            stats_[url] = s;
+        }
+    }
+
+    // The machine's fpkey, for pinned orders; kept with the figures so the
+    // offline queue drain pins the same way before the first login
+    void set_shard_key(uint64_t key) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (key == shard_key_) return;
+        shard_key_ = key;
+        save();
+    }
+
+    uint64_t shard_key() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return shard_key_;
+    }
+
+    // The mirrors of `list` in the order to try them. `pinned` ranks them by
+    // the shard key (if one is set) instead of by cost.
+    std::vector<std::string> order(const std::string& list, bool pinned = false, int64_t now_ms = endpoint_now_ms()) {
+        std::vector<std::string> urls = split_endpoint_list(list);
+        if (urls.size() < 2) return urls;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pinned && shard_key_ != 0) {
+            std::vector<uint64_t> weight(urls.size());
+            for (size_t i = 0; i < urls.size(); ++i) weight[i] = rendezvous_weight(shard_key_, urls[i]);
+            std::vector<size_t> rank(urls.size());
+            for (size_t i = 0; i < rank.size(); ++i) rank[i] = i;
+            std::sort(rank.begin(), rank.end(), [&](size_t a, size_t b) { return weight[a] > weight[b]; });
+            std::vector<std::string> ranked;
+            for (size_t i : rank) ranked.push_back(urls[i]);
+            urls = std::move(ranked);
+        } else {
+            // Mirrors never called cost nothing, so each is tried once
+            std::vector<double> cost(urls.size());
+            for (size_t i = 0; i < urls.size(); ++i) cost[i] = cost_of(urls[i]);
+            std::vector<size_t> rank(urls.size());
+            for (size_t i = 0; i < rank.size(); ++i) rank[i] = i;
+            std::stable_sort(rank.begin(), rank.end(), [&](size_t a, size_t b) { return cost[a] < cost[b]; });
+            std::vector<std::string> ranked;
+            for (size_t i : rank) ranked.push_back(urls[i]);
+            urls = std::move(ranked);
+            if (std::uniform_real_distribution<double>(0, 1)(rng_) < EXPLORE) {
+                size_t other = std::uniform_int_distribution<size_t>(1, urls.size() - 1)(rng_);
+                std::rotate(urls.begin(), urls.begin() + other, urls.begin() + other + 1);
+            }
+        }
+        std::stable_partition(urls.begin(), urls.end(), [&](const std::string& url) { return !is_down(url, now_ms); });
+        return urls;
+    }
+
+    // Records one call to `url`; `latency_ms` counts only if it answered
+    void record(const std::string& url, double latency_ms, bool ok, int64_t now_ms = endpoint_now_ms()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Stats& s = stats_[url];
+        if (ok) {
+            s.latency_ms = s.latency_ms > 0 ? s.latency_ms + ALPHA * (latency_ms - s.latency_ms) : latency_ms;
+            s.error_rate *= 1 - ALPHA;
+            s.failures = 0;
+        } else {
+            s.error_rate += ALPHA * (1 - s.error_rate);
+            ++s.failures;
+        }
+        ++s.samples;
+        s.last_ms = now_ms;
+        save(now_ms);
+    }
+
+    Stats stats(const std::string& url) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = stats_.find(url);
+        return it == stats_.end() ? Stats() : it->second;
+    }
+
+    // Highest-random-weight hash of a machine key and a mirror
+    static uint64_t rendezvous_weight(uint64_t key, const std::string& url) {
+        uint64_t h = 1469598103934665603ull;  // FNV-1a
+        for (unsigned char c : url) h = (h ^ c) * 1099511628211ull;
+        uint64_t x = key ^ h;  // then splitmix64
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+private:
+    double cost_of(const std::string& url) const {
+        auto it = stats_.find(url);
+        if (it == stats_.end() || it->second.samples == 0) return 0;
+        return it->second.latency_ms + it->second.error_rate * ERROR_COST_MS;
+    }
+
+    bool is_down(const std::string& url, int64_t now_ms) const {
+        auto it = stats_.find(url);
+        return it != stats_.end() && it->second.failures >= DOWN_AFTER && now_ms - it->second.last_ms < DOWN_FOR_MS;
+    }
+
+    void save(int64_t now_ms = endpoint_now_ms()) const {
+        if (path_.empty()) return;
+        nlohmann::json endpoints = nlohmann::json::object();
+        for (const auto& [url, s] : stats_) {
+            if (now_ms - s.last_ms > FORGET_AFTER_MS) continue;
+            endpoints[url] = {{"latency_ms", s.latency_ms}, {"error_rate", s.error_rate}, {"samples", s.samples},
+                              {"failures", s.failures}, {"last", s.last_ms}};
+        }
+        char key[17];
+        std::snprintf(key, sizeof(key), "%016llx", (unsigned long long)shard_key_);
+        nlohmann::json j = {{"shard_key", shard_key_ ? std::string(key) : std::string()}, {"endpoints", endpoints}};
+        std::ofstream out(path_, std::ios::binary | std::ios::trunc);
+        out << j.dump();
+    }
+
+    mutable std::mutex mutex_;
+    std::string path_;
+    std::map<std::string, Stats> stats_;
+    uint64_t shard_key_ = 0;
+    std::mt19937 rng_;
+};
+
+// Calls `attempt(url)` (returning EndpointResult) on the mirrors of `list`
+// in `selector`'s order, or in listed order without one, until a mirror
+// answers or is busy; each call is timed and recorded. True if one answered.
+template <typename Attempt>
+bool call_endpoints(EndpointSelector* selector, const std::string& list, bool pinned, Attempt attempt) {
+    std::vector<std::string> urls = selector ? selector->order(list, pinned) : split_endpoint_list(list);
+    for (const std::string& url : urls) {
+        auto start = std::chrono::steady_clock::now();
+        EndpointResult result = attempt(url);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (result == EndpointResult::Busy) return false;
+        if (selector) selector->record(url, ms, result == EndpointResult::Ok);
+        if (result == EndpointResult::Ok) return true;
+    }
+    return false;
+}
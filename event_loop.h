@@ -0,0 +1,328 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+// Single-threaded executor for the UI thread. One wait covers the Win32
+// message queue, continuations posted from other threads, timers and waitable
+// handles, so work finishing elsewhere resumes on the UI thread without extra
+// threads or polling:
+//
+//   Windows  MsgWaitForMultipleObjectsEx on a wake event + watched handles,
+//            alertable (APC completions run too); messages are dispatched
+//            as in a GetMessage loop and WM_QUIT ends run().
+//   Linux    epoll on an eventfd + watched fds; stop() ends run().
+//
+// Modal loops (a window being dragged or sized, TrackPopupMenu) block run()
+// underneath them but keep dispatching messages. On Windows, attach() a
+// window and posted tasks and timers also reach it as messages, so they keep
+// running until the modal loop returns; watched handles wait for run().
+//
+// post() may be called from any thread; everything else belongs to the loop
+// thread. Tasks run in the order they were posted; timers with the same due
+// time in the order they were set.
+class EventLoop {
+public:
+    using Task = std::function<void()>;
+    using TimerId = uint64_t;
+#ifdef _WIN32
+    using Waitable = HANDLE;
+#else
+    using Waitable = int;
+#endif
+
+    EventLoop() : origin_(std::chrono::steady_clock::now()) {
+#ifdef _WIN32
+        wake_ = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+#else
+        epoll_ = epoll_create1(EPOLL_CLOEXEC);
+        wake_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = wake_;
+        epoll_ctl(epoll_, EPOLL_CTL_ADD, wake_, &ev);
+#endif
+    }
+
+    ~EventLoop() {
+#ifdef _WIN32
+        if (wake_) CloseHandle(wake_);
+#else
+        if (wake_ >= 0) ::close(wake_);
+        if (epoll_ >= 0) ::close(epoll_);
+#endif
+    }
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // Runs `task` on the loop thread. Thread-safe.
+    void post(Task task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            posted_.push_back(std::move(task));
+        }
+        wake();
+    }
+
+    TimerId call_later(double delay_ms, Task task) { return add_timer(now_ms() + delay_ms, 0, std::move(task)); }
+
+    // First run after `interval_ms`, then every `interval_ms` until cancelled
+    TimerId call_every(double interval_ms, Task task) {
+        return add_timer(now_ms() + interval_ms, interval_ms, std::move(task));
+    }
+
+    void cancel(TimerId id) {
+        auto it = timer_due_.find(id);
+        if (it == timer_due_.end()) return;
+        timers_.erase({it->second, id});
+        timer_due_.erase(it);
+        arm_window_timer();
+    }
+
+#ifdef _WIN32
+    // Wakes also post `message` to `hwnd`, and a window timer `timer_id`
+    // follows the earliest timer. The window procedure hands both to
+    // on_window_message(). Call before other threads post().
+    void attach(HWND hwnd, UINT message, UINT_PTR timer_id) {
+        hwnd_ = hwnd;
+        message_ = message;
+        timer_id_ = timer_id;
+        window_woken_ = false;
+        arm_window_timer();
+    }
+
+    // Runs posted tasks and due timers for attach()'s message and timer;
+    // false for any other message.
+    bool on_window_message(UINT msg, WPARAM wParam) {
+        if (!hwnd_) return false;
+        if (msg == message_) {
+            window_woken_ = false;
+        } else if (msg != WM_TIMER || wParam != timer_id_) {
+            return false;
+        }
+        run_posted();
+        run_due_timers();
+        return true;
+    }
+#endif
+
+    // Calls `on_signal` on the loop thread each time `waitable` is signalled
+    // (Windows: a waitable handle, at most 62; Linux: a readable fd). The
+    // callback must reset or drain it. Returns false if it cannot be watched.
+    bool watch(Waitable waitable, Task on_signal) {
+#ifdef _WIN32
+        if (watched_.size() + 2 > MAXIMUM_WAIT_OBJECTS) return false;
+#else
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = waitable;
+        if (epoll_ctl(epoll_, EPOLL_CTL_ADD, waitable, &ev) != 0) return false;
+#endif
+        watched_.push_back({waitable, std::make_shared<Task>(std::move(on_signal))});
+        return true;
+    }
+
+    void unwatch(Waitable waitable) {
+        for (size_t i = 0; i < watched_.size(); ++i) {
+            if (watched_[i].first != waitable) continue;
+            watched_.erase(watched_.begin() + i);
+#ifndef _WIN32
+            epoll_ctl(epoll_, EPOLL_CTL_DEL, waitable, nullptr);
+#endif
+            return;
+        }
+    }
+
+    // Services everything until WM_QUIT (Windows) or stop(). Returns the
+    // WM_QUIT exit code or the code given to stop().
+    int run() {
+        stopped_ = false;
+        while (!stopped_) {
+            run_posted();
+            run_due_timers();
+            if (stopped_) break;
+            wait(next_timeout_ms());
+        }
+        return exit_code_;
+    }
+
+    // Makes run() return after the current task. Loop thread only; other
+    // threads post() a task that calls it.
+    void stop(int exit_code = 0) {
+        exit_code_ = exit_code;
+        stopped_ = true;
+    }
+
+    double now_ms() const {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - origin_).count();
+    }
+
+    size_t timer_count() const { return timers_.size(); }
+
+private:
+    struct Timer {
+        double interval_ms;
+        Task task;
+    };
+
+    TimerId add_timer(double due_ms, double interval_ms, Task task) {
+        TimerId id = next_timer_++;
+        timers_[{due_ms, id}] = Timer{interval_ms, std::move(task)};
+        timer_due_[id] = due_ms;
+        arm_window_timer();
+        return id;
+    }
+
+    void wake() {
+#ifdef _WIN32
+        SetEvent(wake_);
+        // One message in flight is enough; it runs everything posted so far
+        if (hwnd_ && !window_woken_.exchange(true)) PostMessageW(hwnd_, message_, 0, 0);
+#else
+        uint64_t one = 1;
+        ssize_t ignored = write(wake_, &one, sizeof(one));
+        (void)ignored;
+#endif
+    }
+
+    void run_posted() {
+        std::deque<Task> batch;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            batch.swap(posted_);
+        }
+        // Tasks posted while this batch runs wait for the next pass, so a
+        // task that re-posts itself cannot starve messages and timers
+        for (auto& task : batch) {
+            if (task) task();
+        }
+    }
+
+    void run_due_timers() {
+        double now = now_ms();
+        while (!timers_.empty() && timers_.begin()->first.first <= now && !stopped_) {
+            auto first = timers_.begin();
+            TimerId id = first->first.second;
+            Timer timer = std::move(first->second);
+            timers_.erase(first);
+            timer_due_.erase(id);
+            if (timer.interval_ms > 0) {
+                // Re-armed before running so the task can cancel itself
+                double due = now + timer.interval_ms;
+                timers_[{due, id}] = Timer{timer.interval_ms, timer.task};
+                timer_due_[id] = due;
+            }
+            if (timer.task) timer.task();
+        }
+        arm_window_timer();
+    }
+
+    // Keeps the attached window's timer on the earliest due time
+    void arm_window_timer() {
+#ifdef _WIN32
+        if (!hwnd_) return;
+        if (timers_.empty()) {
+            KillTimer(hwnd_, timer_id_);
+            return;
+        }
+        double wait = next_timeout_ms();
+        SetTimer(hwnd_, timer_id_, wait < USER_TIMER_MINIMUM ? USER_TIMER_MINIMUM : (UINT)(wait + 0.999), nullptr);
+#endif
+    }
+
+    // -1 = no timer (wait indefinitely)
+    double next_timeout_ms() const {
+        if (timers_.empty()) return -1;
+        double wait = timers_.begin()->first.first - now_ms();
+        return wait > 0 ? wait : 0;
+    }
+
+    void wait(double timeout_ms) {
+#ifdef _WIN32
+        std::vector<HANDLE> handles = {wake_};
+        for (const auto& w : watched_) handles.push_back(w.first);
+        DWORD timeout = timeout_ms < 0 ? INFINITE : (DWORD)(timeout_ms + 0.999);
+        DWORD result = MsgWaitForMultipleObjectsEx((DWORD)handles.size(), handles.data(), timeout, QS_ALLINPUT,
+                                                   MWMO_INPUTAVAILABLE | MWMO_ALERTABLE);
+        if (result == WAIT_OBJECT_0 + handles.size()) {
+            pump_messages();
+        } else if (result > WAIT_OBJECT_0 && result < WAIT_OBJECT_0 + handles.size()) {
+            auto task = watched_[result - WAIT_OBJECT_0 - 1].second;
+            (*task)();
+        }
+        // WAIT_OBJECT_0 (posted work), WAIT_IO_COMPLETION (APCs already ran)
+        // and WAIT_TIMEOUT are picked up by the next pass of run()
+#else
+        epoll_event events[16];
+        int timeout = timeout_ms < 0 ? -1 : (int)(timeout_ms + 0.999);
+        int n = epoll_wait(epoll_, events, 16, timeout);
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == wake_) {
+                uint64_t count;
+                while (read(wake_, &count, sizeof(count)) > 0) {
+                }
+                continue;
+            }
+            for (const auto& w : watched_) {
+                if (w.first != fd) continue;
+                auto task = w.second;
+                (*task)();
+                break;
+            }
+        }
+#endif
+    }
+
+#ifdef _WIN32
+    void pump_messages() {
+        MSG msg;
+        while (PeekMessageW(&msg, nullptr, 0, 0, PM_REMOVE)) {
+            if (msg.message == WM_QUIT) {
+                stop((int)msg.wParam);
+                return;
+            }
+            TranslateMessage(&msg);
+            DispatchMessageW(&msg);
+        }
+    }
+#endif
+
+    std::chrono::steady_clock::time_point origin_;
+    std::mutex mutex_;
+    std::deque<Task> posted_;
+    std::map<std::pair<double, TimerId>, Timer> timers_;
+    std::map<TimerId, double> timer_due_;
+    TimerId next_timer_ = 1;
+    // shared_ptr so a callback can unwatch itself while it runs
+    std::vector<std::pair<Waitable, std::shared_ptr<Task>>> watched_;
+    bool stopped_ = false;
+    int exit_code_ = 0;
+#ifdef _WIN32
+    HANDLE wake_ = nullptr;
+    HWND hwnd_ = nullptr;  // attach()
+    UINT message_ = 0;
+    UINT_PTR timer_id_ = 0;
+    std::atomic<bool> window_woken_{false};
+#else
+    int epoll_ = -1;
+    int wake_ = -1;
+#endif
+};
@@ -1,15 +1,67 @@
 #pragma once
+#include <memory>
 #include <string>
 #include <iostream>
+#include "https_client.h"
 #include <windows.h>
 #include <wininet.h>
 #include <vector>
+#include "admission.h"
+#include "endpoint_selector.h"
 #include "json.hpp" // Download from https://github.com/nlohmann/json/releases
 #include "config.h"
+#include "timing_log.h"
 
 #pragma comment(lib, "wininet.lib")
 
-inline std::string http_get(const std::string& url, const std::string& user_agent = "") {
+// The portable client (https_client.h) with the TLS session cache, if
+// TLS_SESSION_CACHE_FILE is set; null = WinINet
+inline HttpsClient* portable_http_client() {
+    static TlsSessionCache sessions;
+    static std::unique_ptr<HttpsClient> client = []() -> std::unique_ptr<HttpsClient> {
+        if (!g_config || g_config->get_tls_session_cache_file().empty()) return nullptr;
+        sessions.open(g_config->get_tls_session_cache_file());
+        HttpsClientOptions options;
+        options.user_agent = g_config->get_user_agent();
+        options.timeout_ms = g_config->get_timeout_ms();
+        options.early_data = g_config->should_use_tls_early_data();
+        return std::make_unique<HttpsClient>(&sessions, options);
+    }();
+    return client.get();
+}
+
+// A portable-client response as http_get() and send_data() report it;
+// the handshake goes to the timing log
+inline void note_portable_reply(const std::string& url, const HttpsResponse& response, ReplyStatus* status) {
+    if (status) {
+        status->status = response.status;
+        status->retry_after = response.retry_after;
+    }
+    std::string host = url.substr(0, url.find_first_of("/?", url.find("://") + 3));
+    if (response.status == 0) timing_log().mark(host + ": " + response.error);
+    else timing_log().mark(host + ": " + response.tls.describe());
+}
+
+// HTTP status and Retry-After of an open request (admission.h)
+inline ReplyStatus reply_status_of(HINTERNET request) {
+    ReplyStatus reply;
+    DWORD status = 0, size = sizeof(status);
+    if (HttpQueryInfoA(request, HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER, &status, &size, NULL)) {
+        reply.status = (int)status;
+    }
+    char retry_after[128] = {};
+    size = sizeof(retry_after) - 1;
+    if (HttpQueryInfoA(request, HTTP_QUERY_RETRY_AFTER, retry_after, &size, NULL)) reply.retry_after.assign(retry_after, size);
+    return reply;
+}
+
+// Body of a GET; `status` (optional) gets the reply's status and Retry-After
+inline std::string http_get(const std::string& url, const std::string& user_agent = "", ReplyStatus* status = nullptr) {
+    if (HttpsClient* client = portable_http_client()) {
+        HttpsResponse response = client->get(url);
+        note_portable_reply(url, response, status);
+        return response.body;
+    }
     std::string ua = user_agent;
     if (ua.empty() && g_config) {
         ua = g_config->get_user_agent();
@@ -33,6 +85,7 @@ inline std::string http_get(const std::string& url, const std::string& user_agen
         return "";
     }
 
+    if (status) *status = reply_status_of(hConnect);
     std::vector<char> buffer;
     DWORD bytesRead = 0;
     char temp[4096];
@@ -46,20 +99,41 @@ inline std::string http_get(const std::string& url, const std::string& user_agen
     return std::string(buffer.begin(), buffer.end());
 }
 
-// Returns ipinfo and ipinfo2 JSON objects
-inline bool fetch_ipinfo_pair(nlohmann::json& ipinfo, nlohmann::json& ipinfo2) {
+// GETs `suffix` from the mirrors of `list` (endpoint_selector.h) until one
+// answers 2xx with a body; "" if none did. A 429/503 ends the round and is
+// left in `status` for admission.h.
+inline std::string http_get_mirrors(const std::string& list, const std::string& suffix, ReplyStatus& status,
+                                    EndpointSelector* endpoints) {
+    std::string body;
+    bool answered = call_endpoints(endpoints, list, false, [&](const std::string& url) {
+        body = http_get(url + suffix, "", &status);
+        if (status.status == 429 || status.status == 503) return EndpointResult::Busy;
+        if (status.status / 100 != 2 || body.empty()) return EndpointResult::Failed;
+        return EndpointResult::Ok;
+    });
+    return answered ? body : std::string();
+}
+
+// Returns ipinfo and ipinfo2 JSON objects. Replies are recorded in
+// `admission` (optional), which a 429 or 503 from either service holds back,
+// and the mirrors' latencies in `endpoints` (optional).
+inline bool fetch_ipinfo_pair(nlohmann::json& ipinfo, nlohmann::json& ipinfo2, Admission* admission = nullptr,
+                              EndpointSelector* endpoints = nullptr) {
     ipinfo = nullptr;
     ipinfo2 = nullptr;
     try {
-        std::string ipcheck_url = g_config ? g_config->get_ipcheck_url() : "https://ipcheck.siu4.workers.dev/";
-        std::string proxycheck_url = g_config ? g_config->get_proxycheck_url() : "https://proxycheck.io/v2/";
+        std::string ipcheck_urls = g_config ? g_config->get_ipcheck_url() : "https://ipcheck.siu4.workers.dev/";
+        std::string proxycheck_urls = g_config ? g_config->get_proxycheck_url() : "https://proxycheck.io/v2/";
         
-        std::string res1 = http_get(ipcheck_url);
+        ReplyStatus status;
+        std::string res1 = http_get_mirrors(ipcheck_urls, "", status, endpoints);
+        if (admission) admission->on_reply(AdmissionService::IpCheck, status);
         ipinfo = nlohmann::json::parse(res1);
         std::string ip;
         if (ipinfo.contains("IP")) {
             ip = ipinfo["IP"].get<std::string>();
-            std::string res2 = http_get(proxycheck_url + ip + "?vpn=1&asn=1");
+            std::string res2 = http_get_mirrors(proxycheck_urls, ip + "?vpn=1&asn=1", status, endpoints);
+            if (admission) admission->on_reply(AdmissionService::ProxyCheck, status);
             auto j2 = nlohmann::json::parse(res2);
             if (j2.contains(ip)) {
                 ipinfo2 = j2[ip];
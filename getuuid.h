@@ -18,7 +18,8 @@ inline std::string get_system_uuid() {
         RPC_C_IMP_LEVEL_IMPERSONATE,
         NULL, EOAC_NONE, NULL);
 
-    if (FAILED(hres)) {
+    // RPC_E_TOO_LATE: security was already set by an earlier probe in this process
+    if (FAILED(hres) && hres != RPC_E_TOO_LATE) {
         CoUninitialize();
         return "";
     }
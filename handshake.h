@@ -0,0 +1,238 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "admission.h"
+#include "canonical_fingerprint.h"
+#include "delta_payload.h"
+#include "json.hpp"
+#include "stage_progress.h"
+#include "task.h"
+#include "timing_log.h"
+
+// Hardware and network identity sent with every registration
+struct Fingerprint {
+    std::string uuid;
+    std::string machine_guid;
+    std::vector<std::string> serials;
+    nlohmann::json ipinfo, ipinfo2;
+    uint64_t collected_at = 0;  // host clock (GetTickCount64); 0 = never collected
+};
+
+// Reports handshake stages to the splash; may be empty (background refresh)
+using StageFn = std::function<void(LoginStage)>;
+
+// A handshake step failed; what() says which
+struct HandshakeError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// The backend could not be reached at all (no reply)
+struct BackendUnreachable : HandshakeError {
+    using HandshakeError::HandshakeError;
+};
+
+// The blocking pieces of a login. main.cpp binds them to the WMI, WinINet and
+// OpenSSL helpers; each runs on an Offload thread, so none may touch the UI.
+// Stubs make the flow below runnable anywhere.
+struct HandshakeSteps {
+    std::function<void(Fingerprint& fp)> hardware;  // uuid, machine GUID, disk serials
+    std::function<bool(nlohmann::json& ipinfo, nlohmann::json& ipinfo2)> network;  // IP + proxy check
+    std::function<std::string(const nlohmann::json& registration)> encrypt;       // "" = failed; may throw HandshakeError
+    std::function<bool(const std::string& payload, std::string& reply)> send;
+    std::function<void(const std::string& payload)> queue;  // keeps a registration the backend did not get; may be empty
+    std::string dcid;
+    std::string version;
+    std::string login_base_url;
+    nlohmann::json acknowledged;  // last registration the backend acknowledged; null = send in full
+    Admission* admission = nullptr;  // holds on the backend and the IP services; null = none
+    double start_delay_ms = 0;       // start jitter before the network probe
+    double max_hold_ms = 15000;      // a longer hold fails the step instead of waiting
+};
+
+// The raw identifiers stay for existing backends; "fpkey" is the canonical
+// identity (canonical_fingerprint.h) over all disk serials, left out when no
+// identifier survives normalization. The digest is not sent: a full
+// registration is one RSA-OAEP block (190 bytes at 2048 bits, 318 at 3072).
+inline nlohmann::json registration_for(const Fingerprint& fp, const std::string& dcid, const std::string& version) {
+    nlohmann::json registration = {
+        {"ip", fp.ipinfo.value("IP", "Unknown")},
+        {"hwid", fp.uuid},
+        {"hwserial", fp.serials.empty() ? "" : fp.serials[0]},
+        {"country",
+            fp.ipinfo2.value("country", "") + "//"
+            + fp.ipinfo2.value("provider", "") + "//"
+            + fp.ipinfo2.value("organisation", "")
+        },
+        {"machineguid", fp.machine_guid},
+        {"dcid", dcid},
+        {"regdate", fp.ipinfo.value("CheckTimeUTC", "")},
+        {"version", version}
+    };
+    std::string canonical = canonical_fingerprint(fp.uuid, fp.machine_guid, fp.serials);
+    if (canonical_fingerprint_known(canonical)) registration["fpkey"] = fingerprint_id(canonical).key_text();
+    return registration;
+}
+
+// What the backend issued for one registration
+struct LoginToken {
+    std::string url;          // login page with the randkey
+    int64_t expires_in_s = 0;  // optional "expires_in" of the reply; 0 = single use
+    std::string ack;           // optional "ack" of the reply (see delta_payload.h)
+    nlohmann::json acknowledged;  // the registration sent, if the ack matches it; else null
+};
+
+// Reads the backend's {"randkey": ..., "expires_in": <seconds>} reply
+inline LoginToken login_token_from_reply(const std::string& reply, const std::string& base_url) {
+    // Only try to parse JSON if reply looks like JSON
+    if (reply.empty() || reply[0] != '{') throw HandshakeError("server reply is not JSON: " + reply);
+    nlohmann::json j;
+    try {
+        j = nlohmann::json::parse(reply);
+    } catch (const std::exception& e) {
+        throw HandshakeError(std::string("failed to parse server reply: ") + e.what());
+    }
+    if (!j.contains("randkey") || !j["randkey"].is_string()) throw HandshakeError("randkey not found in server reply");
+    LoginToken token;
+    token.url = base_url + "?token=" + j["randkey"].get<std::string>();
+    if (j.contains("expires_in") && j["expires_in"].is_number() && j["expires_in"].get<double>() > 0) {
+        token.expires_in_s = (int64_t)j["expires_in"].get<double>();
+    }
+    if (j.contains("ack") && j["ack"].is_string()) token.ack = j["ack"].get<std::string>();
+    return token;
+}
+
+// Only the hardware IDs (no network round trip)
+inline Task<Fingerprint> identify_hardware(Offload& offload, HandshakeSteps steps, CancelToken token) {
+    auto probe = [hardware = steps.hardware] {
+        Fingerprint ids;
+        hardware(ids);
+        return ids;
+    };
+    Fingerprint fp = co_await offload.call(std::move(probe), token);
+    timing_log().mark("fingerprint collected");
+    co_return fp;
+}
+
+namespace handshake_detail {
+
+inline Task<Fingerprint> probe_hardware(Offload& offload, HandshakeSteps steps, CancelToken token, StageFn stage) {
+    Fingerprint fp = co_await identify_hardware(offload, steps, token);
+    // Only the network probe is left
+    if (stage) stage(LoginStage::NetworkInfo);
+    co_return fp;
+}
+
+inline std::string wait_text(double hold_ms) {
+    return std::to_string((long long)std::ceil(hold_ms / 1000)) + " s";
+}
+
+inline Task<std::pair<nlohmann::json, nlohmann::json>> probe_network(Offload& offload, HandshakeSteps steps, CancelToken token) {
+    double hold = steps.admission ? steps.admission->network_hold_ms() : 0;
+    if (hold > steps.max_hold_ms) throw HandshakeError("IP services held back for another " + wait_text(hold));
+    hold = std::max(hold, steps.start_delay_ms);
+    if (hold > 0) {
+        co_await sleep_for(offload.loop(), hold, token);
+        timing_log().mark("held back before the ip probe");
+    }
+    auto probe = [network = steps.network] {
+        std::pair<nlohmann::json, nlohmann::json> result;
+        if (!network(result.first, result.second)) throw HandshakeError("could not fetch IP or proxy info");
+        return result;
+    };
+    auto info = co_await offload.call(std::move(probe), token);
+    timing_log().mark("ip info fetched");
+    co_return info;
+}
+
+// Encrypts and sends one registration message; returns the raw reply
+inline Task<std::string> send_registration(Offload& offload, HandshakeSteps steps, nlohmann::json message, CancelToken token,
+                                           StageFn stage) {
+    if (stage) stage(LoginStage::Encrypting);
+    auto encrypt = [encrypt = steps.encrypt, message] { return encrypt(message); };
+    std::string payload = co_await offload.call(std::move(encrypt), token);
+    if (payload.empty()) throw HandshakeError("encryption failed");
+    timing_log().mark("payload encrypted");
+
+    if (stage) stage(LoginStage::Backend);
+    auto send = [send = steps.send, payload] {
+        std::pair<bool, std::string> result;
+        result.first = send(payload, result.second);
+        return result;
+    };
+    std::string reply;
+    for (;;) {
+        // A busy backend (429/503) leaves a hold: a short one is waited out
+        // here and the message sent again, without probing anew
+        double hold = steps.admission ? steps.admission->hold_ms(AdmissionService::Backend) : 0;
+        if (hold > steps.max_hold_ms) throw BackendUnreachable("backend held back for another " + wait_text(hold));
+        if (hold > 0) {
+            co_await sleep_for(offload.loop(), hold, token);
+            timing_log().mark("held back before the backend");
+        }
+        auto result = co_await offload.call(send, token);
+        if (result.first) {
+            reply = std::move(result.second);
+            break;
+        }
+        if (!steps.admission || steps.admission->hold_ms(AdmissionService::Backend) <= 0) {
+            throw BackendUnreachable("failed to send encrypted data");
+        }
+    }
+    timing_log().mark("backend replied");
+    co_return reply;
+}
+
+}  // namespace handshake_detail
+
+// Collects the hardware IDs and the IP/proxy info, both probes at once.
+// Throws HandshakeError if the IP info cannot be fetched (the registration
+// cannot be sent without it) and TaskCancelled if `token` fires. Stages are
+// reported on the loop thread. `collected_at` is left for the caller.
+inline Task<Fingerprint> collect_fingerprint(Offload& offload, HandshakeSteps steps, CancelToken token, StageFn stage = nullptr) {
+    if (stage) stage(LoginStage::Fingerprint);
+    auto [fp, network] = co_await when_all(handshake_detail::probe_hardware(offload, steps, token, stage),
+                                           handshake_detail::probe_network(offload, steps, token));
+    fp.ipinfo = std::move(network.first);
+    fp.ipinfo2 = std::move(network.second);
+    co_return fp;
+}
+
+// Sends the registration (as a delta if steps.acknowledged is set and the
+// backend still holds it) and builds the login URL from the returned
+// randkey. Throws HandshakeError or TaskCancelled; BackendUnreachable if
+// there was no reply, after handing the full registration to steps.queue.
+inline Task<LoginToken> request_login_token(Offload& offload, Fingerprint fp, HandshakeSteps steps, CancelToken token,
+                                            StageFn stage = nullptr) {
+    nlohmann::json registration = registration_for(fp, steps.dcid, steps.version);
+    bool delta = !steps.acknowledged.is_null() && keeps_fields(registration, steps.acknowledged);
+    nlohmann::json message = delta ? delta_message(registration, steps.acknowledged) : registration;
+    std::string reply;
+    bool unreachable = false;
+    try {
+        reply = co_await handshake_detail::send_registration(offload, steps, message, token, stage);
+        if (delta && backend_wants_full(reply)) {
+            timing_log().mark("backend asked for the full registration");
+            reply = co_await handshake_detail::send_registration(offload, steps, registration, token, stage);
+        }
+    } catch (const BackendUnreachable&) {
+        unreachable = true;
+    }
+    if (unreachable) {
+        if (!steps.queue) throw BackendUnreachable("failed to send encrypted data");
+        // Queued in full: the backend may no longer hold the delta's base by the time it is sent
+        auto encrypt = [encrypt = steps.encrypt, registration] { return encrypt(registration); };
+        std::string payload = co_await offload.call(std::move(encrypt), token);
+        if (payload.empty()) throw HandshakeError("encryption failed");
+        steps.queue(payload);
+        timing_log().mark("registration queued");
+        throw BackendUnreachable("backend unreachable; registration queued");
+    }
+    LoginToken issued = login_token_from_reply(reply, steps.login_base_url);
+    if (!issued.ack.empty() && issued.ack == payload_hash(registration)) issued.acknowledged = registration;
+    co_return issued;
+}
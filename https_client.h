@@ -0,0 +1,780 @@
+#pragma once
+#include <cerrno>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509v3.h>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <wincrypt.h>
+#else
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+#include "json.hpp"
+#include "protected_file.h"
+
+// A small HTTP/1.1 client on OpenSSL and plain sockets, for where WinINet's
+// TLS cannot be tuned: it keeps each host's latest TLS session ticket in a
+// file protected for the user (protected_file.h: DPAPI on Windows) and
+// resumes it on the next launch, so a relaunch skips the certificate
+// exchange; TLS 1.2 also saves a round trip. With early data on, idempotent
+// GETs to a TLS 1.3 host that allows it are sent in the first flight (0-RTT)
+// and answered one round trip sooner. Every response says whether its
+// handshake was full or resumed and how long it took. Connects race a host's
+// IPv6 and IPv4 addresses (Happy Eyeballs), so a broken route of one version
+// costs 250 ms rather than a connect timeout.
+//
+// One request per connection ("Connection: close"); no proxy support (it
+// connects directly, unlike WinINet's system proxy). Thread-safe: requests
+// may run on several Offload threads at once. On POSIX the caller should
+// ignore SIGPIPE. Windows needs ws2_32, crypt32, ssl and crypto.
+
+struct TlsHandshakeInfo {
+    bool tls = false;          // false: plain http
+    bool resumed = false;      // a cached session was accepted
+    bool early_data_sent = false;
+    bool early_data_accepted = false;  // the request went in the first flight
+    std::string version;       // "TLSv1.3", ...
+    double connect_ms = 0;     // TCP
+    double handshake_ms = 0;   // TLS, after connect
+    std::string address;       // the address that won the connection race
+    int connect_attempts = 0;
+
+    // "TLSv1.3 resumed (early data accepted) in 212 ms, connect 35 ms to 1.2.3.4 (2 attempts)"
+    std::string describe() const {
+        std::string connect = "connect " + std::to_string((long long)connect_ms) + " ms";
+        if (!address.empty()) connect += " to " + address;
+        if (connect_attempts > 1) connect += " (" + std::to_string(connect_attempts) + " attempts)";
+        if (!tls) return "plain http, " + connect;
+        std::string text = version + (resumed ? " resumed" : " full handshake");
+        if (early_data_sent) text += early_data_accepted ? " (early data accepted)" : " (early data rejected)";
+        return text + " in " + std::to_string((long long)handshake_ms) + " ms, " + connect;
+    }
+};
+
+struct HttpsResponse {
+    int status = 0;           // 0 = no reply; `error` says why
+    std::string retry_after;  // Retry-After header ("" if absent)
+    std::string body;
+    TlsHandshakeInfo tls;
+    double total_ms = 0;
+    std::string error;
+};
+
+struct HttpsRequest {
+    std::string method = "GET";
+    std::string url;
+    std::string body;
+    std::string content_type;
+    bool idempotent = false;  // may go in TLS 1.3 early data, which can be replayed
+};
+
+// Splits http[s]://host[:port][/target]; false if it is not such a URL
+inline bool split_http_url(const std::string& url, bool& tls, std::string& host, std::string& port, std::string& target) {
+    size_t scheme_end = url.find("://");
+    if (scheme_end == std::string::npos) return false;
+    std::string scheme = url.substr(0, scheme_end);
+    for (char& c : scheme) c = (char)tolower((unsigned char)c);
+    if (scheme != "http" && scheme != "https") return false;
+    tls = scheme == "https";
+    size_t host_start = scheme_end + 3;
+    size_t path_start = url.find_first_of("/?", host_start);
+    std::string authority = url.substr(host_start, path_start == std::string::npos ? std::string::npos : path_start - host_start);
+    target = path_start == std::string::npos ? "/" : url.substr(path_start);
+    if (target[0] == '?') target = "/" + target;
+    port = tls ? "443" : "80";
+    if (!authority.empty() && authority[0] == '[') {  // [v6]:port
+        size_t close = authority.find(']');
+        if (close == std::string::npos) return false;
+        host = authority.substr(1, close - 1);
+        if (close + 1 < authority.size() && authority[close + 1] == ':') port = authority.substr(close + 2);
+    } else {
+        size_t colon = authority.rfind(':');
+        host = authority.substr(0, colon);
+        if (colon != std::string::npos) port = authority.substr(colon + 1);
+    }
+    return !host.empty() && !port.empty();
+}
+
+// Each host's latest TLS session ticket, in memory and in `path`. Tickets
+// past their lifetime are not offered again. Also which IP version last won
+// the connection race to the host, tried first next time for a day.
+class TlsSessionCache {
+public:
+    static constexpr size_t MAX_HOSTS = 32;  // the least recently stored go beyond this
+
+    // Keeps the tickets in `path` ("" = this run only) and loads the ones an
+    // earlier run left; a file another user wrote is ignored
+    void open(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        path_ = path;
+        entries_.clear();
+        std::string text;
+        if (path_.empty() || !read_protected(path_, text)) return;
+        nlohmann::json j = nlohmann::json::parse(text, nullptr, false);
+        if (!j.is_object() || j.value("v", 0) != VERSION || !j.contains("sessions") || !j["sessions"].is_object()) return;
+        int64_t now = (int64_t)std::time(nullptr);
+        for (auto& [key, e] : j["sessions"].items()) {
+            if (!e.is_object()) continue;
+            Entry entry;
+            entry.der = from_base64(e.value("der", ""));
+            entry.expires_at = e.value("expires_at", (int64_t)0);
+            entry.stored_at = e.value("stored_at", (int64_t)0);
+            entry.ip_version = e.value("ip", 0);
+            entry.ip_at = e.value("ip_at", (int64_t)0);
+            if (entry.expires_at <= now) entry.der.clear();
+            if (now - entry.ip_at >= IP_VERSION_FOR_S) entry.ip_version = 0;
+            if (!entry.der.empty() || entry.ip_version) entries_[key] = entry;
+        }
+    }
+
+    // A session to resume with `host_port` (the caller frees it); null if none
+    SSL_SESSION* find(const std::string& host_port) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(host_port);
+        if (it == entries_.end() || it->second.der.empty() || it->second.expires_at <= (int64_t)std::time(nullptr)) {
+            return nullptr;
+        }
+        const unsigned char* p = (const unsigned char*)it->second.der.data();
+        SSL_SESSION* session = d2i_SSL_SESSION(nullptr, &p, (long)it->second.der.size());
+        if (session && !SSL_SESSION_is_resumable(session)) {
+            SSL_SESSION_free(session);
+            return nullptr;
+        }
+        return session;
+    }
+
+    void store(const std::string& host_port, SSL_SESSION* session) {
+        int len = i2d_SSL_SESSION(session, nullptr);
+        if (len <= 0) return;
+        std::string der((size_t)len, '\0');
+        unsigned char* p = (unsigned char*)&der[0];
+        i2d_SSL_SESSION(session, &p);
+        int64_t lifetime = (int64_t)SSL_SESSION_get_timeout(session);
+        unsigned long hint = SSL_SESSION_get_ticket_lifetime_hint(session);
+        if (hint > 0 && (int64_t)hint < lifetime) lifetime = (int64_t)hint;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        Entry& entry = entries_[host_port];
+        entry.der = std::move(der);
+        entry.stored_at = (int64_t)std::time(nullptr);
+        entry.expires_at = (int64_t)SSL_SESSION_get_time(session) + lifetime;
+        trim();
+        save();
+    }
+
+    // The IP version (4 or 6) that last connected to `host_port` first; 0 if
+    // none within a day
+    int ip_version(const std::string& host_port) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(host_port);
+        if (it == entries_.end() || (int64_t)std::time(nullptr) - it->second.ip_at >= IP_VERSION_FOR_S) return 0;
+        return it->second.ip_version;
+    }
+
+    // Written only when the winner changes or the day is nearly up, so most
+    // connects do not rewrite the file
+    void set_ip_version(const std::string& host_port, int version) {
+        if (version != 4 && version != 6) return;
+        int64_t now = (int64_t)std::time(nullptr);
+        std::lock_guard<std::mutex> lock(mutex_);
+        Entry& entry = entries_[host_port];
+        if (entry.ip_version == version && now - entry.ip_at < IP_VERSION_FOR_S / 2) return;
+        entry.ip_version = version;
+        entry.ip_at = now;
+        if (entry.stored_at == 0) entry.stored_at = now;
+        trim();
+        save();
+    }
+
+    // Drops a host's ticket (the server would not resume it)
+    void erase(const std::string& host_port) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(host_port);
+        if (it == entries_.end() || it->second.der.empty()) return;
+        it->second.der.clear();
+        save();
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.size();
+    }
+
+private:
+    static constexpr int VERSION = 1;
+    static constexpr int64_t IP_VERSION_FOR_S = 24 * 3600;
+
+    struct Entry {
+        std::string der;         // i2d_SSL_SESSION; "" = none
+        int64_t expires_at = 0;  // unix seconds
+        int64_t stored_at = 0;
+        int ip_version = 0;      // 4, 6 or 0
+        int64_t ip_at = 0;
+    };
+
+    void trim() {
+        while (entries_.size() > MAX_HOSTS) {
+            auto oldest = entries_.begin();
+            for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+                if (it->second.stored_at < oldest->second.stored_at) oldest = it;
+            }
+            entries_.erase(oldest);
+        }
+    }
+
+    static std::string to_base64(const std::string& data) {
+        std::string out(4 * ((data.size() + 2) / 3), '\0');
+        int n = EVP_EncodeBlock((unsigned char*)&out[0], (const unsigned char*)data.data(), (int)data.size());
+        out.resize(n > 0 ? (size_t)n : 0);
+        return out;
+    }
+
+    static std::string from_base64(const std::string& text) {
+        if (text.empty() || text.size() % 4) return "";
+        std::string out(text.size() / 4 * 3, '\0');
+        int n = EVP_DecodeBlock((unsigned char*)&out[0], (const unsigned char*)text.data(), (int)text.size());
+        if (n < 0) return "";
+        size_t pad = text[text.size() - 1] == '=' ? (text[text.size() - 2] == '=' ? 2 : 1) : 0;
+        out.resize((size_t)n - pad);
+        return out;
+    }
+
+    void save() const {
+        if (path_.empty()) return;
+        nlohmann::json sessions = nlohmann::json::object();
+        for (const auto& [key, e] : entries_) {
+            sessions[key] = {{"der", to_base64(e.der)}, {"expires_at", e.expires_at}, {"stored_at", e.stored_at},
+                             {"ip", e.ip_version}, {"ip_at", e.ip_at}};
+        }
+        write_protected(path_, nlohmann::json{{"v", VERSION}, {"sessions", sessions}}.dump());
+    }
+
+    mutable std::mutex mutex_;
+    std::string path_;
+    std::map<std::string, Entry> entries_;
+};
+
+namespace https_detail {
+
+#ifdef _WIN32
+using socket_t = SOCKET;
+const socket_t NO_SOCKET = INVALID_SOCKET;
+inline void close_socket(socket_t s) { closesocket(s); }
+#else
+using socket_t = int;
+const socket_t NO_SOCKET = -1;
+inline void close_socket(socket_t s) { close(s); }
+#endif
+
+inline double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline void set_blocking(socket_t s, bool blocking) {
+#ifdef _WIN32
+    u_long mode = blocking ? 0 : 1;
+    ioctlsocket(s, FIONBIO, &mode);
+#else
+    int flags = fcntl(s, F_GETFL, 0);
+    fcntl(s, F_SETFL, blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK));
+#endif
+}
+
+// Reads and writes give up after `timeout_ms`
+inline void set_io_timeout(socket_t s, int timeout_ms) {
+#ifdef _WIN32
+    DWORD t = (DWORD)timeout_ms;
+#else
+    timeval t = {timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+#endif
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&t, sizeof(t));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, (const char*)&t, sizeof(t));
+}
+
+#ifdef _WIN32
+using poll_fd = WSAPOLLFD;
+inline int poll_sockets(poll_fd* fds, size_t count, int timeout_ms) { return WSAPoll(fds, (ULONG)count, timeout_ms); }
+inline bool connect_in_progress() { return WSAGetLastError() == WSAEWOULDBLOCK; }
+#else
+using poll_fd = pollfd;
+inline int poll_sockets(poll_fd* fds, size_t count, int timeout_ms) { return poll(fds, (nfds_t)count, timeout_ms); }
+inline bool connect_in_progress() { return errno == EINPROGRESS; }
+#endif
+
+// 4 or 6; 0 for anything else
+inline int ip_version(int family) { return family == AF_INET ? 4 : family == AF_INET6 ? 6 : 0; }
+
+inline std::string address_text(const addrinfo* ai) {
+    char host[NI_MAXHOST] = {};
+    if (getnameinfo(ai->ai_addr, (socklen_t)ai->ai_addrlen, host, sizeof(host), nullptr, 0, NI_NUMERICHOST) != 0) return "?";
+    return ai->ai_family == AF_INET6 ? "[" + std::string(host) + "]" : std::string(host);
+}
+
+// The resolver's addresses with the families alternating, `first_version`
+// (4 or 6) leading (RFC 8305 section 4)
+inline std::vector<const addrinfo*> interleave_families(const addrinfo* list, int first_version) {
+    std::vector<const addrinfo*> first, second;
+    for (const addrinfo* ai = list; ai; ai = ai->ai_next) {
+        if (ip_version(ai->ai_family) == 0) continue;
+        (ip_version(ai->ai_family) == first_version ? first : second).push_back(ai);
+    }
+    std::vector<const addrinfo*> out;
+    for (size_t i = 0; i < first.size() || i < second.size(); ++i) {
+        if (i < first.size()) out.push_back(first[i]);
+        if (i < second.size()) out.push_back(second[i]);
+    }
+    return out;
+}
+
+// Starts a non-blocking connect; NO_SOCKET if it failed at once
+inline socket_t start_connect(const addrinfo* ai, bool& connected) {
+    connected = false;
+    socket_t s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (s == NO_SOCKET) return NO_SOCKET;
+    set_blocking(s, false);
+    if (connect(s, ai->ai_addr, (int)ai->ai_addrlen) == 0) {
+        connected = true;
+    } else if (!connect_in_progress()) {
+        close_socket(s);
+        return NO_SOCKET;
+    }
+    return s;
+}
+
+// The race's winner: a blocking, connected socket (NO_SOCKET if none)
+struct ConnectResult {
+    socket_t socket = NO_SOCKET;
+    int version = 0;      // 4 or 6
+    std::string address;  // numeric
+    int attempts = 0;     // connections started
+};
+
+// Happy Eyeballs (RFC 8305): connects to `addresses` in order, starting the
+// next attempt when the last has not connected within `attempt_delay_ms`
+// (at once when one fails), until one connects or `timeout_ms` is up. The
+// first to connect wins; the others are closed. So a blackholed IPv6 route
+// costs one attempt delay instead of the OS connect timeout. (Before
+// Windows 10 2004, WSAPoll does not report refused connects; they then cost
+// the attempt delay too.)
+inline ConnectResult race_connect(const std::vector<const addrinfo*>& addresses, int attempt_delay_ms, int timeout_ms) {
+    using Clock = std::chrono::steady_clock;
+    ConnectResult result;
+    std::vector<socket_t> pending;
+    std::vector<const addrinfo*> pending_ai;
+    auto win = [&](socket_t s, const addrinfo* ai) {
+        for (socket_t other : pending) {
+            if (other != s) close_socket(other);
+        }
+        pending.clear();
+        set_blocking(s, true);
+        int one = 1;
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+        result.socket = s;
+        result.version = ip_version(ai->ai_family);
+        result.address = address_text(ai);
+    };
+    auto deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+    auto next_start = Clock::now();
+    size_t next = 0;
+    for (;;) {
+        auto now = Clock::now();
+        if (now >= deadline) break;
+        if (next < addresses.size() && (now >= next_start || pending.empty())) {
+            const addrinfo* ai = addresses[next++];
+            ++result.attempts;
+            bool connected = false;
+            socket_t s = start_connect(ai, connected);
+            if (s == NO_SOCKET) continue;
+            if (connected) {
+                win(s, ai);
+                return result;
+            }
+            pending.push_back(s);
+            pending_ai.push_back(ai);
+            next_start = now + std::chrono::milliseconds(attempt_delay_ms);
+            continue;
+        }
+        if (pending.empty()) break;
+        auto until = next < addresses.size() ? std::min(next_start, deadline) : deadline;
+        int wait_ms = (int)std::chrono::ceil<std::chrono::milliseconds>(until - now).count();
+        std::vector<poll_fd> fds(pending.size());
+        for (size_t i = 0; i < pending.size(); ++i) {
+            fds[i].fd = pending[i];
+            fds[i].events = POLLOUT;
+            fds[i].revents = 0;
+        }
+        if (poll_sockets(fds.data(), fds.size(), std::max(wait_ms, 1)) < 0) break;
+        for (size_t i = fds.size(); i-- > 0;) {
+            if (!fds[i].revents) continue;
+            int error = 0;
+            socklen_t len = sizeof(error);
+            if (getsockopt(pending[i], SOL_SOCKET, SO_ERROR, (char*)&error, &len) == 0 && error == 0 &&
+                (fds[i].revents & POLLOUT)) {
+                win(pending[i], pending_ai[i]);
+                return result;
+            }
+            // Refused or unreachable: the next address need not wait
+            close_socket(pending[i]);
+            pending.erase(pending.begin() + (long)i);
+            pending_ai.erase(pending_ai.begin() + (long)i);
+            next_start = Clock::now();
+        }
+    }
+    for (socket_t s : pending) close_socket(s);
+    return result;
+}
+
+// Resolves `host` and races its addresses, `first_version` (4 or 6; 0 =
+// IPv6, as RFC 8305 prefers) first
+inline ConnectResult connect_tcp(const std::string& host, const std::string& port, int first_version, int attempt_delay_ms,
+                                 int timeout_ms, std::string& error) {
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* found = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0 || !found) {
+        error = "cannot resolve " + host;
+        return ConnectResult();
+    }
+    ConnectResult result = race_connect(interleave_families(found, first_version ? first_version : 6), attempt_delay_ms, timeout_ms);
+    freeaddrinfo(found);
+    if (result.socket == NO_SOCKET) error = "cannot connect to " + host + ":" + port;
+    return result;
+}
+
+inline std::string lower(std::string text) {
+    for (char& c : text) c = (char)tolower((unsigned char)c);
+    return text;
+}
+
+// Decodes a chunked body starting at `pos`; false until the last chunk is in
+inline bool decode_chunked(const std::string& in, size_t pos, std::string& out) {
+    out.clear();
+    for (;;) {
+        size_t line_end = in.find("\r\n", pos);
+        if (line_end == std::string::npos) return false;
+        size_t size = std::strtoul(in.substr(pos, line_end - pos).c_str(), nullptr, 16);
+        pos = line_end + 2;
+        if (size == 0) return in.compare(pos, 2, "\r\n") == 0 || in.find("\r\n\r\n", pos) != std::string::npos;
+        if (in.size() < pos + size + 2) return false;
+        out.append(in, pos, size);
+        pos += size + 2;
+    }
+}
+
+// Splits a raw response; false while it is incomplete (`at_eof`: nothing
+// more will come, so a body without a length ends here)
+inline bool parse_response(const std::string& raw, bool at_eof, HttpsResponse& response) {
+    size_t header_end = raw.find("\r\n\r\n");
+    if (header_end == std::string::npos) return false;
+    if (raw.compare(0, 5, "HTTP/") != 0) return at_eof;
+    size_t space = raw.find(' ');
+    response.status = space < header_end ? atoi(raw.c_str() + space + 1) : 0;
+    long long length = -1;
+    bool chunked = false;
+    size_t pos = raw.find("\r\n") + 2;
+    while (pos < header_end) {
+        size_t end = raw.find("\r\n", pos);
+        std::string line = raw.substr(pos, end - pos);
+        pos = end + 2;
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) continue;
+        std::string name = lower(line.substr(0, colon));
+        size_t value_start = line.find_first_not_of(" \t", colon + 1);
+        std::string value = value_start == std::string::npos ? "" : line.substr(value_start);
+        if (name == "content-length") length = atoll(value.c_str());
+        else if (name == "transfer-encoding") chunked = lower(value).find("chunked") != std::string::npos;
+        else if (name == "retry-after") response.retry_after = value;
+    }
+    size_t body_start = header_end + 4;
+    if (chunked) return decode_chunked(raw, body_start, response.body);
+    if (response.status == 204 || response.status == 304 || length == 0) {
+        response.body.clear();
+        return true;
+    }
+    if (length > 0) {
+        if (raw.size() - body_start < (size_t)length) return false;
+        response.body = raw.substr(body_start, (size_t)length);
+        return true;
+    }
+    if (!at_eof) return false;
+    response.body = raw.substr(body_start);
+    return true;
+}
+
+// What the new-session callback needs to file a ticket
+struct TicketSink {
+    TlsSessionCache* cache;
+    std::string host_port;
+    int tickets = 0;
+};
+
+}  // namespace https_detail
+
+struct HttpsClientOptions {
+    std::string user_agent;
+    int timeout_ms = 30000;
+    int connect_attempt_delay_ms = 250;  // RFC 8305's Connection Attempt Delay
+    bool early_data = false;  // TLS 1.3 0-RTT for idempotent requests
+    std::string ca_file;      // trusted roots; "" = the system's
+};
+
+class HttpsClient {
+public:
+    explicit HttpsClient(TlsSessionCache* cache = nullptr, HttpsClientOptions options = HttpsClientOptions())
+        : cache_(cache), options_(std::move(options)) {
+#ifdef _WIN32
+        static bool winsock_started = [] {
+            WSADATA data;
+            return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+        }();
+        (void)winsock_started;
+#endif
+        ctx_ = SSL_CTX_new(TLS_client_method());
+        if (!ctx_) return;
+        SSL_CTX_set_min_proto_version(ctx_, TLS1_2_VERSION);
+        SSL_CTX_set_verify(ctx_, SSL_VERIFY_PEER, nullptr);
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+        SSL_CTX_set_options(ctx_, SSL_OP_IGNORE_UNEXPECTED_EOF);  // servers that close without close_notify
+#endif
+        if (!options_.ca_file.empty()) {
+            trusted_ = SSL_CTX_load_verify_locations(ctx_, options_.ca_file.c_str(), nullptr) == 1;
+        } else {
+            trusted_ = load_system_roots();
+        }
+        // Sessions go to our cache only; OpenSSL's own store would not outlive the process
+        SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx_, &HttpsClient::on_new_session);
+    }
+
+    ~HttpsClient() {
+        if (ctx_) SSL_CTX_free(ctx_);
+    }
+
+    HttpsClient(const HttpsClient&) = delete;
+    HttpsClient& operator=(const HttpsClient&) = delete;
+
+    HttpsResponse get(const std::string& url) {
+        HttpsRequest request;
+        request.url = url;
+        request.idempotent = true;
+        return fetch(request);
+    }
+
+    HttpsResponse post(const std::string& url, const std::string& body, const std::string& content_type) {
+        HttpsRequest request;
+        request.method = "POST";
+        request.url = url;
+        request.body = body;
+        request.content_type = content_type;
+        return fetch(request);
+    }
+
+    HttpsResponse fetch(const HttpsRequest& request) {
+        using namespace https_detail;
+        HttpsResponse response;
+        auto start = std::chrono::steady_clock::now();
+        bool tls = false;
+        std::string host, port, target;
+        if (!split_http_url(request.url, tls, host, port, target)) {
+            response.error = "not an http(s) URL";
+            return response;
+        }
+        if (tls && (!ctx_ || !trusted_)) {
+            response.error = "TLS is not set up (no trusted roots)";
+            return response;
+        }
+        std::string host_port = host + ":" + port;
+        ConnectResult connection = connect_tcp(host, port, cache_ ? cache_->ip_version(host_port) : 0,
+                                               options_.connect_attempt_delay_ms, options_.timeout_ms, response.error);
+        response.tls.connect_ms = ms_since(start);
+        response.tls.connect_attempts = connection.attempts;
+        response.tls.address = connection.address;
+        socket_t s = connection.socket;
+        if (s == NO_SOCKET) return response;
+        if (cache_) cache_->set_ip_version(host_port, connection.version);
+        set_io_timeout(s, options_.timeout_ms);
+
+        std::string head = request.method + " " + target + " HTTP/1.1\r\nHost: " + host_header(host, port, tls) + "\r\n";
+        if (!options_.user_agent.empty()) head += "User-Agent: " + options_.user_agent + "\r\n";
+        if (!request.content_type.empty()) head += "Content-Type: " + request.content_type + "\r\n";
+        if (request.method != "GET" || !request.body.empty()) head += "Content-Length: " + std::to_string(request.body.size()) + "\r\n";
+        std::string wire = head + "Connection: close\r\n\r\n" + request.body;
+
+        if (tls) {
+            exchange_tls(s, host, port, wire, request.idempotent, start, response);
+        } else {
+            exchange_plain(s, wire, start, response);
+        }
+        close_socket(s);
+        if (response.total_ms == 0) response.total_ms = ms_since(start);
+        return response;
+    }
+
+private:
+    static std::string host_header(const std::string& host, const std::string& port, bool tls) {
+        std::string name = host.find(':') != std::string::npos ? "[" + host + "]" : host;
+        bool default_port = port == (tls ? "443" : "80");
+        return default_port ? name : name + ":" + port;
+    }
+
+    bool load_system_roots() {
+#ifdef _WIN32
+        HCERTSTORE store = CertOpenSystemStoreW(0, L"ROOT");
+        if (!store) return false;
+        X509_STORE* trusted = SSL_CTX_get_cert_store(ctx_);
+        size_t added = 0;
+        PCCERT_CONTEXT cert = nullptr;
+        while ((cert = CertEnumCertificatesInStore(store, cert)) != nullptr) {
+            const unsigned char* p = cert->pbCertEncoded;
+            X509* x509 = d2i_X509(nullptr, &p, (long)cert->cbCertEncoded);
+            if (!x509) continue;
+            if (X509_STORE_add_cert(trusted, x509) == 1) ++added;
+            X509_free(x509);
+        }
+        CertCloseStore(store, 0);
+        return added > 0;
+#else
+        return SSL_CTX_set_default_verify_paths(ctx_) == 1;
+#endif
+    }
+
+    static int on_new_session(SSL* ssl, SSL_SESSION* session) {
+        auto* sink = static_cast<https_detail::TicketSink*>(SSL_get_app_data(ssl));
+        if (!sink) return 0;
+        ++sink->tickets;
+        if (sink->cache) sink->cache->store(sink->host_port, session);
+        return 0;  // not kept: the cache holds its own copy
+    }
+
+    void exchange_plain(https_detail::socket_t s, const std::string& wire, std::chrono::steady_clock::time_point start,
+                        HttpsResponse& response) {
+        size_t sent = 0;
+        while (sent < wire.size()) {
+            int n = send(s, wire.data() + sent, (int)(wire.size() - sent), 0);
+            if (n <= 0) {
+                response.error = "send failed";
+                return;
+            }
+            sent += (size_t)n;
+        }
+        read_response([&](char* buf, int size) { return (int)recv(s, buf, size, 0); }, response);
+        response.total_ms = https_detail::ms_since(start);
+    }
+
+    void exchange_tls(https_detail::socket_t s, const std::string& host, const std::string& port, const std::string& wire,
+                      bool idempotent, std::chrono::steady_clock::time_point fetch_start, HttpsResponse& response) {
+        using namespace https_detail;
+        TlsHandshakeInfo& info = response.tls;
+        info.tls = true;
+        SSL* ssl = SSL_new(ctx_);
+        if (!ssl) {
+            response.error = "SSL_new failed";
+            return;
+        }
+        TicketSink sink{cache_, host + ":" + port};
+        SSL_set_app_data(ssl, &sink);
+        SSL_set_fd(ssl, (int)s);
+        // An IP literal is checked against the certificate's IP entries, a name gets SNI too
+        if (X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), host.c_str()) != 1) {
+            SSL_set_tlsext_host_name(ssl, host.c_str());
+            SSL_set1_host(ssl, host.c_str());
+        }
+        SSL_SESSION* cached = cache_ ? cache_->find(sink.host_port) : nullptr;
+        if (cached) SSL_set_session(ssl, cached);
+
+        auto start = std::chrono::steady_clock::now();
+        bool request_sent = false;
+        if (cached && options_.early_data && idempotent && SSL_SESSION_get_max_early_data(cached) >= wire.size()) {
+            size_t written = 0;
+            info.early_data_sent = SSL_write_early_data(ssl, wire.data(), wire.size(), &written) == 1 && written == wire.size();
+        }
+        bool connected = SSL_connect(ssl) == 1;
+        info.handshake_ms = ms_since(start);
+        if (cached) SSL_SESSION_free(cached);
+        if (!connected) {
+            unsigned long err = ERR_get_error();
+            long verify = SSL_get_verify_result(ssl);
+            response.error = verify != X509_V_OK ? std::string("certificate: ") + X509_verify_cert_error_string(verify)
+                                                 : std::string("TLS handshake: ") + (err ? ERR_reason_error_string(err) : "failed");
+            ERR_clear_error();
+            SSL_free(ssl);
+            return;
+        }
+        info.resumed = SSL_session_reused(ssl) == 1;
+        info.version = SSL_get_version(ssl);
+        if (info.early_data_sent) {
+            info.early_data_accepted = SSL_get_early_data_status(ssl) == SSL_EARLY_DATA_ACCEPTED;
+            request_sent = info.early_data_accepted;
+        }
+        if (!request_sent) {
+            size_t written = 0;
+            if (SSL_write_ex(ssl, wire.data(), wire.size(), &written) != 1 || written != wire.size()) {
+                response.error = "TLS write failed";
+                SSL_free(ssl);
+                return;
+            }
+        }
+        auto read = [&](char* buf, int size) {
+            size_t got = 0;
+            return SSL_read_ex(ssl, buf, (size_t)size, &got) == 1 ? (int)got : 0;
+        };
+        read_response(read, response);
+        response.total_ms = ms_since(fetch_start);
+        // A server answering early data sends the next ticket only after the
+        // handshake, behind the response; wait a round trip or so for it, or
+        // the next launch offers a used ticket and its early data is refused
+        if (info.early_data_accepted && sink.tickets == 0 && cache_) {
+            set_io_timeout(s, (int)std::min<double>(options_.timeout_ms, std::max(100.0, 2 * info.handshake_ms)));
+            char buf[4096];
+            while (sink.tickets == 0 && read(buf, (int)sizeof(buf)) > 0) {
+            }
+        }
+        SSL_shutdown(ssl);
+        ERR_clear_error();
+        SSL_free(ssl);
+    }
+
+    // Reads until the response is complete or the peer closes; `read`
+    // returns the bytes read, 0 at the end (or on an error)
+    template <typename Read>
+    void read_response(Read read, HttpsResponse& response) {
+        std::string raw;
+        char buf[16384];
+        for (;;) {
+            int n = read(buf, (int)sizeof(buf));
+            if (n <= 0) break;
+            raw.append(buf, (size_t)n);
+            if (https_detail::parse_response(raw, false, response)) return;
+        }
+        if (!https_detail::parse_response(raw, true, response)) {
+            response.status = 0;
+            response.body.clear();
+            response.error = raw.empty() ? "no reply" : "incomplete reply";
+        }
+    }
+
+    TlsSessionCache* cache_;
+    HttpsClientOptions options_;
+    SSL_CTX* ctx_ = nullptr;
+    bool trusted_ = false;
+};
@@ -0,0 +1,349 @@
+#pragma once
+#include <string>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <cstdlib>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <sddl.h>
+#include <aclapi.h>
+#else
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#endif
+
+// Single-instance detection and a local command channel between instances.
+// The first process to listen() owns the channel name; later processes send()
+// one line-based command to it and read a one-line reply.
+//
+// Windows uses a named pipe (claimed atomically with FILE_FLAG_FIRST_PIPE_INSTANCE),
+// other platforms a Unix domain socket in the user's runtime directory. Either
+// way the channel belongs to the current user: the pipe's name carries the
+// user's SID and its DACL admits only that user, the socket is 0600, and
+// both sides refuse a peer of another user (a pipe someone else created
+// first, a socket another user planted in /tmp).
+class InstanceChannel {
+public:
+    using Handler = std::function<std::string(const std::string& command)>;
+
+    explicit InstanceChannel(const std::string& name) : name_(sanitize(name)) {}
+    ~InstanceChannel() { close(); }
+
+    InstanceChannel(const InstanceChannel&) = delete;
+    InstanceChannel& operator=(const InstanceChannel&) = delete;
+
+    // Claims the channel and serves commands on a background thread.
+    // Returns false if another live instance already owns it.
+    bool listen(Handler handler) {
+        if (running_) return true;
+        handler_ = std::move(handler);
+        if (!claim()) return false;
+        running_ = true;
+        thread_ = std::thread([this] { serve(); });
+        return true;
+    }
+
+    void close() {
+        if (!running_) return;
+        running_ = false;
+        wake();
+        if (thread_.joinable()) thread_.join();
+        release();
+    }
+
+    bool is_primary() const { return running_; }
+
+    // Sends `command` to the owning instance. Returns false if there is none.
+    static bool send(const std::string& name, const std::string& command, std::string& reply, int timeout_ms) {
+        reply.clear();
+#ifdef _WIN32
+        std::wstring path = pipe_path(sanitize(name));
+        HANDLE pipe = INVALID_HANDLE_VALUE;
+        DWORD waited = 0;
+        while (true) {
+            pipe = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE | READ_CONTROL, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+            if (pipe != INVALID_HANDLE_VALUE) break;
+            if (GetLastError() != ERROR_PIPE_BUSY || waited >= (DWORD)timeout_ms) return false;
+            WaitNamedPipeW(path.c_str(), 50);
+            waited += 50;
+        }
+        if (!owned_by_user(pipe)) {
+            CloseHandle(pipe);
+            return false;
+        }
+        std::string line = command + "\n";
+        DWORD written = 0;
+        bool ok = WriteFile(pipe, line.data(), (DWORD)line.size(), &written, nullptr) != FALSE;
+        char c;
+        DWORD read = 0;
+        while (ok && ReadFile(pipe, &c, 1, &read, nullptr) && read == 1 && c != '\n') reply.push_back(c);
+        CloseHandle(pipe);
+        return ok;
+#else
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return false;
+        timeval tv = {timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        sockaddr_un addr = socket_address(sanitize(name));
+        if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || !peer_is_user(fd)) {
+            ::close(fd);
+            return false;
+        }
+        std::string line = command + "\n";
+        bool ok = write(fd, line.data(), line.size()) == (ssize_t)line.size();
+        char c;
+        while (ok && read(fd, &c, 1) == 1 && c != '\n') reply.push_back(c);
+        ::close(fd);
+        return ok;
+#endif
+    }
+
+#ifndef _WIN32
+    static std::string socket_path(const std::string& name) {
+        const char* runtime = getenv("XDG_RUNTIME_DIR");
+        if (runtime && *runtime) return std::string(runtime) + "/" + name + ".sock";
+        return "/tmp/" + name + "-" + std::to_string(getuid()) + ".sock";
+    }
+#endif
+
+private:
+    static std::string sanitize(const std::string& name) {
+        std::string out;
+        for (char c : name) {
+            bool keep = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '.';
+            out.push_back(keep ? c : '_');
+        }
+        return out;
+    }
+
+#ifdef _WIN32
+    // The current user's SID ("S-1-5-21-..."); "" if the token cannot be read
+    static std::wstring user_sid() {
+        static const std::wstring sid = [] {
+            std::wstring out;
+            HANDLE token = nullptr;
+            if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token)) return out;
+            DWORD size = 0;
+            GetTokenInformation(token, TokenUser, nullptr, 0, &size);
+            std::vector<BYTE> buffer(size);
+            LPWSTR text = nullptr;
+            if (size && GetTokenInformation(token, TokenUser, buffer.data(), size, &size) &&
+                ConvertSidToStringSidW(((TOKEN_USER*)buffer.data())->User.Sid, &text)) {
+                out = text;
+                LocalFree(text);
+            }
+            CloseHandle(token);
+            return out;
+        }();
+        return sid;
+    }
+
+    // Pipe names are machine-wide; the SID keeps one channel per user
+    static std::wstring pipe_path(const std::string& name) {
+        return L"\\\\.\\pipe\\" + std::wstring(name.begin(), name.end()) + L"-" + user_sid();
+    }
+
+    // Whether the pipe was created by the current user, not planted by another
+    static bool owned_by_user(HANDLE pipe) {
+        PSID owner = nullptr;
+        PSECURITY_DESCRIPTOR descriptor = nullptr;
+        if (GetSecurityInfo(pipe, SE_KERNEL_OBJECT, OWNER_SECURITY_INFORMATION, &owner, nullptr, nullptr, nullptr,
+                            &descriptor) != ERROR_SUCCESS) {
+            return false;
+        }
+        LPWSTR text = nullptr;
+        bool same = owner && ConvertSidToStringSidW(owner, &text) && !user_sid().empty() && user_sid() == text;
+        if (text) LocalFree(text);
+        LocalFree(descriptor);
+        return same;
+    }
+
+    // Owned by the current user and open to nobody else
+    HANDLE create_pipe(bool first) {
+        std::wstring sid = user_sid();
+        if (sid.empty()) return INVALID_HANDLE_VALUE;
+        std::wstring sddl = L"O:" + sid + L"D:P(A;;GA;;;" + sid + L")";
+        PSECURITY_DESCRIPTOR descriptor = nullptr;
+        if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(sddl.c_str(), SDDL_REVISION_1, &descriptor, nullptr)) {
+            return INVALID_HANDLE_VALUE;
+        }
+        SECURITY_ATTRIBUTES security = {sizeof(security), descriptor, FALSE};
+        HANDLE pipe = CreateNamedPipeW(pipe_path(name_).c_str(),
+            PIPE_ACCESS_DUPLEX | (first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+            PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+            PIPE_UNLIMITED_INSTANCES, 4096, 4096, 0, &security);
+        LocalFree(descriptor);
+        return pipe;
+    }
+
+    // Ends the serve thread's wait for a client with a connection that sends
+    // nothing; no reply is awaited, as the thread may already be gone
+    void wake() {
+        HANDLE pipe = CreateFileW(pipe_path(name_).c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+        if (pipe != INVALID_HANDLE_VALUE) CloseHandle(pipe);
+    }
+
+    bool claim() {
+        pipe_ = create_pipe(true);
+        return pipe_ != INVALID_HANDLE_VALUE;
+    }
+
+    void serve() {
+        while (running_) {
+            if (!ConnectNamedPipe(pipe_, nullptr) && GetLastError() != ERROR_PIPE_CONNECTED) break;
+            // Create the next instance before releasing this one so the name
+            // is never unowned.
+            HANDLE next = create_pipe(false);
+
+            std::string command;
+            char c;
+            DWORD read = 0;
+            while (ReadFile(pipe_, &c, 1, &read, nullptr) && read == 1 && c != '\n' && command.size() < 4096) {
+                command.push_back(c);
+            }
+            if (running_ && !command.empty()) {
+                std::string reply = handler_(command) + "\n";
+                DWORD written = 0;
+                WriteFile(pipe_, reply.data(), (DWORD)reply.size(), &written, nullptr);
+                FlushFileBuffers(pipe_);
+            }
+            DisconnectNamedPipe(pipe_);
+            CloseHandle(pipe_);
+            pipe_ = next;
+            if (pipe_ == INVALID_HANDLE_VALUE) break;
+        }
+    }
+
+    void release() {
+        if (pipe_ != INVALID_HANDLE_VALUE) {
+            CloseHandle(pipe_);
+            pipe_ = INVALID_HANDLE_VALUE;
+        }
+    }
+
+    HANDLE pipe_ = INVALID_HANDLE_VALUE;
+#else
+    static sockaddr_un socket_address(const std::string& name) {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        std::string path = socket_path(name);
+        path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+        return addr;
+    }
+
+    // Whether the other end of `fd` runs as the current user
+    static bool peer_is_user(int fd) {
+        ucred peer = {};
+        socklen_t len = sizeof(peer);
+        return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &len) == 0 && peer.uid == getuid();
+    }
+
+    // Claiming and releasing the path are serialized across processes with
+    // an flock on "<socket>.lock", so two instances starting at once cannot
+    // both take a stale socket, and one that exits cannot remove the socket
+    // its successor just bound. Without the lock file (not writable) only
+    // the refused-connect check below guards the unlink.
+    static int lock_path(const std::string& path) {
+        int fd = open((path + ".lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd >= 0) flock(fd, LOCK_EX);
+        return fd;
+    }
+
+    static void unlock_path(int fd) {
+        if (fd >= 0) ::close(fd);
+    }
+
+    // Makes the serve thread's accept() fail
+    void wake() {
+        if (listen_fd_ >= 0) shutdown(listen_fd_, SHUT_RDWR);
+    }
+
+    bool claim() {
+        listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0) return false;
+        sockaddr_un addr = socket_address(name_);
+        int lock = lock_path(addr.sun_path);
+        mode_t old_mask = umask(0077);
+        bool bound = bind(listen_fd_, (sockaddr*)&addr, sizeof(addr)) == 0;
+        if (!bound && errno == EADDRINUSE) {
+            // Someone owns the path. Only a refused connect proves it is a
+            // stale socket left by a crashed instance; any other failure (a
+            // busy owner's full backlog) may be a live one. Non-blocking, so
+            // a hung owner cannot hang this launch.
+            int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+            bool stale = probe >= 0 && connect(probe, (sockaddr*)&addr, sizeof(addr)) != 0 && errno == ECONNREFUSED;
+            if (probe >= 0) ::close(probe);
+            if (stale) {
+                unlink(addr.sun_path);
+                bound = bind(listen_fd_, (sockaddr*)&addr, sizeof(addr)) == 0;
+            }
+        }
+        umask(old_mask);
+        struct stat st = {};
+        if (!bound || ::listen(listen_fd_, 8) < 0 || stat(addr.sun_path, &st) != 0) {
+            unlock_path(lock);
+            ::close(listen_fd_);
+            listen_fd_ = -1;
+            return false;
+        }
+        socket_inode_ = st.st_ino;
+        unlock_path(lock);
+        return true;
+    }
+
+    void serve() {
+        while (running_) {
+            int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            if (!peer_is_user(fd)) {
+                ::close(fd);
+                continue;
+            }
+            timeval tv = {1, 0};
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            std::string command;
+            char c;
+            while (read(fd, &c, 1) == 1 && c != '\n' && command.size() < 4096) command.push_back(c);
+            if (running_ && !command.empty()) {
+                std::string reply = handler_(command) + "\n";
+                ssize_t ignored = write(fd, reply.data(), reply.size());
+                (void)ignored;
+            }
+            ::close(fd);
+        }
+    }
+
+    void release() {
+        if (listen_fd_ < 0) return;
+        std::string path = socket_path(name_);
+        int lock = lock_path(path);
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+        // Another instance may have replaced the socket since
+        struct stat st = {};
+        if (stat(path.c_str(), &st) == 0 && st.st_ino == socket_inode_) unlink(path.c_str());
+        unlock_path(lock);
+    }
+
+    int listen_fd_ = -1;
+    ino_t socket_inode_ = 0;
+#endif
+
+    std::string name_;
+    Handler handler_;
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+};
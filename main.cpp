@@ -1,7 +1,18 @@
+#include <winsock2.h>  // before windows.h (https_client.h)
 #include <windows.h>
+#include <shellapi.h>
 #include <wrl/client.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <deque>
+#include <filesystem>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 #include "WebView2.h"
 #include "getuuid.h"
@@ -13,168 +24,737 @@
 #include "encrypt_data.h"
 #include "send_data.h"
 #include "config.h"
+#include "restriction_script.h"
+#include "timing_log.h"
+#include "nav_timeline.h"
+#include "webview_callback.h"
+#include "instance_channel.h"
+#include "memory_policy.h"
+#include "webview_memory.h"
+#include "session_manager.h"
+#include "asset_pack.h"
+#include "url_filter.h"
+#include "page_bridge.h"
+#include "stage_progress.h"
+#include "bounds_coalescer.h"
+#include "dpi_awareness.h"
+#include "event_loop.h"
+#include "task.h"
+#include "handshake.h"
+#include "token_cache.h"
+#include "offline_queue.h"
+#include "admission.h"
+#include "endpoint_selector.h"
+#if __has_include("asset_pack_data.h")
+#include "asset_pack_data.h"  // generated by tools/asset_pack_tool --header
+#define HAVE_EMBEDDED_ASSET_PACK 1
+#endif
 
 using Microsoft::WRL::ComPtr;
 
-// Window procedure for WebView2 window
-LRESULT CALLBACK WindowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
-    if (msg == WM_DESTROY) { PostQuitMessage(0); return 0; }
-    return DefWindowProcW(hwnd, msg, wParam, lParam);
+// Messages posted to the hidden login host window; work from other threads
+// reaches the UI thread through LoginHost::loop instead
+const UINT WM_APP_TRAY = WM_APP + 1;  // tray icon notification (lParam: mouse message)
+const UINT WM_APP_LOOP = WM_APP + 2;  // LoginHost::loop has posted work (runs it inside modal loops)
+const UINT_PTR LOOP_TIMER_ID = 1;     // host window: LoginHost::loop's next timer is due
+const UINT_PTR MEMORY_TICK_TIMER_ID = 2;    // drives the idle check of MemoryPolicy
+const UINT_PTR MEMORY_REPORT_TIMER_ID = 3;  // measures memory shortly after a transition
+const UINT_PTR SPLASH_TIMER_ID = 4;         // animates the progress bar until the page is revealed
+const UINT_PTR SPLASH_CLOSE_TIMER_ID = 5;   // closes the window a moment after a failed login
+const UINT_PTR BOUNDS_TIMER_ID = 6;         // flushes coalesced size/scale changes to the controller
+const UINT MEMORY_TICK_MS = 30 * 1000;
+const UINT MEMORY_REPORT_DELAY_MS = 2000;
+const UINT SPLASH_FRAME_MS = 50;
+const UINT SPLASH_FAILED_MS = 3000;
+const UINT HANDSHAKE_TIMEOUT_MS = 60 * 1000;  // fingerprint + token exchange, then the login fails
+const int64_t TOKEN_REUSE_MARGIN_S = 30;      // a cached token must outlive the page load by this much
+const size_t OFFLINE_BATCH_MAX = 32;          // queued registrations sent per batch request
+const double ADMISSION_MAX_WAIT_MS = 15000;   // a login waits out holds up to this long, then fails
+const UINT TRAY_MENU_OPEN = 1;
+const UINT TRAY_MENU_EXIT = 2;
+
+// Calls the backend with `call(url)` (send_data or send_batch) on the mirrors
+// of `list` in the order `endpoints` gives; the next mirror is tried when one
+// is not reached or answers 5xx, but not after a 429/503 (admission.h)
+template <typename Call>
+bool call_backend(EndpointSelector* endpoints, const std::string& list, ReplyStatus& status, Call call) {
+    return call_endpoints(endpoints, list, g_config->should_pin_backend_shard(), [&](const std::string& url) {
+        status = ReplyStatus();
+        bool sent = call(url);
+        if (status.status == 429 || status.status == 503) return EndpointResult::Busy;
+        if (!sent || status.status >= 500) return EndpointResult::Failed;
+        return EndpointResult::Ok;
+    });
+}
+
+// Binds the handshake's blocking steps (handshake.h) to the WMI, WinINet and
+// OpenSSL helpers. The steps run on Offload threads, record the replies'
+// 429/503 holds and backoff hints in `admission` and pick mirrors with
+// `endpoints`.
+HandshakeSteps handshake_steps(Admission* admission, EndpointSelector* endpoints) {
+    HandshakeSteps steps;
+    steps.hardware = [](Fingerprint& fp) {
+        bool log_system_info = g_config->is_debug_enabled() && g_config->should_log_system_info();
+        fp.uuid = get_system_uuid();
+        fp.machine_guid = get_machine_guid();
+        fp.serials = get_hdd_serials();
+        if (log_system_info) {
+            std::cout << "System UUID: " << fp.uuid << std::endl;
+            std::cout << "Machine GUID: " << fp.machine_guid << std::endl;
+            if (fp.serials.empty()) {
+                std::cout << "No HDD/SSD serial numbers found." << std::endl;
+            } else {
+                for (size_t i = 0; i < fp.serials.size(); ++i) {
+                    std::cout << "HDD/SSD Serial " << (i + 1) << ": " << fp.serials[i] << std::endl;
+                }
+            }
+        }
+    };
+    steps.network = [admission, endpoints](nlohmann::json& ipinfo, nlohmann::json& ipinfo2) {
+        if (!fetch_ipinfo_pair(ipinfo, ipinfo2, admission, endpoints)) return false;
+        if (g_config->is_debug_enabled()) {
+            std::cout << "IP Info (from " << g_config->get_ipcheck_url() << "):\n" << ipinfo.dump(4) << std::endl;
+            std::cout << "\nProxyCheck Info (from " << g_config->get_proxycheck_url() << "):\n" << ipinfo2.dump(4) << std::endl;
+        }
+        return true;
+    };
+    steps.encrypt = [](const nlohmann::json& registration) {
+        bool debug_enabled = g_config->is_debug_enabled();
+        if (debug_enabled) std::cout << "\nData to encrypt:\n" << registration.dump(4) << std::endl;
+        std::string encrypted_data, error;
+        if (!g_config->get_public_key_file().empty()) {
+            // Legacy: use file if specified
+            encrypted_data = encrypt_data(registration, g_config->get_public_key_file(), &error);
+        } else {
+            // Modern: use embedded key
+            encrypted_data = encrypt_data_from_key_string(registration, EmbeddedKey::PUBLIC_KEY_PEM, &error);
+        }
+        // A registration too large for the key would fail the same way on every launch
+        if (encrypted_data.empty() && !error.empty()) throw HandshakeError("encryption failed: " + error);
+        if (debug_enabled && !encrypted_data.empty() && g_config->should_log_encrypted_data()) {
+            std::cout << "\nEncrypted data (" << encrypted_data.size() << " chars, base64):\n" << encrypted_data << std::endl;
+        }
+        return encrypted_data;
+    };
+    steps.send = [admission, endpoints](const std::string& payload, std::string& reply) {
+        ReplyStatus status;
+        bool sent = call_backend(endpoints, g_config->get_backend_url(), status,
+                                 [&](const std::string& url) { return send_data(payload, reply, &status, url); });
+        admission->on_reply(AdmissionService::Backend, status);
+        admission->on_backend_reply(reply);
+        if (!sent) return false;
+        if (g_config->is_debug_enabled() && g_config->should_log_server_responses()) {
+            std::cout << "Data sent, server replied: " << reply << std::endl;
+        }
+        return true;
+    };
+    steps.dcid = g_config->get_dcid();
+    steps.version = g_config->get_app_version();
+    steps.login_base_url = g_config->get_login_base_url();
+    steps.admission = admission;
+    steps.max_hold_ms = ADMISSION_MAX_WAIT_MS;
+    return steps;
+}
+
+// Sends queued registrations (offline_queue.h): to BACKEND_BATCH_URL in one
+// request, or one at a time to BACKEND_URL if there is no batch endpoint.
+// Runs on an Offload thread.
+BatchSendFn offline_batch_sender(Admission* admission, EndpointSelector* endpoints) {
+    return [admission, endpoints](const std::vector<std::string>& messages, std::string& reply) {
+        bool sent = false;
+        ReplyStatus status;
+        if (!g_config->get_backend_batch_url().empty()) {
+            sent = call_backend(endpoints, g_config->get_backend_batch_url(), status,
+                                [&](const std::string& url) { return send_batch(messages, reply, &status, url); });
+            admission->on_backend_reply(reply);
+        } else {
+            std::string single;
+            sent = !messages.empty() && call_backend(endpoints, g_config->get_backend_url(), status, [&](const std::string& url) {
+                return send_data(messages[0], single, &status, url);
+            });
+            admission->on_backend_reply(single);
+            if (sent) reply = nlohmann::json{{"results", nlohmann::json::array({single})}}.dump();
+        }
+        admission->on_reply(AdmissionService::Backend, status);
+        if (sent && g_config->is_debug_enabled() && g_config->should_log_server_responses()) {
+            std::cout << "Queued registrations sent, server replied: " << reply << std::endl;
+        }
+        return sent;
+    };
+}
+
+// What the login page is told at DOMContentLoaded (and on a "context"
+// request) so it does not have to ask the backend for it. "degraded" flags
+// the probes that came back empty.
+nlohmann::json page_context_for(const Fingerprint& fp, uint64_t session_id) {
+    auto field = [](const nlohmann::json& info, const char* key) {
+        return info.is_object() ? info.value(key, "") : std::string();
+    };
+    return {
+        {"version", g_config->get_app_version()},
+        {"app", g_config->get_app_name()},
+        {"session", session_id},
+        {"country", field(fp.ipinfo2, "country")},
+        {"provider", field(fp.ipinfo2, "provider")},
+        {"organisation", field(fp.ipinfo2, "organisation")},
+        {"degraded", {
+            {"hwid", fp.uuid.empty()},
+            {"disk_serial", fp.serials.empty()},
+            {"machine_guid", fp.machine_guid.empty()},
+            {"proxy_check", field(fp.ipinfo2, "country").empty()}
+        }},
+        {"fingerprint_age_s", fp.collected_at ? (GetTickCount64() - fp.collected_at) / 1000 : 0}
+    };
 }
 
 // Helper: Disable context menu, F12, highlight/copy/paste for WebView2
 void RestrictWebView2(ComPtr<ICoreWebView2>& webview) {
-    if (!g_config) return;
-    
-    bool disable_context_menu = g_config->should_disable_context_menu();
-    bool disable_text_selection = g_config->should_disable_text_selection();
-    bool disable_copy_paste = g_config->should_disable_copy_paste();
-    
-    if (!disable_context_menu && !disable_text_selection && !disable_copy_paste) {
+    // Every flag is a compile-time Config constant, so the UTF-16 script is
+    // assembled by the compiler (see restriction_script.h).
+    constexpr auto& script = RESTRICTION_SCRIPT<
+        Config::DISABLE_CONTEXT_MENU,
+        Config::DISABLE_TEXT_SELECTION,
+        Config::DISABLE_COPY_PASTE>;
+
+    if (script.size() == 0) {
         return; // No restrictions needed
     }
-    
-    std::string script = "// WebView2 Security Restrictions\n";
-    
-    if (disable_context_menu) {
-        script += "document.addEventListener('contextmenu', event => event.preventDefault());\n";
+
+    webview->AddScriptToExecuteOnDocumentCreated(script.c_str(), nullptr);
+}
+
+struct LoginHost;
+struct WebViewSession;
+bool PostToLoginPage(WebViewSession& session, const std::string& envelope);
+
+// Per-window WebView2 state shared by the COM callbacks
+struct WebViewSession {
+    uint64_t id;
+    HWND hwnd;
+    LoginHost* host;
+    std::wstring url;  // login URL; navigated to as soon as the controller exists
+    ComPtr<ICoreWebView2Controller> controller;
+    ComPtr<ICoreWebView2> webview;
+    ComPtr<ICoreWebView2Environment> environment;
+    AssetServer* assets = nullptr;  // shared by all sessions of the host
+    UrlFilter* url_filter = nullptr;  // likewise
+    NavigationTimeline timeline;
+    PageBridge bridge;
+    nlohmann::json page_context;  // pushed to the page by the bridge; null until a login is shown
+    StageProgress progress;  // drawn by the splash until the page is revealed
+    bool revealed = false;   // controller visible; false while the splash shows
+    BoundsCoalescer bounds;  // at most one put_Bounds/put_RasterizationScale per frame
+    bool per_monitor_dpi = false;  // we own the rasterization scale (see SetUpWebView)
+
+    MemoryPolicy memory;
+    WebViewMemoryUsage memory_before;  // measured when the last transition was applied
+    ComPtr<TrySuspendCompletedHandler> suspend_handler;
+
+    WebViewSession(uint64_t id, HWND hwnd, LoginHost* host)
+        : id(id), hwnd(hwnd), host(host),
+          timeline(0, [this](const NavigationRecord& record) {
+              timing_log().mark(timeline.format(record));
+          }),
+          bridge([this](const std::string& envelope) { return PostToLoginPage(*this, envelope); }),
+          memory((g_config ? g_config->get_idle_trim_minutes() : 5) * 60.0 * 1000.0) {}
+};
+
+void CloseSessionWindow(WebViewSession& session);
+void BringLoginWindowToFront(HWND hwnd);
+
+// Helper: Apply a MemoryPolicy decision to the webview and schedule the "after" measurement
+void ApplyMemoryAction(WebViewSession& session, MemoryAction action) {
+    if (action == MemoryAction::None || !session.webview) return;
+
+    session.memory_before = webview_memory_usage(session.environment.Get(), session.webview.Get());
+    ComPtr<ICoreWebView2_19> webview19;  // MemoryUsageTargetLevel
+    ComPtr<ICoreWebView2_3> webview3;    // TrySuspend/Resume
+    session.webview->QueryInterface(IID_ICoreWebView2_19, reinterpret_cast<void**>(webview19.GetAddressOf()));
+    session.webview->QueryInterface(IID_ICoreWebView2_3, reinterpret_cast<void**>(webview3.GetAddressOf()));
+
+    switch (action) {
+    case MemoryAction::LowerTarget:
+        if (webview19) webview19->put_MemoryUsageTargetLevel(COREWEBVIEW2_MEMORY_USAGE_TARGET_LEVEL_LOW);
+        break;
+    case MemoryAction::Suspend:
+        if (webview19) webview19->put_MemoryUsageTargetLevel(COREWEBVIEW2_MEMORY_USAGE_TARGET_LEVEL_LOW);
+        // TrySuspend is refused while the controller is visible
+        if (session.controller) session.controller->put_IsVisible(FALSE);
+        if (webview3) {
+            if (!session.suspend_handler) {
+                MemoryPolicy* memory = &session.memory;
+                session.suspend_handler = new TrySuspendCompletedHandler(
+                    [memory](HRESULT error, BOOL suspended) -> HRESULT {
+                        if (FAILED(error) || !suspended) memory->on_suspend_refused();
+                        return S_OK;
+                    });
+            }
+            webview3->TrySuspend(session.suspend_handler.Get());
+        } else {
+            session.memory.on_suspend_refused();
+        }
+        break;
+    case MemoryAction::Resume:
+        if (webview3) webview3->Resume();
+        // While the splash shows, RevealLoginPage makes the controller visible once the page has painted
+        if (session.controller) session.controller->put_IsVisible(session.revealed ? TRUE : FALSE);
+        if (webview19) webview19->put_MemoryUsageTargetLevel(COREWEBVIEW2_MEMORY_USAGE_TARGET_LEVEL_NORMAL);
+        break;
+    case MemoryAction::None:
+        break;
     }
-    
-    script += R"(
-            // Disable F12 and Ctrl+Shift+I (DevTools)
-            document.addEventListener('keydown', function(e) {
-                if (e.keyCode === 123 || (e.ctrlKey && e.shiftKey && e.key.toLowerCase() === 'i')) {
-                    e.preventDefault();
-                }
-    )";
-    
-    if (disable_copy_paste) {
-        script += R"(
-                // Disable Ctrl+C, Ctrl+V, Ctrl+X (Copy/Paste/Cut)
-                if ((e.ctrlKey && (e.key.toLowerCase() === 'c' || e.key.toLowerCase() === 'v' || e.key.toLowerCase() === 'x'))) {
-                    e.preventDefault();
-                }
-        )";
+    SetTimer(session.hwnd, MEMORY_REPORT_TIMER_ID, MEMORY_REPORT_DELAY_MS, nullptr);
+}
+
+// Feeds minimize/restore/activation and the idle tick into the memory policy.
+// Only observes messages; they still take their normal path.
+void HandleMemoryMessage(WebViewSession& session, UINT msg, WPARAM wParam, LPARAM lParam) {
+    double now = timing_log().now_ms();
+    switch (msg) {
+    case WM_SIZE:
+        if (wParam == SIZE_MINIMIZED) ApplyMemoryAction(session, session.memory.on_minimized(now));
+        else if (wParam == SIZE_RESTORED || wParam == SIZE_MAXIMIZED) ApplyMemoryAction(session, session.memory.on_restored(now));
+        break;
+    case WM_ACTIVATEAPP:
+        ApplyMemoryAction(session, session.memory.on_activation(wParam != FALSE, now));
+        break;
+    case WM_TIMER:
+        if (wParam == MEMORY_TICK_TIMER_ID) {
+            ApplyMemoryAction(session, session.memory.on_tick(now));
+        } else if (wParam == MEMORY_REPORT_TIMER_ID) {
+            KillTimer(session.hwnd, MEMORY_REPORT_TIMER_ID);
+            if (g_config && g_config->is_debug_enabled()) {
+                static const char* STATE_NAMES[] = {"active", "reduced", "suspended"};
+                WebViewMemoryUsage after = webview_memory_usage(session.environment.Get(), session.webview.Get());
+                std::cout << "[memory] " << session.memory.reason() << " -> "
+                          << STATE_NAMES[(int)session.memory.state()] << ": "
+                          << format_memory_usage(session.memory_before) << " -> "
+                          << format_memory_usage(after) << std::endl;
+            }
+        }
+        break;
     }
-    
-    if (disable_text_selection) {
-        script += R"(
-                // Disable text selection (mouse and keyboard)
-                if (e.key === "ArrowLeft" || e.key === "ArrowRight" || e.key === "ArrowUp" || e.key === "ArrowDown" || e.key.toLowerCase() == "a") {
-                    if (e.ctrlKey || e.shiftKey) e.preventDefault();
-                }
-        )";
+}
+
+// Pushes the coalesced size/scale changes to the controller
+void FlushBounds(WebViewSession& session) {
+    KillTimer(session.hwnd, BOUNDS_TIMER_ID);
+    BoundsUpdate update;
+    if (!session.bounds.flush(timing_log().now_ms(), update) || !session.controller) return;
+    if (update.resize) {
+        RECT bounds = {0, 0, update.width, update.height};
+        session.controller->put_Bounds(bounds);
     }
-    
-    script += "});\n";
-    
-    if (disable_text_selection) {
-        script += R"(
-            // Disable selection by mouse
-            document.addEventListener('selectstart', function(e) { e.preventDefault(); });
-            // Additional CSS to block selection and highlight
-            const css = `
-                * {
-                    user-select: none !important;
-                    -webkit-user-select: none !important;
-                    -moz-user-select: none !important;
-                    -ms-user-select: none !important;
-                }
-                ::selection { background: transparent !important; }
-            `;
-            const style = document.createElement('style');
-            style.appendChild(document.createTextNode(css));
-            document.head.appendChild(style);
-        )";
+    ComPtr<ICoreWebView2Controller3> ctrl3;
+    if (update.rescale && SUCCEEDED(session.controller->QueryInterface(IID_ICoreWebView2Controller3, reinterpret_cast<void**>(ctrl3.GetAddressOf())))) {
+        ctrl3->put_RasterizationScale(update.scale);
     }
+}
 
-    webview->AddScriptToExecuteOnDocumentCreated(
-        std::wstring(script.begin(), script.end()).c_str(),
-        nullptr
-    );
+void ScheduleBounds(WebViewSession& session, double delay_ms) {
+    if (delay_ms == 0) FlushBounds(session);
+    else if (delay_ms > 0) SetTimer(session.hwnd, BOUNDS_TIMER_ID, (UINT)std::ceil(delay_ms), nullptr);
 }
 
-// COM callback for WebView2Controller
-class ControllerHandler : public ICoreWebView2CreateCoreWebView2ControllerCompletedHandler {
-public:
-    HWND hwnd;
-    std::wstring url;
-    ComPtr<ICoreWebView2Controller>& controller;
-    ComPtr<ICoreWebView2>& webview;
-
-    ControllerHandler(HWND hwnd, const std::wstring& url,
-                      ComPtr<ICoreWebView2Controller>& controller,
-                      ComPtr<ICoreWebView2>& webview)
-        : hwnd(hwnd), url(url), controller(controller), webview(webview) {}
-
-    HRESULT STDMETHODCALLTYPE Invoke(HRESULT, ICoreWebView2Controller* ctrl) override {
-        if (ctrl) {
-            controller = ctrl;
-            ctrl->get_CoreWebView2(&webview);
-            RECT bounds;
-            GetClientRect(hwnd, &bounds);
-            controller->put_Bounds(bounds);
-            webview->Navigate(url.c_str());
-
-            // Restrict actions (disable right-click, F12, highlight, copy, paste)
-            RestrictWebView2(webview);
-
-            // Disable native DevTools correctly
-            ComPtr<ICoreWebView2Settings> settings;
-            webview->get_Settings(&settings);
-            bool disable_devtools = g_config ? g_config->should_disable_devtools() : true;
-            settings->put_AreDevToolsEnabled(disable_devtools ? FALSE : TRUE);
+// Helper: Feed resize and monitor DPI changes through the coalescer. Returns
+// true if the message was fully handled.
+bool HandleBoundsMessage(WebViewSession& session, UINT msg, WPARAM wParam, LPARAM lParam) {
+    double now = timing_log().now_ms();
+    switch (msg) {
+    case WM_SIZE:
+        if (wParam != SIZE_MINIMIZED) ScheduleBounds(session, session.bounds.on_resize(LOWORD(lParam), HIWORD(lParam), now));
+        return false;
+    case WM_TIMER:
+        if (wParam != BOUNDS_TIMER_ID) return false;
+        FlushBounds(session);
+        return true;
+    case WM_DPICHANGED: {
+        // Take the size Windows suggests for the new monitor; its WM_SIZE joins the same flush
+        const RECT* suggested = reinterpret_cast<const RECT*>(lParam);
+        SetWindowPos(session.hwnd, nullptr, suggested->left, suggested->top, suggested->right - suggested->left,
+                     suggested->bottom - suggested->top, SWP_NOZORDER | SWP_NOACTIVATE);
+        ScheduleBounds(session, session.bounds.on_scale(LOWORD(wParam) / 96.0, now));
+        InvalidateRect(session.hwnd, nullptr, FALSE);
+        return true;
+    }
+    }
+    return false;
+}
+
+COLORREF background_color() {
+    unsigned rgb = g_config ? g_config->get_background_color() : 0xFFFFFF;
+    return RGB((rgb >> 16) & 0xFF, (rgb >> 8) & 0xFF, rgb & 0xFF);
+}
+
+// Native progress view shown from the moment the window opens until the login
+// page has painted: app name, current stage and a progress bar.
+void PaintSplash(WebViewSession& session, HDC hdc) {
+    RECT client;
+    GetClientRect(session.hwnd, &client);
+    UINT dpi = window_dpi(session.hwnd);
+    auto px = [dpi](int value) { return scale_for_dpi(value, dpi); };
+    COLORREF background = background_color();
+    HBRUSH background_brush = CreateSolidBrush(background);
+    FillRect(hdc, &client, background_brush);
+    DeleteObject(background_brush);
+
+    // Dark text on light backgrounds and vice versa
+    int luminance = (GetRValue(background) * 299 + GetGValue(background) * 587 + GetBValue(background) * 114) / 1000;
+    COLORREF text = luminance > 128 ? RGB(32, 32, 32) : RGB(235, 235, 235);
+    COLORREF track = luminance > 128 ? RGB(220, 220, 220) : RGB(70, 70, 70);
+    COLORREF accent = session.progress.failed() ? RGB(196, 43, 28) : RGB(0, 120, 212);
+
+    int width = client.right - client.left;
+    int middle = (client.bottom - client.top) / 2;
+    SetBkMode(hdc, TRANSPARENT);
+    SetTextColor(hdc, text);
+
+    HFONT title_font = CreateFontW(-px(26), 0, 0, 0, FW_SEMIBOLD, FALSE, FALSE, FALSE, DEFAULT_CHARSET, OUT_DEFAULT_PRECIS,
+                                   CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY, DEFAULT_PITCH, L"Segoe UI");
+    HFONT label_font = CreateFontW(-px(15), 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET, OUT_DEFAULT_PRECIS,
+                                   CLIP_DEFAULT_PRECIS, CLEARTYPE_QUALITY, DEFAULT_PITCH, L"Segoe UI");
+    HGDIOBJ old_font = SelectObject(hdc, title_font);
+    std::string app_name = g_config ? g_config->get_app_name() : "MagicKeyRevC";
+    std::wstring title = utf8_to_wide(app_name);
+    RECT title_rect = {0, middle - px(70), width, middle - px(30)};
+    DrawTextW(hdc, title.c_str(), -1, &title_rect, DT_CENTER | DT_SINGLELINE | DT_VCENTER);
+
+    SelectObject(hdc, label_font);
+    RECT label_rect = {0, middle - px(20), width, middle + px(5)};
+    DrawTextW(hdc, session.progress.label(), -1, &label_rect, DT_CENTER | DT_SINGLELINE | DT_VCENTER);
+    SelectObject(hdc, old_font);
+    DeleteObject(title_font);
+    DeleteObject(label_font);
+
+    int bar_width = width / 3 < px(280) ? width / 3 : px(280);
+    RECT bar = {(width - bar_width) / 2, middle + px(20), (width + bar_width) / 2, middle + px(24)};
+    HBRUSH track_brush = CreateSolidBrush(track);
+    FillRect(hdc, &bar, track_brush);
+    DeleteObject(track_brush);
+    double fraction = session.progress.failed() ? 1.0 : session.progress.fraction(timing_log().now_ms());
+    bar.right = bar.left + (LONG)(bar_width * fraction);
+    HBRUSH accent_brush = CreateSolidBrush(accent);
+    FillRect(hdc, &bar, accent_brush);
+    DeleteObject(accent_brush);
+}
+
+// Shows the window with the splash right away; the page replaces it once painted
+void StartSplash(WebViewSession& session) {
+    session.progress.reset(timing_log().now_ms());
+    session.revealed = false;
+    if (session.controller) session.controller->put_IsVisible(FALSE);
+    KillTimer(session.hwnd, SPLASH_CLOSE_TIMER_ID);
+    SetTimer(session.hwnd, SPLASH_TIMER_ID, SPLASH_FRAME_MS, nullptr);
+    InvalidateRect(session.hwnd, nullptr, FALSE);
+    BringLoginWindowToFront(session.hwnd);
+}
+
+// Swaps the splash for the login page once it has painted
+void RevealLoginPage(WebViewSession& session, const char* trigger) {
+    if (session.revealed || session.progress.stage() != LoginStage::PageLoading) return;
+    session.revealed = true;
+    session.progress.begin(LoginStage::Ready, timing_log().now_ms());
+    KillTimer(session.hwnd, SPLASH_TIMER_ID);
+    if (session.controller) session.controller->put_IsVisible(TRUE);
+    timing_log().mark(std::string("login page revealed (") + trigger + ")");
+}
+
+// Window procedure for WebView2 windows
+LRESULT CALLBACK WindowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    auto* session = reinterpret_cast<WebViewSession*>(GetWindowLongPtrW(hwnd, GWLP_USERDATA));
+    if (session) {
+        HandleMemoryMessage(*session, msg, wParam, lParam);
+        if (HandleBoundsMessage(*session, msg, wParam, lParam)) return 0;
+        if (msg == WM_TIMER && wParam == MEMORY_TICK_TIMER_ID) session->bridge.expire(timing_log().now_ms());
+        if (msg == WM_TIMER && wParam == SPLASH_TIMER_ID) InvalidateRect(hwnd, nullptr, FALSE);
+        if (msg == WM_TIMER && wParam == SPLASH_CLOSE_TIMER_ID) {
+            KillTimer(hwnd, SPLASH_CLOSE_TIMER_ID);
+            CloseSessionWindow(*session);
+            return 0;
         }
-        return S_OK;
+        // The splash paints every pixel; skipping the erase avoids a flash of the class brush
+        if (msg == WM_ERASEBKGND) return 1;
+        if (msg == WM_PAINT && !session->revealed) {
+            PAINTSTRUCT ps;
+            HDC hdc = BeginPaint(hwnd, &ps);
+            PaintSplash(*session, hdc);
+            EndPaint(hwnd, &ps);
+            return 0;
+        }
+        if (msg == WM_CLOSE) { CloseSessionWindow(*session); return 0; }
     }
-    ULONG STDMETHODCALLTYPE AddRef() override { return 1; }
-    ULONG STDMETHODCALLTYPE Release() override { return 1; }
-    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) override {
-        if (riid == IID_ICoreWebView2CreateCoreWebView2ControllerCompletedHandler || riid == IID_IUnknown) {
-            *ppvObject = this;
+    return DefWindowProcW(hwnd, msg, wParam, lParam);
+}
+
+// Helper: Feed navigation events into the timing output (the page's own
+// paint/resource report arrives through RegisterPageBridge)
+void RegisterNavigationTiming(WebViewSession& session) {
+    NavigationTimeline* timeline = &session.timeline;
+    EventRegistrationToken token;
+
+    session.webview->add_NavigationStarting(new NavigationStartingHandler(
+        [timeline](ICoreWebView2*, ICoreWebView2NavigationStartingEventArgs* args) -> HRESULT {
+            UINT64 id = 0;
+            BOOL redirected = FALSE;
+            LPWSTR uri = nullptr;
+            args->get_NavigationId(&id);
+            args->get_IsRedirected(&redirected);
+            args->get_Uri(&uri);
+            timeline->on_navigation_starting(id, take_cotaskmem_string(uri), redirected != FALSE, timing_log().now_ms());
             return S_OK;
-        }
-        *ppvObject = nullptr;
-        return E_NOINTERFACE;
+        }), &token);
+
+    session.webview->add_ContentLoading(new ContentLoadingHandler(
+        [timeline](ICoreWebView2*, ICoreWebView2ContentLoadingEventArgs* args) -> HRESULT {
+            UINT64 id = 0;
+            args->get_NavigationId(&id);
+            timeline->on_content_loading(id, timing_log().now_ms());
+            return S_OK;
+        }), &token);
+
+    ComPtr<ICoreWebView2_2> webview2;
+    if (SUCCEEDED(session.webview->QueryInterface(IID_ICoreWebView2_2, reinterpret_cast<void**>(webview2.GetAddressOf())))) {
+        webview2->add_DOMContentLoaded(new DOMContentLoadedHandler(
+            [timeline](ICoreWebView2*, ICoreWebView2DOMContentLoadedEventArgs* args) -> HRESULT {
+                UINT64 id = 0;
+                args->get_NavigationId(&id);
+                timeline->on_dom_content_loaded(id, timing_log().now_ms());
+                return S_OK;
+            }), &token);
     }
-};
 
-// COM callback for WebView2Environment
-class EnvironmentHandler : public ICoreWebView2CreateCoreWebView2EnvironmentCompletedHandler {
-public:
-    HWND hwnd;
-    std::wstring url;
-    ComPtr<ICoreWebView2Controller>& controller;
-    ComPtr<ICoreWebView2>& webview;
-
-    EnvironmentHandler(HWND hwnd, const std::wstring& url,
-                      ComPtr<ICoreWebView2Controller>& controller,
-                      ComPtr<ICoreWebView2>& webview)
-        : hwnd(hwnd), url(url), controller(controller), webview(webview) {}
-
-    HRESULT STDMETHODCALLTYPE Invoke(HRESULT, ICoreWebView2Environment* env) override {
-        if (env) {
-            env->CreateCoreWebView2Controller(
-                hwnd,
-                new ControllerHandler(hwnd, url, controller, webview)
-            );
-        }
-        return S_OK;
+    session.webview->add_NavigationCompleted(new NavigationCompletedHandler(
+        [timeline](ICoreWebView2*, ICoreWebView2NavigationCompletedEventArgs* args) -> HRESULT {
+            UINT64 id = 0;
+            BOOL success = FALSE;
+            COREWEBVIEW2_WEB_ERROR_STATUS status = COREWEBVIEW2_WEB_ERROR_STATUS_UNKNOWN;
+            args->get_NavigationId(&id);
+            args->get_IsSuccess(&success);
+            args->get_WebErrorStatus(&status);
+            timeline->on_navigation_completed(id, success != FALSE, (int)status, timing_log().now_ms());
+            return S_OK;
+        }), &token);
+
+    session.webview->AddScriptToExecuteOnDocumentCreated(PAGE_TIMING_SCRIPT, nullptr);
+}
+
+// Posts a bridge envelope, but only to a document from the login origin
+bool PostToLoginPage(WebViewSession& session, const std::string& envelope) {
+    if (!session.webview) return false;
+    LPWSTR source = nullptr;
+    if (FAILED(session.webview->get_Source(&source))) return false;
+    if (!same_origin(take_cotaskmem_string(source), g_config->get_login_base_url())) return false;
+    return SUCCEEDED(session.webview->PostWebMessageAsJson(utf8_to_wide(envelope).c_str()));
+}
+
+// Helper: Give the login page window.magicKey (see page_bridge.h) and push the
+// session context as soon as its DOM is ready. Also routes the timing
+// script's report, which shares WebMessageReceived.
+void RegisterPageBridge(WebViewSession& session) {
+    WebViewSession* s = &session;
+    EventRegistrationToken token;
+    session.bridge.handle("context", [s](const nlohmann::json&) { return s->page_context; });
+
+    session.webview->add_NavigationStarting(new NavigationStartingHandler(
+        [s](ICoreWebView2*, ICoreWebView2NavigationStartingEventArgs*) -> HRESULT {
+            s->bridge.reset("navigated");
+            return S_OK;
+        }), &token);
+
+    ComPtr<ICoreWebView2_2> webview2;
+    if (SUCCEEDED(session.webview->QueryInterface(IID_ICoreWebView2_2, reinterpret_cast<void**>(webview2.GetAddressOf())))) {
+        webview2->add_DOMContentLoaded(new DOMContentLoadedHandler(
+            [s](ICoreWebView2*, ICoreWebView2DOMContentLoadedEventArgs*) -> HRESULT {
+                if (s->page_context.is_null()) return S_OK;
+                s->bridge.push("context", s->page_context);
+                s->bridge.flush();
+                return S_OK;
+            }), &token);
     }
-    ULONG STDMETHODCALLTYPE AddRef() override { return 1; }
-    ULONG STDMETHODCALLTYPE Release() override { return 1; }
-    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) override {
-        if (riid == IID_ICoreWebView2CreateCoreWebView2EnvironmentCompletedHandler || riid == IID_IUnknown) {
-            *ppvObject = this;
+
+    session.webview->add_WebMessageReceived(new WebMessageReceivedHandler(
+        [s](ICoreWebView2*, ICoreWebView2WebMessageReceivedEventArgs* args) -> HRESULT {
+            LPWSTR json = nullptr;
+            LPWSTR source = nullptr;
+            if (FAILED(args->get_WebMessageAsJson(&json))) return S_OK;
+            auto message = nlohmann::json::parse(take_cotaskmem_string(json), nullptr, false);
+            if (message.is_discarded()) return S_OK;
+            args->get_Source(&source);
+            bool from_login_page = same_origin(take_cotaskmem_string(source), g_config->get_login_base_url());
+            if (from_login_page && s->bridge.on_message(message)) return S_OK;
+            s->timeline.on_page_message(message);
             return S_OK;
-        }
-        *ppvObject = nullptr;
-        return E_NOINTERFACE;
+        }), &token);
+
+    session.webview->AddScriptToExecuteOnDocumentCreated(PAGE_BRIDGE_SCRIPT, nullptr);
+}
+
+// Helper: Reveal the page on its first painted frame (reported over the
+// bridge), or when loading completes for pages without the bridge
+void RegisterSplashReveal(WebViewSession& session) {
+    WebViewSession* s = &session;
+    EventRegistrationToken token;
+    session.bridge.handle("painted", [s](const nlohmann::json&) {
+        RevealLoginPage(*s, "painted");
+        return nlohmann::json();
+    });
+    session.webview->add_NavigationCompleted(new NavigationCompletedHandler(
+        [s](ICoreWebView2*, ICoreWebView2NavigationCompletedEventArgs*) -> HRESULT {
+            RevealLoginPage(*s, "navigation completed");
+            return S_OK;
+        }), &token);
+}
+
+
+// Maps WebView2's resource context onto the filter's rule types
+uint32_t url_resource_type(COREWEBVIEW2_WEB_RESOURCE_CONTEXT context) {
+    switch (context) {
+    case COREWEBVIEW2_WEB_RESOURCE_CONTEXT_DOCUMENT: return URL_TYPE_DOCUMENT;
+    case COREWEBVIEW2_WEB_RESOURCE_CONTEXT_STYLESHEET: return URL_TYPE_STYLESHEET;
+    case COREWEBVIEW2_WEB_RESOURCE_CONTEXT_IMAGE: return URL_TYPE_IMAGE;
+    case COREWEBVIEW2_WEB_RESOURCE_CONTEXT_MEDIA: return URL_TYPE_MEDIA;
+    case COREWEBVIEW2_WEB_RESOURCE_CONTEXT_FONT: return URL_TYPE_FONT;
+    case COREWEBVIEW2_WEB_RESOURCE_CONTEXT_SCRIPT: return URL_TYPE_SCRIPT;
+    case COREWEBVIEW2_WEB_RESOURCE_CONTEXT_XML_HTTP_REQUEST: return URL_TYPE_XHR;
+    case COREWEBVIEW2_WEB_RESOURCE_CONTEXT_FETCH: return URL_TYPE_FETCH;
+    case COREWEBVIEW2_WEB_RESOURCE_CONTEXT_WEBSOCKET: return URL_TYPE_WEBSOCKET;
+    case COREWEBVIEW2_WEB_RESOURCE_CONTEXT_PING: return URL_TYPE_PING;
+    default: return URL_TYPE_OTHER;
     }
-};
+}
+
+// Helper: Fail requests denied by URL_FILTER_RULES before they reach the network.
+// Registered ahead of the asset pack so a blocked URL is never served from it either.
+void RegisterUrlFilter(WebViewSession& session) {
+    if (!session.url_filter || session.url_filter->empty()) return;
+    session.webview->AddWebResourceRequestedFilter(L"*", COREWEBVIEW2_WEB_RESOURCE_CONTEXT_ALL);
+
+    EventRegistrationToken token;
+    WebViewSession* s = &session;
+    session.webview->add_WebResourceRequested(new WebResourceRequestedHandler(
+        [s](ICoreWebView2*, ICoreWebView2WebResourceRequestedEventArgs* args) -> HRESULT {
+            COREWEBVIEW2_WEB_RESOURCE_CONTEXT context = COREWEBVIEW2_WEB_RESOURCE_CONTEXT_OTHER;
+            args->get_ResourceContext(&context);
+            ComPtr<ICoreWebView2WebResourceRequest> request;
+            LPWSTR uri = nullptr;
+            if (FAILED(args->get_Request(&request)) || FAILED(request->get_Uri(&uri))) return S_OK;
+            std::string url = take_cotaskmem_string(uri);
+            UrlFilter::Decision decision = s->url_filter->check(url, url_resource_type(context));
+            if (!decision.blocked) return S_OK;
 
-// Show a WebView2 browser window to the given URL (URL is hidden in UI)
-void ShowWebView2(const std::wstring& url) {
+            ComPtr<ICoreWebView2WebResourceResponse> response;
+            if (SUCCEEDED(s->environment->CreateWebResourceResponse(nullptr, 403, L"Blocked", L"", &response))) {
+                args->put_Response(response.Get());
+            }
+            if (g_config && g_config->is_debug_enabled()) {
+                std::cout << "Blocked " << url << " (" << s->url_filter->rule(decision.rule).text << ")" << std::endl;
+            }
+            return S_OK;
+        }), &token);
+}
+
+// Helper: Answer subresource requests under ASSET_URL_PREFIX from the asset pack.
+// The token-bearing document and API calls (XHR/fetch) always go to the network,
+// as does anything the pack does not contain.
+void RegisterAssetPack(WebViewSession& session) {
+    if (!session.assets || !session.assets->enabled()) return;
+    std::string prefix = session.assets->url_prefix();
+    std::wstring filter = utf8_to_wide(prefix) + L"*";
+    session.webview->AddWebResourceRequestedFilter(filter.c_str(), COREWEBVIEW2_WEB_RESOURCE_CONTEXT_ALL);
+
+    EventRegistrationToken token;
+    WebViewSession* s = &session;
+    session.webview->add_WebResourceRequested(new WebResourceRequestedHandler(
+        [s](ICoreWebView2*, ICoreWebView2WebResourceRequestedEventArgs* args) -> HRESULT {
+            COREWEBVIEW2_WEB_RESOURCE_CONTEXT context = COREWEBVIEW2_WEB_RESOURCE_CONTEXT_ALL;
+            args->get_ResourceContext(&context);
+            if (context == COREWEBVIEW2_WEB_RESOURCE_CONTEXT_DOCUMENT
+                || context == COREWEBVIEW2_WEB_RESOURCE_CONTEXT_XML_HTTP_REQUEST
+                || context == COREWEBVIEW2_WEB_RESOURCE_CONTEXT_FETCH) {
+                return S_OK;
+            }
+            ComPtr<ICoreWebView2WebResourceRequest> request;
+            LPWSTR method = nullptr;
+            LPWSTR uri = nullptr;
+            if (FAILED(args->get_Request(&request))) return S_OK;
+            request->get_Method(&method);
+            if (take_cotaskmem_string(method) != "GET") return S_OK;
+            // Already answered, i.e. blocked by the URL filter
+            ComPtr<ICoreWebView2WebResourceResponse> existing;
+            if (SUCCEEDED(args->get_Response(&existing)) && existing) return S_OK;
+            request->get_Uri(&uri);
+
+            AssetPack::Asset asset;
+            const std::string* body = s->assets->lookup(take_cotaskmem_string(uri), asset);
+            if (!body) return S_OK;
+
+            ComPtr<IStream> stream;
+            if (FAILED(CreateStreamOnHGlobal(nullptr, TRUE, &stream))) return S_OK;
+            ULONG written = 0;
+            stream->Write(body->data(), (ULONG)body->size(), &written);
+            LARGE_INTEGER start = {};
+            stream->Seek(start, STREAM_SEEK_SET, nullptr);
+
+            std::string headers = "Content-Type: " + asset.content_type + "\r\nETag: " + asset.etag();
+            std::wstring headers_wide = utf8_to_wide(headers);
+            ComPtr<ICoreWebView2WebResourceResponse> response;
+            if (SUCCEEDED(s->environment->CreateWebResourceResponse(stream.Get(), 200, L"OK", headers_wide.c_str(), &response))) {
+                args->put_Response(response.Get());
+            }
+            return S_OK;
+        }), &token);
+}
+
+// Helper: Configure a new controller and navigate to the session's login URL if it already arrived
+void SetUpWebView(WebViewSession& session, ICoreWebView2Controller* ctrl) {
+    session.controller = ctrl;
+    ctrl->get_CoreWebView2(&session.webview);
+    // Hidden behind the splash until the page paints; until then the page
+    // background is the splash colour rather than white
+    ctrl->put_IsVisible(session.revealed ? TRUE : FALSE);
+    ComPtr<ICoreWebView2Controller2> ctrl2;
+    if (SUCCEEDED(ctrl->QueryInterface(IID_ICoreWebView2Controller2, reinterpret_cast<void**>(ctrl2.GetAddressOf())))) {
+        COLORREF background = background_color();
+        ctrl2->put_DefaultBackgroundColor({255, GetRValue(background), GetGValue(background), GetBValue(background)});
+    }
+
+    // Size (and, per-monitor aware, the scale) go through the coalescer from
+    // here on; the controller starts from the window's current state
+    RECT client;
+    GetClientRect(session.hwnd, &client);
+    double now = timing_log().now_ms();
+    session.bounds.invalidate();
+    session.bounds.on_resize(client.right - client.left, client.bottom - client.top, now);
+    ComPtr<ICoreWebView2Controller3> ctrl3;
+    if (session.per_monitor_dpi
+        && SUCCEEDED(ctrl->QueryInterface(IID_ICoreWebView2Controller3, reinterpret_cast<void**>(ctrl3.GetAddressOf())))) {
+        ctrl3->put_ShouldDetectMonitorScaleChanges(FALSE);
+        session.bounds.on_scale(window_dpi(session.hwnd) / 96.0, now);
+    }
+    FlushBounds(session);
+    timing_log().mark("webview controller ready");
+
+    // Instrument and intercept before navigating so the first requests are not missed
+    RegisterNavigationTiming(session);
+    RegisterPageBridge(session);
+    RegisterSplashReveal(session);
+    RegisterUrlFilter(session);
+    RegisterAssetPack(session);
+    if (!session.url.empty()) session.webview->Navigate(session.url.c_str());
+
+    // Restrict actions (disable right-click, F12, highlight, copy, paste)
+    RestrictWebView2(session.webview);
+
+    // Disable native DevTools correctly
+    ComPtr<ICoreWebView2Settings> settings;
+    session.webview->get_Settings(&settings);
+    bool disable_devtools = g_config ? g_config->should_disable_devtools() : true;
+    settings->put_AreDevToolsEnabled(disable_devtools ? FALSE : TRUE);
+}
+
+// Create the (hidden) WebView2 host window, centered on screen. Extra
+// session windows are cascaded by `cascade` steps.
+HWND CreateLoginWindow(const std::string& title_suffix, int cascade) {
     const wchar_t CLASS_NAME[] = L"WebView2Window";
     WNDCLASSW wc = {};
     wc.lpfnWndProc = WindowProc;
@@ -185,26 +765,32 @@ void ShowWebView2(const std::wstring& url) {
     wc.style = CS_HREDRAW | CS_VREDRAW;
     RegisterClassW(&wc);
 
-    std::string app_name = g_config ? g_config->get_app_name() : "MagicKeyRevC";
-    int window_width = g_config ? g_config->get_window_width() : 900;
-    int window_height = g_config ? g_config->get_window_height() : 700;
-    
-    std::wstring app_name_wide(app_name.begin(), app_name.end());
+    std::string app_name = (g_config ? g_config->get_app_name() : "MagicKeyRevC") + title_suffix;
+    // WINDOW_WIDTH/HEIGHT are at 100 %; DPI-aware processes work in physical pixels
+    UINT dpi = window_dpi(nullptr);
+    int window_width = scale_for_dpi(g_config ? g_config->get_window_width() : 900, dpi);
+    int window_height = scale_for_dpi(g_config ? g_config->get_window_height() : 700, dpi);
+    cascade = scale_for_dpi(cascade * 32, dpi);
+
+    std::wstring app_name_wide = utf8_to_wide(app_name);
 
     // Center the window on screen
     int screen_width = GetSystemMetrics(SM_CXSCREEN);
     int screen_height = GetSystemMetrics(SM_CYSCREEN);
-    int pos_x = (screen_width - window_width) / 2;
-    int pos_y = (screen_height - window_height) / 2;
+    int pos_x = (screen_width - window_width) / 2 + cascade;
+    int pos_y = (screen_height - window_height) / 2 + cascade;
 
-    HWND hwnd = CreateWindowExW(
+    return CreateWindowExW(
         WS_EX_TOPMOST, CLASS_NAME, app_name_wide.c_str(),
         WS_OVERLAPPEDWINDOW, pos_x, pos_y, window_width, window_height,
         NULL, NULL, GetModuleHandleW(nullptr), NULL
     );
-    
+}
+
+// Show the window and bring it to the foreground
+void BringLoginWindowToFront(HWND hwnd) {
     // Properly bring window to foreground
-    ShowWindow(hwnd, SW_SHOW);
+    ShowWindow(hwnd, IsIconic(hwnd) ? SW_RESTORE : SW_SHOW);
     UpdateWindow(hwnd);
     
     // Remove topmost after showing (so it doesn't stay always on top)
@@ -226,10 +812,83 @@ void ShowWebView2(const std::wstring& url) {
     fwi.uCount = 3;
     fwi.dwTimeout = 0;
     FlashWindowEx(&fwi);
+}
 
-    ComPtr<ICoreWebView2Controller> controller;
-    ComPtr<ICoreWebView2> webview;
+// ---- Login host ----
+// One process hosts every login window. All sessions share a single WebView2
+// environment (one browser process); each window costs a renderer. Tokens are
+// fetched by a handshake coroutine with the cached fingerprint.
+//
+// With Config::RESIDENT_MODE the process stays in the tray after its windows
+// are closed, keeping the environment and a recent fingerprint. Later launches
+// find it over InstanceChannel and only trigger a new randkey exchange.
+
+struct LoginHost : SessionEnvironment {
+    HWND hwnd = nullptr;  // hidden window receiving tray messages
+    EventLoop loop;       // UI thread executor; post() is the only member other threads use
+    bool resident = false;
+    DpiMode dpi_mode = DpiMode::Unaware;
+    SessionManager sessions;
+    std::map<uint64_t, std::unique_ptr<WebViewSession>> windows;
+    ComPtr<ICoreWebView2Environment> environment;
+    AssetServer assets;
+    UrlFilter url_filter;
+
+    // One handshake at a time: logins and refreshes share the cached fingerprint
+    Offload offload{loop};  // runs the handshake's blocking calls
+    Fingerprint fingerprint;
+    TokenCache token_cache;
+    Task<std::string> handshake;
+    CancelToken handshake_cancel;
+    uint64_t handshake_session = 0;
+    bool handshake_busy = false;
+    std::deque<uint64_t> login_queue;  // sessions waiting for a token
+    bool refresh_queued = false;
+
+    // Registrations the backend did not get; sent once it answers again
+    OfflineQueue offline_queue;
+    Task<bool> drain;
+    CancelToken drain_cancel;
+    bool drain_busy = false;
+    bool queue_sync_posted = false;
+    EventLoop::TimerId drain_timer = 0;
+    RetryBackoff drain_backoff;
+    Admission admission;          // 429/503 and backoff holds, shared by logins and the drain
+    EndpointSelector endpoints;   // mirror latencies and error rates, likewise
+    double start_jitter_ms = 0;   // delay before the next network probe (START_JITTER_MS)
+    NOTIFYICONDATAW tray = {};
 
+    LoginHost(size_t max_sessions, bool isolate_profiles) : sessions(*this, max_sessions, isolate_profiles) {}
+
+    WebViewSession& window_for(uint64_t id);
+    void create_environment(Done done) override;
+    void create_controller(uint64_t id, const std::string& profile, Done done) override;
+    void destroy_controller(uint64_t id) override;
+};
+
+std::string login_channel_name() {
+    // InstanceChannel adds the user's SID, so each user has their own host
+    return (g_config ? g_config->get_app_name() : "MagicKeyRevC") + "-resident";
+}
+
+WebViewSession& LoginHost::window_for(uint64_t id) {
+    auto it = windows.find(id);
+    if (it != windows.end()) return *it->second;
+
+    const SessionManager::Session* info = sessions.find(id);
+    std::string suffix = info && !info->profile.empty() ? " (" + info->profile + ")" : "";
+    HWND window = CreateLoginWindow(suffix, (int)windows.size());
+    auto session = std::make_unique<WebViewSession>(id, window, this);
+    session->assets = &assets;
+    session->url_filter = &url_filter;
+    session->per_monitor_dpi = dpi_mode == DpiMode::PerMonitor || dpi_mode == DpiMode::PerMonitorV2;
+    SetWindowLongPtrW(window, GWLP_USERDATA, (LONG_PTR)session.get());
+    // Start the memory policy's idle tick
+    SetTimer(window, MEMORY_TICK_TIMER_ID, MEMORY_TICK_MS, nullptr);
+    return *(windows[id] = std::move(session));
+}
+
+void LoginHost::create_environment(Done done) {
     // Set WebView2 user data to hidden directory instead of ugly "main.exe.WebView2"
     std::wstring userDataFolder = L".webview2";
     
@@ -237,131 +896,553 @@ void ShowWebView2(const std::wstring& url) {
     CreateDirectoryW(userDataFolder.c_str(), nullptr);
     SetFileAttributesW(userDataFolder.c_str(), FILE_ATTRIBUTE_HIDDEN);
     
-    CreateCoreWebView2EnvironmentWithOptions(
+    HRESULT hr = CreateCoreWebView2EnvironmentWithOptions(
         nullptr, userDataFolder.c_str(), nullptr,
-        new EnvironmentHandler(hwnd, url, controller, webview)
+        new EnvironmentCompletedHandler([this, done](HRESULT, ICoreWebView2Environment* env) -> HRESULT {
+            environment = env;
+            if (env) timing_log().mark("webview environment ready");
+            done(env != nullptr);
+            return S_OK;
+        })
     );
+    if (FAILED(hr)) done(false);
+}
+
+void OnControllerCreated(LoginHost& host, uint64_t id, ICoreWebView2Controller* ctrl);
+
+void LoginHost::create_controller(uint64_t id, const std::string& profile, Done done) {
+    WebViewSession& session = window_for(id);
+    session.environment = environment;
+    auto* handler = new ControllerCompletedHandler([this, id, done](HRESULT, ICoreWebView2Controller* ctrl) -> HRESULT {
+        OnControllerCreated(*this, id, ctrl);
+        done(ctrl != nullptr);
+        return S_OK;
+    });
 
-    MSG msg = {};
-    while (GetMessageW(&msg, nullptr, 0, 0)) {
-        TranslateMessage(&msg);
-        DispatchMessageW(&msg);
+    // Named profiles keep concurrent accounts apart. They are InPrivate, so
+    // nothing is left behind for the next session that reuses the name.
+    ComPtr<ICoreWebView2Environment10> env10;
+    ComPtr<ICoreWebView2ControllerOptions> options;
+    if (!profile.empty()
+        && SUCCEEDED(environment->QueryInterface(IID_ICoreWebView2Environment10, reinterpret_cast<void**>(env10.GetAddressOf())))
+        && SUCCEEDED(env10->CreateCoreWebView2ControllerOptions(&options))) {
+        std::wstring name = utf8_to_wide(profile);
+        options->put_ProfileName(name.c_str());
+        options->put_IsInPrivateModeEnabled(TRUE);
+        env10->CreateCoreWebView2ControllerWithOptions(session.hwnd, options.Get(), handler);
+        return;
     }
+    environment->CreateCoreWebView2Controller(session.hwnd, handler);
 }
 
-int main() {
-    // Initialize configuration system
-    init_config();
-    
-    bool debug_enabled = g_config->is_debug_enabled();
-    bool log_system_info = g_config->should_log_system_info();
-    
-    std::string uuid = get_system_uuid();
-    if (debug_enabled && log_system_info) {
-        std::cout << "System UUID: " << uuid << std::endl;
+void DestroySessionWindow(LoginHost& host, uint64_t id) {
+    auto it = host.windows.find(id);
+    if (it == host.windows.end()) return;
+    WebViewSession& session = *it->second;
+    if (session.controller) session.controller->Close();
+    SetWindowLongPtrW(session.hwnd, GWLP_USERDATA, 0);
+    DestroyWindow(session.hwnd);
+    host.windows.erase(it);
+}
+
+void LoginHost::destroy_controller(uint64_t id) {
+    DestroySessionWindow(*this, id);
+}
+
+void OnControllerCreated(LoginHost& host, uint64_t id, ICoreWebView2Controller* ctrl) {
+    auto it = host.windows.find(id);
+    if (it == host.windows.end()) {
+        // Closed while its controller was being created
+        if (ctrl) ctrl->Close();
+        return;
     }
+    if (ctrl) SetUpWebView(*it->second, ctrl);
+}
+
+// Ends a session for good. A non-resident host exits with its last session.
+void CloseSession(LoginHost& host, uint64_t id) {
+    // Nobody is waiting for this session's token any more
+    if (host.handshake_busy && host.handshake_session == id) host.handshake_cancel.cancel();
+    host.login_queue.erase(std::remove(host.login_queue.begin(), host.login_queue.end(), id), host.login_queue.end());
+    host.sessions.close(id);
+    // Sessions still waiting for the environment have no controller to destroy
+    DestroySessionWindow(host, id);
+    if (!host.resident && host.sessions.size() == 0) DestroyWindow(host.hwnd);
+}
 
-    std::string machine_guid = get_machine_guid();
-    if (debug_enabled && log_system_info) {
-        std::cout << "Machine GUID: " << machine_guid << std::endl;
+void OnHandshakeDone(LoginHost& host, uint64_t session_id);
+
+// A handshake started a stage for `session_id`
+void OnStage(LoginHost& host, uint64_t session_id, LoginStage stage) {
+    if (!host.windows.count(session_id)) return;
+    WebViewSession& session = *host.windows[session_id];
+    if (session.progress.begin(stage, timing_log().now_ms())) InvalidateRect(session.hwnd, nullptr, FALSE);
+}
+
+// Last registration the backend acknowledged, so the next one can be a delta
+// (delta_payload.h); null if there is none
+nlohmann::json LoadAcknowledgedRegistration() {
+    std::string path = g_config->get_registration_state_file(), text;
+    if (path.empty() || !read_protected(path, text)) return nullptr;
+    nlohmann::json registration = nlohmann::json::parse(text, nullptr, false);
+    return registration.is_object() ? registration : nullptr;
+}
+
+// Null forgets the state (the backend did not ack, so it may not keep any)
+void SaveAcknowledgedRegistration(const nlohmann::json& registration) {
+    std::string path = g_config->get_registration_state_file();
+    if (path.empty()) return;
+    if (registration.is_null()) std::remove(path.c_str());
+    else if (!write_protected(path, registration.dump()) && g_config->is_debug_enabled()) {
+        std::cout << "Registration state not saved: cannot write " << path << std::endl;
     }
+}
 
-    std::vector<std::string> serials = get_hdd_serials();
-    if (debug_enabled && log_system_info) {
-        if (serials.empty()) {
-            std::cout << "No HDD/SSD serial numbers found." << std::endl;
-        } else {
-            for (size_t i = 0; i < serials.size(); ++i) {
-                std::cout << "HDD/SSD Serial " << (i + 1) << ": " << serials[i] << std::endl;
+void StartDrain(LoginHost& host);
+
+// Tries the offline queue again after the next backoff delay, or once the
+// backend's hold is over if that is later
+void ScheduleDrain(LoginHost& host) {
+    if (host.drain_timer || host.drain_busy || host.offline_queue.empty()) return;
+    double delay = std::max(host.drain_backoff.next_ms(), host.admission.hold_ms(AdmissionService::Backend));
+    host.drain_timer = host.loop.call_later(delay, [&host] {
+        host.drain_timer = 0;
+        StartDrain(host);
+    });
+}
+
+void OnDrainDone(LoginHost& host) {
+    bool emptied = false;
+    try {
+        emptied = host.drain.get();
+    } catch (const TaskCancelled&) {
+    }
+    host.drain = Task<bool>();
+    host.drain_busy = false;
+    if (g_config->is_debug_enabled()) {
+        std::cout << "Offline queue: " << host.offline_queue.size() << " registrations left"
+                  << (emptied ? "" : " (backend unreachable)") << std::endl;
+    }
+    if (emptied) host.drain_backoff.reset();
+    else ScheduleDrain(host);
+}
+
+// Sends the offline queue in batches while the backend answers
+void StartDrain(LoginHost& host) {
+    if (host.drain_busy || host.offline_queue.empty()) return;
+    if (host.drain_timer) host.loop.cancel(host.drain_timer);
+    host.drain_timer = 0;
+    if (host.admission.hold_ms(AdmissionService::Backend) > 0) {
+        ScheduleDrain(host);
+        return;
+    }
+    host.drain_busy = true;
+    host.drain_cancel = CancelToken();
+    host.drain = drain_offline_queue(host.offload, host.offline_queue, offline_batch_sender(&host.admission, &host.endpoints), OFFLINE_BATCH_MAX,
+                                     host.drain_cancel);
+    host.drain.start([&host] {
+        // The drain's frame is still on the stack here; finish on the next turn
+        host.loop.post([&host] { OnDrainDone(host); });
+    });
+}
+
+// Keeps a registration the backend did not get. Registrations queued in the
+// same loop turn reach the disk with one sync.
+void QueueRegistration(LoginHost& host, const std::string& payload) {
+    if (!host.offline_queue.push(payload)) {
+        if (g_config->is_debug_enabled()) std::cout << "Registration not queued: cannot write " << host.offline_queue.path() << std::endl;
+        return;
+    }
+    if (!host.queue_sync_posted) {
+        host.queue_sync_posted = true;
+        host.loop.post([&host] {
+            host.queue_sync_posted = false;
+            if (!host.offline_queue.sync() && g_config->is_debug_enabled()) {
+                std::cout << "Offline queue not synced: " << host.offline_queue.path() << std::endl;
             }
-        }
+        });
     }
+    ScheduleDrain(host);
+}
 
-    nlohmann::json ipinfo, ipinfo2;
-    if (debug_enabled) {
-        std::cout << "\nFetching IP info...\n";
+// Remembers a token the backend made reusable; forgets the old one otherwise
+void CacheLoginToken(LoginHost& host, const LoginToken& issued, const HandshakeSteps& steps) {
+    if (!host.token_cache.enabled()) return;
+    if (issued.expires_in_s <= 0) {
+        host.token_cache.clear();
+        return;
     }
-    if (fetch_ipinfo_pair(ipinfo, ipinfo2)) {
-        if (debug_enabled) {
-            std::cout << "IP Info (from " << g_config->get_ipcheck_url() << "):\n" << ipinfo.dump(4) << std::endl;
-            std::cout << "\nProxyCheck Info (from " << g_config->get_proxycheck_url() << "):\n" << ipinfo2.dump(4) << std::endl;
+    CachedToken cached;
+    cached.login_url = issued.url;
+    cached.digest = hardware_digest(host.fingerprint, steps.dcid, steps.version);
+    cached.issued_at = (int64_t)std::time(nullptr);
+    cached.expires_at = cached.issued_at + issued.expires_in_s;
+    if (!host.token_cache.store(cached) && g_config->is_debug_enabled()) {
+        std::cout << "Login token not cached: cannot write " << host.token_cache.path() << std::endl;
+    }
+}
+
+// Refreshes the fingerprint if it is stale and, for a login (`session_id`
+// != 0), fetches a new token. Returns the login URL; "" if there is none.
+//
+// A cached token issued to this machine is used without registering again
+// (only the hardware IDs are checked); the background refresh then renews it
+// once it is half way to its expiry.
+Task<std::string> LoginHandshake(LoginHost& host, uint64_t session_id, CancelToken token) {
+    bool debug_enabled = g_config->is_debug_enabled();
+    StageFn stage;
+    if (session_id) stage = [&host, session_id](LoginStage s) { OnStage(host, session_id, s); };
+    HandshakeSteps steps = handshake_steps(&host.admission, &host.endpoints);
+    if (host.offline_queue.enabled()) steps.queue = [&host](const std::string& payload) { QueueRegistration(host, payload); };
+    try {
+        CachedToken cached;
+        bool have_cached = host.token_cache.load(cached);
+        int64_t now = (int64_t)std::time(nullptr);
+        if (session_id && have_cached && now + TOKEN_REUSE_MARGIN_S < cached.expires_at) {
+            if (stage) stage(LoginStage::Fingerprint);
+            if (host.fingerprint.uuid.empty()) {
+                // Hardware IDs only; the network info follows with the background refresh
+                host.fingerprint = co_await identify_hardware(host.offload, steps, token);
+            }
+            if (cached.usable(hardware_digest(host.fingerprint, steps.dcid, steps.version), now, TOKEN_REUSE_MARGIN_S)) {
+                if (debug_enabled) std::cout << "Reusing the login token cached at " << cached.issued_at << "." << std::endl;
+                timing_log().mark("cached token used");
+                host.refresh_queued = true;
+                co_return cached.login_url;
+            }
         }
 
-        nlohmann::json data_to_encrypt = {
-            {"ip", ipinfo.value("IP", "Unknown")},
-            {"hwid", uuid},
-            {"hwserial", serials.empty() ? "" : serials[0]},
-            {"country",
-                ipinfo2.value("country", "") + "//"
-                + ipinfo2.value("provider", "") + "//"
-                + ipinfo2.value("organisation", "")
-            },
-            {"machineguid", machine_guid},
-            {"dcid", g_config->get_dcid()},
-            {"regdate", ipinfo.value("CheckTimeUTC", "")},
-            {"version", g_config->get_app_version()}
-        };
-
-        if (debug_enabled) {
-            std::cout << "\nData to encrypt:\n" << data_to_encrypt.dump(4) << std::endl;
+        ULONGLONG max_age = (ULONGLONG)g_config->get_resident_refresh_minutes() * 60 * 1000;
+        if (host.fingerprint.collected_at == 0 || GetTickCount64() - host.fingerprint.collected_at >= max_age) {
+            try {
+                steps.start_delay_ms = std::exchange(host.start_jitter_ms, 0.0);
+                Fingerprint fresh = co_await collect_fingerprint(host.offload, steps, token, stage);
+                fresh.collected_at = GetTickCount64();
+                host.fingerprint = std::move(fresh);
+            } catch (const HandshakeError& e) {
+                // A stale fingerprint still serves the login
+                if (debug_enabled) std::cout << "Fingerprint not refreshed: " << e.what() << std::endl;
+            }
         }
+        if (host.fingerprint.collected_at == 0) co_return "";
+        // A refresh only registers again when the cached token is due for renewal
+        if (!session_id && !(have_cached && cached.needs_renewal(now))) co_return "";
 
-        std::string encrypted_data;
-        
-        // Use embedded public key instead of file
-        if (g_config && !g_config->get_public_key_file().empty()) {
-            // Legacy: use file if specified
-            encrypted_data = encrypt_data(data_to_encrypt, g_config->get_public_key_file());
+        // The registration's fpkey pins the backend shard (PIN_BACKEND_SHARD);
+        // without one the mirrors are ordered by cost
+        const Fingerprint& fp = host.fingerprint;
+        std::string canonical = canonical_fingerprint(fp.uuid, fp.machine_guid, fp.serials);
+        host.endpoints.set_shard_key(canonical_fingerprint_known(canonical) ? fingerprint_id(canonical).key : 0);
+        steps.acknowledged = LoadAcknowledgedRegistration();
+        LoginToken issued = co_await request_login_token(host.offload, host.fingerprint, steps, token, stage);
+        CacheLoginToken(host, issued, steps);
+        SaveAcknowledgedRegistration(issued.acknowledged);
+        // The backend answers again: send what was queued while it did not
+        host.drain_backoff.reset();
+        StartDrain(host);
+        co_return session_id ? issued.url : "";
+    } catch (const HandshakeError& e) {
+        if (debug_enabled) std::cout << "Login handshake failed: " << e.what() << std::endl;
+    } catch (const TaskCancelled&) {
+        if (debug_enabled) std::cout << "Login handshake cancelled (window closed or timed out)." << std::endl;
+    }
+    co_return "";
+}
+
+// Runs the next queued job (logins first, then a background refresh)
+void StartHandshake(LoginHost& host) {
+    if (host.handshake_busy) return;
+    uint64_t session_id = 0;
+    if (!host.login_queue.empty()) {
+        session_id = host.login_queue.front();
+        host.login_queue.pop_front();
+    } else if (host.refresh_queued) {
+        host.refresh_queued = false;
+    } else {
+        return;
+    }
+    host.handshake_busy = true;
+    host.handshake_session = session_id;
+    host.handshake_cancel = CancelToken();
+    host.handshake_cancel.cancel_after(host.loop, HANDSHAKE_TIMEOUT_MS);
+    host.handshake = LoginHandshake(host, session_id, host.handshake_cancel);
+    host.handshake.start([&host, session_id] {
+        // The handshake's frame is still on the stack here; finish on the next turn
+        host.loop.post([&host, session_id] { OnHandshakeDone(host, session_id); });
+    });
+}
+
+// Starts a login: reuses an idle session window or opens a new one, shows it
+// with the splash and queues its token exchange.
+void RequestLogin(LoginHost& host) {
+    uint64_t id = host.sessions.acquire();
+    if (id == 0) {
+        if (g_config->is_debug_enabled()) {
+            std::cout << "All " << host.sessions.max_sessions() << " login sessions are in use." << std::endl;
+        }
+        // Bring the newest session forward instead
+        std::vector<uint64_t> ids = host.sessions.ids();
+        if (!ids.empty() && host.windows.count(ids.back())) BringLoginWindowToFront(host.windows[ids.back()]->hwnd);
+        return;
+    }
+    StartSplash(host.window_for(id));
+    host.login_queue.push_back(id);
+    StartHandshake(host);
+}
+
+// Puts a freshly fetched login page on screen
+void ShowLogin(WebViewSession& session, const std::string& login_url) {
+    double token_ms = timing_log().now_ms();
+    timing_log().mark_at(token_ms, "token received");
+    session.timeline.set_origin(token_ms);
+    session.page_context = page_context_for(session.host->fingerprint, session.id);
+    session.progress.begin(LoginStage::PageLoading, token_ms);
+    InvalidateRect(session.hwnd, nullptr, FALSE);
+    session.url = utf8_to_wide(login_url);
+    // Resume before navigating; a suspended webview does not load
+    ApplyMemoryAction(session, session.memory.on_restored(token_ms));
+    // Before the controller exists, SetUpWebView navigates to session.url
+    if (session.webview) session.webview->Navigate(session.url.c_str());
+    BringLoginWindowToFront(session.hwnd);
+}
+
+void OnHandshakeDone(LoginHost& host, uint64_t session_id) {
+    std::string login_url = host.handshake.get();
+    host.handshake = Task<std::string>();
+    host.handshake_busy = false;
+
+    // The session may have been closed while its token was being fetched
+    if (session_id && host.windows.count(session_id)) {
+        WebViewSession& session = *host.windows[session_id];
+        const SessionManager::Session* info = host.sessions.find(session_id);
+        if (info && info->state == SessionManager::State::Failed) {
+            if (g_config->is_debug_enabled()) std::cout << "WebView2 could not be started for session " << session_id << "." << std::endl;
+            CloseSession(host, session_id);
+        } else if (!login_url.empty()) {
+            ShowLogin(session, login_url);
         } else {
-            // Modern: use embedded key
-            encrypted_data = encrypt_data_from_key_string(data_to_encrypt, EmbeddedKey::PUBLIC_KEY_PEM);
+            if (g_config->is_debug_enabled()) std::cout << "Login failed for session " << session_id << "." << std::endl;
+            // Leave the failure on the splash for a moment, then close (resident hosts keep the window for reuse)
+            session.progress.fail();
+            InvalidateRect(session.hwnd, nullptr, FALSE);
+            KillTimer(session.hwnd, SPLASH_TIMER_ID);
+            SetTimer(session.hwnd, SPLASH_CLOSE_TIMER_ID, SPLASH_FAILED_MS, nullptr);
         }
+    }
+    StartHandshake(host);
+}
 
-        if (!encrypted_data.empty()) {
-            if (debug_enabled && g_config->should_log_encrypted_data()) {
-                std::cout << "\nEncrypted data (" << encrypted_data.size() << " chars, base64):\n" << encrypted_data << std::endl;
-            }
+// Closing a window ends its session. Resident hosts only hide the
+// default-profile session and keep it for the next login (the token page is
+// unloaded since each randkey is single-use); sessions with a private profile
+// are always closed so the next account starts without their cookies.
+void CloseSessionWindow(WebViewSession& session) {
+    LoginHost& host = *session.host;
+    const SessionManager::Session* info = host.sessions.find(session.id);
+    if (!host.resident || !info || !info->profile.empty()) {
+        CloseSession(host, session.id);
+        return;
+    }
+    ShowWindow(session.hwnd, SW_HIDE);
+    KillTimer(session.hwnd, SPLASH_TIMER_ID);
+    session.progress.reset(timing_log().now_ms());
+    if (session.webview) session.webview->Navigate(L"about:blank");
+    session.timeline.finish();
+    ApplyMemoryAction(session, session.memory.on_hidden(timing_log().now_ms()));
+    host.sessions.release(session.id);
+}
 
-            std::string server_reply;
-            bool success = send_data(encrypted_data, server_reply);
+void ShowTrayMenu(LoginHost& host) {
+    HMENU menu = CreatePopupMenu();
+    AppendMenuW(menu, MF_STRING, TRAY_MENU_OPEN, L"Open");
+    AppendMenuW(menu, MF_SEPARATOR, 0, nullptr);
+    AppendMenuW(menu, MF_STRING, TRAY_MENU_EXIT, L"Exit");
 
-            if (success) {
-                if (debug_enabled && g_config->should_log_server_responses()) {
-                    std::cout << "Data sent, server replied: " << server_reply << std::endl;
-                }
+    POINT pt;
+    GetCursorPos(&pt);
+    // Required so the menu closes when clicking elsewhere
+    SetForegroundWindow(host.hwnd);
+    UINT cmd = TrackPopupMenu(menu, TPM_RIGHTBUTTON | TPM_RETURNCMD | TPM_NONOTIFY, pt.x, pt.y, 0, host.hwnd, nullptr);
+    DestroyMenu(menu);
 
-                // Only try to parse JSON if reply looks like JSON
-                if (!server_reply.empty() && server_reply[0] == '{') {
-                    try {
-                        auto j = nlohmann::json::parse(server_reply);
-                        if (j.contains("randkey")) {
-                            std::string token = j["randkey"];
-                            std::string login_url = g_config->get_login_base_url() + "?token=" + token;
-                            // Show in embedded browser with restrictions
-                            ShowWebView2(std::wstring(login_url.begin(), login_url.end()));
-                        } else {
-                            if (debug_enabled) std::cout << "randkey not found in server reply." << std::endl;
-                        }
-                    } catch (std::exception& e) {
-                        if (debug_enabled) std::cout << "Failed to parse server reply: " << e.what() << std::endl;
-                    }
-                } else {
-                    if (debug_enabled) std::cout << "Server reply is not JSON: " << server_reply << std::endl;
-                }
-            } else {
-                if (debug_enabled) std::cout << "Failed to send encrypted data." << std::endl;
-            }
-        } else {
-            if (debug_enabled) {
-                std::cout << "Size of data_to_encrypt: " << data_to_encrypt.dump().size() << std::endl;
-                std::cout << "Encryption failed." << std::endl;
+    if (cmd == TRAY_MENU_OPEN) RequestLogin(host);
+    else if (cmd == TRAY_MENU_EXIT) DestroyWindow(host.hwnd);
+}
+
+void AddTrayIcon(LoginHost& host) {
+    NOTIFYICONDATAW& tray = host.tray;
+    tray.cbSize = sizeof(tray);
+    tray.hWnd = host.hwnd;
+    tray.uID = 1;
+    tray.uFlags = NIF_MESSAGE | NIF_ICON | NIF_TIP;
+    tray.uCallbackMessage = WM_APP_TRAY;
+    tray.hIcon = LoadIconW(nullptr, IDI_APPLICATION);
+    std::string app_name = g_config->get_app_name();
+    std::wstring tip = utf8_to_wide(app_name);
+    wcsncpy(tray.szTip, tip.c_str(), sizeof(tray.szTip) / sizeof(tray.szTip[0]) - 1);
+    Shell_NotifyIconW(NIM_ADD, &tray);
+}
+
+// Window procedure for the hidden host window
+LRESULT CALLBACK HostWindowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    auto* host = reinterpret_cast<LoginHost*>(GetWindowLongPtrW(hwnd, GWLP_USERDATA));
+    if (!host) return DefWindowProcW(hwnd, msg, wParam, lParam);
+    if (host->loop.on_window_message(msg, wParam)) return 0;
+
+    switch (msg) {
+    case WM_APP_TRAY:
+        if (LOWORD(lParam) == WM_LBUTTONDBLCLK) RequestLogin(*host);
+        else if (LOWORD(lParam) == WM_RBUTTONUP) ShowTrayMenu(*host);
+        return 0;
+    case WM_DESTROY:
+        if (host->resident) Shell_NotifyIconW(NIM_DELETE, &host->tray);
+        PostQuitMessage(0);
+        return 0;
+    }
+    return DefWindowProcW(hwnd, msg, wParam, lParam);
+}
+
+HWND CreateHostWindow(LoginHost& host) {
+    const wchar_t CLASS_NAME[] = L"WebView2LoginHost";
+    WNDCLASSW wc = {};
+    wc.lpfnWndProc = HostWindowProc;
+    wc.hInstance = GetModuleHandleW(nullptr);
+    wc.lpszClassName = CLASS_NAME;
+    RegisterClassW(&wc);
+    // Never shown; a top-level window so the tray menu can take the foreground
+    HWND hwnd = CreateWindowExW(0, CLASS_NAME, L"", WS_OVERLAPPED, 0, 0, 0, 0,
+                                NULL, NULL, GetModuleHandleW(nullptr), NULL);
+    SetWindowLongPtrW(hwnd, GWLP_USERDATA, (LONG_PTR)&host);
+    return hwnd;
+}
+
+// Loads the login shell asset pack: the copy compiled into the binary if
+// there is one, otherwise ASSET_PACK_FILE next to main.exe.
+void LoadAssetPack(AssetServer& assets) {
+    std::string prefix = g_config->get_asset_url_prefix();
+    if (prefix.empty()) return;
+    std::string error;
+#ifdef HAVE_EMBEDDED_ASSET_PACK
+    bool loaded = assets.open(ASSET_PACK_DATA, ASSET_PACK_SIZE, prefix, error);
+#else
+    wchar_t module_path[MAX_PATH] = {};
+    GetModuleFileNameW(nullptr, module_path, MAX_PATH);
+    std::wstring dir(module_path);
+    dir = dir.substr(0, dir.find_last_of(L"\\/") + 1);
+    std::filesystem::path pack_path = dir + utf8_to_wide(g_config->get_asset_pack_file());
+    bool loaded = assets.open_file(pack_path, prefix, error);
+#endif
+    if (g_config->is_debug_enabled()) {
+        if (loaded) std::cout << "Asset pack: " << assets.pack().size() << " assets under " << prefix << std::endl;
+        else std::cout << "Asset pack not used: " << error << std::endl;
+    }
+}
+
+int main() {
+    // Initialize configuration system
+    init_config();
+    
+    bool debug_enabled = g_config->is_debug_enabled();
+    timing_log().set_enabled(debug_enabled && g_config->should_log_timings());
+    timing_log().mark("config loaded");
+
+    // Must happen before the first window is created
+    DpiMode dpi_mode = g_config->is_per_monitor_dpi() ? enable_per_monitor_dpi() : DpiMode::Unaware;
+    if (debug_enabled) std::cout << "DPI awareness: " << dpi_mode_name(dpi_mode) << std::endl;
+
+    LoginHost host(g_config->get_max_sessions(), g_config->should_isolate_sessions());
+    host.resident = g_config->is_resident_mode();
+    host.token_cache = TokenCache(g_config->get_token_cache_file());
+    host.admission.open(g_config->get_admission_state_file());
+    host.endpoints.open(g_config->get_endpoint_state_file());
+    host.start_jitter_ms = host.admission.start_jitter_ms(g_config->get_start_jitter_ms());
+    host.dpi_mode = dpi_mode;
+    host.hwnd = CreateHostWindow(host);
+    // Keeps posted work and loop timers running while a window is dragged or the tray menu is open
+    host.loop.attach(host.hwnd, WM_APP_LOOP, LOOP_TIMER_ID);
+
+    // A host that can take more logins (resident, or several sessions) owns
+    // the channel; later launches hand their login over to it.
+    std::unique_ptr<InstanceChannel> channel;
+    if (host.resident || g_config->get_max_sessions() > 1) {
+        std::string channel_name = login_channel_name();
+        channel.reset(new InstanceChannel(channel_name));
+        bool primary = channel->listen([&host](const std::string& command) -> std::string {
+            if (command != "SHOW") return "ERROR unknown command";
+            host.loop.post([&host] {
+                timing_log().mark("login requested by another launch");
+                RequestLogin(host);
+            });
+            return "OK";
+        });
+        if (!primary) {
+            // Let the running host take the foreground from us
+            AllowSetForegroundWindow(ASFW_ANY);
+            std::string reply;
+            if (InstanceChannel::send(channel_name, "SHOW", reply, 2000)) {
+                if (debug_enabled) std::cout << "Running instance replied: " << reply << std::endl;
+                DestroyWindow(host.hwnd);
+                cleanup_config();
+                return 0;
             }
+            if (debug_enabled) std::cout << "Running instance not responding, starting on our own." << std::endl;
+            channel.reset();
+            host.resident = false;
+        }
+    }
+
+    if (host.resident) {
+        AddTrayIcon(host);
+        if (g_config->get_resident_refresh_minutes() > 0) {
+            // Keep the cached fingerprint fresh between logins so a relaunch only pays for the token exchange
+            host.loop.call_every(g_config->get_resident_refresh_minutes() * 60.0 * 1000, [&host] {
+                // Hosts started together would otherwise refresh together
+                host.start_jitter_ms = host.admission.start_jitter_ms(g_config->get_start_jitter_ms());
+                host.refresh_queued = true;
+                StartHandshake(host);
+            });
+        }
+    }
+    size_t queue_max_bytes = (size_t)std::max(1, g_config->get_offline_queue_max_kb()) * 1024;
+    if (host.offline_queue.open(g_config->get_offline_queue_file(), queue_max_bytes) && !host.offline_queue.empty()) {
+        if (debug_enabled) std::cout << "Offline queue: " << host.offline_queue.size() << " registrations from an earlier run" << std::endl;
+        // Tried after the first backoff delay, behind this launch's own login
+        ScheduleDrain(host);
+    }
+    LoadAssetPack(host.assets);
+    std::string filter_error;
+    if (!host.url_filter.load(g_config->get_url_filter_rules(), filter_error) && debug_enabled) {
+        std::cout << "URL_FILTER_RULES ignored: " << filter_error << std::endl;
+    }
+    // The window opens with the splash at once; the fingerprint, the token
+    // and the WebView2 environment are all prepared behind it
+    RequestLogin(host);
+    // Ends with WM_QUIT from the host window's WM_DESTROY
+    host.loop.run();
+
+    if (channel) channel->close();
+    // Blocking calls still running are waited for; their results are dropped
+    host.handshake_cancel.cancel();
+    host.drain_cancel.cancel();
+    host.offload.join();
+    host.offline_queue.sync();
+    for (auto& entry : host.windows) {
+        // Report navigations that never completed (window closed while loading)
+        entry.second->timeline.finish();
+        if (entry.second->controller) entry.second->controller->Close();
+    }
+    host.windows.clear();
+    if (debug_enabled && host.assets.enabled()) {
+        std::cout << "Asset pack: " << host.assets.hits() << " served, " << host.assets.misses() << " passed to the network" << std::endl;
+    }
+    if (debug_enabled && !host.url_filter.empty()) {
+        std::cout << "URL filter: " << host.url_filter.blocked() << " of " << host.url_filter.checked() << " requests blocked" << std::endl;
+        for (size_t i = 0; i < host.url_filter.size(); ++i) {
+            std::cout << "  " << host.url_filter.hits(i) << "\t" << host.url_filter.rule(i).text << std::endl;
         }
-    } else {
-        if (debug_enabled) std::cout << "Error fetching IP or proxy info." << std::endl;
     }
 
     // Cleanup configuration
     cleanup_config();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+// Decides when the hosted WebView2 should give memory back. The host feeds it
+// window events and a periodic tick (times in milliseconds on any monotonic
+// clock) and applies the returned action; the policy itself has no Win32
+// dependency so it can be driven by simulated events.
+//
+//   Active    --minimized/hidden-->   Suspended  (lower target, TrySuspend)
+//   Active    --inactive for idle-->  Reduced    (lower target only)
+//   Reduced   --minimized/hidden-->   Suspended
+//   Reduced   --activated-->          Active     (resume)
+//   Suspended --restored/shown-->     Active     (resume)
+//
+// A refused TrySuspend (e.g. the page is playing audio) leaves it Reduced.
+enum class MemoryAction { None, LowerTarget, Suspend, Resume };
+
+class MemoryPolicy {
+public:
+    enum class State { Active, Reduced, Suspended };
+
+    // `idle_after_ms` <= 0 disables the inactivity trim.
+    explicit MemoryPolicy(double idle_after_ms) : idle_after_ms_(idle_after_ms) {}
+
+    MemoryAction on_minimized(double now_ms) { return leave_screen(now_ms, "minimized"); }
+    MemoryAction on_hidden(double now_ms) { return leave_screen(now_ms, "hidden"); }
+
+    MemoryAction on_restored(double now_ms) {
+        if (!off_screen_) return MemoryAction::None;
+        off_screen_ = false;
+        // Restoring usually activates the window too; count idle from here
+        inactive_since_ms_ = -1;
+        return wake(now_ms, "restored");
+    }
+
+    MemoryAction on_activation(bool active, double now_ms) {
+        if (!active) {
+            if (inactive_since_ms_ < 0) inactive_since_ms_ = now_ms;
+            return MemoryAction::None;
+        }
+        inactive_since_ms_ = -1;
+        if (off_screen_) return MemoryAction::None;
+        return wake(now_ms, "activated");
+    }
+
+    MemoryAction on_tick(double now_ms) {
+        if (state_ != State::Active || off_screen_ || idle_after_ms_ <= 0) return MemoryAction::None;
+        if (inactive_since_ms_ < 0 || now_ms - inactive_since_ms_ < idle_after_ms_) return MemoryAction::None;
+        return transition(State::Reduced, MemoryAction::LowerTarget, now_ms, "idle");
+    }
+
+    // The host reports that TrySuspend completed without suspending.
+    void on_suspend_refused() {
+        if (state_ == State::Suspended) state_ = State::Reduced;
+    }
+
+    State state() const { return state_; }
+    bool off_screen() const { return off_screen_; }
+    // Why the last transition happened ("minimized", "idle", ...)
+    const char* reason() const { return reason_; }
+    double last_transition_ms() const { return last_transition_ms_; }
+
+private:
+    MemoryAction leave_screen(double now_ms, const char* reason) {
+        off_screen_ = true;
+        if (state_ == State::Suspended) return MemoryAction::None;
+        return transition(State::Suspended, MemoryAction::Suspend, now_ms, reason);
+    }
+
+    MemoryAction wake(double now_ms, const char* reason) {
+        if (state_ == State::Active) return MemoryAction::None;
+        return transition(State::Active, MemoryAction::Resume, now_ms, reason);
+    }
+
+    MemoryAction transition(State next, MemoryAction action, double now_ms, const char* reason) {
+        state_ = next;
+        reason_ = reason;
+        last_transition_ms_ = now_ms;
+        return action;
+    }
+
+    double idle_after_ms_;
+    State state_ = State::Active;
+    bool off_screen_ = false;
+    double inactive_since_ms_ = -1;
+    const char* reason_ = "";
+    double last_transition_ms_ = -1;
+};
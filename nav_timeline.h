@@ -0,0 +1,221 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include "json.hpp"
+
+// Correlates WebView2 navigation events and the page's own performance report
+// into one record per navigation. Host events are keyed by navigation id; the
+// page report carries no id, so it is attributed to the navigation whose
+// document is currently loaded (the last one that reached ContentLoading).
+//
+// Times are host milliseconds (TimingLog::now_ms()); page paint/resource times
+// are relative to the page's navigation start and are placed on the host
+// clock using the NavigationStarting time.
+
+struct NavigationRecord {
+    uint64_t id = 0;
+    std::string uri;           // without query string (the token stays out of logs)
+    int redirects = 0;
+    double starting_ms = -1;
+    double content_loading_ms = -1;
+    double dom_content_loaded_ms = -1;
+    double completed_ms = -1;
+    bool success = false;
+    int web_error = 0;
+
+    bool has_page_metrics = false;
+    double first_paint_ms = -1;            // page-relative
+    double first_contentful_paint_ms = -1; // page-relative
+    double load_event_ms = -1;             // page-relative
+    uint64_t resource_count = 0;
+    uint64_t resource_bytes = 0;
+    std::string slowest_resource;
+    double slowest_resource_ms = -1;
+};
+
+class NavigationTimeline {
+public:
+    using ReportFn = std::function<void(const NavigationRecord&)>;
+
+    // `origin_ms` is when the token arrived; reports show the time from there
+    // until the page became usable.
+    NavigationTimeline(double origin_ms, ReportFn report)
+        : origin_ms_(origin_ms), report_(std::move(report)) {}
+
+    // Resident mode reuses the timeline for every login; each new token
+    // becomes the origin of the reports that follow.
+    void set_origin(double origin_ms) { origin_ms_ = origin_ms; }
+
+    void on_navigation_starting(uint64_t id, const std::string& uri, bool is_redirect, double now_ms) {
+        NavigationRecord& r = record(id);
+        if (is_redirect && r.starting_ms >= 0) {
+            ++r.redirects;
+            return;
+        }
+        r.uri = strip_query(uri);
+        r.starting_ms = now_ms;
+    }
+
+    void on_content_loading(uint64_t id, double now_ms) {
+        NavigationRecord& r = record(id);
+        r.content_loading_ms = now_ms;
+        // A new document replaces the previous one; page metrics still
+        // missing for it will never arrive.
+        if (current_document_ != 0 && current_document_ != id) flush(current_document_);
+        current_document_ = id;
+    }
+
+    void on_dom_content_loaded(uint64_t id, double now_ms) {
+        record(id).dom_content_loaded_ms = now_ms;
+    }
+
+    void on_navigation_completed(uint64_t id, bool success, int web_error, double now_ms) {
+        NavigationRecord& r = record(id);
+        r.completed_ms = now_ms;
+        r.success = success;
+        r.web_error = web_error;
+        // Failed navigations or ones that never produced a document get no page report.
+        if (!success || r.content_loading_ms < 0) flush(id);
+        else maybe_report(id);
+    }
+
+    // Handles {"type":"perf", ...} posted by PAGE_TIMING_SCRIPT. Returns false
+    // for messages that are not performance reports.
+    bool on_page_message(const nlohmann::json& msg) {
+        if (!msg.is_object() || msg.value("type", "") != "perf") return false;
+        if (current_document_ == 0) return true;
+
+        NavigationRecord& r = record(current_document_);
+        r.has_page_metrics = true;
+        r.first_paint_ms = number(msg, "fp");
+        r.first_contentful_paint_ms = number(msg, "fcp");
+        r.load_event_ms = number(msg, "load");
+        r.resource_count = (uint64_t)std::max(0.0, number(msg, "resources"));
+        r.resource_bytes = (uint64_t)std::max(0.0, number(msg, "bytes"));
+        auto slowest = msg.find("slowest");
+        if (slowest != msg.end() && slowest->is_object()) {
+            r.slowest_resource = strip_query(slowest->value("name", ""));
+            r.slowest_resource_ms = number(*slowest, "duration");
+        }
+        maybe_report(current_document_);
+        return true;
+    }
+
+    // Reports whatever is still pending, e.g. when the window closes.
+    void finish() {
+        while (!pending_.empty()) flush(pending_.front().id);
+    }
+
+    size_t pending() const { return pending_.size(); }
+
+    // One-line summary used for the timing output.
+    std::string format(const NavigationRecord& r) const {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1);
+        out << "navigation " << r.id << " " << (r.uri.empty() ? "(unknown)" : r.uri);
+        if (r.redirects) out << " redirects=" << r.redirects;
+        auto since_token = [&](const char* name, double ms) {
+            if (ms >= 0) out << " " << name << "=" << (ms - origin_ms_);
+        };
+        since_token("start", r.starting_ms);
+        since_token("content", r.content_loading_ms);
+        since_token("dcl", r.dom_content_loaded_ms);
+        since_token("complete", r.completed_ms);
+        if (r.completed_ms >= 0 && !r.success) out << " failed(web_error=" << r.web_error << ")";
+        if (r.has_page_metrics && r.starting_ms >= 0) {
+            if (r.first_paint_ms >= 0) since_token("fp", r.starting_ms + r.first_paint_ms);
+            if (r.first_contentful_paint_ms >= 0) since_token("fcp", r.starting_ms + r.first_contentful_paint_ms);
+            if (r.load_event_ms >= 0) since_token("load", r.starting_ms + r.load_event_ms);
+        }
+        if (r.has_page_metrics) {
+            out << " resources=" << r.resource_count << " bytes=" << r.resource_bytes;
+            if (!r.slowest_resource.empty()) {
+                out << " slowest=" << r.slowest_resource << "(" << r.slowest_resource_ms << "ms)";
+            }
+        }
+        out << " (ms since token)";
+        return out.str();
+    }
+
+private:
+    NavigationRecord& record(uint64_t id) {
+        for (auto& r : pending_) {
+            if (r.id == id) return r;
+        }
+        pending_.emplace_back();
+        pending_.back().id = id;
+        return pending_.back();
+    }
+
+    void maybe_report(uint64_t id) {
+        for (const auto& r : pending_) {
+            if (r.id == id && r.completed_ms >= 0 && r.has_page_metrics) {
+                flush(id);
+                return;
+            }
+        }
+    }
+
+    void flush(uint64_t id) {
+        for (size_t i = 0; i < pending_.size(); ++i) {
+            if (pending_[i].id != id) continue;
+            NavigationRecord r = pending_[i];
+            pending_.erase(pending_.begin() + i);
+            if (current_document_ == id) current_document_ = 0;
+            if (report_) report_(r);
+            return;
+        }
+    }
+
+    static std::string strip_query(const std::string& uri) {
+        return uri.substr(0, uri.find_first_of("?#"));
+    }
+
+    static double number(const nlohmann::json& j, const char* key) {
+        auto it = j.find(key);
+        return (it != j.end() && it->is_number()) ? it->get<double>() : -1;
+    }
+
+    double origin_ms_;
+    ReportFn report_;
+    std::vector<NavigationRecord> pending_;
+    uint64_t current_document_ = 0;
+};
+
+// Injected on document creation; posts paint and resource timing once the
+// page has loaded. URLs are sent without query strings.
+static const wchar_t PAGE_TIMING_SCRIPT[] = LR"(
+(() => {
+    if (!window.chrome || !window.chrome.webview) return;
+    const paints = {};
+    try {
+        new PerformanceObserver((list) => {
+            for (const e of list.getEntries()) paints[e.name] = e.startTime;
+        }).observe({ type: 'paint', buffered: true });
+    } catch (e) {}
+    window.addEventListener('load', () => setTimeout(() => {
+        const nav = performance.getEntriesByType('navigation')[0];
+        const resources = performance.getEntriesByType('resource');
+        let bytes = 0, slowest = null;
+        for (const r of resources) {
+            bytes += r.transferSize || 0;
+            if (!slowest || r.duration > slowest.duration) slowest = r;
+        }
+        for (const p of performance.getEntriesByType('paint')) paints[p.name] = p.startTime;
+        window.chrome.webview.postMessage({
+            type: 'perf',
+            fp: paints['first-paint'],
+            fcp: paints['first-contentful-paint'],
+            load: nav ? nav.loadEventStart : undefined,
+            resources: resources.length,
+            bytes: bytes,
+            slowest: slowest ? { name: slowest.name.split('?')[0], duration: slowest.duration } : undefined
+        });
+    }, 0));
+})();
+)";
@@ -0,0 +1,261 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+#include "json.hpp"
+#include "task.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// Registrations the backend could not be reached for. They are kept on disk
+// until it can be, then sent in batches. The file holds one encrypted
+// message (base64url) per line, the format bulk_decrypt and the batch
+// endpoint read. Appends are made durable by sync(), so appends made close
+// together share one flush. The file never grows past `max_bytes`: the
+// oldest messages make room for new ones.
+class OfflineQueue {
+public:
+    OfflineQueue() = default;
+    ~OfflineQueue() { close_file(); }
+
+    OfflineQueue(const OfflineQueue&) = delete;
+    OfflineQueue& operator=(const OfflineQueue&) = delete;
+
+    // Uses `path` ("" = off) and reads what an earlier run left there. A
+    // torn last line (a crash mid-append) and anything that is not a
+    // message are dropped. False if the queue is off.
+    bool open(const std::string& path, size_t max_bytes) {
+        close_file();
+        path_ = path;
+        max_bytes_ = max_bytes;
+        messages_.clear();
+        bytes_ = 0;
+        dropped_ = 0;
+        if (!enabled()) return false;
+        std::ifstream in(path_, std::ios::binary);
+        if (!in) return true;
+        std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        in.close();
+        bool clean = true;
+        size_t pos = 0;
+        while (pos < text.size()) {
+            size_t end = text.find('\n', pos);
+            if (end == std::string::npos) {
+                clean = false;
+                break;
+            }
+            std::string line = text.substr(pos, end - pos);
+            if (is_message(line)) {
+                bytes_ += line.size() + 1;
+                messages_.push_back(std::move(line));
+            } else {
+                clean = false;
+            }
+            pos = end + 1;
+        }
+        // A smaller limit than the last run's
+        for (; bytes_ > max_bytes_; clean = false, ++dropped_) drop_front();
+        if (!clean) rewrite();
+        return true;
+    }
+
+    bool enabled() const { return !path_.empty(); }
+
+    // Queues `message`; durable once sync() returns. False if it can never
+    // fit or is not base64url text.
+    bool push(const std::string& message) {
+        if (!enabled() || !is_message(message) || message.size() + 1 > max_bytes_) return false;
+        if (bytes_ + message.size() + 1 > max_bytes_) {
+            while (bytes_ + message.size() + 1 > max_bytes_) {
+                drop_front();
+                ++dropped_;
+            }
+            messages_.push_back(message);
+            bytes_ += message.size() + 1;
+            return rewrite();
+        }
+        if (!file_) file_ = std::fopen(path_.c_str(), "ab");
+        if (!file_) return false;
+        std::string line = message + "\n";
+        if (std::fwrite(line.data(), 1, line.size(), file_) != line.size()) {
+            close_file();
+            return false;
+        }
+        messages_.push_back(message);
+        bytes_ += line.size();
+        dirty_ = true;
+        return true;
+    }
+
+    // Flushes the appends since the last sync to disk
+    bool sync() {
+        if (!file_ || !dirty_) return true;
+        dirty_ = false;
+        if (std::fflush(file_) != 0) return false;
+#ifdef _WIN32
+        return _commit(_fileno(file_)) == 0;
+#else
+        return fsync(fileno(file_)) == 0;
+#endif
+    }
+
+    // The oldest messages, at most `max_count` of them and `max_bytes`
+    // of text (always at least one)
+    std::vector<std::string> peek(size_t max_count, size_t max_bytes) const {
+        std::vector<std::string> out;
+        size_t bytes = 0;
+        for (const auto& m : messages_) {
+            if (out.size() >= max_count || (!out.empty() && bytes + m.size() + 1 > max_bytes)) break;
+            bytes += m.size() + 1;
+            out.push_back(m);
+        }
+        return out;
+    }
+
+    // Messages are numbered in the order they were pushed; this is the
+    // number of the oldest one held (or of the next one, if none is)
+    uint64_t front_seq() const { return front_seq_; }
+
+    // Forgets the messages numbered below `seq` (the backend has them).
+    // Ones already pushed out for room are skipped.
+    bool pop_before(uint64_t seq) {
+        if (seq <= front_seq_) return true;
+        while (!messages_.empty() && front_seq_ < seq) drop_front();
+        return rewrite();
+    }
+
+    size_t size() const { return messages_.size(); }
+    bool empty() const { return messages_.empty(); }
+    size_t bytes() const { return bytes_; }
+    size_t dropped() const { return dropped_; }  // pushed out for room since open()
+    const std::string& path() const { return path_; }
+
+private:
+    static bool is_message(const std::string& line) {
+        return !line.empty() &&
+               line.find_first_not_of("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_+/=") == std::string::npos;
+    }
+
+    void drop_front() {
+        bytes_ -= messages_.front().size() + 1;
+        messages_.pop_front();
+        ++front_seq_;
+    }
+
+    void close_file() {
+        if (!file_) return;
+        sync();
+        std::fclose(file_);
+        file_ = nullptr;
+        dirty_ = false;
+    }
+
+    // Replaces the file with the messages held now: written aside, synced
+    // and renamed, so a crash leaves either the old or the new queue
+    bool rewrite() {
+        close_file();
+        if (messages_.empty()) {
+            std::remove(path_.c_str());
+            return true;
+        }
+        std::string temp = path_ + ".tmp";
+        std::FILE* out = std::fopen(temp.c_str(), "wb");
+        if (!out) return false;
+        bool ok = true;
+        for (const auto& m : messages_) {
+            ok = ok && std::fwrite(m.data(), 1, m.size(), out) == m.size() && std::fputc('\n', out) != EOF;
+        }
+        ok = ok && std::fflush(out) == 0;
+#ifdef _WIN32
+        ok = ok && _commit(_fileno(out)) == 0;
+        ok = std::fclose(out) == 0 && ok;
+        return ok && MoveFileExA(temp.c_str(), path_.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        ok = ok && fsync(fileno(out)) == 0;
+        ok = std::fclose(out) == 0 && ok;
+        return ok && std::rename(temp.c_str(), path_.c_str()) == 0;
+#endif
+    }
+
+    std::string path_;
+    size_t max_bytes_ = 0;
+    std::deque<std::string> messages_;
+    uint64_t front_seq_ = 0;
+    size_t bytes_ = 0;
+    size_t dropped_ = 0;
+    std::FILE* file_ = nullptr;  // open for appends between syncs
+    bool dirty_ = false;
+};
+
+// Delays between attempts to reach the backend: doubling from `base_ms` up
+// to `cap_ms`, each drawn from its upper half so clients that lost the
+// backend together do not come back together
+class RetryBackoff {
+public:
+    RetryBackoff(double base_ms = 5000, double cap_ms = 15 * 60 * 1000)
+        : base_ms_(base_ms), cap_ms_(cap_ms), rng_(std::random_device{}()) {}
+
+    double next_ms() {
+        double ceiling = std::min(cap_ms_, base_ms_ * (double)(1ull << std::min(attempts_, 30u)));
+        ++attempts_;
+        return std::uniform_real_distribution<double>(ceiling / 2, ceiling)(rng_);
+    }
+
+    void reset() { attempts_ = 0; }
+    unsigned attempts() const { return attempts_; }
+
+private:
+    double base_ms_, cap_ms_;
+    unsigned attempts_ = 0;
+    std::mt19937 rng_;
+};
+
+// Sends a batch of messages; false if the backend was not reached. The reply
+// is {"results": [<the backend's reply to each message, in order>]}.
+using BatchSendFn = std::function<bool(const std::vector<std::string>& messages, std::string& reply)>;
+
+// How many messages of a batch the backend answered (accepted or rejected;
+// either way they are done with); 0 if the reply is not a batch reply
+inline size_t batch_results_answered(const std::string& reply, size_t sent) {
+    if (reply.empty() || reply[0] != '{') return 0;
+    nlohmann::json j = nlohmann::json::parse(reply, nullptr, false);
+    if (!j.is_object() || !j.contains("results") || !j["results"].is_array()) return 0;
+    return std::min(j["results"].size(), sent);
+}
+
+// Sends the queue in batches of up to `batch_max` messages until it is empty
+// (true) or the backend cannot be reached (false; the rest stays queued).
+// Messages may be pushed while a batch is out. A batch whose reply is lost
+// (cancelled, or the connection dropped after the backend got it) is sent
+// again, so the backend may see a registration twice.
+inline Task<bool> drain_offline_queue(Offload& offload, OfflineQueue& queue, BatchSendFn send, size_t batch_max,
+                                      CancelToken token) {
+    const size_t BATCH_BYTES = 64 * 1024;
+    while (!queue.empty()) {
+        uint64_t first = queue.front_seq();
+        std::vector<std::string> batch = queue.peek(batch_max, BATCH_BYTES);
+        auto call = [send, batch] {
+            std::string reply;
+            if (!send(batch, reply)) reply.clear();
+            return reply;
+        };
+        std::string reply = co_await offload.call(std::move(call), token);
+        size_t answered = batch_results_answered(reply, batch.size());
+        if (answered == 0) co_return false;
+        // Messages pushed out for room meanwhile are not popped twice
+        queue.pop_before(first + answered);
+    }
+    co_return true;
+}
@@ -0,0 +1,313 @@
+#pragma once
+#include <cctype>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include "json.hpp"
+
+// Typed message channel between the client and the login page on top of
+// PostWebMessageAsJson / chrome.webview.postMessage. Messages travel in
+// batches, one envelope per post:
+//
+//   {"bridge": 1, "messages": [
+//       {"kind": "event",    "type": "context", "data": {...}},
+//       {"kind": "request",  "id": 7, "type": "context", "data": null},
+//       {"kind": "response", "id": 7, "data": {...}},
+//       {"kind": "response", "id": 8, "error": "no handler for 'x'"}]}
+//
+// Request ids are per side, so a response always answers a request the
+// receiving side made. The bridge does no I/O itself: main.cpp supplies the
+// post function and feeds it parsed WebMessageReceived payloads, which keeps
+// the codec and the correlation drivable without WebView2.
+//
+// Not thread-safe: use it from the UI thread.
+class PageBridge {
+public:
+    using json = nlohmann::json;
+    // Delivers one envelope to the page; false if there is no page to take it
+    using Post = std::function<bool(const std::string& envelope)>;
+    // ok == false: `result` is the error message (a string)
+    using Reply = std::function<void(bool ok, const json& result)>;
+    // Answers a page request; throw to send an error response
+    using Handler = std::function<json(const json& data)>;
+
+    static constexpr int VERSION = 1;
+
+    explicit PageBridge(Post post, size_t max_batch = 64) : post_(std::move(post)), max_batch_(max_batch ? max_batch : 1) {}
+
+    void handle(const std::string& type, Handler handler) { handlers_[type] = std::move(handler); }
+
+    // Queues a fire-and-forget event; sent by the next flush().
+    void push(const std::string& type, json data) {
+        outbox_.push_back({{"kind", "event"}, {"type", type}, {"data", std::move(data)}});
+    }
+
+    // Queues a request; `reply` runs once, with the response, a timeout
+    // (see expire()) or the page going away (see reset()).
+    uint64_t request(const std::string& type, json data, Reply reply, double now_ms, double timeout_ms) {
+        uint64_t id = next_id_++;
+        outbox_.push_back({{"kind", "request"}, {"id", id}, {"type", type}, {"data", std::move(data)}});
+        pending_[id] = Pending{std::move(reply), now_ms + timeout_ms};
+        return id;
+    }
+
+    // Posts the queued messages, at most max_batch per envelope. Messages
+    // stay queued if the page cannot take them yet. Returns messages sent.
+    size_t flush() {
+        size_t sent = 0;
+        while (!outbox_.empty()) {
+            size_t count = outbox_.size() < max_batch_ ? outbox_.size() : max_batch_;
+            std::vector<json> batch(outbox_.begin(), outbox_.begin() + count);
+            if (!post_(encode(batch))) break;
+            outbox_.erase(outbox_.begin(), outbox_.begin() + count);
+            sent += count;
+            ++batches_posted_;
+        }
+        messages_posted_ += sent;
+        return sent;
+    }
+
+    // Handles a parsed page message. Returns false if it is not a bridge
+    // envelope (e.g. the timing script's "perf" report). Responses to page
+    // requests are flushed before returning, so a batch gets one reply post.
+    bool on_message(const json& envelope) {
+        std::vector<json> messages;
+        if (!decode(envelope, messages)) return false;
+        for (const json& m : messages) {
+            ++messages_received_;
+            dispatch(m);
+        }
+        flush();
+        return true;
+    }
+
+    // Fails requests whose deadline has passed.
+    void expire(double now_ms) {
+        for (auto it = pending_.begin(); it != pending_.end();) {
+            if (it->second.deadline_ms > now_ms) {
+                ++it;
+                continue;
+            }
+            Reply reply = std::move(it->second.reply);
+            it = pending_.erase(it);
+            if (reply) reply(false, "timeout");
+        }
+    }
+
+    // The page went away (navigation, window hidden): unsent messages are
+    // dropped and outstanding requests fail with `reason`.
+    void reset(const std::string& reason) {
+        outbox_.clear();
+        std::map<uint64_t, Pending> pending;
+        pending.swap(pending_);
+        for (auto& entry : pending) {
+            if (entry.second.reply) entry.second.reply(false, reason);
+        }
+    }
+
+    size_t queued() const { return outbox_.size(); }
+    size_t pending() const { return pending_.size(); }
+    uint64_t batches_posted() const { return batches_posted_; }
+    uint64_t messages_posted() const { return messages_posted_; }
+    uint64_t messages_received() const { return messages_received_; }
+
+    static std::string encode(const std::vector<json>& messages) {
+        json envelope = {{"bridge", VERSION}, {"messages", messages}};
+        return envelope.dump();
+    }
+
+    // Accepts only well-formed envelopes of our version; messages inside are
+    // checked one by one in dispatch().
+    static bool decode(const json& envelope, std::vector<json>& messages) {
+        if (!envelope.is_object()) return false;
+        auto version = envelope.find("bridge");
+        auto list = envelope.find("messages");
+        if (version == envelope.end() || !version->is_number_integer() || version->get<int>() != VERSION) return false;
+        if (list == envelope.end() || !list->is_array()) return false;
+        messages.assign(list->begin(), list->end());
+        return true;
+    }
+
+private:
+    struct Pending {
+        Reply reply;
+        double deadline_ms = 0;
+    };
+
+    void dispatch(const json& m) {
+        if (!m.is_object()) return;
+        std::string kind = m.value("kind", "");
+        json data = m.contains("data") ? m["data"] : json();
+        if (kind == "request") {
+            auto id = m.find("id");
+            if (id == m.end() || !id->is_number_unsigned()) return;
+            std::string type = m.value("type", "");
+            json response = {{"kind", "response"}, {"id", *id}};
+            auto handler = handlers_.find(type);
+            if (handler == handlers_.end()) {
+                response["error"] = "no handler for '" + type + "'";
+            } else {
+                try {
+                    response["data"] = handler->second(data);
+                } catch (const std::exception& e) {
+                    response["error"] = e.what();
+                }
+            }
+            outbox_.push_back(std::move(response));
+        } else if (kind == "response") {
+            auto id = m.find("id");
+            if (id == m.end() || !id->is_number_unsigned()) return;
+            auto it = pending_.find(id->get<uint64_t>());
+            if (it == pending_.end()) return;  // late answer to an expired request
+            Reply reply = std::move(it->second.reply);
+            pending_.erase(it);
+            if (!reply) return;
+            auto error = m.find("error");
+            if (error != m.end()) reply(false, error->is_string() ? *error : json(error->dump()));
+            else reply(true, data);
+        } else if (kind == "event") {
+            auto handler = handlers_.find(m.value("type", ""));
+            if (handler == handlers_.end()) return;
+            try {
+                handler->second(data);
+            } catch (const std::exception&) {
+            }
+        }
+    }
+
+    Post post_;
+    size_t max_batch_;
+    std::vector<json> outbox_;
+    std::map<std::string, Handler> handlers_;
+    std::map<uint64_t, Pending> pending_;
+    uint64_t next_id_ = 1;
+    uint64_t batches_posted_ = 0;
+    uint64_t messages_posted_ = 0;
+    uint64_t messages_received_ = 0;
+};
+
+// "https://Example.com:8443/login?x" -> "https://example.com:8443"; "" if the
+// URL has no scheme or no host. Userinfo and the scheme's default port are
+// dropped, so "https://host:443" and "https://host" are the same origin.
+inline std::string url_origin(const std::string& url) {
+    size_t scheme_end = url.find("://");
+    if (scheme_end == std::string::npos) return "";
+    size_t authority_end = url.find_first_of("/?#", scheme_end + 3);
+    std::string scheme = url.substr(0, scheme_end);
+    std::string host = url.substr(scheme_end + 3, authority_end == std::string::npos ? authority_end : authority_end - scheme_end - 3);
+    size_t at = host.rfind('@');
+    if (at != std::string::npos) host.erase(0, at + 1);
+    for (auto& c : scheme) c = (char)tolower((unsigned char)c);
+    for (auto& c : host) c = (char)tolower((unsigned char)c);
+    size_t port = host.find(':', host[0] == '[' ? host.find(']') : 0);
+    if (port != std::string::npos) {
+        std::string number = host.substr(port + 1);
+        bool default_port = number.empty() || ((scheme == "https" || scheme == "wss") && number == "443") ||
+                            ((scheme == "http" || scheme == "ws") && number == "80");
+        if (default_port) host.erase(port);
+    }
+    if (host.empty() || host[0] == ':') return "";
+    return scheme + "://" + host;
+}
+
+// Whether two URLs share an origin. A URL without one (about:blank, data:,
+// an empty or malformed LOGIN_BASE_URL) matches nothing, not even itself.
+inline bool same_origin(const std::string& a, const std::string& b) {
+    std::string origin = url_origin(a);
+    return !origin.empty() && origin == url_origin(b);
+}
+
+// Injected on document creation. Exposes window.magicKey to the page:
+//   magicKey.context            last "context" event (null until it arrives)
+//   magicKey.on(type, fn)       events from the client
+//   magicKey.handle(type, fn)   answers client requests (fn may return a promise)
+//   magicKey.request(type, data[, timeoutMs]) -> Promise
+//   magicKey.emit(type, data)
+// Events and requests that arrive before their listener/handler are held and
+// replayed on registration (the client's own timeout still applies). Outgoing
+// messages are batched per microtask. A "magickey-context" DOM event fires
+// when the context arrives; a "painted" event goes to the client after the
+// first frame following DOMContentLoaded.
+static const wchar_t PAGE_BRIDGE_SCRIPT[] = LR"(
+(() => {
+    if (!window.chrome || !window.chrome.webview || window.magicKey) return;
+    const webview = window.chrome.webview;
+    const listeners = {}, handlers = {}, pending = new Map(), early = [];
+    let outbox = [], nextId = 1, context = null;
+
+    const send = (m) => {
+        outbox.push(m);
+        if (outbox.length > 1) return;
+        queueMicrotask(() => {
+            const messages = outbox;
+            outbox = [];
+            webview.postMessage({ bridge: 1, messages });
+        });
+    };
+    const notify = (m) => {
+        const fns = listeners[m.type];
+        if (!fns) { early.push(m); return; }
+        for (const fn of fns) { try { fn(m.data); } catch (e) { console.error(e); } }
+    };
+    const replay = (kind, type) => {
+        for (let i = 0; i < early.length;) {
+            if (early[i].kind === kind && early[i].type === type) dispatch(early.splice(i, 1)[0]); else ++i;
+        }
+    };
+    const dispatch = (m) => {
+        if (m.kind === 'event') {
+            if (m.type === 'context') {
+                context = m.data;
+                window.dispatchEvent(new CustomEvent('magickey-context', { detail: m.data }));
+            }
+            notify(m);
+        } else if (m.kind === 'request') {
+            const fn = handlers[m.type];
+            if (!fn) { early.push(m); return; }
+            Promise.resolve()
+                .then(() => fn(m.data))
+                .then((data) => send({ kind: 'response', id: m.id, data: data === undefined ? null : data }),
+                      (e) => send({ kind: 'response', id: m.id, error: String(e && e.message || e) }));
+        } else if (m.kind === 'response') {
+            const p = pending.get(m.id);
+            if (!p) return;
+            pending.delete(m.id);
+            clearTimeout(p.timer);
+            if ('error' in m) p.reject(new Error(m.error)); else p.resolve(m.data);
+        }
+    };
+    webview.addEventListener('message', (e) => {
+        const envelope = e.data;
+        if (!envelope || envelope.bridge !== 1 || !Array.isArray(envelope.messages)) return;
+        for (const m of envelope.messages) dispatch(m);
+    });
+
+    // Tells the client when the first frame is on screen so it can swap its splash for the page
+    const painted = () => requestAnimationFrame(() => requestAnimationFrame(() => send({ kind: 'event', type: 'painted', data: null })));
+    if (document.readyState === 'loading') document.addEventListener('DOMContentLoaded', painted); else painted();
+
+    window.magicKey = Object.freeze({
+        get context() { return context; },
+        on(type, fn) {
+            (listeners[type] = listeners[type] || []).push(fn);
+            replay('event', type);
+        },
+        handle(type, fn) {
+            handlers[type] = fn;
+            replay('request', type);
+        },
+        request(type, data, timeoutMs = 10000) {
+            return new Promise((resolve, reject) => {
+                const id = nextId++;
+                const timer = setTimeout(() => { pending.delete(id); reject(new Error('timeout')); }, timeoutMs);
+                pending.set(id, { resolve, reject, timer });
+                send({ kind: 'request', id, type, data: data === undefined ? null : data });
+            });
+        },
+        emit(type, data) { send({ kind: 'event', type, data: data === undefined ? null : data }); }
+    });
+})();
+)";
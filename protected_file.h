@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <wincrypt.h>
+#endif
+
+// Encrypts `data` so only the current Windows user can read it back (DPAPI).
+// Other platforms have no equivalent here and store it as is.
+inline bool protect_for_user(const std::string& data, std::string& out) {
+#ifdef _WIN32
+    DATA_BLOB in = {(DWORD)data.size(), (BYTE*)data.data()};
+    DATA_BLOB blob = {};
+    if (!CryptProtectData(&in, L"MagicKeyRevC", nullptr, nullptr, nullptr, CRYPTPROTECT_UI_FORBIDDEN, &blob)) return false;
+    out.assign((const char*)blob.pbData, blob.cbData);
+    LocalFree(blob.pbData);
+#else
+    out = data;
+#endif
+    return true;
+}
+
+inline bool unprotect_for_user(const std::string& data, std::string& out) {
+#ifdef _WIN32
+    DATA_BLOB in = {(DWORD)data.size(), (BYTE*)data.data()};
+    DATA_BLOB blob = {};
+    if (!CryptUnprotectData(&in, nullptr, nullptr, nullptr, nullptr, CRYPTPROTECT_UI_FORBIDDEN, &blob)) return false;
+    out.assign((const char*)blob.pbData, blob.cbData);
+    LocalFree(blob.pbData);
+#else
+    out = data;
+#endif
+    return true;
+}
+
+// Reads a file written by write_protected(). False if it is missing,
+// damaged or belongs to another user.
+inline bool read_protected(const std::string& path, std::string& data) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    std::string blob((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    return unprotect_for_user(blob, data);
+}
+
+// Protects `data` for the current user and replaces `path` with it. Written
+// aside and renamed, so a crash never leaves half a file.
+inline bool write_protected(const std::string& path, const std::string& data) {
+    std::string blob;
+    if (!protect_for_user(data, blob)) return false;
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        if (!out.write(blob.data(), (std::streamsize)blob.size())) return false;
+    }
+#ifdef _WIN32
+    return MoveFileExA(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(temp.c_str(), path.c_str()) == 0;
+#endif
+}
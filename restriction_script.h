@@ -0,0 +1,150 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// JavaScript injected by RestrictWebView2() to block DevTools shortcuts, the
+// context menu, copy/paste and text selection.
+//
+// The script is composed from fixed pieces. RESTRICTION_SCRIPT<...> assembles
+// it at compile time as a UTF-16 literal for the Config::DISABLE_* constants;
+// build_restriction_script() produces the same text at runtime for builds
+// whose flags are not constant expressions.
+namespace RestrictionScript {
+    constexpr wchar_t HEADER[] = L"// WebView2 Security Restrictions\n";
+    constexpr wchar_t CONTEXT_MENU[] = L"document.addEventListener('contextmenu', event => event.preventDefault());\n";
+    // Opens the keydown listener; F12 and Ctrl+Shift+I are always blocked
+    constexpr wchar_t KEYDOWN_BEGIN[] = LR"(
+            // Disable F12 and Ctrl+Shift+I (DevTools)
+            document.addEventListener('keydown', function(e) {
+                if (e.keyCode === 123 || (e.ctrlKey && e.shiftKey && e.key.toLowerCase() === 'i')) {
+                    e.preventDefault();
+                }
+    )";
+    // Optional checks inside the keydown listener
+    constexpr wchar_t COPY_PASTE_KEYS[] = LR"(
+                // Disable Ctrl+C, Ctrl+V, Ctrl+X (Copy/Paste/Cut)
+                if ((e.ctrlKey && (e.key.toLowerCase() === 'c' || e.key.toLowerCase() === 'v' || e.key.toLowerCase() === 'x'))) {
+                    e.preventDefault();
+                }
+        )";
+    constexpr wchar_t SELECTION_KEYS[] = LR"(
+                // Disable text selection (mouse and keyboard)
+                if (e.key === "ArrowLeft" || e.key === "ArrowRight" || e.key === "ArrowUp" || e.key === "ArrowDown" || e.key.toLowerCase() == "a") {
+                    if (e.ctrlKey || e.shiftKey) e.preventDefault();
+                }
+        )";
+    constexpr wchar_t KEYDOWN_END[] = L"});\n";
+    // Appended after the keydown listener
+    constexpr wchar_t SELECTION_MOUSE[] = LR"(
+            // Disable selection by mouse
+            document.addEventListener('selectstart', function(e) { e.preventDefault(); });
+            // Additional CSS to block selection and highlight
+            const css = `
+                * {
+                    user-select: none !important;
+                    -webkit-user-select: none !important;
+                    -moz-user-select: none !important;
+                    -ms-user-select: none !important;
+                }
+                ::selection { background: transparent !important; }
+            `;
+            const style = document.createElement('style');
+            style.appendChild(document.createTextNode(css));
+            document.head.appendChild(style);
+        )";
+
+    template <size_t N>
+    constexpr size_t length(const wchar_t (&)[N]) { return N - 1; }
+}
+
+// Fixed-capacity, NUL-terminated wide string usable in constant expressions.
+template <size_t N>
+struct StaticWString {
+    wchar_t chars[N + 1] = {};
+
+    constexpr StaticWString() = default;
+    constexpr StaticWString(const wchar_t (&s)[N + 1]) {
+        for (size_t i = 0; i < N; ++i) chars[i] = s[i];
+    }
+
+    constexpr const wchar_t* c_str() const { return chars; }
+    static constexpr size_t size() { return N; }
+};
+
+template <size_t A, size_t B>
+constexpr StaticWString<A + B> operator+(const StaticWString<A>& a, const StaticWString<B>& b) {
+    StaticWString<A + B> out;
+    for (size_t i = 0; i < A; ++i) out.chars[i] = a.chars[i];
+    for (size_t i = 0; i < B; ++i) out.chars[A + i] = b.chars[i];
+    return out;
+}
+
+template <bool Enabled, size_t N>
+constexpr auto restriction_piece(const wchar_t (&s)[N]) {
+    if constexpr (Enabled) return StaticWString<N - 1>(s);
+    else return StaticWString<0>();
+}
+
+// An empty script means no restriction is enabled and nothing is injected.
+template <bool DisableContextMenu, bool DisableTextSelection, bool DisableCopyPaste>
+constexpr auto make_restriction_script() {
+    using namespace RestrictionScript;
+    if constexpr (!DisableContextMenu && !DisableTextSelection && !DisableCopyPaste) {
+        return StaticWString<0>();
+    } else {
+        return restriction_piece<true>(HEADER)
+            + restriction_piece<DisableContextMenu>(CONTEXT_MENU)
+            + restriction_piece<true>(KEYDOWN_BEGIN)
+            + restriction_piece<DisableCopyPaste>(COPY_PASTE_KEYS)
+            + restriction_piece<DisableTextSelection>(SELECTION_KEYS)
+            + restriction_piece<true>(KEYDOWN_END)
+            + restriction_piece<DisableTextSelection>(SELECTION_MOUSE);
+    }
+}
+
+template <bool DisableContextMenu, bool DisableTextSelection, bool DisableCopyPaste>
+inline constexpr auto RESTRICTION_SCRIPT =
+    make_restriction_script<DisableContextMenu, DisableTextSelection, DisableCopyPaste>();
+
+constexpr size_t restriction_script_length(bool disable_context_menu, bool disable_text_selection, bool disable_copy_paste) {
+    using namespace RestrictionScript;
+    if (!disable_context_menu && !disable_text_selection && !disable_copy_paste) return 0;
+    return length(HEADER)
+        + (disable_context_menu ? length(CONTEXT_MENU) : 0)
+        + length(KEYDOWN_BEGIN)
+        + (disable_copy_paste ? length(COPY_PASTE_KEYS) : 0)
+        + (disable_text_selection ? length(SELECTION_KEYS) : 0)
+        + length(KEYDOWN_END)
+        + (disable_text_selection ? length(SELECTION_MOUSE) : 0);
+}
+
+// Runtime counterpart of RESTRICTION_SCRIPT, with a single allocation.
+inline std::wstring build_restriction_script(bool disable_context_menu, bool disable_text_selection, bool disable_copy_paste) {
+    using namespace RestrictionScript;
+    std::wstring script;
+    if (!disable_context_menu && !disable_text_selection && !disable_copy_paste) return script;
+
+    script.reserve(restriction_script_length(disable_context_menu, disable_text_selection, disable_copy_paste));
+    script += HEADER;
+    if (disable_context_menu) script += CONTEXT_MENU;
+    script += KEYDOWN_BEGIN;
+    if (disable_copy_paste) script += COPY_PASTE_KEYS;
+    if (disable_text_selection) script += SELECTION_KEYS;
+    script += KEYDOWN_END;
+    if (disable_text_selection) script += SELECTION_MOUSE;
+    return script;
+}
+
+// Compile-time check of every flag combination against the runtime layout.
+#define RESTRICTION_SCRIPT_CHECK(a, b, c) \
+    static_assert(RESTRICTION_SCRIPT<a, b, c>.size() == restriction_script_length(a, b, c), \
+                  "restriction script pieces out of sync")
+RESTRICTION_SCRIPT_CHECK(false, false, false);
+RESTRICTION_SCRIPT_CHECK(false, false, true);
+RESTRICTION_SCRIPT_CHECK(false, true, false);
+RESTRICTION_SCRIPT_CHECK(false, true, true);
+RESTRICTION_SCRIPT_CHECK(true, false, false);
+RESTRICTION_SCRIPT_CHECK(true, false, true);
+RESTRICTION_SCRIPT_CHECK(true, true, false);
+RESTRICTION_SCRIPT_CHECK(true, true, true);
+#undef RESTRICTION_SCRIPT_CHECK
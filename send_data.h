@@ -1,12 +1,18 @@
 #pragma once
 #include <string>
+#include <vector>
 #include <windows.h>
 #include <wininet.h>
 #include "config.h"
+#include "endpoint_selector.h"
+#include "getipinfo.h"
 
 // Sends encrypted data via HTTP GET and returns server reply as string.
-// Returns true on success, false on failure.
-inline bool send_data(const std::string& encrypted_data, std::string& server_reply) {
+// Returns true on success, false on failure (a 429 or 503 is one; `status`,
+// if given, says how long the backend wants to be left alone). `base_url` is
+// one mirror of BACKEND_URL; "" = the first one listed.
+inline bool send_data(const std::string& encrypted_data, std::string& server_reply, ReplyStatus* status = nullptr,
+                      const std::string& base_url = "") {
     server_reply.clear();
 
     // Configuration must be loaded - no fallback to production URLs for security
@@ -15,8 +21,20 @@ inline bool send_data(const std::string& encrypted_data, std::string& server_rep
         return false;
     }
 
-    std::string base_url = g_config->get_backend_url();
-    std::string url = base_url + "?message=" + encrypted_data;
+    std::string url = (base_url.empty() ? first_endpoint(g_config->get_backend_url()) : base_url) + "?message=" + encrypted_data;
+
+    // A registration is not idempotent, so it never goes in TLS early data
+    if (HttpsClient* client = portable_http_client()) {
+        HttpsRequest request;
+        request.url = url;
+        HttpsResponse response = client->fetch(request);
+        ReplyStatus reply_status;
+        note_portable_reply(url, response, &reply_status);
+        if (status) *status = reply_status;
+        server_reply = response.body;
+        if (reply_status.status == 429 || reply_status.status == 503) return false;
+        return !server_reply.empty();
+    }
 
     std::string user_agent = g_config->get_user_agent();
     
@@ -35,6 +53,9 @@ inline bool send_data(const std::string& encrypted_data, std::string& server_rep
         return false;
     }
 
+    ReplyStatus reply_status = reply_status_of(hConnect);
+    if (status) *status = reply_status;
+
     // Read the server reply
     char buffer[4096];
     DWORD bytes_read = 0;
@@ -47,5 +68,62 @@ inline bool send_data(const std::string& encrypted_data, std::string& server_rep
     InternetCloseHandle(hInternet);
 
     server_reply = reply;
+    if (reply_status.status == 429 || reply_status.status == 503) return false;
     return !server_reply.empty();
-}
\ No newline at end of file
+}
+
+// POSTs several encrypted messages, one per line, to BACKEND_BATCH_URL in a
+// single request; the reply is {"results": [...]} with one entry per message.
+// Returns false if the backend was not reached or did not answer 200.
+// `batch_url` is one mirror of BACKEND_BATCH_URL; "" = the first one listed.
+inline bool send_batch(const std::vector<std::string>& messages, std::string& server_reply, ReplyStatus* status = nullptr,
+                       const std::string& batch_url = "") {
+    server_reply.clear();
+    if (!g_config || g_config->get_backend_batch_url().empty()) return false;
+
+    std::string url = batch_url.empty() ? first_endpoint(g_config->get_backend_batch_url()) : batch_url;
+    std::string body;
+    for (const auto& m : messages) body += m + "\n";
+
+    if (HttpsClient* client = portable_http_client()) {
+        HttpsResponse response = client->post(url, body, "text/plain");
+        ReplyStatus reply_status;
+        note_portable_reply(url, response, &reply_status);
+        if (status) *status = reply_status;
+        server_reply = response.body;
+        return reply_status.status == 200 && !server_reply.empty();
+    }
+
+    char host[256] = {}, path[2048] = {};
+    URL_COMPONENTSA parts = {};
+    parts.dwStructSize = sizeof(parts);
+    parts.lpszHostName = host;
+    parts.dwHostNameLength = sizeof(host);
+    parts.lpszUrlPath = path;
+    parts.dwUrlPathLength = sizeof(path);
+    if (!InternetCrackUrlA(url.c_str(), 0, 0, &parts)) return false;
+
+    std::string user_agent = g_config->get_user_agent();
+    HINTERNET hInternet = InternetOpenA(user_agent.c_str(), INTERNET_OPEN_TYPE_PRECONFIG, NULL, NULL, 0);
+    if (!hInternet) return false;
+    HINTERNET hConnect = InternetConnectA(hInternet, host, parts.nPort, NULL, NULL, INTERNET_SERVICE_HTTP, 0, 0);
+    DWORD flags = INTERNET_FLAG_RELOAD | INTERNET_FLAG_NO_CACHE_WRITE;
+    if (parts.nScheme == INTERNET_SCHEME_HTTPS) flags |= INTERNET_FLAG_SECURE;
+    HINTERNET hRequest = hConnect ? HttpOpenRequestA(hConnect, "POST", path, NULL, NULL, NULL, flags, 0) : NULL;
+    const char headers[] = "Content-Type: text/plain\r\n";
+    bool sent = hRequest && HttpSendRequestA(hRequest, headers, (DWORD)(sizeof(headers) - 1), (LPVOID)body.data(), (DWORD)body.size());
+
+    ReplyStatus reply_status;
+    if (sent) reply_status = reply_status_of(hRequest);
+    if (status) *status = reply_status;
+    char buffer[4096];
+    DWORD bytes_read = 0;
+    while (sent && InternetReadFile(hRequest, buffer, sizeof(buffer), &bytes_read) && bytes_read != 0) {
+        server_reply.append(buffer, bytes_read);
+    }
+
+    if (hRequest) InternetCloseHandle(hRequest);
+    if (hConnect) InternetCloseHandle(hConnect);
+    InternetCloseHandle(hInternet);
+    return sent && reply_status.status == 200 && !server_reply.empty();
+}
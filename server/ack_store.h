@@ -0,0 +1,49 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "../json.hpp"
+
+// Registrations the backend has acknowledged, by payload_hash(), so clients
+// can send deltas against them (see delta_payload.h). Bounded: the oldest
+// entries go first, and a client whose base was evicted is simply asked for
+// the full registration. Thread-safe.
+class AckStore {
+public:
+    explicit AckStore(size_t capacity) : capacity_(capacity ? capacity : 1) {}
+
+    void put(const std::string& hash, const nlohmann::json& registration) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(hash);
+        if (it != entries_.end()) {
+            it->second = registration;
+            return;
+        }
+        entries_.emplace(hash, registration);
+        order_.push_back(hash);
+        while (entries_.size() > capacity_) {
+            entries_.erase(order_.front());
+            order_.pop_front();
+        }
+    }
+
+    bool get(const std::string& hash, nlohmann::json& registration) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(hash);
+        if (it == entries_.end()) return false;
+        registration = it->second;
+        return true;
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.size();
+    }
+
+private:
+    size_t capacity_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, nlohmann::json> entries_;
+    std::deque<std::string> order_;
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include <algorithm>
+#include <mutex>
+
+// Server-driven admission: registrations are taken at up to `rate_per_s`
+// (a token bucket `burst` deep). A request over the rate is not simply
+// refused; it is given the next free slot after those already handed out
+// and told how long to wait for it (Retry-After and "retry_after"), so a
+// fleet that powers on together comes back spread out at the rate instead
+// of all at once again. Thread-safe; times are seconds on any clock.
+class AdmissionGate {
+public:
+    AdmissionGate(double rate_per_s = 0, double burst = 0) { configure(rate_per_s, burst); }
+
+    // A rate of 0 admits everything
+    void configure(double rate_per_s, double burst) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rate_ = std::max(0.0, rate_per_s);
+        burst_ = std::max(1.0, burst);
+        tokens_ = burst_;
+        last_s_ = next_slot_s_ = -1;
+    }
+
+    bool enabled() const { return rate_ > 0; }
+
+    // Admits a request costing `cost` registrations (a batch costs one per
+    // message and may take the bucket below zero); otherwise false, with
+    // the seconds until its slot in `retry_after_s`
+    bool admit(double now_s, double cost, double& retry_after_s) {
+        retry_after_s = 0;
+        if (rate_ <= 0) return true;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (last_s_ >= 0) tokens_ = std::min(burst_, tokens_ + (now_s - last_s_) * rate_);
+        last_s_ = now_s;
+        if (tokens_ >= 1) {
+            tokens_ -= cost;
+            return true;
+        }
+        // The bucket refills to one token by `ready`; slots are handed out after that, 1/rate apart
+        double ready = now_s + (1 - tokens_) / rate_;
+        double slot = std::max(ready, next_slot_s_);
+        next_slot_s_ = slot + 1 / rate_;
+        retry_after_s = slot - now_s;
+        return false;
+    }
+
+private:
+    std::mutex mutex_;
+    double rate_ = 0, burst_ = 1;
+    double tokens_ = 1;
+    double last_s_ = -1;       // last refill
+    double next_slot_s_ = -1;  // first slot not handed out yet
+};
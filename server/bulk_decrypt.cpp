@@ -0,0 +1,183 @@
+// Offline decryptor/verifier for archived registration messages (Linux only).
+//
+// Reads one base64url message per line from a file (memory-mapped) or from
+// stdin, decrypts them on all cores and writes the payload JSON as
+// newline-delimited output in input order.
+//
+// Build: see BUILD.md ("Reference backend").
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bulk_decrypt.h"
+
+namespace {
+
+struct CliOptions {
+    std::string private_key_file = "private_key.pem";
+    std::string input = "-";
+    std::string output = "-";
+    std::string errors;
+    size_t window_bytes = 256u * 1024 * 1024;
+    BulkDecryptOptions decrypt;
+};
+
+void print_usage() {
+    std::cout << "Usage: bulk_decrypt [options] <input|->\n"
+              << "  --key <file>        RSA private key (PEM), default private_key.pem\n"
+              << "  -o <file>           NDJSON output, default stdout\n"
+              << "  --errors <file>     write {\"offset\",\"error\"} records for rejected lines\n"
+              << "  --threads <n>       worker threads, default = hardware threads\n"
+              << "  --chunk-mb <n>      work unit size, default 8\n"
+              << "  --window-mb <n>     read window for stdin input, default 256\n"
+              << "  --verify            parse and schema-check every payload\n";
+}
+
+bool parse_options(int argc, char** argv, CliOptions& opts) {
+    bool have_input = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&](std::string& out) {
+            if (i + 1 >= argc) return false;
+            out = argv[++i];
+            return true;
+        };
+        std::string value;
+        if (arg == "--key" && next(value)) opts.private_key_file = value;
+        else if (arg == "-o" && next(value)) opts.output = value;
+        else if (arg == "--errors" && next(value)) opts.errors = value;
+        else if (arg == "--threads" && next(value)) opts.decrypt.threads = (unsigned)std::atoi(value.c_str());
+        else if (arg == "--chunk-mb" && next(value)) opts.decrypt.chunk_bytes = (size_t)std::atoi(value.c_str()) << 20;
+        else if (arg == "--window-mb" && next(value)) opts.window_bytes = (size_t)std::atoi(value.c_str()) << 20;
+        else if (arg == "--verify") opts.decrypt.verify = true;
+        else if (!have_input && (arg == "-" || arg[0] != '-')) { opts.input = arg; have_input = true; }
+        else return false;
+    }
+    return have_input && opts.window_bytes > 0;
+}
+
+int open_output(const std::string& path) {
+    if (path == "-") return STDOUT_FILENO;
+    return open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+}
+
+void write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t w = write(fd, data, len);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Write failed: " << strerror(errno) << std::endl;
+            exit(1);
+        }
+        data += w;
+        len -= (size_t)w;
+    }
+}
+
+// Streams input through one reusable window; a trailing partial line is moved
+// to the front of the window before the next read.
+bool process_stream(int fd, size_t window_bytes, BulkDecryptor& decryptor) {
+    std::vector<char> window(window_bytes);
+    size_t filled = 0;
+    uint64_t base = 0;
+    bool eof = false;
+    while (!eof) {
+        ssize_t r = read(fd, window.data() + filled, window.size() - filled);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        if (r == 0) eof = true;
+        filled += (size_t)r;
+        if (!eof && filled < window.size()) continue;
+
+        size_t usable = filled;
+        if (!eof) {
+            const char* p = window.data() + filled;
+            while (p > window.data() && p[-1] != '\n') --p;
+            usable = (size_t)(p - window.data());
+            if (usable == 0) {
+                std::cerr << "Record longer than the read window" << std::endl;
+                return false;
+            }
+        }
+        decryptor.process(window.data(), usable, base);
+        base += usable;
+        memmove(window.data(), window.data() + usable, filled - usable);
+        filled -= usable;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    CliOptions opts;
+    if (!parse_options(argc, argv, opts)) {
+        print_usage();
+        return 1;
+    }
+
+    EVP_PKEY* key = load_private_key(opts.private_key_file);
+    if (!key) {
+        std::cerr << "Failed to load private key from " << opts.private_key_file << std::endl;
+        return 1;
+    }
+
+    int out_fd = open_output(opts.output);
+    int err_fd = opts.errors.empty() ? -1 : open_output(opts.errors);
+    if (out_fd < 0 || (!opts.errors.empty() && err_fd < 0)) {
+        std::cerr << "Failed to open output file" << std::endl;
+        return 1;
+    }
+
+    BulkSink errors = nullptr;
+    if (err_fd >= 0) errors = [err_fd](const char* d, size_t n) { write_all(err_fd, d, n); };
+    BulkDecryptor decryptor(key, opts.decrypt,
+        [out_fd](const char* d, size_t n) { write_all(out_fd, d, n); }, errors);
+    EVP_PKEY_free(key);
+    if (!decryptor.valid()) {
+        std::cerr << "Private key is not usable for RSA-OAEP-SHA256" << std::endl;
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    int in_fd = opts.input == "-" ? STDIN_FILENO : open(opts.input.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in_fd < 0) {
+        std::cerr << "Failed to open " << opts.input << std::endl;
+        return 1;
+    }
+
+    struct stat st = {};
+    bool mapped = false;
+    if (fstat(in_fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* data = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, in_fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+            decryptor.process((const char*)data, (size_t)st.st_size, 0);
+            munmap(data, (size_t)st.st_size);
+            mapped = true;
+        }
+    }
+    if (!mapped && !process_stream(in_fd, opts.window_bytes, decryptor)) {
+        std::cerr << "Failed to read " << opts.input << std::endl;
+        return 1;
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const BulkDecryptStats& stats = decryptor.stats();
+    std::cerr << stats.records << " records, " << stats.decoded << " decoded, " << stats.failed
+              << " failed in " << seconds << "s (" << (uint64_t)(stats.records / (seconds > 0 ? seconds : 1))
+              << " records/s)" << std::endl;
+
+    if (out_fd != STDOUT_FILENO) close(out_fd);
+    if (err_fd >= 0) close(err_fd);
+    return stats.failed == 0 ? 0 : 2;
+}
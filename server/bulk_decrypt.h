@@ -0,0 +1,204 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <cstring>
+#include <cstdint>
+#include "../json.hpp"
+#include "rsa_decrypt.h"
+#include "registration_schema.h"
+
+// Parallel decryptor for archives of client registration messages: one
+// base64url message (as produced by encrypt_data_from_key_string()) per line.
+//
+// Input is split into newline-aligned chunks that worker threads claim in
+// order. Each worker owns its OpenSSL context and scratch buffers, and writes
+// into one of a fixed ring of output slots, so steady-state processing does no
+// per-record allocation. Slots are handed to the sinks strictly in input order.
+
+struct BulkDecryptOptions {
+    unsigned threads = std::thread::hardware_concurrency();
+    size_t chunk_bytes = 8 * 1024 * 1024;
+    bool verify = false;           // parse and schema-check every payload
+};
+
+struct BulkDecryptStats {
+    uint64_t records = 0;
+    uint64_t decoded = 0;
+    uint64_t failed = 0;
+};
+
+// Receives output in input order; called from one thread at a time.
+using BulkSink = std::function<void(const char* data, size_t len)>;
+
+class BulkDecryptor {
+public:
+    BulkDecryptor(EVP_PKEY* key, const BulkDecryptOptions& opts, BulkSink out, BulkSink errors = nullptr)
+        : opts_(opts), out_(std::move(out)), errors_(std::move(errors)) {
+        if (opts_.threads == 0) opts_.threads = 1;
+        if (opts_.chunk_bytes < 4096) opts_.chunk_bytes = 4096;
+        for (unsigned i = 0; i < opts_.threads; ++i) workers_.emplace_back(new Worker(key));
+        slots_.resize(opts_.threads * 2);
+    }
+
+    bool valid() const { return workers_[0]->decryptor.valid(); }
+
+    const BulkDecryptStats& stats() const { return stats_; }
+
+    // Processes a region that ends on a record boundary (or at end of input).
+    // `base_offset` is the region's position in the whole input and is only
+    // used for error reports.
+    void process(const char* data, size_t len, uint64_t base_offset) {
+        chunks_.clear();
+        size_t pos = 0;
+        while (pos < len) {
+            size_t end = pos + opts_.chunk_bytes;
+            if (end >= len) {
+                end = len;
+            } else {
+                const void* nl = memchr(data + end, '\n', len - end);
+                end = nl ? (size_t)((const char*)nl - data) + 1 : len;
+            }
+            chunks_.push_back({pos, end});
+            pos = end;
+        }
+
+        data_ = data;
+        base_offset_ = base_offset;
+        next_chunk_ = 0;
+        next_flush_ = 0;
+        for (auto& s : slots_) s.ready = false;
+
+        std::vector<std::thread> threads;
+        for (unsigned t = 1; t < workers_.size(); ++t) threads.emplace_back([this, t] { run(*workers_[t]); });
+        run(*workers_[0]);
+        for (auto& th : threads) th.join();
+
+        for (auto& w : workers_) {
+            stats_.records += w->stats.records;
+            stats_.decoded += w->stats.decoded;
+            stats_.failed += w->stats.failed;
+            w->stats = BulkDecryptStats();
+        }
+    }
+
+private:
+    struct Worker {
+        explicit Worker(EVP_PKEY* key) : decryptor(key) {}
+        DecryptContext decryptor;
+        std::vector<unsigned char> ciphertext;
+        std::string plaintext;
+        BulkDecryptStats stats;
+    };
+
+    struct Slot {
+        std::string out;
+        std::string errors;
+        bool ready = false;
+    };
+
+    struct Chunk {
+        size_t begin;
+        size_t end;
+    };
+
+    void run(Worker& w) {
+        while (true) {
+            size_t index = next_chunk_.fetch_add(1);
+            if (index >= chunks_.size()) return;
+
+            Slot* slot;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                slot_free_.wait(lock, [&] { return index < next_flush_ + slots_.size(); });
+                slot = &slots_[index % slots_.size()];
+            }
+            slot->out.clear();
+            slot->errors.clear();
+            decode_chunk(w, chunks_[index], *slot);
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            slot->ready = true;
+            while (next_flush_ < chunks_.size()) {
+                Slot& head = slots_[next_flush_ % slots_.size()];
+                if (!head.ready) break;
+                if (!head.out.empty()) out_(head.out.data(), head.out.size());
+                if (errors_ && !head.errors.empty()) errors_(head.errors.data(), head.errors.size());
+                head.ready = false;
+                ++next_flush_;
+            }
+            slot_free_.notify_all();
+        }
+    }
+
+    void decode_chunk(Worker& w, const Chunk& chunk, Slot& slot) {
+        size_t pos = chunk.begin;
+        while (pos < chunk.end) {
+            const char* line = data_ + pos;
+            const void* nl = memchr(line, '\n', chunk.end - pos);
+            size_t line_len = nl ? (size_t)((const char*)nl - line) : chunk.end - pos;
+            uint64_t offset = base_offset_ + pos;
+            pos += line_len + (nl ? 1 : 0);
+
+            while (line_len > 0 && (line[line_len - 1] == '\r' || line[line_len - 1] == ' ')) --line_len;
+            if (line_len > 8 && memcmp(line, "message=", 8) == 0) {
+                line += 8;
+                line_len -= 8;
+            }
+            if (line_len == 0) continue;
+
+            ++w.stats.records;
+            if (!w.decryptor.decrypt_message(line, line_len, w.ciphertext, w.plaintext)) {
+                fail(w, slot, offset, "decryption failed");
+                continue;
+            }
+            if (opts_.verify) {
+                nlohmann::json payload = nlohmann::json::parse(w.plaintext, nullptr, false);
+                if (payload.is_discarded()) {
+                    fail(w, slot, offset, "payload is not JSON");
+                    continue;
+                }
+                std::string problem = validate_registration_message(payload);
+                if (!problem.empty()) {
+                    fail(w, slot, offset, problem.c_str());
+                    continue;
+                }
+            } else if (w.plaintext.find('\n') != std::string::npos) {
+                fail(w, slot, offset, "payload contains a newline");
+                continue;
+            }
+            ++w.stats.decoded;
+            slot.out += w.plaintext;
+            slot.out += '\n';
+        }
+    }
+
+    void fail(Worker& w, Slot& slot, uint64_t offset, const char* reason) {
+        ++w.stats.failed;
+        if (!errors_) return;
+        slot.errors += "{\"offset\":";
+        slot.errors += std::to_string(offset);
+        slot.errors += ",\"error\":\"";
+        slot.errors += reason;
+        slot.errors += "\"}\n";
+    }
+
+    BulkDecryptOptions opts_;
+    BulkSink out_;
+    BulkSink errors_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<Slot> slots_;
+    std::vector<Chunk> chunks_;
+    const char* data_ = nullptr;
+    uint64_t base_offset_ = 0;
+    std::atomic<size_t> next_chunk_{0};
+    size_t next_flush_ = 0;
+    std::mutex mutex_;
+    std::condition_variable slot_free_;
+    BulkDecryptStats stats_;
+};
@@ -0,0 +1,392 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+// Minimal HTTP/1.1 server for the reference backend (Linux only).
+// Every worker thread owns an SO_REUSEPORT listener and an epoll loop, so the
+// kernel spreads connections across workers and handlers never share state
+// unless they choose to.
+
+struct HttpRequest {
+    std::string method;
+    std::string path;
+    std::string query;
+    std::string body;
+    bool keep_alive = true;
+};
+
+struct HttpResponse {
+    int status = 200;
+    std::string content_type = "application/json";
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+};
+
+// Handler runs on worker thread `worker` (0 .. thread_count()-1).
+using HttpHandler = std::function<void(const HttpRequest&, HttpResponse&, unsigned worker)>;
+
+inline std::string url_decode(const char* s, size_t len) {
+    std::string out;
+    out.reserve(len);
+    for (size_t i = 0; i < len; ++i) {
+        char c = s[i];
+        if (c == '%' && i + 2 < len) {
+            auto hex = [](char h) -> int {
+                if (h >= '0' && h <= '9') return h - '0';
+                if (h >= 'a' && h <= 'f') return h - 'a' + 10;
+                if (h >= 'A' && h <= 'F') return h - 'A' + 10;
+                return -1;
+            };
+            int hi = hex(s[i + 1]), lo = hex(s[i + 2]);
+            if (hi >= 0 && lo >= 0) {
+                out.push_back((char)(hi * 16 + lo));
+                i += 2;
+                continue;
+            }
+        }
+        out.push_back(c);
+    }
+    return out;
+}
+
+// Returns the decoded value of `name` in a query or form string. '+' is kept
+// literally because the client's URL-safe base64 never encodes spaces.
+inline bool query_param(const std::string& query, const std::string& name, std::string& value) {
+    size_t pos = 0;
+    while (pos <= query.size()) {
+        size_t end = query.find('&', pos);
+        if (end == std::string::npos) end = query.size();
+        size_t eq = query.find('=', pos);
+        if (eq != std::string::npos && eq < end && eq - pos == name.size() &&
+            query.compare(pos, name.size(), name) == 0) {
+            value = url_decode(query.data() + eq + 1, end - eq - 1);
+            return true;
+        }
+        pos = end + 1;
+    }
+    return false;
+}
+
+inline const char* http_status_text(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 202: return "Accepted";
+        case 400: return "Bad Request";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 429: return "Too Many Requests";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default: return "Unknown";
+    }
+}
+
+class HttpServer {
+public:
+    static const size_t MAX_HEADER_BYTES = 16 * 1024;
+    static const size_t MAX_BODY_BYTES = 8 * 1024 * 1024;
+
+    HttpServer(const std::string& bind_address, uint16_t port, unsigned threads, HttpHandler handler)
+        : bind_address_(bind_address), port_(port), handler_(std::move(handler)) {
+        if (threads == 0) threads = 1;
+        workers_.reserve(threads);
+        for (unsigned i = 0; i < threads; ++i) workers_.emplace_back(new Worker());
+    }
+
+    ~HttpServer() { stop(); }
+
+    unsigned thread_count() const { return (unsigned)workers_.size(); }
+
+    uint64_t requests_served(unsigned worker) const {
+        return workers_[worker]->requests.load(std::memory_order_relaxed);
+    }
+
+    bool start() {
+        for (unsigned i = 0; i < workers_.size(); ++i) {
+            Worker& w = *workers_[i];
+            w.listen_fd = open_listener();
+            if (w.listen_fd < 0) { stop(); return false; }
+            w.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            if (w.epoll_fd < 0) { stop(); return false; }
+            epoll_event ev = {};
+            ev.events = EPOLLIN;
+            ev.data.fd = w.listen_fd;
+            epoll_ctl(w.epoll_fd, EPOLL_CTL_ADD, w.listen_fd, &ev);
+        }
+        running_ = true;
+        for (unsigned i = 0; i < workers_.size(); ++i) {
+            workers_[i]->thread = std::thread([this, i] { run_worker(i); });
+        }
+        return true;
+    }
+
+    void stop() {
+        running_ = false;
+        for (auto& w : workers_) {
+            if (w->thread.joinable()) w->thread.join();
+            for (auto& c : w->connections) close(c.first);
+            w->connections.clear();
+            if (w->listen_fd >= 0) { close(w->listen_fd); w->listen_fd = -1; }
+            if (w->epoll_fd >= 0) { close(w->epoll_fd); w->epoll_fd = -1; }
+        }
+    }
+
+private:
+    struct Connection {
+        std::string in;
+        std::string out;
+        size_t out_offset = 0;
+        bool close_after_write = false;
+        bool want_write = false;
+        bool read_closed = false;  // the client half-closed: answer what came, then close
+    };
+
+    struct alignas(64) Worker {
+        int listen_fd = -1;
+        int epoll_fd = -1;
+        std::thread thread;
+        std::unordered_map<int, Connection> connections;
+        std::atomic<uint64_t> requests{0};
+    };
+
+    int open_listener() {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port_);
+        if (inet_pton(AF_INET, bind_address_.c_str(), &addr.sin_addr) != 1 ||
+            bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 ||
+            listen(fd, 1024) < 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    void run_worker(unsigned index) {
+        Worker& w = *workers_[index];
+        epoll_event events[256];
+        while (running_) {
+            int n = epoll_wait(w.epoll_fd, events, 256, 200);
+            for (int i = 0; i < n; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == w.listen_fd) {
+                    accept_all(w);
+                    continue;
+                }
+                auto it = w.connections.find(fd);
+                if (it == w.connections.end()) continue;
+                bool keep = true;
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) keep = false;
+                if (keep && (events[i].events & EPOLLIN)) keep = on_readable(w, index, fd, it->second);
+                if (keep && (events[i].events & EPOLLOUT)) keep = flush(w, fd, it->second);
+                if (!keep) close_connection(w, fd);
+            }
+        }
+    }
+
+    void accept_all(Worker& w) {
+        while (true) {
+            int fd = accept4(w.listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return;
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            epoll_event ev = {};
+            ev.events = EPOLLIN | EPOLLRDHUP;
+            ev.data.fd = fd;
+            if (epoll_ctl(w.epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                close(fd);
+                continue;
+            }
+            w.connections.emplace(fd, Connection());
+        }
+    }
+
+    void close_connection(Worker& w, int fd) {
+        epoll_ctl(w.epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        w.connections.erase(fd);
+    }
+
+    bool on_readable(Worker& w, unsigned index, int fd, Connection& c) {
+        char buf[16 * 1024];
+        while (true) {
+            ssize_t r = read(fd, buf, sizeof(buf));
+            if (r > 0) {
+                c.in.append(buf, (size_t)r);
+                continue;
+            }
+            if (r == 0) {
+                c.read_closed = true;
+                break;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == EINTR) continue;
+            return false;
+        }
+
+        // Handle every complete (possibly pipelined) request in the buffer.
+        size_t consumed = 0;
+        while (!c.close_after_write) {
+            HttpRequest req;
+            int status = 0;
+            size_t used = parse_request(c.in, consumed, req, status);
+            if (used == 0) {
+                if (status == 0) break;
+                HttpResponse err;
+                err.status = status;
+                err.body = "{\"error\":\"malformed request\"}";
+                append_response(c, err, false);
+                c.close_after_write = true;
+                break;
+            }
+            consumed += used;
+
+            HttpResponse resp;
+            handler_(req, resp, index);
+            bool keep_alive = req.keep_alive && !c.read_closed;
+            append_response(c, resp, keep_alive);
+            if (!keep_alive) c.close_after_write = true;
+            w.requests.fetch_add(1, std::memory_order_relaxed);
+        }
+        c.in.erase(0, consumed);
+        if (!c.read_closed) return flush(w, fd, c);
+        // Nothing more will arrive; a partial request is dropped
+        c.close_after_write = true;
+        if (c.out_offset == c.out.size()) return false;
+        bool keep = flush(w, fd, c);
+        // Still writing: wait for EPOLLOUT only, as EPOLLIN would fire at EOF on every wait
+        if (keep) set_write_interest(w, fd, c, true);
+        return keep;
+    }
+
+    // Returns bytes used by one complete request starting at `offset`, or 0 if
+    // more data is needed (status 0) or the request is invalid (status set).
+    static size_t parse_request(const std::string& buf, size_t offset, HttpRequest& req, int& status) {
+        size_t header_end = buf.find("\r\n\r\n", offset);
+        if (header_end == std::string::npos) {
+            if (buf.size() - offset > MAX_HEADER_BYTES) status = 400;
+            return 0;
+        }
+
+        size_t line_end = buf.find("\r\n", offset);
+        size_t sp1 = buf.find(' ', offset);
+        size_t sp2 = sp1 == std::string::npos ? sp1 : buf.find(' ', sp1 + 1);
+        if (sp1 == std::string::npos || sp2 == std::string::npos || sp2 > line_end) {
+            status = 400;
+            return 0;
+        }
+        req.method.assign(buf, offset, sp1 - offset);
+        std::string target(buf, sp1 + 1, sp2 - sp1 - 1);
+        size_t q = target.find('?');
+        req.path = target.substr(0, q);
+        req.query = q == std::string::npos ? "" : target.substr(q + 1);
+        bool http10 = buf.compare(sp2 + 1, 8, "HTTP/1.0") == 0;
+        req.keep_alive = !http10;
+
+        size_t content_length = 0;
+        size_t pos = line_end + 2;
+        while (pos < header_end) {
+            size_t eol = buf.find("\r\n", pos);
+            size_t colon = buf.find(':', pos);
+            if (colon != std::string::npos && colon < eol) {
+                std::string name(buf, pos, colon - pos);
+                size_t vstart = colon + 1;
+                while (vstart < eol && buf[vstart] == ' ') ++vstart;
+                std::string value(buf, vstart, eol - vstart);
+                for (auto& ch : name) ch = (char)tolower((unsigned char)ch);
+                for (auto& ch : value) ch = (char)tolower((unsigned char)ch);
+                if (name == "content-length") {
+                    content_length = strtoull(value.c_str(), nullptr, 10);
+                    if (content_length > MAX_BODY_BYTES) {
+                        status = 413;
+                        return 0;
+                    }
+                } else if (name == "connection") {
+                    if (value == "close") req.keep_alive = false;
+                    else if (value == "keep-alive") req.keep_alive = true;
+                }
+            }
+            pos = eol + 2;
+        }
+
+        size_t body_start = header_end + 4;
+        if (buf.size() - body_start < content_length) return 0;
+        req.body.assign(buf, body_start, content_length);
+        return body_start + content_length - offset;
+    }
+
+    static void append_response(Connection& c, const HttpResponse& resp, bool keep_alive) {
+        c.out += "HTTP/1.1 ";
+        c.out += std::to_string(resp.status);
+        c.out += ' ';
+        c.out += http_status_text(resp.status);
+        c.out += "\r\nContent-Type: ";
+        c.out += resp.content_type;
+        c.out += "\r\nContent-Length: ";
+        c.out += std::to_string(resp.body.size());
+        for (const auto& h : resp.headers) {
+            c.out += "\r\n";
+            c.out += h.first;
+            c.out += ": ";
+            c.out += h.second;
+        }
+        c.out += keep_alive ? "\r\nConnection: keep-alive\r\n\r\n" : "\r\nConnection: close\r\n\r\n";
+        c.out += resp.body;
+    }
+
+    bool flush(Worker& w, int fd, Connection& c) {
+        while (c.out_offset < c.out.size()) {
+            ssize_t r = write(fd, c.out.data() + c.out_offset, c.out.size() - c.out_offset);
+            if (r > 0) {
+                c.out_offset += (size_t)r;
+                continue;
+            }
+            if (r < 0 && errno == EINTR) continue;
+            if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if (!c.want_write) set_write_interest(w, fd, c, true);
+                return true;
+            }
+            return false;
+        }
+        c.out.clear();
+        c.out_offset = 0;
+        if (c.want_write) set_write_interest(w, fd, c, false);
+        return !c.close_after_write;
+    }
+
+    static void set_write_interest(Worker& w, int fd, Connection& c, bool enable) {
+        epoll_event ev = {};
+        ev.events = (c.read_closed ? 0u : (uint32_t)(EPOLLIN | EPOLLRDHUP)) | (enable ? (uint32_t)EPOLLOUT : 0u);
+        ev.data.fd = fd;
+        epoll_ctl(w.epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+        c.want_write = enable;
+    }
+
+    std::string bind_address_;
+    uint16_t port_;
+    HttpHandler handler_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<bool> running_{false};
+};
@@ -0,0 +1,313 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <openssl/core_names.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+// Self-verifying randkeys: the backend mints them, and anything holding the
+// key (the login page's server) can check them without a database.
+//
+//   base64url( version | key id | nonce[12] | expires_at (u32, unix s) |
+//              fpkey (u64) | HMAC-SHA256(key, all of the above)[0..15] )
+//
+// 42 bytes, 56 URL-safe characters. `fpkey` is the machine's canonical key
+// (canonical_fingerprint.h; already a one-way digest), so a verifier that
+// knows which machine is asking can refuse a token minted for another one.
+// The nonce doubles as the token's id for revocation (RevocationSet).
+//
+// Keys are shared read-only (RandkeyKeys); minting and verifying go through
+// a RandkeyContext per worker thread, which holds the keyed MAC contexts and
+// a buffer of CSPRNG output (RAND_bytes in 4 KB refills), and is never shared.
+
+struct RandkeyId {
+    std::array<unsigned char, 12> bytes{};
+    bool operator==(const RandkeyId& other) const { return bytes == other.bytes; }
+};
+
+struct RandkeyIdHash {
+    size_t operator()(const RandkeyId& id) const {
+        uint64_t h;
+        memcpy(&h, id.bytes.data(), sizeof(h));  // random already
+        return (size_t)h;
+    }
+};
+
+struct RandkeyClaims {
+    uint8_t key_id = 0;
+    RandkeyId id;
+    uint64_t expires_at = 0;
+    uint64_t fpkey = 0;
+};
+
+enum class RandkeyStatus { Valid, Malformed, UnknownKey, BadSignature, Expired, WrongMachine, Revoked };
+
+inline const char* randkey_status_name(RandkeyStatus status) {
+    switch (status) {
+        case RandkeyStatus::Valid: return "valid";
+        case RandkeyStatus::Malformed: return "malformed";
+        case RandkeyStatus::UnknownKey: return "unknown key";
+        case RandkeyStatus::BadSignature: return "bad signature";
+        case RandkeyStatus::Expired: return "expired";
+        case RandkeyStatus::WrongMachine: return "wrong machine";
+        case RandkeyStatus::Revoked: return "revoked";
+    }
+    return "?";
+}
+
+// Tokens revoked (or, when single-use, consumed) before their expiry, kept
+// only until they would have expired anyway. Expiry runs on a timer wheel of
+// one-second slots, so advance() touches only the slots that came due; call
+// it about once a second. Thread-safe.
+class RevocationSet {
+public:
+    explicit RevocationSet(size_t slots = 4096) {
+        size_t n = 1;
+        while (n < slots) n *= 2;
+        wheel_.resize(n);
+    }
+
+    // False if `id` was already in the set or its token has expired
+    bool revoke(const RandkeyId& id, uint64_t expires_at, uint64_t now) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (expires_at <= now) return false;
+        if (!ids_.emplace(id, expires_at).second) return false;
+        wheel_[expires_at & (wheel_.size() - 1)].push_back(id);
+        if (last_ == 0) last_ = now;
+        return true;
+    }
+
+    bool revoked(const RandkeyId& id) const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        return ids_.count(id) != 0;
+    }
+
+    // Drops entries whose tokens have expired by `now`
+    void advance(uint64_t now) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (last_ == 0 || now <= last_) {
+            if (last_ == 0) last_ = now;
+            return;
+        }
+        // A jump of a whole turn or more visits every slot once
+        uint64_t from = now - last_ >= wheel_.size() ? now - wheel_.size() + 1 : last_ + 1;
+        for (uint64_t t = from; t <= now; ++t) {
+            auto& slot = wheel_[t & (wheel_.size() - 1)];
+            for (size_t i = 0; i < slot.size();) {
+                auto it = ids_.find(slot[i]);
+                if (it == ids_.end() || it->second <= now) {
+                    if (it != ids_.end()) ids_.erase(it);
+                    slot[i] = slot.back();
+                    slot.pop_back();
+                } else {
+                    ++i;  // due on a later turn of the wheel
+                }
+            }
+        }
+        last_ = now;
+    }
+
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        return ids_.size();
+    }
+
+private:
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<RandkeyId, uint64_t, RandkeyIdHash> ids_;  // -> expires_at
+    std::vector<std::vector<RandkeyId>> wheel_;
+    uint64_t last_ = 0;
+};
+
+// HMAC keys by id; the last one added mints. Keep retired keys until the
+// tokens they signed have expired. Not modified once contexts exist.
+class RandkeyKeys {
+public:
+    static constexpr size_t MIN_SECRET_BYTES = 32;
+
+    bool add(uint8_t key_id, const std::string& secret) {
+        if (secret.size() < MIN_SECRET_BYTES) return false;
+        for (const auto& k : keys_) {
+            if (k.first == key_id) return false;
+        }
+        keys_.emplace_back(key_id, secret);
+        return true;
+    }
+
+    bool empty() const { return keys_.empty(); }
+    const std::vector<std::pair<uint8_t, std::string>>& all() const { return keys_; }
+
+private:
+    std::vector<std::pair<uint8_t, std::string>> keys_;
+};
+
+class RandkeyContext {
+public:
+    static constexpr size_t TOKEN_BYTES = 42;
+    static constexpr size_t TOKEN_CHARS = 56;
+
+    explicit RandkeyContext(const RandkeyKeys& keys, const RevocationSet* revoked = nullptr) : revoked_(revoked) {
+        EVP_MAC* mac = EVP_MAC_fetch(nullptr, "HMAC", nullptr);
+        if (!mac) return;
+        char digest[] = "SHA256";
+        OSSL_PARAM params[] = {OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0), OSSL_PARAM_construct_end()};
+        for (const auto& k : keys.all()) {
+            EVP_MAC_CTX* ctx = EVP_MAC_CTX_new(mac);
+            if (!ctx || !EVP_MAC_init(ctx, (const unsigned char*)k.second.data(), k.second.size(), params)) {
+                EVP_MAC_CTX_free(ctx);
+                continue;
+            }
+            macs_.push_back({k.first, ctx});
+        }
+        EVP_MAC_free(mac);
+    }
+
+    ~RandkeyContext() {
+        for (auto& m : macs_) EVP_MAC_CTX_free(m.ctx);
+    }
+
+    RandkeyContext(const RandkeyContext&) = delete;
+    RandkeyContext& operator=(const RandkeyContext&) = delete;
+
+    bool valid() const { return !macs_.empty(); }
+
+    // A token for `fpkey` valid for `ttl_s` seconds from `now`; "" if the
+    // CSPRNG or the MAC failed
+    std::string mint(uint64_t fpkey, uint64_t now, uint32_t ttl_s, RandkeyClaims* claims = nullptr) {
+        if (macs_.empty()) return "";
+        unsigned char raw[TOKEN_BYTES];
+        const Mac& key = macs_.back();
+        raw[0] = VERSION;
+        raw[1] = key.id;
+        if (!random_bytes(raw + 2, 12)) return "";
+        uint64_t expires_at = now + ttl_s;
+        if (expires_at > 0xffffffffull) return "";
+        put_be(raw + 14, expires_at, 4);
+        put_be(raw + 18, fpkey, 8);
+        if (!sign(key.ctx, raw, raw + 26)) return "";
+        if (claims) {
+            claims->key_id = key.id;
+            memcpy(claims->id.bytes.data(), raw + 2, 12);
+            claims->expires_at = expires_at;
+            claims->fpkey = fpkey;
+        }
+        return encode(raw);
+    }
+
+    // Checks the token's form, signature and expiry at `now`, then the
+    // machine (when `expected_fpkey` is given) and the revocation set
+    RandkeyStatus verify(const std::string& token, uint64_t now, RandkeyClaims& claims,
+                         const uint64_t* expected_fpkey = nullptr) {
+        unsigned char raw[TOKEN_BYTES];
+        if (token.size() != TOKEN_CHARS || !decode(token, raw) || raw[0] != VERSION) return RandkeyStatus::Malformed;
+        EVP_MAC_CTX* ctx = nullptr;
+        for (const auto& m : macs_) {
+            if (m.id == raw[1]) ctx = m.ctx;
+        }
+        if (!ctx) return RandkeyStatus::UnknownKey;
+        unsigned char expected[16];
+        if (!sign(ctx, raw, expected) || CRYPTO_memcmp(expected, raw + 26, sizeof(expected)) != 0) {
+            return RandkeyStatus::BadSignature;
+        }
+        claims.key_id = raw[1];
+        memcpy(claims.id.bytes.data(), raw + 2, 12);
+        claims.expires_at = get_be(raw + 14, 4);
+        claims.fpkey = get_be(raw + 18, 8);
+        if (now >= claims.expires_at) return RandkeyStatus::Expired;
+        if (expected_fpkey && *expected_fpkey != claims.fpkey) return RandkeyStatus::WrongMachine;
+        if (revoked_ && revoked_->revoked(claims.id)) return RandkeyStatus::Revoked;
+        return RandkeyStatus::Valid;
+    }
+
+private:
+    static constexpr unsigned char VERSION = 1;
+    static constexpr size_t RANDOM_BUFFER = 4096;
+
+    struct Mac {
+        uint8_t id;
+        EVP_MAC_CTX* ctx;
+    };
+
+    bool random_bytes(unsigned char* out, size_t n) {
+        if (random_used_ + n > random_.size()) {
+            random_.resize(RANDOM_BUFFER);
+            if (RAND_bytes(random_.data(), (int)random_.size()) != 1) {
+                random_used_ = random_.size();
+                return false;
+            }
+            random_used_ = 0;
+        }
+        memcpy(out, random_.data() + random_used_, n);
+        // Hand out each byte once
+        OPENSSL_cleanse(random_.data() + random_used_, n);
+        random_used_ += n;
+        return true;
+    }
+
+    // MAC of raw[0..25] into out[0..15]; init with no key reuses the context's key
+    static bool sign(EVP_MAC_CTX* ctx, const unsigned char* raw, unsigned char* out) {
+        unsigned char full[32];
+        size_t len = 0;
+        if (!EVP_MAC_init(ctx, nullptr, 0, nullptr) || !EVP_MAC_update(ctx, raw, 26) ||
+            !EVP_MAC_final(ctx, full, &len, sizeof(full))) {
+            return false;
+        }
+        memcpy(out, full, 16);
+        return true;
+    }
+
+    static void put_be(unsigned char* p, uint64_t v, int bytes) {
+        for (int i = bytes - 1; i >= 0; --i, v >>= 8) p[i] = (unsigned char)v;
+    }
+
+    static uint64_t get_be(const unsigned char* p, int bytes) {
+        uint64_t v = 0;
+        for (int i = 0; i < bytes; ++i) v = (v << 8) | p[i];
+        return v;
+    }
+
+    static const char* alphabet() { return "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"; }
+
+    // 42 bytes are exactly 14 groups of three: no padding
+    static std::string encode(const unsigned char* raw) {
+        std::string out(TOKEN_CHARS, '\0');
+        for (size_t i = 0, o = 0; i < TOKEN_BYTES; i += 3, o += 4) {
+            uint32_t n = (uint32_t)raw[i] << 16 | (uint32_t)raw[i + 1] << 8 | raw[i + 2];
+            for (int c = 0; c < 4; ++c) out[o + c] = alphabet()[(n >> (18 - 6 * c)) & 0x3f];
+        }
+        return out;
+    }
+
+    static bool decode(const std::string& text, unsigned char* raw) {
+        static const auto values = [] {
+            std::array<int8_t, 256> v;
+            v.fill(-1);
+            for (int i = 0; i < 64; ++i) v[(unsigned char)alphabet()[i]] = (int8_t)i;
+            return v;
+        }();
+        for (size_t i = 0, o = 0; i < TOKEN_CHARS; i += 4, o += 3) {
+            uint32_t n = 0;
+            for (int c = 0; c < 4; ++c) {
+                int8_t v = values[(unsigned char)text[i + c]];
+                if (v < 0) return false;
+                n = n << 6 | (uint32_t)v;
+            }
+            raw[o] = (unsigned char)(n >> 16);
+            raw[o + 1] = (unsigned char)(n >> 8);
+            raw[o + 2] = (unsigned char)n;
+        }
+        return true;
+    }
+
+    const RevocationSet* revoked_;
+    std::vector<Mac> macs_;
+    std::vector<unsigned char> random_;
+    size_t random_used_ = 0;
+};
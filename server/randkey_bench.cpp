@@ -0,0 +1,126 @@
+// Benchmark for randkey minting and verification (randkey.h).
+//
+// Per thread: mints, verifies of fresh tokens (with the machine check and a
+// populated revocation set), and rejections of tampered tokens; then the
+// same across all threads, and the timer wheel dropping a million revoked
+// tokens as they expire.
+//
+// Build: see BUILD.md ("Reference backend").
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "randkey.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+const uint64_t NOW = 1790000000;
+
+struct Rates {
+    double mint = 0, verify = 0, reject = 0;
+};
+
+// One worker's loop; `failures` counts results that are not what they should be
+Rates run(const RandkeyKeys& keys, const RevocationSet& revoked, size_t ops, std::atomic<size_t>& failures) {
+    RandkeyContext ctx(keys, &revoked);
+    std::vector<std::string> tokens(ops);
+    Rates rates;
+
+    auto start = Clock::now();
+    for (size_t i = 0; i < ops; ++i) tokens[i] = ctx.mint(i, NOW, 300);
+    rates.mint = ops / seconds_since(start);
+
+    size_t bad = 0;
+    RandkeyClaims claims;
+    start = Clock::now();
+    for (size_t i = 0; i < ops; ++i) {
+        uint64_t fpkey = i;
+        bad += ctx.verify(tokens[i], NOW + 1, claims, &fpkey) != RandkeyStatus::Valid;
+    }
+    rates.verify = ops / seconds_since(start);
+
+    for (size_t i = 0; i < ops; ++i) tokens[i][20] = tokens[i][20] == 'A' ? 'B' : 'A';
+    start = Clock::now();
+    for (size_t i = 0; i < ops; ++i) bad += ctx.verify(tokens[i], NOW + 1, claims) == RandkeyStatus::Valid;
+    rates.reject = ops / seconds_since(start);
+
+    failures += bad;
+    return rates;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t ops = 1000000;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t revocations = 1000000;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--ops" && i + 1 < argc) ops = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--threads" && i + 1 < argc) threads = (unsigned)atoi(argv[++i]);
+        else if (arg == "--revoked" && i + 1 < argc) revocations = strtoull(argv[++i], nullptr, 10);
+        else {
+            std::cerr << "usage: randkey_bench [--ops N] [--threads N] [--revoked N]\n";
+            return 1;
+        }
+    }
+    if (ops == 0 || threads == 0) {
+        std::cerr << "need positive --ops and --threads\n";
+        return 1;
+    }
+
+    RandkeyKeys keys;
+    keys.add(1, std::string(32, 'k'));
+    RevocationSet revoked;
+    {
+        // Revoked tokens expiring over the next hour, all with other ids
+        RandkeyContext ctx(keys);
+        RandkeyClaims claims;
+        auto start = Clock::now();
+        for (size_t i = 0; i < revocations; ++i) {
+            ctx.mint(0, NOW, 1 + (uint32_t)(i % 3600), &claims);
+            revoked.revoke(claims.id, claims.expires_at, NOW);
+        }
+        printf("revoke   %zu tokens  %9.0f /s\n", revocations, revocations / seconds_since(start));
+    }
+
+    std::atomic<size_t> failures{0};
+    Rates one = run(keys, revoked, ops, failures);
+    printf("1 thread   mint %9.0f /s   verify %9.0f /s   reject tampered %9.0f /s\n", one.mint, one.verify, one.reject);
+
+    std::vector<Rates> per_thread(threads);
+    std::vector<std::thread> workers;
+    auto start = Clock::now();
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] { per_thread[t] = run(keys, revoked, ops, failures); });
+    }
+    for (auto& w : workers) w.join();
+    double wall = seconds_since(start);
+    Rates sum;
+    for (const auto& r : per_thread) {
+        sum.mint += r.mint;
+        sum.verify += r.verify;
+        sum.reject += r.reject;
+    }
+    printf("%u threads  mint %9.0f /s   verify %9.0f /s   reject tampered %9.0f /s  (%.1f s wall)\n", threads, sum.mint,
+           sum.verify, sum.reject, wall);
+
+    start = Clock::now();
+    for (uint64_t t = NOW + 1; t <= NOW + 3600; ++t) revoked.advance(t);
+    printf("expire   %zu revoked tokens over one simulated hour in %.3f s, %zu left\n", revocations, seconds_since(start),
+           revoked.size());
+
+    if (failures) printf("FAILED: %zu wrong verification results\n", failures.load());
+    return failures || revoked.size() ? 2 : 0;
+}
@@ -0,0 +1,481 @@
+// Reference backend stand-in for MagicKeyRevC (Linux only).
+//
+// Accepts what send_data() produces: GET <path>?message=<base64url> or a POST
+// whose body is either `message=<base64url>` or the bare base64url text. The
+// message is RSA-OAEP-SHA256 decrypted with a local private key, validated
+// against the registration schema and answered with {"randkey": "..."}, plus
+// "expires_in" when --token-ttl makes the token reusable. Delta registrations
+// (delta_payload.h) are merged with the acknowledged registration they name.
+// With --store accepted registrations are kept in a RegistrationStore; with
+// --token-secret randkeys are signed (randkey.h) and /verify and /revoke
+// answer for them. POST /batch takes one message per line, as a client's
+// offline queue sends them, and answers {"results": [...]}. With --max-rps
+// registrations over the rate get 503 with a Retry-After slot
+// (admission_gate.h) that spreads a fleet starting together.
+//
+// Build: see BUILD.md ("Reference backend").
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <thread>
+#include <csignal>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <sys/resource.h>
+#include <openssl/rand.h>
+#include "../json.hpp"
+#include "rsa_decrypt.h"
+#include "registration_schema.h"
+#include "ack_store.h"
+#include "randkey.h"
+#include "admission_gate.h"
+#include "registration_store.h"
+#include "http_server.h"
+
+namespace {
+
+std::atomic<bool> g_stop{false};
+
+void on_signal(int) { g_stop = true; }
+
+struct ServerOptions {
+    std::string bind_address = "127.0.0.1";
+    uint16_t port = 8080;
+    unsigned threads = std::thread::hardware_concurrency();
+    std::string private_key_file = "private_key.pem";
+    int stats_interval_s = 5;
+    bool quiet = false;
+    int token_ttl_s = 0;
+    size_t ack_capacity = 1000000;
+    std::string store_dir;
+    std::string token_secret_file;
+    double max_rps = 0;
+};
+
+void print_usage() {
+    std::cout << "Usage: reference_server [options]\n"
+              << "  --key <file>        RSA private key (PEM), default private_key.pem\n"
+              << "  --bind <addr>       IPv4 address to listen on, default 127.0.0.1\n"
+              << "  --port <n>          TCP port, default 8080\n"
+              << "  --threads <n>       worker threads, default = hardware threads\n"
+              << "  --stats <seconds>   throughput report interval, 0 disables\n"
+              << "  --quiet             do not log rejected registrations\n"
+              << "  --token-ttl <s>     send \"expires_in\" so clients may reuse a randkey, 0 = single use\n"
+              << "  --acks <n>          acknowledged registrations kept for delta payloads, default 1000000\n"
+              << "  --store <dir>       keep accepted registrations in <dir> (flushed every second)\n"
+              << "  --token-secret <f>  sign randkeys with the key in <f> (>= 32 bytes) and serve /verify, /revoke\n"
+              << "  --max-rps <n>       take up to <n> registrations/s; others get 503 and a slot to come back in\n";
+}
+
+bool parse_options(int argc, char** argv, ServerOptions& opts) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&](std::string& out) {
+            if (i + 1 >= argc) return false;
+            out = argv[++i];
+            return true;
+        };
+        std::string value;
+        if (arg == "--key" && next(value)) opts.private_key_file = value;
+        else if (arg == "--bind" && next(value)) opts.bind_address = value;
+        else if (arg == "--port" && next(value)) opts.port = (uint16_t)std::atoi(value.c_str());
+        else if (arg == "--threads" && next(value)) opts.threads = (unsigned)std::atoi(value.c_str());
+        else if (arg == "--stats" && next(value)) opts.stats_interval_s = std::atoi(value.c_str());
+        else if (arg == "--quiet") opts.quiet = true;
+        else if (arg == "--token-ttl" && next(value)) opts.token_ttl_s = std::atoi(value.c_str());
+        else if (arg == "--acks" && next(value)) opts.ack_capacity = (size_t)std::atoll(value.c_str());
+        else if (arg == "--store" && next(value)) opts.store_dir = value;
+        else if (arg == "--token-secret" && next(value)) opts.token_secret_file = value;
+        else if (arg == "--max-rps" && next(value)) opts.max_rps = std::atof(value.c_str());
+        else return false;
+    }
+    if (opts.threads == 0) opts.threads = 1;
+    return true;
+}
+
+std::string mint_randkey() {
+    unsigned char raw[16];
+    RAND_bytes(raw, sizeof(raw));
+    static const char hex[] = "0123456789abcdef";
+    std::string out(32, '\0');
+    for (size_t i = 0; i < sizeof(raw); ++i) {
+        out[2 * i] = hex[raw[i] >> 4];
+        out[2 * i + 1] = hex[raw[i] & 0x0f];
+    }
+    return out;
+}
+
+void reply_error(HttpResponse& resp, int status, const std::string& reason) {
+    resp.status = status;
+    resp.body = nlohmann::json({{"error", reason}}).dump();
+}
+
+// One decryption context and scratch buffers per worker thread; never shared.
+struct WorkerState {
+    std::unique_ptr<DecryptContext> decryptor;
+    std::unique_ptr<RandkeyContext> randkeys;  // with --token-secret
+    std::vector<unsigned char> ciphertext;
+    std::string plaintext;
+};
+
+class ReferenceBackend {
+public:
+    ReferenceBackend(EVP_PKEY* key, unsigned threads, bool quiet, int token_ttl_s, size_t ack_capacity)
+        : quiet_(quiet), token_ttl_s_(token_ttl_s), acks_(ack_capacity), workers_(threads) {
+        for (auto& w : workers_) w.decryptor.reset(new DecryptContext(key));
+    }
+
+    bool valid() const { return !workers_.empty() && workers_[0].decryptor->valid(); }
+
+    bool open_store(const std::string& dir, std::string& error) { return store_.open(dir, error); }
+    size_t stored_machines() const { return store_.size(); }
+
+    bool use_signed_tokens(const std::string& secret) {
+        if (!keys_.add(1, secret)) return false;
+        for (auto& w : workers_) {
+            w.randkeys.reset(new RandkeyContext(keys_, &revoked_));
+            if (!w.randkeys->valid()) return false;
+        }
+        return true;
+    }
+
+    // Registrations per second to take, a second's worth at once; 0 = all
+    void limit_rate(double per_s) { gate_.configure(per_s, per_s); }
+
+    void flush_store() {
+        std::lock_guard<std::mutex> lock(store_mutex_);
+        if (store_.is_open() && !store_.flush()) std::cerr << "Registration store flush failed" << std::endl;
+    }
+
+    // Once a second: flushes the store and forgets revoked tokens that expired
+    void tick() {
+        flush_store();
+        revoked_.advance((uint64_t)time(nullptr));
+    }
+
+    void handle(const HttpRequest& req, HttpResponse& resp, unsigned worker) {
+        if (req.method != "GET" && req.method != "POST") {
+            reply_error(resp, 405, "method not allowed");
+            return;
+        }
+
+        WorkerState& w = workers_[worker];
+        if (w.randkeys && (req.path == "/verify" || req.path == "/revoke")) {
+            handle_token(req, resp, w);
+            return;
+        }
+
+        // A batch costs what its messages would cost one by one
+        std::vector<std::string> batch;
+        if (req.path == "/batch") batch = batch_messages(req.body);
+        if (gate_.enabled()) {
+            size_t cost = req.path == "/batch" ? std::max<size_t>(1, batch.size()) : 1;
+            double retry_after_s = 0;
+            if (!gate_.admit(seconds_now(), (double)cost, retry_after_s)) {
+                // Whole seconds, rounded up, in both the header and the hint
+                long long wait_s = (long long)std::ceil(retry_after_s);
+                resp.status = 503;
+                resp.headers.push_back({"Retry-After", std::to_string(wait_s)});
+                resp.body = nlohmann::json({{"error", "busy"}, {"retry_after", wait_s}}).dump();
+                return;
+            }
+        }
+
+        if (req.path == "/batch") {
+            handle_batch(req, batch, resp, w);
+            return;
+        }
+
+        std::string message;
+        if (!query_param(req.query, "message", message)) {
+            if (!query_param(req.body, "message", message)) message = req.body;
+        }
+        while (!message.empty() && (message.back() == '\n' || message.back() == '\r' || message.back() == ' ')) {
+            message.pop_back();
+        }
+        if (message.empty()) {
+            reply_error(resp, 400, "missing message");
+            return;
+        }
+        nlohmann::json reply;
+        resp.status = register_message(message, w, reply);
+        resp.body = reply.dump();
+    }
+
+private:
+    // Lifetime of a signed randkey the client may not reuse (no --token-ttl)
+    static constexpr uint32_t SIGNED_TOKEN_TTL_S = 300;
+    static constexpr size_t MAX_BATCH_MESSAGES = 1000;
+
+    static double seconds_now() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Decrypts, validates and stores one message; `reply` is what a single
+    // request gets back ({"status": "accepted", "randkey", ...}, {"status":
+    // "send_full"} or {"error": ...}). Returns the HTTP status for it.
+    int register_message(const std::string& message, WorkerState& w, nlohmann::json& reply) {
+        if (!w.decryptor->decrypt_message(message.data(), message.size(), w.ciphertext, w.plaintext)) {
+            return reject(reply, "decryption failed");
+        }
+
+        nlohmann::json payload = nlohmann::json::parse(w.plaintext, nullptr, false);
+        if (payload.is_discarded()) return reject(reply, "payload is not JSON");
+        if (is_delta_message(payload)) {
+            std::string problem = validate_registration_delta(payload);
+            if (!problem.empty()) return reject(reply, problem);
+            nlohmann::json base;
+            if (!acks_.get(payload["base"].get<std::string>(), base)) {
+                reply = {{"status", "send_full"}};
+                return 200;
+            }
+            payload = apply_delta(base, payload);
+        }
+        std::string problem = validate_registration(payload);
+        if (!problem.empty()) return reject(reply, problem);
+        std::string ack = payload_hash(payload);
+        acks_.put(ack, payload);
+        if (store_.is_open()) {
+            // The store takes one writer at a time
+            std::lock_guard<std::mutex> lock(store_mutex_);
+            if (!store_.append(payload)) {
+                reply = {{"error", "registration not stored"}};
+                return 500;
+            }
+        }
+
+        std::string randkey = mint_randkey();
+        if (w.randkeys) {
+            uint64_t fpkey = strtoull(payload.value("fpkey", "0").c_str(), nullptr, 16);
+            randkey = w.randkeys->mint(fpkey, (uint64_t)time(nullptr), token_ttl_s_ > 0 ? token_ttl_s_ : SIGNED_TOKEN_TTL_S);
+            if (randkey.empty()) {
+                reply = {{"error", "could not mint randkey"}};
+                return 500;
+            }
+        }
+        reply = {{"status", "accepted"}, {"randkey", randkey}, {"ack", ack}};
+        if (token_ttl_s_ > 0) reply["expires_in"] = token_ttl_s_;
+        return 200;
+    }
+
+    // The non-empty lines of a /batch body, without trailing '\r' or spaces
+    static std::vector<std::string> batch_messages(const std::string& body) {
+        std::vector<std::string> messages;
+        size_t pos = 0;
+        while (pos < body.size()) {
+            size_t end = body.find('\n', pos);
+            if (end == std::string::npos) end = body.size();
+            std::string message = body.substr(pos, end - pos);
+            pos = end + 1;
+            while (!message.empty() && (message.back() == '\r' || message.back() == ' ')) message.pop_back();
+            if (!message.empty()) messages.push_back(std::move(message));
+        }
+        return messages;
+    }
+
+    // POST /batch with one message per line (a client's offline queue,
+    // offline_queue.h): {"results": [<the reply to each message, in order>]}
+    void handle_batch(const HttpRequest& req, const std::vector<std::string>& messages, HttpResponse& resp, WorkerState& w) {
+        if (req.method != "POST") {
+            reply_error(resp, 405, "method not allowed");
+            return;
+        }
+        if (messages.empty()) {
+            reply_error(resp, 400, "missing message");
+            return;
+        }
+        if (messages.size() > MAX_BATCH_MESSAGES) {
+            reply_error(resp, 413, "more than " + std::to_string(MAX_BATCH_MESSAGES) + " messages");
+            return;
+        }
+        nlohmann::json results = nlohmann::json::array();
+        for (const auto& message : messages) {
+            nlohmann::json reply;
+            register_message(message, w, reply);
+            results.push_back(std::move(reply));
+        }
+        resp.body = nlohmann::json({{"results", results}}).dump();
+    }
+
+    // GET /verify?token=<randkey>[&fpkey=<hex>]: {"status": "valid", "expires_at", "fpkey"}
+    // or {"status": "<why not>"}. /revoke?token=<randkey> revokes a valid token.
+    // Without --token-ttl tokens are single-use: the first valid /verify
+    // consumes the token, and later ones answer "revoked".
+    void handle_token(const HttpRequest& req, HttpResponse& resp, WorkerState& w) {
+        std::string token, fp;
+        if (!query_param(req.query, "token", token)) {
+            reply_error(resp, 400, "missing token");
+            return;
+        }
+        uint64_t now = (uint64_t)time(nullptr);
+        uint64_t expected = 0;
+        bool check_machine = query_param(req.query, "fpkey", fp);
+        if (check_machine) expected = strtoull(fp.c_str(), nullptr, 16);
+        RandkeyClaims claims;
+        RandkeyStatus status = w.randkeys->verify(token, now, claims, check_machine ? &expected : nullptr);
+        if (status == RandkeyStatus::Valid && req.path == "/revoke") {
+            revoked_.revoke(claims.id, claims.expires_at, now);
+            resp.body = nlohmann::json({{"status", "revoked"}}).dump();
+            return;
+        }
+        // Consumed in the same step as the check, so two requests cannot both use it
+        if (status == RandkeyStatus::Valid && token_ttl_s_ == 0 && !revoked_.revoke(claims.id, claims.expires_at, now)) {
+            status = RandkeyStatus::Revoked;
+        }
+        nlohmann::json reply = {{"status", randkey_status_name(status)}};
+        if (status == RandkeyStatus::Valid) {
+            char hex[17];
+            snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)claims.fpkey);
+            reply["expires_at"] = claims.expires_at;
+            reply["fpkey"] = hex;
+        } else {
+            resp.status = 403;
+        }
+        resp.body = reply.dump();
+    }
+
+    int reject(nlohmann::json& reply, const std::string& reason) {
+        if (!quiet_) std::cerr << "Rejected registration: " << reason << std::endl;
+        reply = {{"error", reason}};
+        return 400;
+    }
+
+    bool quiet_;
+    int token_ttl_s_;
+    AckStore acks_;
+    RandkeyKeys keys_;
+    RevocationSet revoked_;
+    RegistrationStore store_;
+    std::mutex store_mutex_;
+    AdmissionGate gate_;
+    std::vector<WorkerState> workers_;
+};
+
+double process_cpu_seconds() {
+    rusage ru = {};
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+// Prints total throughput, throughput per worker thread and requests per
+// CPU-second, which is the figure to use for capacity planning.
+void report_stats(const HttpServer& server, int interval_s) {
+    using clock = std::chrono::steady_clock;
+    unsigned threads = server.thread_count();
+    std::vector<uint64_t> last(threads, 0);
+    auto last_time = clock::now();
+    double last_cpu = process_cpu_seconds();
+
+    while (!g_stop) {
+        for (int i = 0; i < interval_s * 10 && !g_stop; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        auto now = clock::now();
+        double cpu = process_cpu_seconds();
+        double wall = std::chrono::duration<double>(now - last_time).count();
+        double cpu_used = cpu - last_cpu;
+
+        uint64_t total = 0;
+        std::string per_worker;
+        for (unsigned t = 0; t < threads; ++t) {
+            uint64_t served = server.requests_served(t);
+            uint64_t delta = served - last[t];
+            last[t] = served;
+            total += delta;
+            per_worker += " " + std::to_string((uint64_t)(delta / wall));
+        }
+
+        std::cout << "[stats] " << (uint64_t)(total / wall) << " req/s total, "
+                  << (uint64_t)(total / wall / threads) << " req/s per thread, "
+                  << (cpu_used > 0 ? (uint64_t)(total / cpu_used) : 0) << " req/s per busy core"
+                  << " | per thread:" << per_worker << std::endl;
+
+        last_time = now;
+        last_cpu = cpu;
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    ServerOptions opts;
+    if (!parse_options(argc, argv, opts)) {
+        print_usage();
+        return 1;
+    }
+
+    EVP_PKEY* key = load_private_key(opts.private_key_file);
+    if (!key) {
+        std::cerr << "Failed to load private key from " << opts.private_key_file << std::endl;
+        return 1;
+    }
+
+    ReferenceBackend backend(key, opts.threads, opts.quiet, opts.token_ttl_s, opts.ack_capacity);
+    EVP_PKEY_free(key);
+    if (!backend.valid()) {
+        std::cerr << "Private key is not usable for RSA-OAEP-SHA256" << std::endl;
+        return 1;
+    }
+
+    if (!opts.token_secret_file.empty()) {
+        std::ifstream in(opts.token_secret_file, std::ios::binary);
+        std::stringstream secret;
+        secret << in.rdbuf();
+        if (!in || !backend.use_signed_tokens(secret.str())) {
+            std::cerr << "Token secret " << opts.token_secret_file << " is unreadable or shorter than "
+                      << RandkeyKeys::MIN_SECRET_BYTES << " bytes" << std::endl;
+            return 1;
+        }
+    }
+
+    backend.limit_rate(opts.max_rps);
+
+    if (!opts.store_dir.empty()) {
+        std::string error;
+        if (!backend.open_store(opts.store_dir, error)) {
+            std::cerr << "Cannot open registration store: " << error << std::endl;
+            return 1;
+        }
+        std::cout << "Registration store " << opts.store_dir << ": " << backend.stored_machines() << " machines" << std::endl;
+    }
+
+    HttpServer server(opts.bind_address, opts.port, opts.threads,
+        [&backend](const HttpRequest& req, HttpResponse& resp, unsigned worker) {
+            backend.handle(req, resp, worker);
+        });
+    if (!server.start()) {
+        std::cerr << "Failed to listen on " << opts.bind_address << ":" << opts.port << std::endl;
+        return 1;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    std::cout << "Reference backend listening on " << opts.bind_address << ":" << opts.port
+              << " with " << opts.threads << " worker threads" << std::endl;
+
+    std::thread ticker([&backend] {
+        while (!g_stop) {
+            for (int i = 0; i < 10 && !g_stop; ++i) std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            backend.tick();
+        }
+    });
+
+    if (opts.stats_interval_s > 0) {
+        report_stats(server, opts.stats_interval_s);
+    } else {
+        while (!g_stop) std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+
+    server.stop();
+    ticker.join();
+    return 0;
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <string>
+#include "../delta_payload.h"
+#include "../json.hpp"
+
+// Fields main() puts into data_to_encrypt. All of them are strings; empty
+// values are allowed where the client legitimately may not know them
+// (no disk serial, no CheckTimeUTC from ipcheck).
+namespace RegistrationSchema {
+    struct Field {
+        const char* name;
+        bool may_be_empty;
+    };
+
+    static const Field REQUIRED_FIELDS[] = {
+        {"ip", false},
+        {"hwid", false},
+        {"hwserial", true},
+        {"country", true},
+        {"machineguid", false},
+        {"dcid", false},
+        {"regdate", true},
+        {"version", false},
+    };
+
+    // Canonical identity (canonical_fingerprint.h); older clients omit it,
+    // and fpdigest only comes from builds that sent the digest too
+    struct Format {
+        const char* name;
+        size_t length;
+        const char* alphabet;
+    };
+
+    static const Format OPTIONAL_FIELDS[] = {
+        {"fpdigest", 43, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"},
+        {"fpkey", 16, "0123456789abcdef"},
+    };
+
+    static const size_t MAX_FIELD_LENGTH = 512;
+
+    inline const Format* optional_field(const std::string& name) {
+        for (const auto& f : OPTIONAL_FIELDS) {
+            if (name == f.name) return &f;
+        }
+        return nullptr;
+    }
+
+    inline bool well_formed(const Format& format, const nlohmann::json& value) {
+        if (!value.is_string()) return false;
+        const auto& text = value.get_ref<const std::string&>();
+        return text.size() == format.length && text.find_first_not_of(format.alphabet) == std::string::npos;
+    }
+}
+
+// Returns an empty string when `payload` is a valid registration, otherwise a
+// short reason suitable for an error reply.
+inline std::string validate_registration(const nlohmann::json& payload) {
+    if (!payload.is_object()) return "payload is not an object";
+
+    for (const auto& field : RegistrationSchema::REQUIRED_FIELDS) {
+        auto it = payload.find(field.name);
+        if (it == payload.end()) return std::string("missing field: ") + field.name;
+        if (!it->is_string()) return std::string("field is not a string: ") + field.name;
+        const auto& value = it->get_ref<const std::string&>();
+        if (!field.may_be_empty && value.empty()) return std::string("empty field: ") + field.name;
+        if (value.size() > RegistrationSchema::MAX_FIELD_LENGTH) return std::string("field too long: ") + field.name;
+    }
+    for (const auto& format : RegistrationSchema::OPTIONAL_FIELDS) {
+        auto it = payload.find(format.name);
+        if (it != payload.end() && !RegistrationSchema::well_formed(format, *it)) return std::string("malformed field: ") + format.name;
+    }
+    return "";
+}
+
+// Checks a delta registration (see delta_payload.h): a 32-hex-digit base and
+// only known fields, each held to the same rules as in a full registration.
+// Whether the merged result is complete can only be checked against the base.
+inline std::string validate_registration_delta(const nlohmann::json& message) {
+    if (!is_delta_message(message)) return "not a delta registration";
+    const auto& base = message["base"].get_ref<const std::string&>();
+    if (base.size() != 32 || base.find_first_not_of("0123456789abcdef") != std::string::npos) return "malformed base";
+    for (auto it = message["delta"].begin(); it != message["delta"].end(); ++it) {
+        const RegistrationSchema::Field* field = nullptr;
+        for (const auto& f : RegistrationSchema::REQUIRED_FIELDS) {
+            if (it.key() == f.name) field = &f;
+        }
+        if (!field) {
+            const RegistrationSchema::Format* format = RegistrationSchema::optional_field(it.key());
+            if (!format) return "unknown field: " + it.key();
+            if (!RegistrationSchema::well_formed(*format, *it)) return "malformed field: " + it.key();
+            continue;
+        }
+        if (!it->is_string()) return "field is not a string: " + it.key();
+        const auto& value = it->get_ref<const std::string&>();
+        if (!field->may_be_empty && value.empty()) return "empty field: " + it.key();
+        if (value.size() > RegistrationSchema::MAX_FIELD_LENGTH) return "field too long: " + it.key();
+    }
+    return "";
+}
+
+// Either form a client may send
+inline std::string validate_registration_message(const nlohmann::json& payload) {
+    return is_delta_message(payload) ? validate_registration_delta(payload) : validate_registration(payload);
+}
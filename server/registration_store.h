@@ -0,0 +1,453 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../canonical_fingerprint.h"
+#include "../json.hpp"
+
+// Embedded store for accepted registrations (Linux only): an append-only log
+// of payloads plus a memory-mapped open-addressing index from the machine
+// (normalized hwid + machineguid) to its latest record.
+//
+//   <dir>/registrations.log   records: u32 length, u32 crc32, u64 key hash,
+//                             then u16 key length, key, payload JSON
+//   <dir>/registrations.idx   64-byte header, then slots {u64 key hash, u64 offset}
+//
+// One writer (append/flush), any number of concurrent lookups without locks:
+// a record is written before its slot is published, slots are never removed,
+// and a slot's offset is replaced with a single atomic store. When the index
+// fills up the writer builds a twice as large one beside it and swaps it in;
+// the old mapping stays valid for lookups already in it until close().
+//
+// Records are durable once flush() returns. On open the log tail is replayed
+// into the index from the last flushed position, a torn last record is cut
+// off, and an index that points past the log (unflushed index pages that
+// made it to disk without their records) is rebuilt from the whole log.
+class RegistrationStore {
+public:
+    RegistrationStore() = default;
+    ~RegistrationStore() { close(); }
+
+    RegistrationStore(const RegistrationStore&) = delete;
+    RegistrationStore& operator=(const RegistrationStore&) = delete;
+
+    // Creates `dir`'s files if needed; `expected_records` sizes a new index
+    bool open(const std::string& dir, std::string& error, size_t expected_records = 0) {
+        close();
+        dir_ = dir;
+        ::mkdir(dir.c_str(), 0755);
+        log_fd_ = ::open(log_path().c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (log_fd_ < 0) return fail(error, "cannot open " + log_path());
+        struct stat st = {};
+        if (fstat(log_fd_, &st) != 0) return fail(error, "cannot stat " + log_path());
+        uint64_t log_size = (uint64_t)st.st_size;
+
+        if (!map_existing_index(log_size)) {
+            size_t capacity = MIN_CAPACITY;
+            while (capacity * MAX_LOAD_PERCENT / 100 < expected_records) capacity *= 2;
+            if (!create_index(capacity)) return fail(error, "cannot create " + index_path());
+        }
+
+        Table* table = table_.load();
+        bool clean = table->header->clean != 0;
+        uint64_t end = 0;
+        if (!replay(table->header->indexed_end, log_size, end)) return fail(error, "cannot index " + log_path());
+        if (end < log_size && ftruncate(log_fd_, (off_t)end) != 0) return fail(error, "cannot truncate " + log_path());
+        if (!clean && points_past(end)) {
+            // Rebuild from scratch rather than trust slots that name lost records
+            if (!create_index(table->capacity()) || !replay(0, end, end)) return fail(error, "cannot rebuild " + index_path());
+        }
+        log_end_.store(end);
+        table_.load()->header->clean = 0;
+        sync_index();
+        return true;
+    }
+
+    bool is_open() const { return log_fd_ >= 0; }
+
+    // Flushes, marks the index clean and releases everything
+    void close() {
+        if (log_fd_ < 0) return;
+        flush();
+        Table* table = table_.load();
+        table->header->clean = 1;
+        msync(table->map, table->map_bytes, MS_SYNC);
+        for (auto& t : tables_) munmap(t->map, t->map_bytes);
+        tables_.clear();
+        table_.store(nullptr);
+        ::close(log_fd_);
+        log_fd_ = -1;
+    }
+
+    // Writer only. False if the registration has no hwid/machineguid or the
+    // log write failed.
+    bool append(const nlohmann::json& registration) {
+        std::string key = machine_key(registration.value("hwid", ""), registration.value("machineguid", ""));
+        if (key.size() <= 1 || key.size() > 0xffff) return false;
+        std::string payload = registration.dump();
+        uint64_t hash = key_hash(key);
+
+        std::string body(2, '\0');
+        uint16_t key_len = (uint16_t)key.size();
+        memcpy(&body[0], &key_len, 2);
+        body += key;
+        body += payload;
+        if (body.size() > MAX_RECORD_BYTES) return false;
+        RecordHeader header = {(uint32_t)body.size(), record_crc(hash, body), hash};
+        std::string record((const char*)&header, sizeof(header));
+        record += body;
+
+        uint64_t offset = log_end_.load(std::memory_order_relaxed);
+        if (!write_all(record, offset)) {
+            // Cut the partial record off now; the next open() would otherwise
+            int cut = ftruncate(log_fd_, (off_t)offset);
+            (void)cut;
+            return false;
+        }
+        if (!index(hash, key, offset)) return false;
+        log_end_.store(offset + record.size(), std::memory_order_release);
+        return true;
+    }
+
+    // Any thread. The latest payload stored for the machine.
+    bool lookup(const std::string& hwid, const std::string& machine_guid, std::string& payload) const {
+        Table* table = table_.load(std::memory_order_acquire);
+        if (!table) return false;
+        std::string key = machine_key(hwid, machine_guid);
+        uint64_t hash = key_hash(key);
+        for (uint64_t i = hash & table->mask;; i = (i + 1) & table->mask) {
+            uint64_t h = table->slots[i].hash.load(std::memory_order_acquire);
+            if (h == 0) return false;
+            if (h != hash) continue;
+            std::string stored_key;
+            if (read_record(table->slots[i].offset.load(std::memory_order_acquire), stored_key, &payload) &&
+                stored_key == key) {
+                return true;
+            }
+        }
+    }
+
+    // Writer only. Makes everything appended so far durable.
+    bool flush() {
+        if (log_fd_ < 0) return false;
+        if (fdatasync(log_fd_) != 0) return false;
+        Table* table = table_.load();
+        // Slots first, so a durable indexed_end never covers slots that are not
+        if (msync(table->map, table->map_bytes, MS_SYNC) != 0) return false;
+        table->header->indexed_end = log_end_.load();
+        return sync_index();
+    }
+
+    // Distinct machines
+    size_t size() const {
+        Table* table = table_.load(std::memory_order_acquire);
+        return table ? (size_t)table->header->count.load(std::memory_order_relaxed) : 0;
+    }
+
+    uint64_t log_bytes() const { return log_end_.load(std::memory_order_acquire); }
+    size_t index_bytes() const {
+        Table* table = table_.load(std::memory_order_acquire);
+        return table ? table->map_bytes : 0;
+    }
+
+    // Records replayed into the index by the last open()
+    size_t replayed() const { return replayed_; }
+
+    // Normalized (normalize_identifier()) hwid and machineguid
+    static std::string machine_key(const std::string& hwid, const std::string& machine_guid) {
+        return normalize_identifier(hwid) + "\n" + normalize_identifier(machine_guid);
+    }
+
+private:
+    static constexpr uint64_t MAGIC = 0x3130584449524b4dull;  // "MKRIDX01"
+    static constexpr size_t MIN_CAPACITY = 1024;
+    static constexpr size_t MAX_LOAD_PERCENT = 70;
+    static constexpr size_t MAX_RECORD_BYTES = 1 << 20;
+
+    struct RecordHeader {
+        uint32_t length;  // bytes after this header
+        uint32_t crc;     // record_crc()
+        uint64_t hash;
+    };
+
+    struct IndexHeader {
+        uint64_t magic;
+        uint64_t capacity;
+        std::atomic<uint64_t> count;
+        uint64_t indexed_end;  // log offset covered by the slots as of the last flush()
+        uint64_t clean;        // closed by close()
+        uint64_t reserved[3];
+    };
+
+    struct Slot {
+        std::atomic<uint64_t> hash;  // 0 = empty
+        std::atomic<uint64_t> offset;
+    };
+    static_assert(sizeof(IndexHeader) == 64, "index header layout");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "the index is mapped as-is");
+    static_assert(sizeof(Slot) == 16, "slot layout");
+
+    struct Table {
+        void* map = nullptr;
+        size_t map_bytes = 0;
+        IndexHeader* header = nullptr;
+        Slot* slots = nullptr;
+        uint64_t mask = 0;
+        size_t capacity() const { return (size_t)mask + 1; }
+    };
+
+    std::string log_path() const { return dir_ + "/registrations.log"; }
+    std::string index_path() const { return dir_ + "/registrations.idx"; }
+
+    // open() failed: reports `what` and drops whatever it had set up
+    bool fail(std::string& error, const std::string& what) {
+        error = what + ": " + strerror(errno);
+        for (auto& t : tables_) munmap(t->map, t->map_bytes);
+        tables_.clear();
+        table_.store(nullptr);
+        if (log_fd_ >= 0) ::close(log_fd_);
+        log_fd_ = -1;
+        return false;
+    }
+
+    static uint64_t key_hash(const std::string& key) {
+        uint64_t h = 0xcbf29ce484222325ull;  // FNV-1a, then a finalizer for the low bits
+        for (unsigned char c : key) h = (h ^ c) * 0x100000001b3ull;
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+        h ^= h >> 31;
+        return h ? h : 1;
+    }
+
+    static uint32_t crc32(uint32_t crc, const void* data, size_t size) {
+        static const auto table = [] {
+            std::vector<uint32_t> t(256);
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                t[i] = c;
+            }
+            return t;
+        }();
+        const unsigned char* p = (const unsigned char*)data;
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i) crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    static uint32_t record_crc(uint64_t hash, const std::string& body) {
+        return crc32(crc32(0, &hash, sizeof(hash)), body.data(), body.size());
+    }
+
+    bool write_all(const std::string& data, uint64_t offset) {
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t n = pwrite(log_fd_, data.data() + done, data.size() - done, (off_t)(offset + done));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            done += (size_t)n;
+        }
+        return true;
+    }
+
+    bool read_all(void* out, size_t size, uint64_t offset) const {
+        size_t done = 0;
+        while (done < size) {
+            ssize_t n = pread(log_fd_, (char*)out + done, size - done, (off_t)(offset + done));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            done += (size_t)n;
+        }
+        return true;
+    }
+
+    // The key (and payload, if asked) of the record at `offset`. One pread
+    // covers a typical registration.
+    bool read_record(uint64_t offset, std::string& key, std::string* payload) const {
+        char buf[512];
+        ssize_t n;
+        do {
+            n = pread(log_fd_, buf, sizeof(buf), (off_t)offset);
+        } while (n < 0 && errno == EINTR);
+        RecordHeader header;
+        if (n < (ssize_t)sizeof(header)) return false;
+        memcpy(&header, buf, sizeof(header));
+        if (header.length < 2 || header.length > MAX_RECORD_BYTES) return false;
+        std::string body(header.length, '\0');
+        size_t have = std::min((size_t)n - sizeof(header), body.size());
+        memcpy(&body[0], buf + sizeof(header), have);
+        if (have < body.size() && !read_all(&body[have], body.size() - have, offset + sizeof(header) + have)) return false;
+        uint16_t key_len;
+        memcpy(&key_len, body.data(), 2);
+        if (2u + key_len > body.size()) return false;
+        key.assign(body, 2, key_len);
+        if (payload) payload->assign(body, 2 + key_len, std::string::npos);
+        return true;
+    }
+
+    // Points `hash`/`key` at `offset`: replaces the machine's slot or takes a new one
+    bool index(uint64_t hash, const std::string& key, uint64_t offset) {
+        Table* table = table_.load(std::memory_order_relaxed);
+        if ((table->header->count.load(std::memory_order_relaxed) + 1) * 100 > table->capacity() * MAX_LOAD_PERCENT) {
+            if (!grow()) return false;
+            table = table_.load(std::memory_order_relaxed);
+        }
+        for (uint64_t i = hash & table->mask;; i = (i + 1) & table->mask) {
+            Slot& slot = table->slots[i];
+            uint64_t h = slot.hash.load(std::memory_order_relaxed);
+            if (h == 0) {
+                slot.offset.store(offset, std::memory_order_relaxed);
+                slot.hash.store(hash, std::memory_order_release);
+                table->header->count.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+            if (h != hash) continue;
+            std::string stored_key;
+            // Another machine with the same 64-bit hash keeps its own slot
+            if (read_record(slot.offset.load(std::memory_order_relaxed), stored_key, nullptr) && stored_key != key) continue;
+            slot.offset.store(offset, std::memory_order_release);
+            return true;
+        }
+    }
+
+    // Writer: a new index of twice the capacity, written beside the old one
+    // and renamed over it
+    bool grow() {
+        Table* old = table_.load(std::memory_order_relaxed);
+        std::unique_ptr<Table> table = map_new_index(old->capacity() * 2, index_path() + ".tmp");
+        if (!table) return false;
+        for (size_t i = 0; i < old->capacity(); ++i) {
+            uint64_t h = old->slots[i].hash.load(std::memory_order_relaxed);
+            if (h == 0) continue;
+            uint64_t j = h & table->mask;
+            while (table->slots[j].hash.load(std::memory_order_relaxed) != 0) j = (j + 1) & table->mask;
+            table->slots[j].offset.store(old->slots[i].offset.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            table->slots[j].hash.store(h, std::memory_order_relaxed);
+        }
+        table->header->count.store(old->header->count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        table->header->indexed_end = old->header->indexed_end;
+        if (rename((index_path() + ".tmp").c_str(), index_path().c_str()) != 0) {
+            munmap(table->map, table->map_bytes);
+            return false;
+        }
+        table_.store(table.get(), std::memory_order_release);
+        tables_.push_back(std::move(table));
+        return true;
+    }
+
+    std::unique_ptr<Table> map_new_index(size_t capacity, const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) return nullptr;
+        size_t bytes = sizeof(IndexHeader) + capacity * sizeof(Slot);
+        std::unique_ptr<Table> table = ftruncate(fd, (off_t)bytes) == 0 ? map_index(fd, bytes) : nullptr;
+        ::close(fd);
+        if (!table) return nullptr;
+        table->header->magic = MAGIC;
+        table->header->capacity = capacity;
+        table->mask = capacity - 1;
+        return table;
+    }
+
+    static std::unique_ptr<Table> map_index(int fd, size_t bytes) {
+        void* map = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) return nullptr;
+        std::unique_ptr<Table> table(new Table);
+        table->map = map;
+        table->map_bytes = bytes;
+        table->header = (IndexHeader*)map;
+        table->slots = (Slot*)((char*)map + sizeof(IndexHeader));
+        table->mask = table->header->capacity ? table->header->capacity - 1 : 0;
+        return table;
+    }
+
+    // An empty index, replacing whatever open() had mapped (no lookups yet)
+    bool create_index(size_t capacity) {
+        for (auto& t : tables_) munmap(t->map, t->map_bytes);
+        tables_.clear();
+        table_.store(nullptr);
+        std::unique_ptr<Table> table = map_new_index(capacity, index_path());
+        if (!table) return false;
+        table_.store(table.get());
+        tables_.push_back(std::move(table));
+        return true;
+    }
+
+    // The index on disk, if it is intact and does not claim more log than exists
+    bool map_existing_index(uint64_t log_size) {
+        int fd = ::open(index_path().c_str(), O_RDWR | O_CLOEXEC);
+        if (fd < 0) return false;
+        struct stat st = {};
+        std::unique_ptr<Table> table;
+        if (fstat(fd, &st) == 0 && (size_t)st.st_size > sizeof(IndexHeader)) table = map_index(fd, (size_t)st.st_size);
+        ::close(fd);
+        if (!table) return false;
+        const IndexHeader& h = *table->header;
+        bool valid = h.magic == MAGIC && h.capacity >= MIN_CAPACITY && (h.capacity & (h.capacity - 1)) == 0 &&
+                     sizeof(IndexHeader) + h.capacity * sizeof(Slot) == table->map_bytes && h.indexed_end <= log_size &&
+                     h.count.load() <= h.capacity;
+        if (!valid) {
+            munmap(table->map, table->map_bytes);
+            return false;
+        }
+        table_.store(table.get());
+        tables_.push_back(std::move(table));
+        return true;
+    }
+
+    // Indexes the valid records in [from, log_size) and sets `end` to where
+    // they stop. False only if the index could not take them.
+    bool replay(uint64_t from, uint64_t log_size, uint64_t& end) {
+        replayed_ = 0;
+        uint64_t offset = from;
+        RecordHeader header;
+        std::string body;
+        while (offset + sizeof(header) <= log_size) {
+            if (!read_all(&header, sizeof(header), offset) || header.length < 2 || header.length > MAX_RECORD_BYTES ||
+                offset + sizeof(header) + header.length > log_size) {
+                break;
+            }
+            body.resize(header.length);
+            if (!read_all(&body[0], body.size(), offset + sizeof(header)) || record_crc(header.hash, body) != header.crc) break;
+            uint16_t key_len;
+            memcpy(&key_len, body.data(), 2);
+            if (2u + key_len > body.size()) break;
+            if (!index(header.hash, body.substr(2, key_len), offset)) return false;
+            offset += sizeof(header) + header.length;
+            ++replayed_;
+        }
+        end = offset;
+        return true;
+    }
+
+    // Some slot names a record at or beyond `end`
+    bool points_past(uint64_t end) const {
+        Table* table = table_.load();
+        for (size_t i = 0; i < table->capacity(); ++i) {
+            if (table->slots[i].hash.load(std::memory_order_relaxed) && table->slots[i].offset.load(std::memory_order_relaxed) >= end) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool sync_index() {
+        Table* table = table_.load();
+        return msync(table->map, sizeof(IndexHeader), MS_SYNC) == 0;
+    }
+
+    std::string dir_;
+    int log_fd_ = -1;
+    std::atomic<uint64_t> log_end_{0};
+    std::atomic<Table*> table_{nullptr};
+    std::vector<std::unique_ptr<Table>> tables_;  // current and retired mappings
+    size_t replayed_ = 0;
+};
@@ -0,0 +1,209 @@
+// Benchmark for RegistrationStore (registration_store.h).
+//
+// Appends synthetic registrations (the client's field set, ~300 bytes each),
+// then measures lookups of random stored machines from one thread and from
+// several reader threads while the writer keeps appending re-registrations.
+// Finally a forked writer appends unflushed records and exits without
+// closing, and the store is reopened to time the recovery.
+//
+// Build: see BUILD.md ("Reference backend").
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include "registration_store.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// A UUID-shaped id, the same for the same (n, salt)
+std::string hex_id(uint64_t n, uint64_t salt) {
+    static const char hex[] = "0123456789ABCDEF";
+    uint64_t x = n * 0x9e3779b97f4a7c15ull ^ salt;
+    std::string out;
+    for (int i = 0; i < 32; ++i) {
+        if (i % 16 == 0) {  // splitmix64
+            x += 0x9e3779b97f4a7c15ull;
+            uint64_t z = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            n = z ^ (z >> 31);
+        }
+        if (i == 8 || i == 12 || i == 16 || i == 20) out += '-';
+        out += hex[(n >> (4 * (i % 16))) & 15];
+    }
+    return out;
+}
+
+std::string hwid_of(uint64_t machine) { return hex_id(machine, 1); }
+std::string guid_of(uint64_t machine) { return hex_id(machine, 2); }
+
+nlohmann::json registration(uint64_t machine, uint64_t serial) {
+    return {
+        {"ip", "10." + std::to_string(machine >> 16 & 255) + "." + std::to_string(machine >> 8 & 255) + "." +
+                   std::to_string(machine & 255)},
+        {"hwid", hwid_of(machine)},
+        {"hwserial", "WD-" + std::to_string(machine * 7919 + 12345)},
+        {"country", "HK//Example Telecom//Example Org"},
+        {"machineguid", guid_of(machine)},
+        {"dcid", "123456"},
+        {"regdate", "2026-10-19 12:00:" + std::to_string(serial % 60)},
+        {"version", "1.2.3"},
+    };
+}
+
+struct Options {
+    std::string dir = "store_bench";
+    size_t records = 10000000;
+    size_t lookups = 2000000;
+    unsigned readers = std::max(1u, std::thread::hardware_concurrency());
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--dir" && i + 1 < argc) opts.dir = argv[++i];
+        else if (arg == "--records" && i + 1 < argc) opts.records = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--lookups" && i + 1 < argc) opts.lookups = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--readers" && i + 1 < argc) opts.readers = (unsigned)atoi(argv[++i]);
+        else {
+            std::cerr << "usage: registration_store_bench [--dir DIR] [--records N] [--lookups N] [--readers N]\n"
+                      << "DIR's registrations.log/.idx are replaced\n";
+            return 1;
+        }
+    }
+    if (opts.records == 0 || opts.readers == 0) {
+        std::cerr << "need positive --records and --readers\n";
+        return 1;
+    }
+    std::string error;
+    ::mkdir(opts.dir.c_str(), 0755);
+    unlink((opts.dir + "/registrations.log").c_str());
+    unlink((opts.dir + "/registrations.idx").c_str());
+
+    RegistrationStore store;
+    if (!store.open(opts.dir, error)) {
+        std::cerr << error << "\n";
+        return 1;
+    }
+
+    // Registrations are built in batches outside the timed part
+    std::vector<nlohmann::json> batch;
+    double append_s = 0;
+    for (size_t i = 0; i < opts.records; ++i) {
+        if (batch.empty()) {
+            for (size_t j = i; j < opts.records && batch.size() < 65536; ++j) batch.push_back(registration(j, 0));
+            std::reverse(batch.begin(), batch.end());
+        }
+        auto start = Clock::now();
+        bool ok = store.append(batch.back());
+        append_s += seconds_since(start);
+        batch.pop_back();
+        if (!ok) {
+            std::cerr << "append failed at record " << i << "\n";
+            return 1;
+        }
+    }
+    auto start = Clock::now();
+    store.flush();
+    printf("append   %zu records  %8.0f records/s  flush %.2f s  log %.0f MB  index %.0f MB (growing from empty)\n",
+           opts.records, opts.records / append_s, seconds_since(start), store.log_bytes() / 1e6, store.index_bytes() / 1e6);
+
+    // Keys are made up front so the loops time only the store
+    std::mt19937_64 rng(7);
+    std::vector<std::pair<std::string, std::string>> probes(std::min(opts.lookups, (size_t)1 << 18));
+    for (auto& p : probes) {
+        uint64_t m = rng() % opts.records;
+        p = {hwid_of(m), guid_of(m)};
+    }
+    start = Clock::now();
+    size_t found = 0;
+    std::string payload;
+    for (size_t i = 0; i < opts.lookups; ++i) {
+        const auto& p = probes[i % probes.size()];
+        found += store.lookup(p.first, p.second, payload);
+    }
+    double lookup_s = seconds_since(start);
+    printf("lookup   1 thread     %8.0f lookups/s  %.1f us each  %zu/%zu found\n", opts.lookups / lookup_s,
+           lookup_s * 1e6 / opts.lookups, found, opts.lookups);
+
+    // Readers alongside a writer re-registering random machines
+    std::atomic<bool> stop{false};
+    std::atomic<size_t> total{0}, misses{0};
+    std::vector<std::thread> readers;
+    start = Clock::now();
+    for (unsigned t = 0; t < opts.readers; ++t) {
+        readers.emplace_back([&, t] {
+            std::string out;
+            size_t n = 0, miss = 0;
+            for (size_t i = t; i < opts.lookups; i += opts.readers, ++n) {
+                const auto& p = probes[i % probes.size()];
+                miss += !store.lookup(p.first, p.second, out);
+            }
+            total += n;
+            misses += miss;
+        });
+    }
+    size_t rewrites = 0;
+    std::thread writer([&] {
+        std::mt19937_64 wrng(11);
+        while (!stop) {
+            store.append(registration(wrng() % opts.records, rewrites + 1));
+            ++rewrites;
+        }
+    });
+    for (auto& r : readers) r.join();
+    double mixed_s = seconds_since(start);
+    stop = true;
+    writer.join();
+    printf("lookup   %u readers    %8.0f lookups/s  with %.0f appends/s alongside  %zu misses\n", opts.readers,
+           total / mixed_s, rewrites / mixed_s, misses.load());
+    store.close();
+
+    start = Clock::now();
+    if (!store.open(opts.dir, error)) {
+        std::cerr << error << "\n";
+        return 1;
+    }
+    printf("reopen   clean        %.2f s  %zu machines\n", seconds_since(start), store.size());
+    store.close();
+
+    // A writer that dies with unflushed records (and a torn last one)
+    size_t unflushed = std::min(opts.records, (size_t)100000);
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        RegistrationStore dying;
+        if (!dying.open(opts.dir, error)) _exit(1);
+        for (size_t i = 0; i < unflushed; ++i) dying.append(registration(opts.records + i, 0));
+        int fd = ::open((opts.dir + "/registrations.log").c_str(), O_WRONLY | O_APPEND);
+        if (fd >= 0 && write(fd, "\x40\x01\0\0torn", 8) != 8) _exit(1);
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    start = Clock::now();
+    if (!store.open(opts.dir, error)) {
+        std::cerr << error << "\n";
+        return 1;
+    }
+    bool recovered = store.lookup(hwid_of(opts.records + unflushed - 1), guid_of(opts.records + unflushed - 1), payload);
+    printf("reopen   after crash  %.2f s  %zu records replayed  %zu machines  last record %s\n", seconds_since(start),
+           store.replayed(), store.size(), recovered ? "found" : "MISSING");
+    return recovered ? 0 : 2;
+}
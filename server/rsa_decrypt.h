@@ -0,0 +1,101 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <openssl/pem.h>
+#include <openssl/evp.h>
+#include <openssl/rsa.h>
+#include <openssl/err.h>
+
+// Inverse of base64_encode() in encrypt_data.h. Accepts both the URL-safe and
+// the standard alphabet, with or without '=' padding. Reuses `out` capacity.
+inline bool base64url_decode(const char* in, size_t len, std::vector<unsigned char>& out) {
+    static const signed char* table = [] {
+        static signed char t[256];
+        for (int i = 0; i < 256; ++i) t[i] = -1;
+        const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        for (int i = 0; i < 64; ++i) t[(unsigned char)alphabet[i]] = (signed char)i;
+        t[(unsigned char)'-'] = 62;
+        t[(unsigned char)'_'] = 63;
+        return t;
+    }();
+
+    while (len > 0 && in[len - 1] == '=') --len;
+    if (len % 4 == 1) return false;
+
+    out.resize(len / 4 * 3 + (len % 4 ? len % 4 - 1 : 0));
+    unsigned char* dst = out.data();
+    unsigned int acc = 0;
+    int bits = 0;
+    for (size_t i = 0; i < len; ++i) {
+        signed char v = table[(unsigned char)in[i]];
+        if (v < 0) return false;
+        acc = (acc << 6) | (unsigned int)v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            *dst++ = (unsigned char)(acc >> bits);
+        }
+    }
+    return true;
+}
+
+inline EVP_PKEY* load_private_key(const std::string& path) {
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f) return nullptr;
+    EVP_PKEY* key = PEM_read_PrivateKey(f, nullptr, nullptr, nullptr);
+    fclose(f);
+    return key;
+}
+
+// RSA-OAEP-SHA256 decryption context matching encrypt_data_from_key_string().
+// The EVP_PKEY_CTX is initialised once and reused for every message, so a
+// worker thread should own exactly one of these.
+class DecryptContext {
+public:
+    explicit DecryptContext(EVP_PKEY* key) {
+        if (!key) return;
+        ctx_ = EVP_PKEY_CTX_new(key, nullptr);
+        if (!ctx_) return;
+        if (EVP_PKEY_decrypt_init(ctx_) <= 0 ||
+            EVP_PKEY_CTX_set_rsa_padding(ctx_, RSA_PKCS1_OAEP_PADDING) <= 0 ||
+            EVP_PKEY_CTX_set_rsa_oaep_md(ctx_, EVP_sha256()) <= 0 ||
+            EVP_PKEY_CTX_set_rsa_mgf1_md(ctx_, EVP_sha256()) <= 0) {
+            EVP_PKEY_CTX_free(ctx_);
+            ctx_ = nullptr;
+            return;
+        }
+        block_size_ = (size_t)EVP_PKEY_get_size(key);
+    }
+    ~DecryptContext() { if (ctx_) EVP_PKEY_CTX_free(ctx_); }
+    DecryptContext(const DecryptContext&) = delete;
+    DecryptContext& operator=(const DecryptContext&) = delete;
+
+    bool valid() const { return ctx_ != nullptr; }
+    size_t block_size() const { return block_size_; }
+
+    // Decrypts one ciphertext block into `out`, which keeps its capacity
+    // between calls.
+    bool decrypt(const unsigned char* in, size_t len, std::string& out) {
+        if (!ctx_ || len != block_size_) return false;
+        out.resize(block_size_);
+        size_t outlen = out.size();
+        if (EVP_PKEY_decrypt(ctx_, reinterpret_cast<unsigned char*>(&out[0]), &outlen, in, len) <= 0) {
+            ERR_clear_error();
+            out.clear();
+            return false;
+        }
+        out.resize(outlen);
+        return true;
+    }
+
+    // base64url text -> plaintext, using `scratch` for the decoded ciphertext.
+    bool decrypt_message(const char* b64, size_t len, std::vector<unsigned char>& scratch, std::string& out) {
+        if (!base64url_decode(b64, len, scratch)) return false;
+        return decrypt(scratch.data(), scratch.size(), out);
+    }
+
+private:
+    EVP_PKEY_CTX* ctx_ = nullptr;
+    size_t block_size_ = 0;
+};
@@ -0,0 +1,147 @@
+// Benchmark for SimilarityIndex (similarity_index.h) on a synthetic fleet.
+//
+// Machines get a random UUID, machine GUID and disk serial (a few share a
+// cloned-image GUID or report a placeholder serial). The index grows through
+// the checkpoint sizes; at each one it is queried with drifted registrations
+// of known machines and with machines it has never seen:
+//
+//   disk       new disk serial                    (Jaccard 0.5)
+//   board      new UUID                           (Jaccard 0.5)
+//   reinstall  new machine GUID                   (Jaccard 0.5)
+//   two        new disk serial and machine GUID   (Jaccard 0.2)
+//   unseen     a machine not in the index         (should not match)
+//
+// and reports recall@1, query latency (mean and p99) and index bytes per entry.
+//
+// Build: see BUILD.md ("Reference backend").
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "similarity_index.h"
+
+namespace {
+
+struct Machine {
+    std::string uuid, guid, serial;
+};
+
+std::string random_hex(std::mt19937_64& rng, size_t digits) {
+    static const char hex[] = "0123456789ABCDEF";
+    std::string out;
+    for (size_t i = 0; i < digits; ++i) out += hex[rng() & 15];
+    return out;
+}
+
+// Machine `n` of the fleet, the same on every call
+Machine fleet_machine(uint64_t n) {
+    std::mt19937_64 rng(n * 0x9e3779b97f4a7c15ull + 1);
+    Machine m;
+    m.uuid = random_hex(rng, 32);
+    m.guid = rng() % 200 == 0 ? "CLONED-IMAGE-" + std::to_string(rng() % 20) : random_hex(rng, 32);
+    m.serial = rng() % 100 == 0 ? "To Be Filled By O.E.M." : "WD-" + random_hex(rng, 12);
+    return m;
+}
+
+std::vector<std::string> tokens_of(const Machine& m) {
+    return SimilarityIndex::components(m.uuid, m.guid, {m.serial});
+}
+
+struct Scenario {
+    const char* name;
+    bool known;
+    void (*drift)(Machine&, std::mt19937_64&);
+};
+
+const Scenario SCENARIOS[] = {
+    {"disk", true, [](Machine& m, std::mt19937_64& rng) { m.serial = "ST-" + random_hex(rng, 12); }},
+    {"board", true, [](Machine& m, std::mt19937_64& rng) { m.uuid = random_hex(rng, 32); }},
+    {"reinstall", true, [](Machine& m, std::mt19937_64& rng) { m.guid = random_hex(rng, 32); }},
+    {"two", true,
+     [](Machine& m, std::mt19937_64& rng) {
+         m.serial = "ST-" + random_hex(rng, 12);
+         m.guid = random_hex(rng, 32);
+     }},
+    {"unseen", false, [](Machine& m, std::mt19937_64& rng) { m = fleet_machine((1ull << 40) + rng() % (1ull << 40)); }},
+};
+
+void measure(const SimilarityIndex& index, size_t fleet, size_t queries, double min_similarity) {
+    printf("%9zu machines  %6.1f B/entry\n", fleet, (double)index.memory_bytes() / index.size());
+    std::mt19937_64 rng(fleet);
+    for (const auto& scenario : SCENARIOS) {
+        std::vector<double> latencies;
+        size_t hits = 0;
+        for (size_t q = 0; q < queries; ++q) {
+            uint64_t id = rng() % fleet;
+            Machine m = fleet_machine(id);
+            scenario.drift(m, rng);
+            std::vector<std::string> tokens = tokens_of(m);
+
+            auto start = std::chrono::steady_clock::now();
+            std::vector<SimilarityIndex::Match> matches = index.query(tokens, 5, min_similarity);
+            latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+
+            if (scenario.known) hits += !matches.empty() && matches[0].id == id;
+            else hits += !matches.empty();
+        }
+        std::sort(latencies.begin(), latencies.end());
+        double mean = 0;
+        for (double l : latencies) mean += l;
+        mean /= latencies.size();
+        printf("  %-10s %s %6.2f%%   %6.2f us mean  %6.2f us p99\n", scenario.name,
+               scenario.known ? "recall@1   " : "false match", 100.0 * hits / queries, mean,
+               latencies[latencies.size() * 99 / 100]);
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::vector<size_t> sizes = {1000000, 2000000, 5000000, 10000000};
+    size_t queries = 20000;
+    double min_similarity = 0.3;
+    SimilarityIndex::Params params;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--sizes" && i + 1 < argc) {
+            sizes.clear();
+            for (char* p = argv[++i]; *p;) {
+                sizes.push_back(strtoull(p, &p, 10));
+                if (*p == ',') ++p;
+                else if (*p) break;
+            }
+        } else if (arg == "--queries" && i + 1 < argc) queries = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--bands" && i + 1 < argc) params.bands = (unsigned)atoi(argv[++i]);
+        else if (arg == "--rows" && i + 1 < argc) params.rows = (unsigned)atoi(argv[++i]);
+        else if (arg == "--min-similarity" && i + 1 < argc) min_similarity = atof(argv[++i]);
+        else {
+            std::cerr << "usage: similarity_bench [--sizes 1000000,10000000] [--queries N] [--bands B] [--rows R]"
+                      << " [--min-similarity S]\n";
+            return 1;
+        }
+    }
+    std::sort(sizes.begin(), sizes.end());
+    if (sizes.empty() || sizes[0] == 0 || queries == 0) {
+        std::cerr << "need positive --sizes and --queries\n";
+        return 1;
+    }
+
+    SimilarityIndex index(params);
+    printf("%u bands x %u rows, min similarity %.2f, %zu queries per scenario\n", index.params().bands,
+           index.params().rows, min_similarity, queries);
+    size_t inserted = 0;
+    for (size_t size : sizes) {
+        auto start = std::chrono::steady_clock::now();
+        index.reserve(size);
+        for (; inserted < size; ++inserted) index.insert(inserted, tokens_of(fleet_machine(inserted)));
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("inserted up to %zu in %.1f s\n", size, seconds);
+        measure(index, size, queries, min_similarity);
+    }
+    return 0;
+}
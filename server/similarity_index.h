@@ -0,0 +1,226 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+#include "../canonical_fingerprint.h"
+#include "../json.hpp"
+
+// Fuzzy lookup of machines by hardware components, for registrations whose
+// exact identity changed (disk swapped, motherboard replaced, OS reinstalled).
+//
+// Each registration becomes a small set of normalized component tokens and a
+// MinHash signature of `bands * rows` 32-bit values; two signatures agree in
+// a position with probability equal to the Jaccard similarity of the sets.
+// Every band (`rows` consecutive values) is a bucket key, so a query only
+// visits entries sharing at least one whole band with it and then scores
+// them on the full signature. A band of r rows matches with probability
+// J^r, so an entry is a candidate with probability 1 - (1 - J^r)^bands. A
+// registration has only about three components (one replaced: J = 0.5), so
+// the defaults are single-row bands: 16 of them find such a machine almost
+// surely, and `min_similarity` on the 16-value estimate decides the rest
+// (server/similarity_bench.cpp measures both). Larger component sets want
+// rows = 2 or more to keep unrelated machines out of the candidates.
+//
+// Storage is flat: per entry the signature, the caller's id and one chain
+// link per band; per band key a bucket head in a power-of-two table that is
+// rebuilt from the signatures when it fills up. Entries are never removed; a
+// machine that drifted is added again under the id it matched. Chains are
+// newest first and capped at `max_chain` per band, which bounds queries that
+// hit a component shared by thousands of machines (cloned VM images).
+// Thread-safe: queries share a lock, inserts take it exclusively.
+class SimilarityIndex {
+public:
+    struct Params {
+        unsigned bands = 16;
+        unsigned rows = 1;
+        unsigned max_chain = 64;
+    };
+
+    struct Match {
+        uint64_t id;
+        double similarity;  // estimated Jaccard similarity of the component sets
+    };
+
+    SimilarityIndex() : SimilarityIndex(Params()) {}
+    explicit SimilarityIndex(Params params) : params_(params) {
+        if (params_.bands == 0) params_.bands = 1;
+        if (params_.rows == 0) params_.rows = 1;
+        if (params_.max_chain == 0) params_.max_chain = 1;
+        width_ = params_.bands * params_.rows;
+    }
+
+    // Normalized, deduplicated component tokens; identifiers that are blank
+    // or firmware placeholders (normalize_identifier()) are left out
+    static std::vector<std::string> components(const std::string& uuid, const std::string& machine_guid,
+                                               const std::vector<std::string>& serials) {
+        std::vector<std::string> tokens;
+        std::string id = normalize_identifier(uuid);
+        if (!id.empty()) tokens.push_back("u:" + id);
+        id = normalize_identifier(machine_guid);
+        if (!id.empty()) tokens.push_back("g:" + id);
+        for (const auto& serial : serials) {
+            id = normalize_identifier(serial);
+            if (!id.empty()) tokens.push_back("s:" + id);
+        }
+        std::sort(tokens.begin(), tokens.end());
+        tokens.erase(std::unique(tokens.begin(), tokens.end()), tokens.end());
+        return tokens;
+    }
+
+    // The components of a registration (registration_schema.h)
+    static std::vector<std::string> components(const nlohmann::json& registration) {
+        return components(registration.value("hwid", ""), registration.value("machineguid", ""),
+                          {registration.value("hwserial", "")});
+    }
+
+    // False (and nothing stored) for an empty component set
+    bool insert(uint64_t id, const std::vector<std::string>& tokens) {
+        std::vector<uint32_t> sig;
+        if (!signature(tokens, sig)) return false;
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (ids_.size() >= NIL) return false;
+        uint32_t entry = (uint32_t)ids_.size();
+        ids_.push_back(id);
+        sigs_.insert(sigs_.end(), sig.begin(), sig.end());
+        next_.resize(next_.size() + params_.bands, NIL);
+        if (ids_.size() > band_mask_) rebuild(ids_.size() * 2);
+        else link(entry);
+        return true;
+    }
+
+    // Up to `max_results` ids at `min_similarity` or above, best first; an
+    // id stored more than once is reported with its best entry
+    std::vector<Match> query(const std::vector<std::string>& tokens, size_t max_results = 5,
+                             double min_similarity = 0.3) const {
+        std::vector<Match> matches;
+        std::vector<uint32_t> sig;
+        if (!signature(tokens, sig)) return matches;
+
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        if (buckets_.empty()) return matches;
+        std::vector<uint32_t> seen;
+        for (unsigned band = 0; band < params_.bands; ++band) {
+            const uint32_t* key = sig.data() + band * params_.rows;
+            uint32_t entry = buckets_[bucket(key, band)];
+            for (unsigned steps = 0; entry != NIL && steps < params_.max_chain; ++steps) {
+                const uint32_t* other = &sigs_[(size_t)entry * width_] + band * params_.rows;
+                // Buckets are shared by unrelated keys; only a whole-band match counts
+                if (std::equal(key, key + params_.rows, other) &&
+                    std::find(seen.begin(), seen.end(), entry) == seen.end()) {
+                    seen.push_back(entry);
+                    double similarity = agreement(sig.data(), &sigs_[(size_t)entry * width_]);
+                    if (similarity >= min_similarity) add_match(matches, {ids_[entry], similarity});
+                }
+                entry = next_[(size_t)entry * params_.bands + band];
+            }
+        }
+        std::sort(matches.begin(), matches.end(), [](const Match& a, const Match& b) {
+            return a.similarity != b.similarity ? a.similarity > b.similarity : a.id < b.id;
+        });
+        if (matches.size() > max_results) matches.resize(max_results);
+        return matches;
+    }
+
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        return ids_.size();
+    }
+
+    // Heap bytes held by the index (capacity, not just what is in use)
+    size_t memory_bytes() const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        return ids_.capacity() * sizeof(uint64_t) + sigs_.capacity() * sizeof(uint32_t) +
+               next_.capacity() * sizeof(uint32_t) + buckets_.capacity() * sizeof(uint32_t);
+    }
+
+    // Sizes the storage for `entries` up front (avoids rebuilds while loading)
+    void reserve(size_t entries) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        ids_.reserve(entries);
+        sigs_.reserve(entries * width_);
+        next_.reserve(entries * params_.bands);
+        if (entries > band_mask_) rebuild(entries);
+    }
+
+    const Params& params() const { return params_; }
+
+private:
+    static constexpr uint32_t NIL = 0xffffffffu;
+
+    static uint64_t mix(uint64_t x) {
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    bool signature(const std::vector<std::string>& tokens, std::vector<uint32_t>& sig) const {
+        if (tokens.empty()) return false;
+        sig.assign(width_, 0xffffffffu);
+        for (const auto& token : tokens) {
+            uint64_t h = 0xcbf29ce484222325ull;  // FNV-1a
+            for (unsigned char c : token) h = (h ^ c) * 0x100000001b3ull;
+            for (unsigned i = 0; i < width_; ++i) {
+                uint32_t v = (uint32_t)(mix(h + i * 0x632be59bd9b4e019ull) >> 32);
+                if (v < sig[i]) sig[i] = v;
+            }
+        }
+        return true;
+    }
+
+    // Each band has its own slice of the table, so a chain only ever holds
+    // entries linked under that band
+    size_t bucket(const uint32_t* key, unsigned band) const {
+        uint64_t h = mix(band);
+        for (unsigned r = 0; r < params_.rows; ++r) h = mix(h ^ key[r]);
+        return band * (band_mask_ + 1) + (h & band_mask_);
+    }
+
+    double agreement(const uint32_t* a, const uint32_t* b) const {
+        unsigned same = 0;
+        for (unsigned i = 0; i < width_; ++i) same += a[i] == b[i];
+        return (double)same / width_;
+    }
+
+    static void add_match(std::vector<Match>& matches, Match match) {
+        for (auto& m : matches) {
+            if (m.id == match.id) {
+                m.similarity = std::max(m.similarity, match.similarity);
+                return;
+            }
+        }
+        matches.push_back(match);
+    }
+
+    void link(uint32_t entry) {
+        const uint32_t* sig = &sigs_[(size_t)entry * width_];
+        for (unsigned band = 0; band < params_.bands; ++band) {
+            uint32_t& head = buckets_[bucket(sig + band * params_.rows, band)];
+            next_[(size_t)entry * params_.bands + band] = head;
+            head = entry;
+        }
+    }
+
+    // A bucket per band and expected entry, re-linked in insertion order so
+    // chains stay newest first
+    void rebuild(size_t entries) {
+        size_t capacity = 1024;
+        while (capacity < entries) capacity *= 2;
+        band_mask_ = capacity - 1;
+        buckets_.assign(capacity * params_.bands, NIL);
+        buckets_.shrink_to_fit();
+        for (uint32_t entry = 0; entry < (uint32_t)ids_.size(); ++entry) link(entry);
+    }
+
+    Params params_;
+    unsigned width_;
+    size_t band_mask_ = 0;  // buckets per band - 1; 0 before the first rebuild
+    mutable std::shared_mutex mutex_;
+    std::vector<uint64_t> ids_;
+    std::vector<uint32_t> sigs_;     // width_ per entry
+    std::vector<uint32_t> next_;     // bands per entry: next entry in the same bucket
+    std::vector<uint32_t> buckets_;  // newest entry per bucket
+};
@@ -0,0 +1,159 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Operations SessionManager needs from the WebView2 host. main.cpp implements
+// them on top of one shared ICoreWebView2Environment; a fake can stand in to
+// drive the manager without WebView2.
+class SessionEnvironment {
+public:
+    using Done = std::function<void(bool ok)>;
+
+    virtual ~SessionEnvironment() = default;
+    // Called once, before the first controller is requested.
+    virtual void create_environment(Done done) = 0;
+    // Creates the window/controller for `id`. An empty profile is the
+    // environment's default (persistent) profile; named profiles are private.
+    virtual void create_controller(uint64_t id, const std::string& profile, Done done) = 0;
+    virtual void destroy_controller(uint64_t id) = 0;
+};
+
+// Login sessions (one window + controller each) hosted by a single process.
+// All sessions share one environment, i.e. one browser process; each costs a
+// renderer. The first session uses the default profile, later concurrent
+// sessions get their own profile when isolation is on so accounts do not
+// share cookies. Profile names are reused once their session has closed.
+//
+// Not thread-safe: call it and complete the Done callbacks on the UI thread.
+class SessionManager {
+public:
+    enum class State { WaitingForEnvironment, CreatingController, Ready, Failed };
+
+    struct Session {
+        uint64_t id = 0;
+        std::string profile;
+        State state = State::WaitingForEnvironment;
+        bool in_use = false;  // showing a login; idle sessions can be reused
+    };
+
+    SessionManager(SessionEnvironment& env, size_t max_sessions, bool isolate_profiles)
+        : env_(env), max_sessions_(max_sessions ? max_sessions : 1), isolate_(isolate_profiles) {}
+
+    // Picks the session for a new login: an idle one if possible, otherwise a
+    // new one. Returns 0 when every session is in use and the limit is reached.
+    uint64_t acquire() {
+        for (auto& s : sessions_) {
+            if (!s.in_use && s.state != State::Failed) {
+                s.in_use = true;
+                return s.id;
+            }
+        }
+        if (sessions_.size() >= max_sessions_) return 0;
+
+        Session s;
+        s.id = next_id_++;
+        s.profile = pick_profile();
+        s.in_use = true;
+        sessions_.push_back(s);
+        uint64_t id = s.id;
+
+        if (env_state_ == EnvState::None) {
+            env_state_ = EnvState::Creating;
+            env_.create_environment([this](bool ok) { on_environment(ok); });
+        } else if (env_state_ == EnvState::Ready) {
+            start_controller(id);
+        } else if (env_state_ == EnvState::Failed) {
+            find_mutable(id)->state = State::Failed;
+        }
+        return id;
+    }
+
+    // The session's window was hidden; it may be reused by acquire().
+    void release(uint64_t id) {
+        if (Session* s = find_mutable(id)) s->in_use = false;
+    }
+
+    // The session's window is gone; its profile becomes free.
+    void close(uint64_t id) {
+        for (size_t i = 0; i < sessions_.size(); ++i) {
+            if (sessions_[i].id != id) continue;
+            bool had_controller = sessions_[i].state != State::WaitingForEnvironment;
+            sessions_.erase(sessions_.begin() + i);
+            if (had_controller) env_.destroy_controller(id);
+            return;
+        }
+    }
+
+    const Session* find(uint64_t id) const {
+        for (const auto& s : sessions_) {
+            if (s.id == id) return &s;
+        }
+        return nullptr;
+    }
+
+    std::vector<uint64_t> ids() const {
+        std::vector<uint64_t> out;
+        for (const auto& s : sessions_) out.push_back(s.id);
+        return out;
+    }
+
+    size_t size() const { return sessions_.size(); }
+    size_t max_sessions() const { return max_sessions_; }
+    bool environment_ready() const { return env_state_ == EnvState::Ready; }
+    bool environment_failed() const { return env_state_ == EnvState::Failed; }
+
+private:
+    enum class EnvState { None, Creating, Ready, Failed };
+
+    Session* find_mutable(uint64_t id) {
+        for (auto& s : sessions_) {
+            if (s.id == id) return &s;
+        }
+        return nullptr;
+    }
+
+    // "" (default profile) first, then the lowest free "session-N"
+    std::string pick_profile() const {
+        auto taken = [this](const std::string& name) {
+            for (const auto& s : sessions_) {
+                if (s.profile == name) return true;
+            }
+            return false;
+        };
+        if (!isolate_ || !taken("")) return "";
+        for (size_t n = 2;; ++n) {
+            std::string name = "session-" + std::to_string(n);
+            if (!taken(name)) return name;
+        }
+    }
+
+    void on_environment(bool ok) {
+        env_state_ = ok ? EnvState::Ready : EnvState::Failed;
+        // Sessions acquired while the environment was being created
+        for (uint64_t id : ids()) {
+            Session* s = find_mutable(id);
+            if (!s || s->state != State::WaitingForEnvironment) continue;
+            if (ok) start_controller(id);
+            else s->state = State::Failed;
+        }
+    }
+
+    void start_controller(uint64_t id) {
+        Session* s = find_mutable(id);
+        s->state = State::CreatingController;
+        env_.create_controller(id, s->profile, [this, id](bool ok) {
+            // The session may have been closed while its controller was created
+            if (Session* s = find_mutable(id)) s->state = ok ? State::Ready : State::Failed;
+        });
+    }
+
+    SessionEnvironment& env_;
+    size_t max_sessions_;
+    bool isolate_;
+    EnvState env_state_ = EnvState::None;
+    uint64_t next_id_ = 1;
+    std::vector<Session> sessions_;
+};
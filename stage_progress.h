@@ -0,0 +1,91 @@
+#pragma once
+#include <cmath>
+
+// Stages of bringing up a login window, in order. Workers report a stage when
+// they start it; skipped stages (e.g. a cached fingerprint) count as done.
+enum class LoginStage { Starting, Fingerprint, NetworkInfo, Encrypting, Backend, PageLoading, Ready };
+
+// Progress shown on the splash while the handshake runs. Each stage has an
+// expected duration; inside a stage the bar approaches the stage's end
+// asymptotically (it never stalls and never claims a stage is done before it
+// is reported), and it never moves backwards. No Win32 dependency: the host
+// feeds it stage reports and a clock in milliseconds.
+class StageProgress {
+public:
+    StageProgress() { reset(0); }
+
+    void reset(double now_ms) {
+        stage_ = LoginStage::Starting;
+        stage_started_ms_ = now_ms;
+        shown_ = 0;
+        failed_ = false;
+    }
+
+    // Moves to `stage` unless it is behind the current one. Returns true if
+    // the stage changed (the label needs repainting).
+    bool begin(LoginStage stage, double now_ms) {
+        if (failed_ || stage <= stage_) return false;
+        shown_ = fraction(now_ms);
+        stage_ = stage;
+        stage_started_ms_ = now_ms;
+        return true;
+    }
+
+    void fail() { failed_ = true; }
+
+    // 0..1 for the progress bar
+    double fraction(double now_ms) const {
+        if (stage_ == LoginStage::Ready) return 1.0;
+        double done = 0;
+        for (int s = 0; s < (int)stage_; ++s) done += expected_ms((LoginStage)s);
+        double expected = expected_ms(stage_);
+        double elapsed = now_ms > stage_started_ms_ ? now_ms - stage_started_ms_ : 0;
+        double partial = expected * (1.0 - std::exp(-elapsed / expected));
+        double value = (done + partial) / total_ms();
+        return value > shown_ ? value : shown_;
+    }
+
+    LoginStage stage() const { return stage_; }
+    bool failed() const { return failed_; }
+    bool ready() const { return stage_ == LoginStage::Ready; }
+
+    const wchar_t* label() const {
+        if (failed_) return L"Sign-in could not be started";
+        switch (stage_) {
+        case LoginStage::Starting: return L"Starting\x2026";
+        case LoginStage::Fingerprint: return L"Checking this device\x2026";
+        case LoginStage::NetworkInfo: return L"Checking the network\x2026";
+        case LoginStage::Encrypting: return L"Securing the request\x2026";
+        case LoginStage::Backend: return L"Contacting the server\x2026";
+        case LoginStage::PageLoading: return L"Loading the login page\x2026";
+        case LoginStage::Ready: return L"";
+        }
+        return L"";
+    }
+
+    // Rough typical durations; only the proportions matter
+    static double expected_ms(LoginStage stage) {
+        switch (stage) {
+        case LoginStage::Starting: return 100;
+        case LoginStage::Fingerprint: return 400;
+        case LoginStage::NetworkInfo: return 1200;
+        case LoginStage::Encrypting: return 50;
+        case LoginStage::Backend: return 800;
+        case LoginStage::PageLoading: return 1000;
+        case LoginStage::Ready: return 1;
+        }
+        return 1;
+    }
+
+private:
+    static double total_ms() {
+        double total = 0;
+        for (int s = 0; s < (int)LoginStage::Ready; ++s) total += expected_ms((LoginStage)s);
+        return total;
+    }
+
+    LoginStage stage_;
+    double stage_started_ms_;
+    double shown_;
+    bool failed_;
+};
@@ -0,0 +1,442 @@
+#pragma once
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "event_loop.h"
+
+// C++20 coroutines on top of EventLoop. A Task<T> is lazy: it runs when it
+// is co_awaited by another task or start()ed at the top level, always on the
+// loop thread. Blocking calls (WMI, WinINet, RSA) go through Offload, which
+// runs them on a thread and resumes the task on the loop when they return.
+//
+//   Task<std::string> login(Offload& offload, CancelToken token) {
+//       auto [hw, net] = co_await when_all(probe_hardware(...), probe_network(...));
+//       auto send = [=] { return post_registration(...); };
+//       std::string reply = co_await offload.call(send, token);
+//       co_return parse(reply);
+//   }
+//
+// No Win32 dependency beyond EventLoop's, so flows can be driven on Linux
+// with stub calls.
+
+// Thrown out of co_await when the task's CancelToken fires
+struct TaskCancelled : std::exception {
+    const char* what() const noexcept override { return "cancelled"; }
+};
+
+// Shared cancellation flag with an optional deadline. Copies refer to the
+// same state. Loop thread only.
+class CancelToken {
+public:
+    using Callback = std::function<void()>;
+
+    CancelToken() : state_(std::make_shared<State>()) {}
+
+    void cancel() {
+        if (state_->cancelled) return;
+        state_->cancelled = true;
+        std::map<uint64_t, Callback> callbacks;
+        callbacks.swap(state_->callbacks);
+        for (auto& entry : callbacks) entry.second();
+    }
+
+    // Cancels the token `timeout_ms` from now unless it is cancelled first
+    void cancel_after(EventLoop& loop, double timeout_ms) {
+        std::weak_ptr<State> weak = state_;
+        loop.call_later(timeout_ms, [weak] {
+            if (auto state = weak.lock()) CancelToken(state).cancel();
+        });
+    }
+
+    bool cancelled() const { return state_->cancelled; }
+
+    // Runs `callback` on cancel() (at once if already cancelled). Returns an
+    // id for remove(); 0 if it already ran.
+    uint64_t on_cancel(Callback callback) {
+        if (state_->cancelled) {
+            callback();
+            return 0;
+        }
+        uint64_t id = state_->next_id++;
+        state_->callbacks[id] = std::move(callback);
+        return id;
+    }
+
+    void remove(uint64_t id) { state_->callbacks.erase(id); }
+
+private:
+    struct State {
+        bool cancelled = false;
+        uint64_t next_id = 1;
+        std::map<uint64_t, Callback> callbacks;
+    };
+
+    explicit CancelToken(std::shared_ptr<State> state) : state_(std::move(state)) {}
+
+    std::shared_ptr<State> state_;
+};
+
+template <typename T>
+class Task;
+
+namespace task_detail {
+
+class PromiseBase {
+public:
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    // Hands control to whoever waits for the task: the awaiting coroutine
+    // (symmetric transfer) or the start() callback.
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) noexcept {
+            PromiseBase& promise = h.promise();
+            if (promise.continuation_) return promise.continuation_;
+            // The callback may destroy this frame; nothing here touches it afterwards
+            std::function<void()> done = std::move(promise.done_);
+            if (done) done();
+            return std::noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() { error_ = std::current_exception(); }
+
+    std::coroutine_handle<> continuation_;
+    std::function<void()> done_;
+    std::exception_ptr error_;
+};
+
+template <typename T>
+class Promise : public PromiseBase {
+public:
+    Task<T> get_return_object();
+    template <typename U>
+    void return_value(U&& value) { value_.emplace(std::forward<U>(value)); }
+
+    T take() {
+        if (error_) std::rethrow_exception(error_);
+        return std::move(*value_);
+    }
+
+private:
+    std::optional<T> value_;
+};
+
+template <>
+class Promise<void> : public PromiseBase {
+public:
+    Task<void> get_return_object();
+    void return_void() {}
+
+    void take() {
+        if (error_) std::rethrow_exception(error_);
+    }
+};
+
+}  // namespace task_detail
+
+template <typename T = void>
+class Task {
+public:
+    using promise_type = task_detail::Promise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    Task() = default;
+    explicit Task(Handle h) : h_(h) {}
+    Task(Task&& other) noexcept : h_(std::exchange(other.h_, {})) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (h_) h_.destroy();
+            h_ = std::exchange(other.h_, {});
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (h_) h_.destroy();
+    }
+
+    bool valid() const { return (bool)h_; }
+    bool done() const { return h_ && h_.done(); }
+
+    // Runs the task from the top level; `on_done` runs once it has finished
+    // (its result or exception is then available from get()). The task
+    // object must stay alive until then.
+    void start(std::function<void()> on_done = nullptr) {
+        h_.promise().done_ = std::move(on_done);
+        h_.resume();
+    }
+
+    // Result of a finished task; rethrows its exception
+    T get() { return h_.promise().take(); }
+
+    // co_await task: runs it and resumes the awaiting coroutine with its result
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            Handle h;
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                h.promise().continuation_ = awaiting;
+                return h;
+            }
+            T await_resume() { return h.promise().take(); }
+        };
+        return Awaiter{h_};
+    }
+
+private:
+    Handle h_;
+};
+
+template <typename T>
+Task<T> task_detail::Promise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> task_detail::Promise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+// Runs both tasks concurrently and resumes when both have finished. If one
+// fails, its exception is rethrown after the other one has finished too
+// (share a CancelToken to stop it early).
+template <typename A, typename B>
+Task<std::pair<A, B>> when_all(Task<A> a, Task<B> b) {
+    struct Join {
+        int remaining = 2;
+        std::coroutine_handle<> waiting;
+        void arrive() {
+            if (--remaining == 0 && waiting) waiting.resume();
+        }
+        bool await_ready() const noexcept { return remaining == 0; }
+        void await_suspend(std::coroutine_handle<> h) noexcept { waiting = h; }
+        void await_resume() const noexcept {}
+    } join;
+    a.start([&join] { join.arrive(); });
+    b.start([&join] { join.arrive(); });
+    co_await join;
+    A first = a.get();
+    co_return std::pair<A, B>(std::move(first), b.get());
+}
+
+// Runs blocking calls on their own threads and resumes the awaiting task on
+// the loop with the result. A cancelled call resumes the task at once with
+// TaskCancelled; the thread still runs to the end and its result is dropped.
+// join() (or the destructor) waits for calls still running, so an Offload
+// must be destroyed before the EventLoop it posts to.
+class Offload {
+public:
+    explicit Offload(EventLoop& loop) : loop_(loop) {}
+    ~Offload() { join(); }
+
+    Offload(const Offload&) = delete;
+    Offload& operator=(const Offload&) = delete;
+
+    // Pass a named callable rather than a lambda written inside the co_await
+    // expression: g++ 12 destroys such temporaries twice.
+    template <typename Fn>
+    auto call(Fn fn, CancelToken token = CancelToken()) {
+        using R = std::invoke_result_t<Fn&>;
+        return Awaiter<R, Fn>(*this, std::move(fn), std::move(token));
+    }
+
+    void join() {
+        for (auto& t : threads_) {
+            if (t.thread.joinable()) t.thread.join();
+        }
+        threads_.clear();
+    }
+
+    size_t running() const {
+        size_t n = 0;
+        for (const auto& t : threads_) n += !t.finished->load();
+        return n;
+    }
+
+    EventLoop& loop() const { return loop_; }
+
+private:
+    template <typename R>
+    struct Shared {
+        std::optional<std::conditional_t<std::is_void_v<R>, bool, R>> value;
+        std::exception_ptr error;
+        bool cancelled = false;
+        bool resumed = false;  // the coroutine was resumed or went away
+        std::coroutine_handle<> waiting;
+    };
+
+    template <typename R, typename Fn>
+    class Awaiter {
+    public:
+        Awaiter(Offload& offload, Fn fn, CancelToken token)
+            : offload_(offload), fn_(std::move(fn)), token_(std::move(token)), shared_(std::make_shared<Shared<R>>()) {}
+        Awaiter(const Awaiter&) = delete;
+        Awaiter(Awaiter&&) = default;
+
+        ~Awaiter() {
+            // A frame destroyed mid-call must not be resumed by the thread's post
+            if (shared_) shared_->resumed = true;
+            if (cancel_id_) token_.remove(cancel_id_);
+        }
+
+        bool await_ready() {
+            if (token_.cancelled()) throw TaskCancelled();
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> h) {
+            shared_->waiting = h;
+            auto shared = shared_;
+            EventLoop& loop = offload_.loop_;
+            cancel_id_ = token_.on_cancel([shared, &loop] {
+                shared->cancelled = true;
+                // Resume on a fresh turn rather than inside cancel()
+                loop.post([shared] { resume(*shared); });
+            });
+            offload_.spawn([shared, fn = std::move(fn_), &loop]() mutable {
+                try {
+                    if constexpr (std::is_void_v<R>) {
+                        fn();
+                        shared->value.emplace(true);
+                    } else {
+                        shared->value.emplace(fn());
+                    }
+                } catch (...) {
+                    shared->error = std::current_exception();
+                }
+                loop.post([shared] { resume(*shared); });
+            });
+        }
+
+        R await_resume() {
+            if (cancel_id_) token_.remove(cancel_id_);
+            cancel_id_ = 0;
+            if (shared_->cancelled) throw TaskCancelled();
+            if (shared_->error) std::rethrow_exception(shared_->error);
+            if constexpr (!std::is_void_v<R>) return std::move(*shared_->value);
+        }
+
+    private:
+        static void resume(Shared<R>& shared) {
+            if (shared.resumed) return;
+            shared.resumed = true;
+            shared.waiting.resume();
+        }
+
+        Offload& offload_;
+        Fn fn_;
+        CancelToken token_;
+        uint64_t cancel_id_ = 0;
+        std::shared_ptr<Shared<R>> shared_;
+    };
+
+    struct Worker {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> finished;
+    };
+
+    template <typename Body>
+    void spawn(Body body) {
+        reap();
+        auto finished = std::make_shared<std::atomic<bool>>(false);
+        std::thread thread([body = std::move(body), finished]() mutable {
+            body();
+            finished->store(true);
+        });
+        threads_.push_back({std::move(thread), finished});
+    }
+
+    // Joins threads that have already returned
+    void reap() {
+        for (size_t i = 0; i < threads_.size();) {
+            if (threads_[i].finished->load()) {
+                threads_[i].thread.join();
+                threads_.erase(threads_.begin() + i);
+            } else {
+                ++i;
+            }
+        }
+    }
+
+    EventLoop& loop_;
+    std::vector<Worker> threads_;
+};
+
+// co_await sleep_for(loop, ms, token): resumes the task on the loop after
+// `delay_ms`, or at once with TaskCancelled when `token` fires. A delay of
+// 0 or less does not suspend.
+class SleepFor {
+public:
+    SleepFor(EventLoop& loop, double delay_ms, CancelToken token)
+        : loop_(loop), delay_ms_(delay_ms), token_(std::move(token)), state_(std::make_shared<State>()) {}
+    SleepFor(const SleepFor&) = delete;
+    SleepFor(SleepFor&&) = default;
+
+    ~SleepFor() {
+        if (!state_) return;
+        // A frame destroyed mid-sleep must not be resumed by the timer
+        state_->resumed = true;
+        if (timer_) loop_.cancel(timer_);
+        if (cancel_id_) token_.remove(cancel_id_);
+    }
+
+    bool await_ready() {
+        if (token_.cancelled()) throw TaskCancelled();
+        return delay_ms_ <= 0;
+    }
+
+    void await_suspend(std::coroutine_handle<> h) {
+        state_->waiting = h;
+        auto state = state_;
+        EventLoop& loop = loop_;
+        timer_ = loop.call_later(delay_ms_, [state] { resume(*state); });
+        cancel_id_ = token_.on_cancel([state, &loop] {
+            state->cancelled = true;
+            // Resume on a fresh turn rather than inside cancel()
+            loop.post([state] { resume(*state); });
+        });
+    }
+
+    void await_resume() {
+        if (timer_) loop_.cancel(timer_);
+        if (cancel_id_) token_.remove(cancel_id_);
+        timer_ = cancel_id_ = 0;
+        if (state_ && state_->cancelled) throw TaskCancelled();
+    }
+
+private:
+    struct State {
+        bool cancelled = false;
+        bool resumed = false;
+        std::coroutine_handle<> waiting;
+    };
+
+    static void resume(State& state) {
+        if (state.resumed) return;
+        state.resumed = true;
+        state.waiting.resume();
+    }
+
+    EventLoop& loop_;
+    double delay_ms_;
+    CancelToken token_;
+    EventLoop::TimerId timer_ = 0;
+    uint64_t cancel_id_ = 0;
+    std::shared_ptr<State> state_;
+};
+
+inline SleepFor sleep_for(EventLoop& loop, double delay_ms, CancelToken token = CancelToken()) {
+    return SleepFor(loop, delay_ms, std::move(token));
+}
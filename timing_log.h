@@ -0,0 +1,55 @@
+#pragma once
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Startup/page-load timing output. Marks are milliseconds since the log was
+// created (process start for the global instance) and are printed as they
+// happen when enabled.
+class TimingLog {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Mark {
+        double ms;
+        std::string label;
+    };
+
+    TimingLog() : origin_(Clock::now()) {}
+
+    void set_enabled(bool enabled) { enabled_ = enabled; }
+    bool enabled() const { return enabled_; }
+
+    double now_ms() const {
+        return std::chrono::duration<double, std::milli>(Clock::now() - origin_).count();
+    }
+
+    void mark(const std::string& label) { mark_at(now_ms(), label); }
+
+    void mark_at(double ms, const std::string& label) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        marks_.push_back({ms, label});
+        if (enabled_) {
+            std::cout << "[timing] +" << std::fixed << std::setprecision(1) << ms << " ms  " << label << std::endl;
+        }
+    }
+
+    std::vector<Mark> marks() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return marks_;
+    }
+
+private:
+    Clock::time_point origin_;
+    bool enabled_ = false;
+    mutable std::mutex mutex_;
+    std::vector<Mark> marks_;
+};
+
+inline TimingLog& timing_log() {
+    static TimingLog log;
+    return log;
+}
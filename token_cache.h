@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <openssl/evp.h>
+#include "json.hpp"
+#include "handshake.h"
+#include "protected_file.h"
+
+// SHA-256 (hex) of what identifies the machine a token was issued to: the
+// canonical hardware identity plus the client build. Network info is left
+// out so the check needs no round trip; the backend still sees the IP when
+// the token is used.
+inline std::string hardware_digest(const Fingerprint& fp, const std::string& dcid, const std::string& version) {
+    std::string canonical = canonical_fingerprint(fp.uuid, fp.machine_guid, fp.serials) + "\n" + dcid + "\n" + version;
+
+    unsigned char hash[EVP_MAX_MD_SIZE];
+    unsigned int len = 0;
+    if (!EVP_Digest(canonical.data(), canonical.size(), hash, &len, EVP_sha256(), nullptr)) return "";
+    static const char hex[] = "0123456789abcdef";
+    std::string out;
+    for (unsigned int i = 0; i < len; ++i) {
+        out += hex[hash[i] >> 4];
+        out += hex[hash[i] & 0x0f];
+    }
+    return out;
+}
+
+// Login token kept across launches. The backend opts in per token by sending
+// "expires_in"; until then a relaunch on the same machine navigates straight
+// to the cached login URL instead of registering again. Times are unix
+// seconds (the file outlives the process).
+struct CachedToken {
+    std::string login_url;
+    std::string digest;  // hardware_digest() at issue time
+    int64_t issued_at = 0;
+    int64_t expires_at = 0;
+
+    // Usable for `digest` at `now` with `margin_s` left for the page to load
+    bool usable(const std::string& current_digest, int64_t now, int64_t margin_s) const {
+        return !login_url.empty() && !digest.empty() && digest == current_digest && now + margin_s < expires_at;
+    }
+
+    // Past half its lifetime: time to fetch the next one in the background
+    bool needs_renewal(int64_t now) const { return now >= issued_at + (expires_at - issued_at) / 2; }
+};
+
+// One token in one file (see write_protected()). An empty path disables
+// the cache.
+class TokenCache {
+public:
+    explicit TokenCache(std::string path = "") : path_(std::move(path)) {}
+
+    bool enabled() const { return !path_.empty(); }
+
+    // False if there is no readable token (missing, damaged, another user's)
+    bool load(CachedToken& token) const {
+        if (!enabled()) return false;
+        std::string text;
+        if (!read_protected(path_, text)) return false;
+        nlohmann::json j = nlohmann::json::parse(text, nullptr, false);
+        if (!j.is_object() || !j.contains("v") || !j["v"].is_number_integer() || j["v"] != VERSION) return false;
+        // A field of the wrong type is a damaged file, not an exception
+        for (const char* key : {"url", "digest"}) {
+            if (j.contains(key) && !j[key].is_string()) return false;
+        }
+        for (const char* key : {"issued_at", "expires_at"}) {
+            if (j.contains(key) && !j[key].is_number_integer()) return false;
+        }
+        token.login_url = j.value("url", "");
+        token.digest = j.value("digest", "");
+        token.issued_at = j.value("issued_at", (int64_t)0);
+        token.expires_at = j.value("expires_at", (int64_t)0);
+        return true;
+    }
+
+    bool store(const CachedToken& token) const {
+        if (!enabled()) return false;
+        nlohmann::json j = {{"v", VERSION}, {"url", token.login_url}, {"digest", token.digest},
+                            {"issued_at", token.issued_at}, {"expires_at", token.expires_at}};
+        return write_protected(path_, j.dump());
+    }
+
+    void clear() const {
+        if (enabled()) std::remove(path_.c_str());
+    }
+
+    const std::string& path() const { return path_; }
+
+private:
+    static constexpr int VERSION = 1;
+
+    std::string path_;
+};
@@ -0,0 +1,313 @@
+// The asset pack format of asset_pack.h: build, load, lookup, tampering and
+// verification.
+//
+//   round trip     files written by AssetPackWriter come back byte for byte;
+//                  identical files share a blob, compressible ones are gzip
+//   lookup         binary search over the pack, near misses, URL mapping
+//                  (percent-encoded names included)
+//   malformed      every truncation, bad magic and version, unsorted
+//                  entries and out-of-range tables are refused by load()
+//   tampering      every single-byte change to the pack: load() refuses it,
+//                  verify() reports it, or AssetServer serves only original
+//                  contents and passes damaged blobs to the network
+//   file           load_file() with a non-ASCII file name, and a missing one
+//
+//   g++ -std=c++17 -O2 -I. tools/asset_pack_test.cpp -o asset_pack_test -lcrypto -lz
+//   ./asset_pack_test
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "asset_pack.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (!ok) {
+        printf("  FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+const unsigned char* bytes(const std::string& s) { return (const unsigned char*)s.data(); }
+
+// Login shell files: text that compresses, random bytes that do not, an
+// empty file and two copies of the same script
+std::map<std::string, std::string> sample_files() {
+    std::map<std::string, std::string> files;
+    std::string html = "<!doctype html><title>Login</title>";
+    for (int i = 0; i < 200; ++i) html += "<div class=\"row\">field " + std::to_string(i) + "</div>\n";
+    files["index.html"] = html;
+    files["css/app.css"] = std::string(3000, ' ') + "body { margin: 0 }";
+    files["js/app.js"] = "console.log('login');\n";
+    files["js/copy-of-app.js"] = files["js/app.js"];
+    std::mt19937 rng(7);
+    std::string noise(4096, '\0');
+    for (char& c : noise) c = (char)rng();
+    files["img/logo.png"] = noise;
+    files["empty.txt"] = "";
+    return files;
+}
+
+std::string sample_pack(const std::map<std::string, std::string>& files) {
+    AssetPackWriter writer;
+    for (const auto& f : files) writer.add(f.first, asset_content_type(f.first), f.second);
+    return writer.build();
+}
+
+void round_trip() {
+    printf("round trip\n");
+    auto files = sample_files();
+    AssetPackWriter writer;
+    for (const auto& f : files) writer.add(f.first, asset_content_type(f.first), f.second);
+    std::string data = writer.build();
+    check(writer.blob_count() == files.size() - 1, "identical files not stored once");
+
+    AssetPack pack;
+    std::string error;
+    check(pack.load(bytes(data), data.size(), error), "load: " + error);
+    check(pack.size() == files.size() && pack.blob_count() == files.size() - 1, "entry or blob count");
+    check(pack.verify(error), "verify: " + error);
+    for (const auto& f : files) {
+        AssetPack::Asset a;
+        std::string contents;
+        bool found = pack.find(f.first, a);
+        check(found && pack.read(a, contents) && contents == f.second, f.first + " not read back");
+        if (!found) continue;
+        check(a.path == f.first && a.content_type == asset_content_type(f.first), f.first + " path or type");
+        check(a.raw_size == f.second.size(), f.first + " raw size");
+        check(!a.gzip || a.stored_size < a.raw_size, f.first + " gzip without a gain");
+    }
+    AssetPack::Asset html, png, app, copy;
+    pack.find("index.html", html);
+    pack.find("img/logo.png", png);
+    pack.find("js/app.js", app);
+    pack.find("js/copy-of-app.js", copy);
+    check(html.gzip && !png.gzip, "compressible text stored plain or random bytes compressed");
+    check(app.blob == copy.blob && app.etag() == copy.etag() && app.etag() != html.etag(), "etags by content");
+    check(app.etag().size() == 66 && app.etag().front() == '"', "etag is not a quoted SHA-256");
+
+    std::string empty_pack = AssetPackWriter().build();
+    AssetPack none;
+    check(none.load(bytes(empty_pack), empty_pack.size(), error) && none.size() == 0 && none.verify(error),
+          "empty pack");
+}
+
+void lookup() {
+    printf("lookup\n");
+    auto files = sample_files();
+    std::string data = sample_pack(files);
+    AssetPack pack;
+    std::string error;
+    pack.load(bytes(data), data.size(), error);
+    AssetPack::Asset a;
+    for (const char* miss : {"", "index.htm", "index.html2", "js", "js/", "JS/app.js", "/index.html", "zzz", "a"}) {
+        check(!pack.find(miss, a), std::string("found ") + miss);
+    }
+    AssetPack unloaded;
+    check(!unloaded.loaded() && unloaded.size() == 0 && !unloaded.find("index.html", a), "unloaded pack answers");
+
+    AssetServer server;
+    check(server.open(bytes(data), data.size(), "https://assets.example/shell/", error) && server.enabled(), "open");
+    check(server.path_for("https://assets.example/shell/js/app.js?v=3#top") == "js/app.js", "query and fragment kept");
+    check(server.path_for("https://assets.example/shell/") == "index.html", "root not mapped to index.html");
+    check(server.path_for("https://assets.example/shellx/index.html") == "", "prefix matched by a longer path");
+    check(server.path_for("https://other.example/shell/index.html") == "", "other origin mapped");
+    const std::string* body = server.lookup("https://assets.example/shell/", a);
+    check(body && *body == files["index.html"], "index.html not served");
+    body = server.lookup("https://assets.example/shell/", a);
+    check(body && server.hits() == 2, "cached blob not served");
+    check(!server.lookup("https://assets.example/shell/missing.js", a) && server.misses() == 1, "miss not counted");
+    AssetServer off;
+    off.open(bytes(data), data.size(), "", error);
+    check(!off.enabled(), "enabled without a prefix");
+
+    // Names with spaces and non-ASCII characters, as the page requests them
+    AssetPackWriter escaped;
+    escaped.add("fonts/Open Sans.woff2", "font/woff2", "font");
+    escaped.add("img/r\xc3\xa9sum\xc3\xa9.png", "image/png", "png");
+    escaped.add("100%.txt", "text/plain", "percent");
+    std::string escaped_data = escaped.build();
+    AssetServer names;
+    names.open(bytes(escaped_data), escaped_data.size(), "app:/", error);
+    check(names.path_for("app:/fonts/Open%20Sans.woff2?v=2#x") == "fonts/Open Sans.woff2", "%20 not decoded");
+    check(names.path_for("app:/img/r%C3%A9sum%c3%a9.png") == "img/r\xc3\xa9sum\xc3\xa9.png", "UTF-8 escapes not decoded");
+    check(names.path_for("app:/100%25.txt") == "100%.txt" && names.path_for("app:/100%.txt") == "100%.txt" &&
+              names.path_for("app:/a%2") == "a%2" && names.path_for("app:/a%zz") == "a%zz",
+          "stray '%' not kept");
+    check(names.path_for("app:/fonts/Open%20Sans.woff2%3Fv=2") == "fonts/Open Sans.woff2?v=2", "escaped '?' taken as a query");
+    const std::string* font = names.lookup("app:/fonts/Open%20Sans.woff2", a);
+    const std::string* png = names.lookup("app:/img/r%C3%A9sum%C3%A9.png", a);
+    const std::string* raw = names.lookup("app:/img/r\xc3\xa9sum\xc3\xa9.png", a);
+    check(font && *font == "font" && png && *png == "png" && raw && *raw == "png" && names.misses() == 0,
+          "escaped names not served from the pack");
+
+    check(asset_content_type("a/B.JS") == "text/javascript; charset=utf-8", "type by upper-case extension");
+    check(asset_content_type("font.woff2") == "font/woff2", "woff2 type");
+    check(asset_content_type("README") == "application/octet-stream", "type without an extension");
+}
+
+void set_u32(std::string& data, size_t at, uint32_t v) {
+    std::string le;
+    AssetPackFormat::write_u32(le, v);
+    data.replace(at, 4, le);
+}
+
+void malformed() {
+    printf("malformed\n");
+    using namespace AssetPackFormat;
+    std::string data = sample_pack(sample_files());
+    std::string error;
+    size_t accepted = 0;
+    for (size_t len = 0; len < data.size(); ++len) {
+        AssetPack pack;
+        std::string cut = data.substr(0, len);  // its own buffer, so reads past it are caught by ASan
+        if (pack.load(bytes(cut), cut.size(), error)) ++accepted;
+    }
+    check(accepted == 0, std::to_string(accepted) + " truncated packs accepted");
+
+    auto refused = [&](std::string bad, const std::string& expected, const std::string& what) {
+        AssetPack pack;
+        bool loaded = pack.load(bytes(bad), bad.size(), error);
+        check(!loaded && error == expected && !pack.loaded(), what + ": " + (loaded ? "accepted" : error));
+    };
+    std::string bad = data;
+    bad[0] = 'X';
+    refused(bad, "not an asset pack", "bad magic");
+    bad = data;
+    set_u32(bad, 4, VERSION + 1);
+    refused(bad, "unsupported asset pack version", "newer version");
+    bad = data;
+    set_u32(bad, 8, 0x10000000);
+    refused(bad, "truncated asset pack", "huge entry count");
+    bad = data;
+    set_u32(bad, 16, 0xffffffff);
+    refused(bad, "truncated asset pack", "huge strings size");
+    bad = data;
+    set_u32(bad, HEADER_SIZE + 16, 99);
+    refused(bad, "corrupt asset pack entry", "entry's blob out of range");
+    bad = data;
+    set_u32(bad, HEADER_SIZE + 4, 0x7fffffff);
+    refused(bad, "corrupt asset pack entry", "path past the strings");
+    // Entries 0 and 1 swapped
+    bad = data;
+    bad.replace(HEADER_SIZE, 2 * ENTRY_SIZE, data.substr(HEADER_SIZE + ENTRY_SIZE, ENTRY_SIZE) + data.substr(HEADER_SIZE, ENTRY_SIZE));
+    refused(bad, "asset pack entries not sorted", "unsorted entries");
+    size_t blobs = HEADER_SIZE + 6 * ENTRY_SIZE;
+    bad = data;
+    set_u32(bad, blobs + 4, 0x7fffffff);
+    refused(bad, "corrupt asset pack blob", "blob past the data");
+    bad = data;
+    set_u32(bad, blobs + 12, 2);
+    refused(bad, "corrupt asset pack blob", "unknown encoding");
+
+    // A failed load leaves nothing usable behind
+    AssetPack pack;
+    pack.load(bytes(data), data.size(), error);
+    bad = data;
+    bad[0] = 'X';
+    AssetPack::Asset a;
+    check(!pack.load(bytes(bad), bad.size(), error) && !pack.find("index.html", a), "failed reload kept the old pack");
+}
+
+void tampering() {
+    printf("tampering\n");
+    auto files = sample_files();
+    std::set<std::string> originals;
+    for (const auto& f : files) originals.insert(f.second);
+    std::string data = sample_pack(files);
+    std::string error;
+    size_t refused = 0, reported = 0, unnoticed = 0, wrong = 0;
+    for (size_t at = 0; at < data.size(); ++at) {
+        std::string bad = data;
+        bad[at] ^= 0x20;
+        AssetPack pack;
+        if (!pack.load(bytes(bad), bad.size(), error)) {
+            ++refused;
+            continue;
+        }
+        bool verified = pack.verify(error);
+        if (!verified) ++reported;
+        AssetServer server;
+        server.open(bytes(bad), bad.size(), "app:/", error);
+        size_t served = 0;
+        for (size_t i = 0; i < pack.size(); ++i) {
+            AssetPack::Asset a;
+            const std::string* body = server.lookup("app:/" + pack.at(i).path, a);
+            if (!body) continue;
+            ++served;
+            if (!originals.count(*body)) ++wrong;
+        }
+        // Only names, content types and unused bytes can change unnoticed
+        if (verified) {
+            ++unnoticed;
+            if (served != pack.size()) ++wrong;
+        }
+    }
+    printf("  %zu bytes: %zu refused by load, %zu by verify, %zu in names or types\n", data.size(), refused, reported,
+           unnoticed);
+    check(wrong == 0, std::to_string(wrong) + " tampered packs served altered contents");
+    check(reported > 0 && refused > 0, "tampering not detected");
+
+    // A damaged blob goes to the network; the others are still served
+    std::string bad = data;
+    AssetPack pack;
+    pack.load(bytes(data), data.size(), error);
+    AssetPack::Asset html;
+    pack.find("index.html", html);
+    bad[html.data - bytes(data) + html.stored_size / 2] ^= 0x01;
+    AssetServer server;
+    server.open(bytes(bad), bad.size(), "app:/", error);
+    AssetPack::Asset a;
+    check(!server.lookup("app:/index.html", a) && !server.lookup("app:/", a) && server.misses() == 2, "damaged blob served");
+    const std::string* css = server.lookup("app:/css/app.css", a);
+    check(css && *css == files["css/app.css"], "undamaged blob not served");
+    AssetPack damaged;
+    damaged.load(bytes(bad), bad.size(), error);
+    check(!damaged.verify(error) && error == "asset index.html does not match its hash", "verify: " + error);
+}
+
+void file() {
+    printf("file\n");
+    auto files = sample_files();
+    std::string data = sample_pack(files);
+    char tmpl[] = "/tmp/asset_pack_test.XXXXXX";
+    if (!mkdtemp(tmpl)) {
+        check(false, "mkdtemp");
+        return;
+    }
+    std::filesystem::path dir(tmpl);
+    std::filesystem::path path = dir / std::filesystem::u8path("r\xc3\xa9sum\xc3\xa9-\xd0\xba\xd0\xbb\xd1\x8e\xd1\x87.mkap");
+    std::ofstream(path, std::ios::binary) << data;
+
+    std::string error;
+    AssetServer server;
+    check(server.open_file(path, "app:/", error), "non-ASCII file name: " + error);
+    AssetPack::Asset a;
+    const std::string* png = server.lookup("app:/img/logo.png", a);
+    check(png && *png == files["img/logo.png"], "file pack contents");
+
+    AssetPack missing;
+    check(!missing.load_file(dir / "missing.mkap", error) && error == "cannot open the asset pack file",
+          "missing file: " + error);
+    std::filesystem::remove_all(dir);
+}
+
+}  // namespace
+
+int main() {
+    round_trip();
+    lookup();
+    malformed();
+    tampering();
+    file();
+    printf("\n%s\n", failures ? "FAILED: the asset pack did not behave as expected" : "all asset packs as expected");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,167 @@
+// Builds and inspects the login shell asset pack (see asset_pack.h).
+//
+//   asset_pack_tool build <dir> <out.pack> [--header asset_pack_data.h]
+//   asset_pack_tool list <pack>
+//   asset_pack_tool verify <pack>
+//   asset_pack_tool get <pack> <path>     (writes the original file to stdout)
+//
+// Paths in the pack are relative to <dir> with '/' separators, e.g.
+// "css/login.css"; the client maps ASSET_URL_PREFIX + path onto them.
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../asset_pack.h"
+
+namespace fs = std::filesystem;
+
+static void usage() {
+    std::cerr << "usage:\n"
+                 "  asset_pack_tool build <dir> <out.pack> [--header <asset_pack_data.h>]\n"
+                 "  asset_pack_tool list <pack>\n"
+                 "  asset_pack_tool verify <pack>\n"
+                 "  asset_pack_tool get <pack> <path>\n";
+}
+
+static bool read_whole_file(const fs::path& path, std::string& out) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    out.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// C++ header embedding the pack; main.cpp picks it up with __has_include
+static bool write_header(const fs::path& path, const std::string& pack, const std::string& source) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) return false;
+    out << "#pragma once\n"
+        << "#include <cstddef>\n\n"
+        << "// Generated by tools/asset_pack_tool from " << source << "; do not edit.\n"
+        << "static const unsigned char ASSET_PACK_DATA[] = {";
+    char buf[8];
+    for (size_t i = 0; i < pack.size(); ++i) {
+        if (i % 16 == 0) out << "\n   ";
+        snprintf(buf, sizeof(buf), " %u,", (unsigned)(unsigned char)pack[i]);
+        out << buf;
+    }
+    out << "\n};\n"
+        << "static const size_t ASSET_PACK_SIZE = sizeof(ASSET_PACK_DATA);\n";
+    return (bool)out;
+}
+
+static int build(int argc, char** argv) {
+    if (argc < 4) {
+        usage();
+        return 1;
+    }
+    fs::path root = argv[2];
+    fs::path output = argv[3];
+    fs::path header;
+    for (int i = 4; i < argc; ++i) {
+        if (!strcmp(argv[i], "--header") && i + 1 < argc) header = argv[++i];
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    std::error_code ec;
+    if (!fs::is_directory(root, ec)) {
+        std::cerr << root << " is not a directory\n";
+        return 1;
+    }
+
+    // Sorted so identical inputs produce identical packs
+    std::vector<fs::path> files;
+    for (const auto& entry : fs::recursive_directory_iterator(root)) {
+        if (entry.is_regular_file()) files.push_back(entry.path());
+    }
+    std::sort(files.begin(), files.end());
+
+    AssetPackWriter writer;
+    uint64_t raw_bytes = 0;
+    for (const auto& file : files) {
+        std::string contents;
+        if (!read_whole_file(file, contents)) {
+            std::cerr << "cannot read " << file << "\n";
+            return 1;
+        }
+        std::string path = fs::relative(file, root).generic_string();
+        writer.add(path, asset_content_type(path), contents);
+        raw_bytes += contents.size();
+    }
+
+    std::string pack = writer.build();
+    std::ofstream out(output, std::ios::binary);
+    if (!out.write(pack.data(), pack.size())) {
+        std::cerr << "cannot write " << output << "\n";
+        return 1;
+    }
+    out.close();
+    if (!header.empty() && !write_header(header, pack, root.generic_string())) {
+        std::cerr << "cannot write " << header << "\n";
+        return 1;
+    }
+
+    std::cout << files.size() << " files, " << writer.blob_count() << " unique blobs, "
+              << raw_bytes << " bytes -> " << pack.size() << " bytes\n";
+    return 0;
+}
+
+static bool open_pack(const char* path, AssetPack& pack) {
+    std::string error;
+    if (!pack.load_file(path, error)) {
+        std::cerr << path << ": " << error << "\n";
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+    std::string command = argv[1];
+    if (command == "build") return build(argc, argv);
+
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+    AssetPack pack;
+    if (!open_pack(argv[2], pack)) return 1;
+
+    if (command == "list") {
+        for (size_t i = 0; i < pack.size(); ++i) {
+            AssetPack::Asset a = pack.at(i);
+            std::cout << a.path << "\t" << a.content_type << "\t" << a.raw_size << " -> " << a.stored_size
+                      << (a.gzip ? " gzip" : "") << "\t" << hex_encode(a.sha256, 8) << "\n";
+        }
+        return 0;
+    }
+    if (command == "verify") {
+        std::string error;
+        if (!pack.verify(error)) {
+            std::cerr << argv[2] << ": " << error << "\n";
+            return 2;
+        }
+        std::cout << argv[2] << ": " << pack.size() << " assets OK\n";
+        return 0;
+    }
+    if (command == "get" && argc >= 4) {
+        AssetPack::Asset a;
+        std::string contents;
+        if (!pack.find(argv[3], a) || !pack.read(a, contents)) {
+            std::cerr << argv[3] << ": not found\n";
+            return 1;
+        }
+        std::cout.write(contents.data(), contents.size());
+        return 0;
+    }
+    usage();
+    return 1;
+}
@@ -0,0 +1,268 @@
+// Coalescing and scheduling of bounds_coalescer.h, driven by a mock window.
+//
+// The mock handles the coalescer's answers as main.cpp's ScheduleBounds does
+// (flush now, a timer rounded up to whole milliseconds, or nothing) and
+// records what would be pushed to the controller. Scenarios:
+//
+//   first resize   pushed at once
+//   burst          a burst inside one frame is one timer and one update
+//   no change      sizes that end where they started push nothing
+//   dpi change     the new scale and its WM_SIZE go out in one update
+//   invalidate     a new controller gets the full state
+//   drag           a 1 s drag at 500 events/s stays at one update per frame
+//
+// Then --events random resizes and scale changes on a random clock against
+// the invariants: updates at least a frame apart, every event pushed within
+// a frame, the controller ending at the last size and scale.
+//
+//   g++ -std=c++17 -O2 -I. tools/bounds_coalescer_test.cpp -o bounds_coalescer_test
+//   ./bounds_coalescer_test [--events 200000] [--seed 1]
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "bounds_coalescer.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (!ok) {
+        printf("  FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+// The window and its controller as main.cpp drives them
+class MockWindow {
+public:
+    explicit MockWindow(double frame_ms = 16.0) : bounds(frame_ms) {}
+
+    void resize(int width, int height) { schedule(bounds.on_resize(width, height, now)); }
+    void dpi(double scale) { schedule(bounds.on_scale(scale, now)); }
+
+    // Advances the clock, firing the timer if it comes due
+    void advance_to(double ms) {
+        if (timer_ >= 0 && timer_ <= ms) {
+            now = timer_;
+            timer_ = -1;
+            flush();
+        }
+        now = ms;
+    }
+
+    void new_controller() {
+        bounds.invalidate();
+        flush();
+    }
+
+    bool timer_set() const { return timer_ >= 0; }
+
+    struct Push {
+        double at_ms;
+        BoundsUpdate update;
+    };
+
+    BoundsCoalescer bounds;
+    double now = 0;
+    std::vector<Push> pushes;
+    int width = -1, height = -1;
+    double scale = 0;
+    double last_delay = 0;  // the coalescer's last answer
+
+private:
+    void schedule(double delay_ms) {
+        last_delay = delay_ms;
+        if (delay_ms == 0) flush();
+        else if (delay_ms > 0) timer_ = now + std::ceil(delay_ms);
+    }
+
+    void flush() {
+        timer_ = -1;
+        BoundsUpdate update;
+        if (!bounds.flush(now, update)) return;
+        pushes.push_back({now, update});
+        if (update.resize) {
+            width = update.width;
+            height = update.height;
+        }
+        if (update.rescale) scale = update.scale;
+    }
+
+    double timer_ = -1;
+};
+
+void first_resize() {
+    printf("first resize\n");
+    MockWindow w;
+    w.now = 100;
+    w.resize(800, 600);
+    check(w.pushes.size() == 1 && w.pushes[0].at_ms == 100 && w.width == 800 && w.height == 600, "not pushed at once");
+    check(w.pushes[0].update.resize && !w.pushes[0].update.rescale && !w.timer_set(), "first update");
+}
+
+void burst() {
+    printf("burst\n");
+    MockWindow w;
+    w.resize(800, 600);
+    for (int i = 1; i <= 100; ++i) {
+        w.advance_to(i * 0.1);
+        w.resize(800 + i, 600 + i);
+    }
+    check(w.pushes.size() == 1 && w.timer_set() && w.bounds.scheduled(), "burst not left to one timer");
+    check(w.last_delay == -1, "event with a flush scheduled asked for another timer");
+    // Due a frame after the first update; the timer rounds up to whole milliseconds
+    w.advance_to(17);
+    check(w.pushes.size() == 2 && w.pushes[1].at_ms >= 16 && w.pushes[1].at_ms <= 17 && w.width == 900 && w.height == 700,
+          "burst not pushed as its last size");
+    check(w.bounds.events() == 101 && w.bounds.updates() == 2, "counters");
+    w.advance_to(20);
+    w.resize(901, 700);
+    check(w.pushes.size() == 2 && w.timer_set(), "next event inside the frame pushed early");
+    w.advance_to(34);
+    check(w.pushes.size() == 3 && w.pushes[2].at_ms - w.pushes[1].at_ms >= 16 && w.pushes[2].at_ms - w.pushes[1].at_ms <= 17,
+          "next frame's update");
+    w.advance_to(100);
+    w.resize(902, 700);
+    check(w.pushes.size() == 4 && w.pushes[3].at_ms == 100, "event after a quiet period not pushed at once");
+}
+
+void no_change() {
+    printf("no change\n");
+    MockWindow w;
+    w.resize(800, 600);
+    w.advance_to(1);
+    w.resize(500, 400);
+    w.advance_to(2);
+    w.resize(800, 600);
+    w.advance_to(50);
+    check(w.pushes.size() == 1 && !w.bounds.scheduled(), "round trip to the same size pushed");
+    w.dpi(1.0);
+    check(w.pushes.size() == 2 && w.pushes[1].update.rescale && !w.pushes[1].update.resize, "first scale not pushed");
+    w.advance_to(100);
+    w.dpi(1.0);
+    check(w.pushes.size() == 2, "unchanged scale pushed again");
+}
+
+void dpi_change() {
+    printf("dpi change\n");
+    MockWindow w;
+    w.resize(800, 600);
+    w.dpi(1.0);
+    w.advance_to(5);
+    // WM_DPICHANGED: SetWindowPos sends WM_SIZE, then the scale
+    w.resize(1200, 900);
+    w.dpi(1.5);
+    w.advance_to(40);
+    check(w.pushes.size() == 2, "size and scale not in one update");
+    if (w.pushes.size() < 2) return;
+    const BoundsUpdate& u = w.pushes.back().update;
+    check(u.resize && u.rescale && u.width == 1200 && u.height == 900 && u.scale == 1.5, "dpi update");
+}
+
+void invalidate() {
+    printf("invalidate\n");
+    MockWindow w;
+    w.resize(800, 600);
+    w.dpi(1.25);
+    w.advance_to(100);
+    size_t before = w.pushes.size();
+    w.new_controller();
+    check(w.pushes.size() == before + 1, "full state not pushed to a new controller");
+    if (w.pushes.size() != before + 1) return;
+    const BoundsUpdate& u = w.pushes.back().update;
+    check(u.resize && u.rescale && u.width == 800 && u.height == 600 && u.scale == 1.25, "full state");
+
+    MockWindow fresh;
+    fresh.new_controller();
+    check(fresh.pushes.empty(), "update without any size");
+}
+
+void drag() {
+    printf("drag\n");
+    MockWindow w;
+    w.resize(800, 600);
+    for (int i = 1; i <= 500; ++i) {
+        w.advance_to(i * 2.0);
+        w.resize(800 + i, 600);
+    }
+    w.advance_to(2000);
+    printf("  500 events -> %zu updates\n", w.pushes.size());
+    check(w.pushes.size() <= 1000 / 16 + 2, "more than one update per frame");
+    check(w.pushes.size() >= 1000 / 17, "updates held back longer than a frame");
+    check(w.width == 1300, "drag did not end at its last size");
+}
+
+// Random events against the invariants
+void random_events(size_t events, unsigned seed) {
+    printf("random: %zu events, seed %u\n", events, seed);
+    std::mt19937 rng(seed);
+    size_t violations = 0;
+    auto violation = [&](const std::string& what, size_t i) {
+        if (violations++ < 5) printf("  event %zu: %s\n", i, what.c_str());
+    };
+    for (double frame : {16.0, 7.5}) {
+        MockWindow w(frame);
+        int width = -1, height = -1;
+        double scale = 0;
+        double unpushed_since = -1;  // first event not yet pushed
+        for (size_t i = 0; i < events; ++i) {
+            double step = std::uniform_int_distribution<int>(0, 3)(rng) == 0 ? std::uniform_real_distribution<double>(0, 100)(rng)
+                                                                              : std::uniform_real_distribution<double>(0, 3)(rng);
+            size_t before = w.pushes.size();
+            w.advance_to(w.now + step);
+            if (w.pushes.size() > before || (w.width == width && w.height == height && w.scale == scale)) unpushed_since = -1;
+            if (unpushed_since >= 0 && w.now - unpushed_since > frame + 1) violation("event not pushed within a frame", i);
+
+            if (std::uniform_int_distribution<int>(0, 9)(rng) == 0) {
+                scale = 1.0 + 0.25 * std::uniform_int_distribution<int>(0, 3)(rng);
+                w.dpi(scale);
+            } else {
+                width = std::uniform_int_distribution<int>(400, 410)(rng);
+                height = std::uniform_int_distribution<int>(300, 302)(rng);
+                w.resize(width, height);
+            }
+            bool pushed = w.width == width && w.height == height && (scale == 0 || w.scale == scale);
+            if (!pushed && unpushed_since < 0) unpushed_since = w.now;
+            if (pushed) unpushed_since = -1;
+            if (w.pushes.size() >= 2) {
+                double gap = w.pushes.back().at_ms - w.pushes[w.pushes.size() - 2].at_ms;
+                if (w.pushes.size() > before && gap < frame) violation("updates less than a frame apart", i);
+            }
+            if (w.bounds.scheduled() != w.timer_set()) violation("timer and coalescer disagree", i);
+        }
+        w.advance_to(w.now + 1000);
+        if (w.width != width || w.height != height || w.scale != scale) violation("controller not at the last state", events);
+        if (w.bounds.events() != events) violation("events not counted", events);
+    }
+    check(violations == 0, std::to_string(violations) + " invariant violations");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t events = 200000;
+    unsigned seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--events" && i + 1 < argc) events = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--seed" && i + 1 < argc) seed = (unsigned)strtoul(argv[++i], nullptr, 10);
+        else {
+            std::cerr << "usage: bounds_coalescer_test [--events N] [--seed N]\n";
+            return 1;
+        }
+    }
+    first_resize();
+    burst();
+    no_change();
+    dpi_change();
+    invalidate();
+    drag();
+    random_events(events, seed);
+    printf("\n%s\n", failures ? "FAILED: the coalescer did not behave as expected" : "all updates as expected");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,163 @@
+// The canonical machine identity of canonical_fingerprint.h and the size of
+// the registration that carries it (handshake.h, encrypt_data.h).
+//
+//   vectors        canonical string, key and digest of fixed inputs
+//   normalization  padding, case, disk order, duplicates and firmware
+//                  placeholders do not change the identity
+//   blank          no identifier left: no identity, and no "fpkey" in the
+//                  registration or shard key to share with other machines
+//   size           a full registration fits one RSA-OAEP block of a 3072-bit
+//                  key; encryption refuses data past the key's limit
+//
+//   g++ -std=c++20 -O2 -pthread -I. tools/canonical_fingerprint_test.cpp -o canonical_fingerprint_test -lcrypto
+//   ./canonical_fingerprint_test
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <openssl/rsa.h>
+#include "canonical_fingerprint.h"
+#include "encrypt_data.h"
+#include "handshake.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (!ok) {
+        printf("  FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+struct Vector {
+    const char* uuid;
+    const char* guid;
+    std::vector<std::string> serials;
+    const char* canonical;
+    const char* key;
+    const char* digest;
+};
+
+void vectors() {
+    printf("vectors\n");
+    const Vector VECTORS[] = {
+        {" 4C4C4544-0042-3510-8052-B4C04F384E32 ", "6F1E2D3C-AAAA-4BBB-8CCC-0123456789AB",
+         {" WD-WX11A ", "s3z9nb0k123", "WD-WX11A", ""},
+         "v1|uuid=4c4c4544-0042-3510-8052-b4c04f384e32|guid=6f1e2d3c-aaaa-4bbb-8ccc-0123456789ab|serials=s3z9nb0k123,wd-wx11a",
+         "6fc04a48ed3bab74", "b8BKSO07q3QRU51nfuMWSHfdpxojtza6G_e8s2FI2Bs"},
+        {"FFFFFFFF-FFFF-FFFF-FFFF-FFFFFFFFFFFF", "abc", {"To Be Filled By O.E.M."},
+         "v1|uuid=|guid=abc|serials=", "76134d176d5a66e4", "dhNNF21aZuRHeXd7z7o9sKrJekJZcP8E1fzV5fZEyR0"},
+        {"", "", {}, "v1|uuid=|guid=|serials=", "e678733b4e87dec7", "5nhzO06H3sfDSixErmi6ERqrn992-oVEEMkrUWBPr_A"},
+    };
+    for (const auto& v : VECTORS) {
+        std::string canonical = canonical_fingerprint(v.uuid, v.guid, v.serials);
+        FingerprintId id = fingerprint_id(canonical);
+        check(canonical == v.canonical, "canonical: " + canonical);
+        check(id.key_text() == v.key, "key of " + canonical + ": " + id.key_text());
+        check(id.digest_text() == v.digest, "digest of " + canonical + ": " + id.digest_text());
+    }
+}
+
+void normalization() {
+    printf("normalization\n");
+    std::string reference = canonical_fingerprint("4C4C4544-0042", "6F1E2D3C", {"WD-1", "S3Z-2"});
+    check(canonical_fingerprint("\t4c4c4544-0042\n", "6f1e2d3c ", {"s3z-2", " wd-1", "WD-1", ""}) == reference,
+          "padding, case, order or duplicates changed the identity");
+    check(canonical_fingerprint(std::string("4C4C4544-0042\0\0", 15), "6F1E2D3C", {"WD-1", "S3Z-2"}) == reference,
+          "trailing NULs changed the identity");
+    check(canonical_fingerprint("4C4C4544-0042", "6F1E2D3C", {"WD-1", "S3Z-2", "Default string", "0"}) == reference,
+          "placeholder serials changed the identity");
+    check(canonical_fingerprint("4C4C4544-0042", "6F1E2D3C", {"WD-1"}) != reference, "a missing disk kept the identity");
+
+    for (const char* placeholder : {"To Be Filled By O.E.M.", " default STRING ", "System Serial Number", "Not Applicable",
+                                    "not specified", "None", "N/A", "0", "00000000-0000-0000-0000-000000000000",
+                                    "ffffffff-ffff-ffff-ffff-ffffffffffff", ""}) {
+        check(normalize_identifier(placeholder).empty(), std::string("placeholder kept: ") + placeholder);
+    }
+    // Short all-zero or all-F values are real identifiers
+    check(normalize_identifier("00") == "00" && normalize_identifier("FFF") == "fff", "short identifier dropped");
+}
+
+Fingerprint machine(const std::string& uuid, const std::string& guid, std::vector<std::string> serials) {
+    Fingerprint fp;
+    fp.uuid = uuid;
+    fp.machine_guid = guid;
+    fp.serials = std::move(serials);
+    fp.ipinfo = {{"IP", "203.0.113.7"}, {"CheckTimeUTC", "2026-10-19 08:00:00"}};
+    fp.ipinfo2 = {{"country", "NL"}, {"provider", "Example ISP"}, {"organisation", "Example"}};
+    return fp;
+}
+
+void blank() {
+    printf("blank\n");
+    for (const Fingerprint& fp : {machine("", "", {}), machine("FFFFFFFF-FFFF-FFFF-FFFF-FFFFFFFFFFFF", " ", {"None", "0"})}) {
+        check(!canonical_fingerprint_known(canonical_fingerprint(fp.uuid, fp.machine_guid, fp.serials)),
+              "blank identity counted as known");
+        nlohmann::json registration = registration_for(fp, "dc-7", "2.4.0");
+        check(!registration.contains("fpkey") && !registration.contains("fpdigest"), "blank identity sent: " + registration.dump());
+    }
+    Fingerprint guid_only = machine("", "6F1E2D3C-AAAA-4BBB-8CCC-0123456789AB", {});
+    nlohmann::json registration = registration_for(guid_only, "dc-7", "2.4.0");
+    check(registration.value("fpkey", "") == fingerprint_id("v1|uuid=|guid=6f1e2d3c-aaaa-4bbb-8ccc-0123456789ab|serials=").key_text(),
+          "one identifier is an identity");
+    check(!registration.contains("fpdigest"), "digest sent");
+}
+
+std::string public_key_pem(unsigned int bits) {
+    EVP_PKEY* key = EVP_RSA_gen(bits);
+    BIO* bio = BIO_new(BIO_s_mem());
+    std::string pem;
+    if (key && bio && PEM_write_bio_PUBKEY(bio, key)) {
+        BUF_MEM* buf;
+        BIO_get_mem_ptr(bio, &buf);
+        pem.assign(buf->data, buf->length);
+    }
+    BIO_free(bio);
+    EVP_PKEY_free(key);
+    return pem;
+}
+
+// A JSON string of exactly `bytes` bytes once dumped
+nlohmann::json payload_of(size_t bytes) { return std::string(bytes - 2, 'x'); }
+
+void size() {
+    printf("size\n");
+    // Full-length IDs and a 20-character serial
+    Fingerprint fp = machine("4C4C4544-0042-3510-8052-B4C04F384E32", "6F1E2D3C-AAAA-4BBB-8CCC-0123456789AB",
+                             {"WD-WX11A12345678901", "S3Z9NB0K123456"});
+    nlohmann::json registration = registration_for(fp, "dc-7", "2.4.0");
+    size_t bytes = registration.dump().size();
+    printf("  full registration %zu bytes\n", bytes);
+
+    for (unsigned int bits : {2048u, 3072u}) {
+        std::string pem = public_key_pem(bits);
+        size_t limit = bits / 8 - 66;
+        std::string error;
+        check(!encrypt_data_from_key_string(payload_of(limit), pem, &error).empty() && error.empty(),
+              std::to_string(bits) + " bits: data at the limit refused: " + error);
+        check(encrypt_data_from_key_string(payload_of(limit + 1), pem, &error).empty() &&
+                  error == "data is " + std::to_string(limit + 1) + " bytes; the public key's RSA-OAEP limit is " +
+                               std::to_string(limit),
+              std::to_string(bits) + " bits: data past the limit: " + error);
+        if (bits == 3072) {
+            error.clear();
+            bool encrypted = !encrypt_data_from_key_string(registration, pem, &error).empty();
+            check(encrypted, "registration does not fit 3072 bits: " + error);
+        }
+    }
+    std::string error;
+    check(encrypt_data_from_key_string(registration, "not a key", &error).empty() && error == "public key is not a PEM public key",
+          "bad key: " + error);
+}
+
+}  // namespace
+
+int main() {
+    vectors();
+    normalization();
+    blank();
+    size();
+    printf("\n%s\n", failures ? "FAILED: the fingerprint did not behave as expected" : "all fingerprints as expected");
+    return failures ? 1 : 0;
+}
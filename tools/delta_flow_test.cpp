@@ -0,0 +1,249 @@
+// The delta + ack registration flow (delta_payload.h) end to end:
+// request_login_token() from handshake.h against a mock backend that
+// handles messages as server/reference_server.cpp does (schema check,
+// AckStore, apply_delta, "ack" = payload_hash of the merged registration).
+//
+// Encryption is the identity and the network a function call, so each
+// launch runs the real coroutine on a Linux EventLoop. The acknowledged
+// registration is carried from one launch to the next as main.cpp stores
+// it. Scenarios:
+//
+//   first launch   no acknowledged state: the full registration, acked
+//   delta          the next launch sends only what changed (regdate, then
+//                  a moved IP) and the backend merges it to the same hash
+//   send full      the backend no longer holds the base: it asks for the
+//                  full registration, sent in the same handshake
+//   ack mismatch   an ack for other bytes, or none (an older backend),
+//                  leaves `acknowledged` null, so the next launch is full
+//   unreachable    a delta that cannot be sent is queued in full
+//   older base     a base with a field the registration no longer has
+//                  ("fpdigest" of earlier builds) is replaced in full
+//
+//   g++ -std=c++20 -O2 -pthread -I. tools/delta_flow_test.cpp -o delta_flow_test -lcrypto
+//   ./delta_flow_test
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "handshake.h"
+#include "server/ack_store.h"
+#include "server/registration_schema.h"
+
+namespace {
+
+using json = nlohmann::json;
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (!ok) {
+        printf("  FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+// register_message() of the reference backend, without the crypto
+class MockBackend {
+public:
+    enum class Mode { Normal, NoAck, WrongAck, Down };
+
+    explicit MockBackend(size_t acks) : acks_(acks) {}
+
+    bool send(const std::string& payload, std::string& reply) {
+        received.push_back(payload);
+        if (mode == Mode::Down) return false;
+        json message = json::parse(payload, nullptr, false);
+        if (message.is_discarded()) return answer(reply, {{"error", "payload is not JSON"}});
+        if (is_delta_message(message)) {
+            std::string problem = validate_registration_delta(message);
+            if (!problem.empty()) return answer(reply, {{"error", problem}});
+            json base;
+            if (!acks_.get(message["base"].get<std::string>(), base)) return answer(reply, {{"status", "send_full"}});
+            message = apply_delta(base, message);
+        }
+        std::string problem = validate_registration(message);
+        if (!problem.empty()) return answer(reply, {{"error", problem}});
+        std::string ack = payload_hash(message);
+        acks_.put(ack, message);
+        stored.push_back(message);
+        json accepted = {{"status", "accepted"}, {"randkey", "rk" + std::to_string(stored.size())}};
+        if (mode == Mode::Normal) accepted["ack"] = ack;
+        if (mode == Mode::WrongAck) accepted["ack"] = payload_hash(json{{"other", ack}});
+        return answer(reply, accepted);
+    }
+
+    Mode mode = Mode::Normal;
+    std::vector<std::string> received;  // every message, in order
+    std::vector<json> stored;           // merged registrations
+
+private:
+    static bool answer(std::string& reply, const json& j) {
+        reply = j.dump();
+        return true;
+    }
+
+    AckStore acks_;
+};
+
+struct Launch {
+    LoginToken token;
+    std::string error;
+    std::vector<std::string> sent;  // messages of this launch
+    std::vector<std::string> queued;
+};
+
+Fingerprint machine(const std::string& ip, const std::string& check_time) {
+    Fingerprint fp;
+    fp.uuid = "4C4C4544-0038-4810-8035-B7C04F4E4E32";
+    fp.machine_guid = "a3f1c2d4-5b6e-4f70-8192-a3b4c5d6e7f8";
+    fp.serials = {"S3Z9NB0K712345", "WD-WCC4N7XXXXXX"};
+    fp.ipinfo = {{"IP", ip}, {"CheckTimeUTC", check_time}};
+    fp.ipinfo2 = {{"country", "NL"}, {"provider", "Example ISP"}, {"organisation", "Example"}};
+    return fp;
+}
+
+// One launch: request_login_token() on its own loop, with `acknowledged`
+// as loaded from the registration state file
+Launch launch(MockBackend& backend, const Fingerprint& fp, const json& acknowledged) {
+    EventLoop loop;
+    Offload offload(loop);
+    Launch result;
+    size_t before = backend.received.size();
+    HandshakeSteps steps;
+    steps.encrypt = [](const json& message) { return message.dump(); };
+    steps.send = [&backend](const std::string& payload, std::string& reply) { return backend.send(payload, reply); };
+    steps.queue = [&result](const std::string& payload) { result.queued.push_back(payload); };
+    steps.dcid = "dc-7";
+    steps.version = "2.4.0";
+    steps.login_base_url = "https://login.example/";
+    steps.acknowledged = acknowledged;
+
+    Task<LoginToken> task = request_login_token(offload, fp, steps, CancelToken());
+    task.start([&loop] { loop.stop(); });
+    if (!task.done()) loop.run();
+    try {
+        result.token = task.get();
+    } catch (const std::exception& e) {
+        result.error = e.what();
+    }
+    offload.join();
+    result.sent.assign(backend.received.begin() + before, backend.received.end());
+    return result;
+}
+
+json parsed(const std::string& text) { return json::parse(text, nullptr, false); }
+
+void first_launch_and_deltas() {
+    printf("first launch\n");
+    MockBackend backend(100);
+    Fingerprint fp = machine("203.0.113.7", "2026-10-19 08:00:00");
+    json registration = registration_for(fp, "dc-7", "2.4.0");
+    Launch first = launch(backend, fp, nullptr);
+    check(first.error.empty(), "first launch failed: " + first.error);
+    check(first.sent.size() == 1 && parsed(first.sent[0]) == registration, "first launch did not send the full registration");
+    check(first.token.url == "https://login.example/?token=rk1", "login URL: " + first.token.url);
+    check(first.token.ack == payload_hash(registration) && first.token.acknowledged == registration,
+          "acknowledged registration not kept");
+
+    printf("delta\n");
+    Fingerprint later = machine("203.0.113.7", "2026-10-20 08:00:00");
+    Launch second = launch(backend, later, first.token.acknowledged);
+    json delta = second.sent.empty() ? json() : parsed(second.sent[0]);
+    check(second.error.empty() && second.sent.size() == 1, "delta launch: " + second.error);
+    check(is_delta_message(delta) && delta["base"] == first.token.ack, "not a delta against the acked registration");
+    check(delta["delta"] == json({{"regdate", "2026-10-20 08:00:00"}}), "delta is not only regdate: " + delta.dump());
+    json expected = registration_for(later, "dc-7", "2.4.0");
+    check(!backend.stored.empty() && backend.stored.back() == expected, "backend did not merge the delta");
+    check(second.token.acknowledged == expected && second.token.ack == payload_hash(expected), "merged registration not acked");
+    printf("  full %zu bytes, delta %zu bytes\n", first.sent[0].size(), second.sent.empty() ? 0 : second.sent[0].size());
+    check(!second.sent.empty() && second.sent[0].size() < first.sent[0].size() / 2, "delta not smaller than half");
+
+    Fingerprint moved = machine("198.51.100.23", "2026-10-21 08:00:00");
+    Launch third = launch(backend, moved, second.token.acknowledged);
+    json moved_delta = third.sent.empty() ? json() : parsed(third.sent[0]);
+    check(third.error.empty() && moved_delta["delta"] == json({{"ip", "198.51.100.23"}, {"regdate", "2026-10-21 08:00:00"}}),
+          "moved IP not in the delta: " + moved_delta.dump());
+    check(third.token.acknowledged == registration_for(moved, "dc-7", "2.4.0"), "moved registration not acked");
+}
+
+void send_full() {
+    printf("send full\n");
+    // Room for one acknowledged registration: another machine evicts ours
+    MockBackend backend(1);
+    Fingerprint fp = machine("203.0.113.7", "2026-10-19 08:00:00");
+    Launch first = launch(backend, fp, nullptr);
+    Fingerprint other = fp;
+    other.uuid = "11111111-2222-3333-4444-555555555555";
+    launch(backend, other, nullptr);
+
+    Fingerprint later = machine("203.0.113.7", "2026-10-20 08:00:00");
+    Launch again = launch(backend, later, first.token.acknowledged);
+    json expected = registration_for(later, "dc-7", "2.4.0");
+    check(again.error.empty(), "launch after eviction failed: " + again.error);
+    check(again.sent.size() == 2 && is_delta_message(parsed(again.sent[0])) && parsed(again.sent[1]) == expected,
+          "send_full not answered with the full registration in the same handshake");
+    check(again.token.acknowledged == expected && again.token.url == "https://login.example/?token=rk3", "token after send_full");
+}
+
+void ack_mismatch() {
+    printf("ack mismatch\n");
+    MockBackend backend(100);
+    Fingerprint fp = machine("203.0.113.7", "2026-10-19 08:00:00");
+    Launch first = launch(backend, fp, nullptr);
+
+    backend.mode = MockBackend::Mode::WrongAck;
+    Fingerprint later = machine("203.0.113.7", "2026-10-20 08:00:00");
+    Launch wrong = launch(backend, later, first.token.acknowledged);
+    check(wrong.error.empty() && !wrong.token.url.empty(), "login failed on a wrong ack: " + wrong.error);
+    check(!wrong.token.ack.empty() && wrong.token.acknowledged.is_null(), "mismatched ack kept a registration");
+
+    // Nothing acknowledged: the next launch is full again
+    backend.mode = MockBackend::Mode::Normal;
+    Launch next = launch(backend, later, wrong.token.acknowledged);
+    check(next.sent.size() == 1 && !is_delta_message(parsed(next.sent[0])), "delta sent without an acknowledged base");
+
+    backend.mode = MockBackend::Mode::NoAck;
+    Launch old = launch(backend, later, next.token.acknowledged);
+    check(old.error.empty() && old.token.ack.empty() && old.token.acknowledged.is_null(), "reply without ack kept state");
+}
+
+void unreachable() {
+    printf("unreachable\n");
+    MockBackend backend(100);
+    Fingerprint fp = machine("203.0.113.7", "2026-10-19 08:00:00");
+    Launch first = launch(backend, fp, nullptr);
+
+    backend.mode = MockBackend::Mode::Down;
+    Fingerprint later = machine("203.0.113.7", "2026-10-20 08:00:00");
+    Launch down = launch(backend, later, first.token.acknowledged);
+    check(down.error == "backend unreachable; registration queued", "unreachable error: " + down.error);
+    check(down.sent.size() == 1 && is_delta_message(parsed(down.sent[0])), "delta not tried first");
+    check(down.queued.size() == 1 && parsed(down.queued[0]) == registration_for(later, "dc-7", "2.4.0"),
+          "queued registration is not the full one");
+}
+
+void older_base() {
+    printf("older base\n");
+    MockBackend backend(100);
+    Fingerprint fp = machine("203.0.113.7", "2026-10-19 08:00:00");
+    json older = registration_for(fp, "dc-7", "2.3.0");
+    older["fpdigest"] = "b8BKSO07q3QRU51nfuMWSHfdpxojtza6G_e8s2FI2Bs";
+    std::string reply;
+    backend.send(older.dump(), reply);
+
+    Launch launched = launch(backend, fp, older);
+    json expected = registration_for(fp, "dc-7", "2.4.0");
+    check(launched.sent.size() == 1 && parsed(launched.sent[0]) == expected, "delta sent that cannot drop fpdigest");
+    check(launched.token.acknowledged == expected, "full registration not acked");
+}
+
+}  // namespace
+
+int main() {
+    first_launch_and_deltas();
+    send_full();
+    ack_mismatch();
+    unreachable();
+    older_base();
+    printf("\n%s\n", failures ? "FAILED: the delta flow did not behave as expected" : "all registrations as expected");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,253 @@
+// Mirror selection (endpoint_selector.h) against a simulated latency matrix,
+// in virtual time.
+//
+// Clients in each region call the backend about once a minute, each with its
+// own selector, which lives on across calls as it does across launches. The
+// matrix gives the median latency from every region to every mirror (calls
+// vary log-normally around it); a failed call costs FAIL_MS and the next
+// mirror is tried. A third of the way in the first mirror slows down
+// (--slow-factor) and fails --slow-errors of its calls; the second mirror is
+// down for ten minutes in the middle. Three policies:
+//
+//   first     the listed order, next mirror on failure (one URL per service before)
+//   random    a random order per call
+//   selector  EndpointSelector::order
+//
+// Prints mean, 50/95/99% latency per call (failed attempts included), calls
+// no mirror answered, and the mean while the first mirror is slow. Then the
+// shard pinning: how evenly --keys fpkeys spread over the mirrors and how
+// many move when a mirror is added.
+//
+//   g++ -std=c++17 -O2 -I. tools/endpoint_sim.cpp -o endpoint_sim
+//   ./endpoint_sim [--matrix "20,90,180;90,20,150;180,150,30"] [--clients N] [--minutes N]
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "endpoint_selector.h"
+
+namespace {
+
+struct Options {
+    // Rows are client regions, columns mirrors: median ms
+    std::vector<std::vector<double>> matrix = {{20, 90, 180}, {90, 20, 150}, {180, 150, 30}};
+    size_t clients = 100;       // per region
+    int minutes = 180;
+    double slow_factor = 6;     // the first mirror's latency while slow ..
+    double slow_errors = 0.3;   // .. and the share of its calls that fail
+    double base_errors = 0.005;
+    size_t keys = 100000;
+};
+
+enum class Policy { First, Random, Selector };
+
+const char* policy_name(Policy policy) {
+    switch (policy) {
+        case Policy::First: return "first";
+        case Policy::Random: return "random";
+        case Policy::Selector: return "selector";
+    }
+    return "";
+}
+
+const double FAIL_MS = 2000;    // what a failed attempt costs (connect timeout)
+const double SPREAD = 0.35;     // sigma of the log-normal latency
+
+bool parse_matrix(const std::string& text, std::vector<std::vector<double>>& matrix) {
+    matrix.clear();
+    std::stringstream rows(text);
+    std::string row;
+    while (std::getline(rows, row, ';')) {
+        std::vector<double> cells;
+        std::stringstream cols(row);
+        std::string cell;
+        while (std::getline(cols, cell, ',')) cells.push_back(atof(cell.c_str()));
+        if (cells.empty() || (!matrix.empty() && cells.size() != matrix[0].size())) return false;
+        for (double v : cells) {
+            if (!(v > 0)) return false;
+        }
+        matrix.push_back(cells);
+    }
+    return !matrix.empty() && matrix[0].size() >= 2;
+}
+
+struct Result {
+    std::vector<double> latencies;  // per call
+    size_t unanswered = 0;
+    double slow_sum = 0;
+    size_t slow_calls = 0;
+};
+
+Result run(const Options& opts, Policy policy, unsigned seed) {
+    std::mt19937 rng(seed);
+    auto uniform = [&rng](double lo, double hi) { return std::uniform_real_distribution<double>(lo, hi)(rng); };
+    std::normal_distribution<double> noise(0, SPREAD);
+    size_t regions = opts.matrix.size(), mirrors = opts.matrix[0].size();
+
+    std::vector<std::string> urls;
+    std::string list;
+    for (size_t m = 0; m < mirrors; ++m) {
+        urls.push_back("https://m" + std::to_string(m) + ".example/message");
+        list += (m ? " " : "") + urls.back();
+    }
+    auto mirror_of = [&](const std::string& url) { return (size_t)(std::find(urls.begin(), urls.end(), url) - urls.begin()); };
+
+    int64_t end_ms = (int64_t)opts.minutes * 60000;
+    int64_t slow_from = end_ms / 3, slow_to = end_ms * 2 / 3;
+    int64_t down_from = end_ms / 2 - 5 * 60000, down_to = end_ms / 2 + 5 * 60000;
+
+    struct Client {
+        size_t region;
+        std::unique_ptr<EndpointSelector> selector;
+    };
+    std::vector<Client> clients;
+    using Call = std::pair<int64_t, size_t>;  // at, client
+    std::priority_queue<Call, std::vector<Call>, std::greater<Call>> calls;
+    for (size_t r = 0; r < regions; ++r) {
+        for (size_t i = 0; i < opts.clients; ++i) {
+            calls.push({(int64_t)uniform(0, 60000), clients.size()});
+            clients.push_back({r, std::make_unique<EndpointSelector>()});
+        }
+    }
+
+    Result result;
+    while (!calls.empty()) {
+        auto [now, c] = calls.top();
+        calls.pop();
+        if (now >= end_ms) break;
+        Client& client = clients[c];
+        std::vector<std::string> order;
+        if (policy == Policy::Selector) {
+            order = client.selector->order(list, false, now);
+        } else {
+            order = urls;
+            if (policy == Policy::Random) std::shuffle(order.begin(), order.end(), rng);
+        }
+
+        double elapsed = 0;
+        bool answered = false;
+        for (const std::string& url : order) {
+            size_t m = mirror_of(url);
+            int64_t at = now + (int64_t)elapsed;
+            double median = opts.matrix[client.region][m];
+            double errors = opts.base_errors;
+            if (m == 0 && at >= slow_from && at < slow_to) {
+                median *= opts.slow_factor;
+                errors = opts.slow_errors;
+            }
+            if (m == 1 && at >= down_from && at < down_to) errors = 1;
+            bool ok = uniform(0, 1) >= errors;
+            double ms = ok ? median * std::exp(noise(rng)) : FAIL_MS;
+            elapsed += ms;
+            if (policy == Policy::Selector) client.selector->record(url, ms, ok, now + (int64_t)elapsed);
+            if (ok) {
+                answered = true;
+                break;
+            }
+        }
+        result.latencies.push_back(elapsed);
+        if (!answered) ++result.unanswered;
+        if (now >= slow_from && now < slow_to) {
+            result.slow_sum += elapsed;
+            ++result.slow_calls;
+        }
+        calls.push({now + (int64_t)uniform(45000, 75000), c});
+    }
+    return result;
+}
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) return 0;
+    size_t k = std::min(values.size() - 1, (size_t)(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+// Pinned orders: the first mirror each key gets, before and after one more
+// mirror is listed
+void shard_report(const Options& opts) {
+    size_t mirrors = opts.matrix[0].size();
+    std::mt19937_64 rng(7);
+    std::vector<std::string> urls;
+    std::string before, after;
+    for (size_t m = 0; m <= mirrors; ++m) {
+        urls.push_back("https://m" + std::to_string(m) + ".example/message");
+        if (m < mirrors) before += (m ? " " : "") + urls.back();
+        after += (m ? " " : "") + urls.back();
+    }
+    auto mirror_of = [&](const std::string& url) { return (size_t)(std::find(urls.begin(), urls.end(), url) - urls.begin()); };
+    EndpointSelector selector;
+    std::vector<size_t> load(mirrors);
+    size_t moved = 0, moved_elsewhere = 0;
+    for (size_t i = 0; i < opts.keys; ++i) {
+        selector.set_shard_key(rng() | 1);
+        size_t was = mirror_of(selector.order(before, true)[0]);
+        size_t now = mirror_of(selector.order(after, true)[0]);
+        ++load[was];
+        if (was != now) {
+            ++moved;
+            if (now != mirrors) ++moved_elsewhere;
+        }
+    }
+    auto [lo, hi] = std::minmax_element(load.begin(), load.end());
+    printf("\nshard pinning, %zu keys over %zu mirrors: %zu .. %zu per mirror (ideal %zu)\n", opts.keys, mirrors, *lo, *hi,
+           opts.keys / mirrors);
+    printf("adding mirror %zu moved %.1f%% of keys (ideal %.1f%%), %zu of them between the old mirrors\n", mirrors,
+           100.0 * moved / opts.keys, 100.0 / (mirrors + 1), moved_elsewhere);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--matrix" && i + 1 < argc) {
+            if (!parse_matrix(argv[++i], opts.matrix)) {
+                std::cerr << "--matrix: rows of positive ms separated by ';', the same number (>= 2) of mirrors in each\n";
+                return 1;
+            }
+        } else if (arg == "--clients" && i + 1 < argc) {
+            opts.clients = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--minutes" && i + 1 < argc) {
+            opts.minutes = atoi(argv[++i]);
+        } else if (arg == "--slow-factor" && i + 1 < argc) {
+            opts.slow_factor = atof(argv[++i]);
+        } else if (arg == "--slow-errors" && i + 1 < argc) {
+            opts.slow_errors = atof(argv[++i]);
+        } else if (arg == "--keys" && i + 1 < argc) {
+            opts.keys = strtoull(argv[++i], nullptr, 10);
+        } else {
+            std::cerr << "usage: endpoint_sim [--matrix \"r0m0,r0m1;r1m0,r1m1\"] [--clients N] [--minutes N]\n"
+                         "                    [--slow-factor X] [--slow-errors P] [--keys N]\n";
+            return 1;
+        }
+    }
+    if (opts.clients == 0 || opts.minutes < 3) {
+        std::cerr << "need --clients > 0 and --minutes >= 3\n";
+        return 1;
+    }
+
+    printf("%zu regions x %zu mirrors, %zu clients per region, %d min; mirror 0 slow (x%.0f, %.0f%% errors) from min %d to %d,\n"
+           "mirror 1 down from min %d to %d\n\n",
+           opts.matrix.size(), opts.matrix[0].size(), opts.clients, opts.minutes, opts.slow_factor, opts.slow_errors * 100,
+           opts.minutes / 3, opts.minutes * 2 / 3, opts.minutes / 2 - 5, opts.minutes / 2 + 5);
+    printf("%-9s %9s %8s %8s %8s %8s %10s %10s\n", "policy", "calls", "mean", "50%", "95%", "99%", "unanswered", "slow mean");
+    for (Policy policy : {Policy::First, Policy::Random, Policy::Selector}) {
+        Result r = run(opts, policy, 42);
+        double sum = 0;
+        for (double v : r.latencies) sum += v;
+        printf("%-9s %9zu %6.0fms %6.0fms %6.0fms %6.0fms %10zu %8.0fms\n", policy_name(policy), r.latencies.size(),
+               sum / r.latencies.size(), percentile(r.latencies, 0.5), percentile(r.latencies, 0.95),
+               percentile(r.latencies, 0.99), r.unanswered, r.slow_calls ? r.slow_sum / r.slow_calls : 0);
+    }
+    shard_report(opts);
+    return 0;
+}
@@ -0,0 +1,268 @@
+// The IPv6/IPv4 connection race of https_client.h (race_connect) against
+// loopback listeners, Linux only.
+//
+// Every scenario listens on [::1] and 127.0.0.1 and races the two addresses
+// as HttpsClient does, with --delay-ms between attempts and --timeout-ms in
+// all. A listener is one of:
+//
+//   up         accepts
+//   blackhole  its accept queue is full, so SYNs are dropped and the
+//              connect hangs, as on a broken IPv6 route
+//   slow       a blackhole that frees its queue after 100 ms: the connect
+//              gets in at the kernel's first SYN retransmit (about 1 s)
+//   refused    nothing listens on the port
+//
+// Prints each scenario's winner, attempts and time, and checks them; then the
+// same broken IPv6 route connected one address after the other (the client
+// before the race) for comparison, that the IP version kept by
+// TlsSessionCache survives a reopen, and that no socket is left open.
+//
+//   g++ -std=c++17 -O2 -pthread -I. tools/happy_eyeballs_test.cpp -o happy_eyeballs_test -lssl -lcrypto
+//   ./happy_eyeballs_test [--delay-ms 250] [--timeout-ms 3000] [--dir /tmp]
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "https_client.h"
+
+namespace {
+
+using https_detail::ConnectResult;
+
+struct Options {
+    int delay_ms = 250;
+    int timeout_ms = 3000;
+    std::string dir = "/tmp";
+};
+
+enum class Mode { Up, Blackhole, Slow, Refused };
+
+const char* mode_name(Mode mode) {
+    switch (mode) {
+        case Mode::Up: return "up";
+        case Mode::Blackhole: return "blackhole";
+        case Mode::Slow: return "slow";
+        case Mode::Refused: return "refused";
+    }
+    return "";
+}
+
+const int SLOW_FREE_MS = 100;  // a slow listener frees its queue after this
+
+// A loopback listener of one IP version behaving as `mode`
+class Listener {
+public:
+    Listener(int version, Mode mode) : mode_(mode) {
+        int family = version == 6 ? AF_INET6 : AF_INET;
+        fd_ = socket(family, SOCK_STREAM, 0);
+        sockaddr_storage addr = {};
+        socklen_t len = loopback(family, 0, addr);
+        if (fd_ < 0 || bind(fd_, (sockaddr*)&addr, len) != 0 || getsockname(fd_, (sockaddr*)&addr, &len) != 0) return;
+        port_ = ntohs(family == AF_INET6 ? ((sockaddr_in6*)&addr)->sin6_port : ((sockaddr_in*)&addr)->sin_port);
+        if (mode == Mode::Refused) {
+            close(fd_);  // the port stays free, so connects are refused
+            fd_ = -1;
+            return;
+        }
+        if (listen(fd_, mode == Mode::Up ? 16 : 0) != 0) return;
+        if (mode == Mode::Up) return;
+        // A backlog of 0 queues one connection; this one fills it
+        filler_ = socket(family, SOCK_STREAM, 0);
+        if (connect(filler_, (sockaddr*)&addr, len) != 0) return;
+        if (mode == Mode::Slow) {
+            freer_ = std::thread([this] {
+                std::this_thread::sleep_for(std::chrono::milliseconds(SLOW_FREE_MS));
+                int queued = accept(fd_, nullptr, nullptr);
+                if (queued >= 0) close(queued);
+            });
+        }
+    }
+
+    ~Listener() {
+        if (freer_.joinable()) freer_.join();
+        if (filler_ >= 0) close(filler_);
+        if (fd_ >= 0) close(fd_);
+    }
+
+    Listener(const Listener&) = delete;
+    Listener& operator=(const Listener&) = delete;
+
+    int port() const { return port_; }
+
+    static socklen_t loopback(int family, int port, sockaddr_storage& addr) {
+        if (family == AF_INET6) {
+            sockaddr_in6* a = (sockaddr_in6*)&addr;
+            a->sin6_family = AF_INET6;
+            a->sin6_addr = in6addr_loopback;
+            a->sin6_port = htons((uint16_t)port);
+            return sizeof(*a);
+        }
+        sockaddr_in* a = (sockaddr_in*)&addr;
+        a->sin_family = AF_INET;
+        a->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        a->sin_port = htons((uint16_t)port);
+        return sizeof(*a);
+    }
+
+private:
+    Mode mode_;
+    int fd_ = -1;
+    int filler_ = -1;
+    int port_ = 0;
+    std::thread freer_;
+};
+
+// [::1]:port6 then 127.0.0.1:port4, as a dual-stack host resolves
+addrinfo* resolve_pair(int port6, int port4) {
+    addrinfo hints = {};
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+    addrinfo *v6 = nullptr, *v4 = nullptr;
+    if (getaddrinfo("::1", std::to_string(port6).c_str(), &hints, &v6) != 0) return nullptr;
+    if (getaddrinfo("127.0.0.1", std::to_string(port4).c_str(), &hints, &v4) != 0) {
+        freeaddrinfo(v6);
+        return nullptr;
+    }
+    addrinfo* last = v6;
+    while (last->ai_next) last = last->ai_next;
+    last->ai_next = v4;
+    return v6;
+}
+
+// Sockets this process has open
+size_t open_fds() {
+    size_t n = 0;
+    if (DIR* dir = opendir("/proc/self/fd")) {
+        while (dirent* e = readdir(dir)) n += e->d_name[0] != '.';
+        closedir(dir);
+    }
+    return n;
+}
+
+struct Scenario {
+    const char* name;
+    Mode v6, v4;
+    int first;             // the cached IP version, 0 = none
+    int delay_ms;          // 0 = --delay-ms
+    int want;              // the winner's IP version, 0 = none
+    int attempts;
+    double min_ms, max_ms;  // < 0 = from --delay-ms / --timeout-ms
+};
+
+double ms_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Races the pair; the winner's socket is closed before returning
+ConnectResult race(Mode v6, Mode v4, int first, int delay_ms, int timeout_ms, double& ms) {
+    Listener l6(6, v6), l4(4, v4);
+    addrinfo* list = resolve_pair(l6.port(), l4.port());
+    ConnectResult r;
+    auto start = std::chrono::steady_clock::now();
+    if (list) r = https_detail::race_connect(https_detail::interleave_families(list, first ? first : 6), delay_ms, timeout_ms);
+    ms = ms_since(start);
+    if (list) freeaddrinfo(list);
+    if (r.socket != https_detail::NO_SOCKET) close(r.socket);
+    return r;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--delay-ms" && i + 1 < argc) opts.delay_ms = atoi(argv[++i]);
+        else if (arg == "--timeout-ms" && i + 1 < argc) opts.timeout_ms = atoi(argv[++i]);
+        else if (arg == "--dir" && i + 1 < argc) opts.dir = argv[++i];
+        else {
+            std::cerr << "usage: happy_eyeballs_test [--delay-ms N] [--timeout-ms N] [--dir DIR]\n";
+            return 1;
+        }
+    }
+    if (opts.delay_ms < 50 || opts.timeout_ms < 4 * opts.delay_ms || opts.timeout_ms < 1500) {
+        std::cerr << "need --delay-ms >= 50 and --timeout-ms >= 1500 and >= 4 x --delay-ms\n";
+        return 1;
+    }
+    size_t fds_before = open_fds();
+    double delay = opts.delay_ms, timeout = opts.timeout_ms;
+    const double FAST_MS = 100;  // "at once" on loopback, with room for a loaded machine
+
+    const Scenario scenarios[] = {
+        {"both up", Mode::Up, Mode::Up, 0, 0, 6, 1, 0, FAST_MS},
+        {"v6 blackholed", Mode::Blackhole, Mode::Up, 0, 0, 4, 2, delay, delay + FAST_MS},
+        {"v6 blackholed, v4 cached", Mode::Blackhole, Mode::Up, 4, 0, 4, 1, 0, FAST_MS},
+        {"v6 refused", Mode::Refused, Mode::Up, 0, 0, 4, 2, 0, FAST_MS},
+        {"v4 blackholed, v4 cached", Mode::Up, Mode::Blackhole, 4, 0, 6, 2, delay, delay + FAST_MS},
+        // The first SYN is lost but the retransmit gets in before the delay
+        {"v6 slow, delay 2000", Mode::Slow, Mode::Up, 0, 2000, 6, 1, 800, 1600},
+        {"both blackholed", Mode::Blackhole, Mode::Blackhole, 0, 0, 0, 2, timeout, timeout + FAST_MS},
+    };
+
+    int failures = 0;
+    printf("attempt delay %d ms, timeout %d ms\n\n", opts.delay_ms, opts.timeout_ms);
+    printf("%-26s %-10s %-10s %6s %7s %8s %9s\n", "scenario", "[::1]", "127.0.0.1", "won", "tries", "time", "expected");
+    for (const Scenario& s : scenarios) {
+        double ms = 0;
+        ConnectResult r = race(s.v6, s.v4, s.first, s.delay_ms ? s.delay_ms : opts.delay_ms, opts.timeout_ms, ms);
+        bool ok = r.version == s.want && r.attempts == s.attempts && ms >= s.min_ms && ms <= s.max_ms;
+        std::string won = r.version ? "v" + std::to_string(r.version) : "none";
+        printf("%-26s %-10s %-10s %6s %7d %6.0fms %4.0f-%.0fms%s\n", s.name, mode_name(s.v6), mode_name(s.v4), won.c_str(),
+               r.attempts, ms, s.min_ms, s.max_ms, ok ? "" : "  FAILED");
+        if (!ok) ++failures;
+    }
+
+    // Before the race: each address in turn, each with the whole timeout
+    {
+        Listener l6(6, Mode::Blackhole), l4(4, Mode::Up);
+        addrinfo* list = resolve_pair(l6.port(), l4.port());
+        auto start = std::chrono::steady_clock::now();
+        ConnectResult r;
+        for (const addrinfo* ai : https_detail::interleave_families(list, 6)) {
+            r = https_detail::race_connect({ai}, opts.timeout_ms, opts.timeout_ms);
+            if (r.socket != https_detail::NO_SOCKET) break;
+        }
+        double ms = ms_since(start);
+        if (r.socket != https_detail::NO_SOCKET) close(r.socket);
+        freeaddrinfo(list);
+        printf("\nv6 blackholed, one address after the other: v%d in %.0f ms\n", r.version, ms);
+    }
+
+    // The winner is kept per host across launches
+    {
+        std::string path = opts.dir + "/happy_eyeballs_test_sessions.dat";
+        std::remove(path.c_str());
+        TlsSessionCache cache;
+        cache.open(path);
+        double ms = 0;
+        ConnectResult r = race(Mode::Blackhole, Mode::Up, cache.ip_version("dual:443"), opts.delay_ms, opts.timeout_ms, ms);
+        cache.set_ip_version("dual:443", r.version);
+        TlsSessionCache relaunch;
+        relaunch.open(path);
+        int kept = relaunch.ip_version("dual:443");
+        SSL_SESSION* ticket = relaunch.find("dual:443");
+        double again = 0;
+        ConnectResult next = race(Mode::Blackhole, Mode::Up, kept, opts.delay_ms, opts.timeout_ms, again);
+        bool ok = r.version == 4 && kept == 4 && !ticket && next.version == 4 && next.attempts == 1 && again < FAST_MS;
+        printf("cached IP version after a reopen: v%d, next connect v%d in %.0f ms%s\n", kept, next.version, again,
+               ok ? "" : "  FAILED");
+        if (ticket) SSL_SESSION_free(ticket);
+        if (!ok) ++failures;
+        std::remove(path.c_str());
+    }
+
+    size_t fds_after = open_fds();
+    printf("open descriptors before %zu, after %zu%s\n", fds_before, fds_after, fds_after == fds_before ? "" : "  FAILED");
+    if (fds_after != fds_before) ++failures;
+
+    printf("\n%s\n", failures ? "FAILED: a race did not go as expected" : "all races as expected");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,266 @@
+// Request-rate curves for a fleet that powers on together (admission.h and
+// server/admission_gate.h), in virtual time.
+//
+// N clients launch within a few seconds of each other and each does what
+// LoginHandshake does: ipcheck, then proxycheck, then the backend. The
+// proxycheck service allows --proxy-rps and answers 429 (no Retry-After)
+// beyond it. A failed login is retried by the user 10-30 s later. Three runs:
+//
+//   herd       no jitter, no admission, backend takes everything
+//   jitter     START_JITTER_MS only
+//   admission  jitter, client holds (429/503, Retry-After, "retry_after")
+//              and the backend at --backend-rps with slots (--max-rps)
+//
+// Prints requests per second to each service per run, then the peaks, the
+// seconds the backend took more than --backend-rps, 429/503 counts and how
+// long the fleet took to log in.
+//
+//   g++ -std=c++17 -O2 -I. tools/herd_sim.cpp -o herd_sim
+//   ./herd_sim [--clients N] [--jitter-ms MS] [--proxy-rps N] [--backend-rps N] [--seconds N]
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+#include "admission.h"
+#include "server/admission_gate.h"
+
+namespace {
+
+struct Options {
+    size_t clients = 500;
+    double power_on_s = 2;      // launches spread over this much
+    double jitter_ms = 30000;
+    double proxy_rps = 20;
+    double backend_rps = 10;
+    double max_wait_ms = 15000;  // ADMISSION_MAX_WAIT_MS
+    int seconds = 90;            // rows printed
+};
+
+enum class Mode { Herd, Jitter, Admission };
+
+const char* mode_name(Mode mode) {
+    switch (mode) {
+        case Mode::Herd: return "herd";
+        case Mode::Jitter: return "jitter";
+        case Mode::Admission: return "admission";
+    }
+    return "";
+}
+
+// A third party's plain rate limit: a token bucket, over it 429
+class RateLimit {
+public:
+    explicit RateLimit(double per_s) : rate_(per_s), tokens_(per_s) {}
+    bool take(double now_s) {
+        tokens_ = std::min(rate_, tokens_ + (now_s - last_s_) * rate_);
+        last_s_ = now_s;
+        if (tokens_ < 1) return false;
+        tokens_ -= 1;
+        return true;
+    }
+
+private:
+    double rate_, tokens_, last_s_ = 0;
+};
+
+enum class Step { Launch, Probe, Send };
+
+struct Event {
+    double at_ms;
+    size_t client;
+    Step step;
+    bool operator>(const Event& other) const { return at_ms > other.at_ms; }
+};
+
+struct Counts {
+    std::vector<int> ipcheck, proxycheck, proxy_429, backend, backend_503;
+    explicit Counts(size_t seconds)
+        : ipcheck(seconds), proxycheck(seconds), proxy_429(seconds), backend(seconds), backend_503(seconds) {}
+};
+
+struct Result {
+    Counts counts;
+    std::vector<double> logged_in_ms;  // per client; < 0 = never
+    size_t launches = 0;
+    explicit Result(size_t seconds) : counts(seconds) {}
+};
+
+const double LATENCY_MS = 60;   // each request
+const double ENCRYPT_MS = 5;
+const double HORIZON_S = 1800;  // the run ends here whether or not everyone got in
+
+Result run(const Options& opts, Mode mode, unsigned seed) {
+    std::mt19937 rng(seed);
+    auto uniform = [&rng](double lo, double hi) { return std::uniform_real_distribution<double>(lo, hi)(rng); };
+    bool admission = mode == Mode::Admission;
+    double jitter_ms = mode == Mode::Herd ? 0 : opts.jitter_ms;
+
+    std::vector<Admission> clients(opts.clients);
+    Result result((size_t)HORIZON_S);
+    result.logged_in_ms.assign(opts.clients, -1);
+    RateLimit proxycheck(opts.proxy_rps);
+    AdmissionGate backend(admission ? opts.backend_rps : 0, opts.backend_rps);
+
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+    for (size_t c = 0; c < opts.clients; ++c) events.push({uniform(0, opts.power_on_s * 1000), c, Step::Launch});
+
+    auto count = [](std::vector<int>& series, double at_ms) {
+        size_t s = (size_t)(at_ms / 1000);
+        if (s < series.size()) ++series[s];
+    };
+    // The login failed; the user tries again
+    auto relaunch = [&](size_t c, double now_ms) { events.push({now_ms + uniform(10000, 30000), c, Step::Launch}); };
+
+    while (!events.empty()) {
+        Event e = events.top();
+        events.pop();
+        if (e.at_ms >= HORIZON_S * 1000) break;
+        Admission& client = clients[e.client];
+        int64_t now = (int64_t)e.at_ms;
+        switch (e.step) {
+        case Step::Launch: {
+            ++result.launches;
+            // handshake.h probe_network: a far-off hold fails at once, else
+            // the start jitter and the hold run together
+            double hold = admission ? client.network_hold_ms(now) : 0;
+            if (hold > opts.max_wait_ms) {
+                relaunch(e.client, e.at_ms);
+                break;
+            }
+            double jitter = jitter_ms > 0 ? uniform(0, jitter_ms) : 0;
+            events.push({e.at_ms + std::max(hold, jitter), e.client, Step::Probe});
+            break;
+        }
+        case Step::Probe: {
+            count(result.counts.ipcheck, e.at_ms);
+            double at = e.at_ms + LATENCY_MS;
+            count(result.counts.proxycheck, at);
+            ReplyStatus reply;
+            reply.status = proxycheck.take(at / 1000) ? 200 : 429;
+            if (admission) client.on_reply(AdmissionService::ProxyCheck, reply, (int64_t)at);
+            if (reply.status == 429) {
+                count(result.counts.proxy_429, at);
+                relaunch(e.client, at + LATENCY_MS);
+                break;
+            }
+            events.push({at + LATENCY_MS + ENCRYPT_MS, e.client, Step::Send});
+            break;
+        }
+        case Step::Send: {
+            double hold = admission ? client.hold_ms(AdmissionService::Backend, now) : 0;
+            if (hold > opts.max_wait_ms) {
+                relaunch(e.client, e.at_ms);
+                break;
+            }
+            if (hold > 0) {
+                // Waited out inline; checked again when it is over
+                events.push({e.at_ms + hold, e.client, Step::Send});
+                break;
+            }
+            count(result.counts.backend, e.at_ms);
+            double retry_after_s = 0;
+            ReplyStatus reply;
+            reply.status = backend.admit(e.at_ms / 1000, 1, retry_after_s) ? 200 : 503;
+            if (reply.status == 503) {
+                long long wait_s = (long long)std::ceil(retry_after_s);
+                reply.retry_after = std::to_string(wait_s);
+                client.on_reply(AdmissionService::Backend, reply, now);
+                client.on_backend_reply("{\"retry_after\":" + std::to_string(wait_s) + "}", now);
+                count(result.counts.backend_503, e.at_ms);
+                // send_registration waits out a short slot and sends again
+                events.push({e.at_ms + LATENCY_MS, e.client, Step::Send});
+                break;
+            }
+            if (admission) client.on_reply(AdmissionService::Backend, reply, now);
+            result.logged_in_ms[e.client] = e.at_ms + LATENCY_MS;
+            break;
+        }
+        }
+    }
+    return result;
+}
+
+int peak(const std::vector<int>& series) { return series.empty() ? 0 : *std::max_element(series.begin(), series.end()); }
+
+int total(const std::vector<int>& series) {
+    int sum = 0;
+    for (int v : series) sum += v;
+    return sum;
+}
+
+// Seconds until `fraction` of the fleet had logged in; -1 if it never did
+double time_to(const std::vector<double>& logged_in_ms, double fraction) {
+    std::vector<double> done;
+    for (double t : logged_in_ms) {
+        if (t >= 0) done.push_back(t);
+    }
+    size_t need = (size_t)std::ceil(fraction * logged_in_ms.size());
+    if (need == 0 || done.size() < need) return -1;
+    std::nth_element(done.begin(), done.begin() + (need - 1), done.end());
+    return done[need - 1] / 1000;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--clients" && i + 1 < argc) opts.clients = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--jitter-ms" && i + 1 < argc) opts.jitter_ms = atof(argv[++i]);
+        else if (arg == "--proxy-rps" && i + 1 < argc) opts.proxy_rps = atof(argv[++i]);
+        else if (arg == "--backend-rps" && i + 1 < argc) opts.backend_rps = atof(argv[++i]);
+        else if (arg == "--seconds" && i + 1 < argc) opts.seconds = atoi(argv[++i]);
+        else {
+            std::cerr << "usage: herd_sim [--clients N] [--jitter-ms MS] [--proxy-rps N] [--backend-rps N] [--seconds N]\n";
+            return 1;
+        }
+    }
+    if (opts.clients == 0 || opts.proxy_rps <= 0 || opts.backend_rps <= 0) {
+        std::cerr << "need positive --clients, --proxy-rps and --backend-rps\n";
+        return 1;
+    }
+
+    const Mode modes[] = {Mode::Herd, Mode::Jitter, Mode::Admission};
+    std::vector<Result> results;
+    for (Mode mode : modes) results.push_back(run(opts, mode, 42));
+
+    printf("%zu clients powering on within %.0f s; proxycheck allows %.0f/s, backend slots at %.0f/s\n\n", opts.clients,
+           opts.power_on_s, opts.proxy_rps, opts.backend_rps);
+    printf("requests per second: ipcheck  proxycheck(429)  backend(503)\n");
+    printf("%5s", "t");
+    for (Mode mode : modes) printf("  |%-26s", mode_name(mode));
+    printf("\n");
+    for (int s = 0; s < opts.seconds && s < (int)HORIZON_S; ++s) {
+        printf("%5d", s);
+        for (const Result& r : results) {
+            const Counts& c = r.counts;
+            printf("  |%4d %5d(%4d) %5d(%4d)", c.ipcheck[s], c.proxycheck[s], c.proxy_429[s], c.backend[s],
+                   c.backend_503[s]);
+        }
+        printf("\n");
+    }
+    printf("\n%-10s %8s %8s %8s %7s %7s %7s %9s %7s %7s %7s\n", "run", "peak ip", "peak px", "peak be", "over", "429s",
+           "503s", "launches", "50% in", "95% in", "all in");
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        const Counts& c = r.counts;
+        // Registrations the backend took per second (503s cost it no decryption)
+        int taken_peak = 0, over = 0;
+        for (size_t s = 0; s < c.backend.size(); ++s) {
+            int taken = c.backend[s] - c.backend_503[s];
+            taken_peak = std::max(taken_peak, taken);
+            over += taken > opts.backend_rps;
+        }
+        printf("%-10s %8d %8d %8d %6ds %7d %7d %9zu %6.0fs %6.0fs %6.0fs\n", mode_name(modes[i]), peak(c.ipcheck),
+               peak(c.proxycheck), taken_peak, over, total(c.proxy_429), total(c.backend_503), r.launches,
+               time_to(r.logged_in_ms, 0.5), time_to(r.logged_in_ms, 0.95), time_to(r.logged_in_ms, 1.0));
+    }
+    printf("peak be: registrations taken in one second; over: seconds above --backend-rps\n");
+    return 0;
+}
@@ -0,0 +1,212 @@
+// Connection handling of server/http_server.h against plain loopback
+// sockets, Linux only. The handler echoes the path, or answers ?size=<n>
+// bytes. Scenarios:
+//
+//   keep-alive   two requests on one connection, both answered
+//   pipelined    two requests in one write, answered in order
+//   half close   a request then shutdown(SHUT_WR), as one-shot HTTP/1.0
+//                tools send it: answered, then closed; also with a body,
+//                with two requests, and with a response too large for one
+//                write
+//   partial      a half close in the middle of a request: closed unanswered
+//   malformed    400, then closed
+//
+//   g++ -std=c++17 -O2 -pthread -I. tools/http_server_test.cpp -o http_server_test
+//   ./http_server_test [--port 18190]
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "server/http_server.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (!ok) {
+        printf("  FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+uint16_t port = 18190;
+
+int connect_server() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    timeval timeout = {5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return fd;
+}
+
+void send_all(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t r = write(fd, data.data() + sent, data.size() - sent);
+        if (r <= 0) return;
+        sent += (size_t)r;
+    }
+}
+
+// Everything until the server closes (or 5 s pass: `closed` stays false)
+std::string read_to_close(int fd, bool& closed) {
+    std::string in;
+    char buf[64 * 1024];
+    closed = false;
+    while (true) {
+        ssize_t r = read(fd, buf, sizeof(buf));
+        if (r > 0) {
+            in.append(buf, (size_t)r);
+            continue;
+        }
+        closed = r == 0;
+        return in;
+    }
+}
+
+// One response (headers and Content-Length body) from `fd`, or "" on timeout
+std::string read_response(int fd) {
+    std::string in;
+    char c;
+    while (in.find("\r\n\r\n") == std::string::npos && read(fd, &c, 1) == 1) in += c;
+    size_t at = in.find("Content-Length: ");
+    if (at == std::string::npos) return "";
+    size_t length = strtoull(in.c_str() + at + 16, nullptr, 10);
+    std::string body(length, '\0');
+    size_t got = 0;
+    while (got < length) {
+        ssize_t r = read(fd, &body[got], length - got);
+        if (r <= 0) return "";
+        got += (size_t)r;
+    }
+    return in + body;
+}
+
+size_t count_of(const std::string& text, const std::string& what) {
+    size_t n = 0;
+    for (size_t at = text.find(what); at != std::string::npos; at = text.find(what, at + 1)) ++n;
+    return n;
+}
+
+void handle(const HttpRequest& req, HttpResponse& resp, unsigned) {
+    if (req.query.compare(0, 5, "size=") == 0) {
+        resp.body.assign(strtoull(req.query.c_str() + 5, nullptr, 10), 'x');
+        return;
+    }
+    resp.body = req.method + " " + req.path + " " + std::to_string(req.body.size());
+}
+
+void keep_alive() {
+    printf("keep-alive\n");
+    int fd = connect_server();
+    send_all(fd, "GET /one HTTP/1.1\r\nHost: x\r\n\r\n");
+    std::string first = read_response(fd);
+    send_all(fd, "GET /two HTTP/1.1\r\nHost: x\r\n\r\n");
+    std::string second = read_response(fd);
+    check(first.find("GET /one 0") != std::string::npos && first.find("Connection: keep-alive") != std::string::npos,
+          "first response: " + first);
+    check(second.find("GET /two 0") != std::string::npos, "second response: " + second);
+    close(fd);
+}
+
+void pipelined() {
+    printf("pipelined\n");
+    int fd = connect_server();
+    send_all(fd, "GET /a HTTP/1.1\r\n\r\nGET /b HTTP/1.1\r\nConnection: close\r\n\r\n");
+    bool closed;
+    std::string in = read_to_close(fd, closed);
+    size_t a = in.find("GET /a 0"), b = in.find("GET /b 0");
+    check(closed && a != std::string::npos && b != std::string::npos && a < b, "pipelined responses: " + in);
+    close(fd);
+}
+
+void half_close() {
+    printf("half close\n");
+    struct Case {
+        const char* name;
+        std::string request;
+        size_t responses;
+        std::string expected;
+    };
+    const Case CASES[] = {
+        {"HTTP/1.0", "GET /status HTTP/1.0\r\n\r\n", 1, "GET /status 0"},
+        {"HTTP/1.1 keep-alive", "GET /status HTTP/1.1\r\nHost: x\r\n\r\n", 1, "GET /status 0"},
+        {"body", "POST /message HTTP/1.0\r\nContent-Length: 11\r\n\r\nmessage=abc", 1, "POST /message 11"},
+        {"two requests", "GET /a HTTP/1.1\r\n\r\nGET /b HTTP/1.1\r\n\r\n", 2, "GET /b 0"},
+        {"large response", "GET /big?size=4000000 HTTP/1.0\r\n\r\n", 1, std::string(1000, 'x')},
+    };
+    for (const Case& c : CASES) {
+        int fd = connect_server();
+        send_all(fd, c.request);
+        shutdown(fd, SHUT_WR);
+        bool closed;
+        std::string in = read_to_close(fd, closed);
+        check(closed && count_of(in, "HTTP/1.1 200") == c.responses && in.find(c.expected) != std::string::npos,
+              std::string(c.name) + ": " + (in.size() > 200 ? in.substr(0, 200) + "..." : in));
+        // HTTP/1.1 ones may be answered before the FIN is seen
+        if (c.request.find("HTTP/1.0") != std::string::npos) {
+            check(count_of(in, "Connection: close") == c.responses, std::string(c.name) + ": not marked Connection: close");
+        }
+        if (c.expected.size() == 1000) check(in.size() > 4000000, "large response cut short");
+        close(fd);
+    }
+}
+
+void partial() {
+    printf("partial\n");
+    int fd = connect_server();
+    send_all(fd, "POST /message HTTP/1.1\r\nContent-Length: 100\r\n\r\nshort");
+    shutdown(fd, SHUT_WR);
+    bool closed;
+    std::string in = read_to_close(fd, closed);
+    check(closed && in.empty(), "partial request answered: " + in);
+    close(fd);
+}
+
+void malformed() {
+    printf("malformed\n");
+    int fd = connect_server();
+    send_all(fd, "NONSENSE\r\n\r\n");
+    bool closed;
+    std::string in = read_to_close(fd, closed);
+    check(closed && in.compare(0, 12, "HTTP/1.1 400") == 0, "malformed request: " + in);
+    close(fd);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--port" && i + 1 < argc) port = (uint16_t)atoi(argv[++i]);
+        else {
+            std::cerr << "usage: http_server_test [--port N]\n";
+            return 1;
+        }
+    }
+    HttpServer server("127.0.0.1", port, 2, handle);
+    if (!server.start()) {
+        std::cerr << "cannot listen on 127.0.0.1:" << port << "\n";
+        return 1;
+    }
+    keep_alive();
+    pipelined();
+    half_close();
+    partial();
+    malformed();
+    server.stop();
+    printf("\n%s\n", failures ? "FAILED: the server did not behave as expected" : "all connections as expected");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,327 @@
+// Single-instance detection and the command channel of instance_channel.h over
+// its Linux Unix-socket transport.
+//
+// Runs in a private XDG_RUNTIME_DIR. Checks:
+//
+//   round trip     a second launch's command reaches the owner's handler and
+//                  the reply comes back; empty and oversized commands
+//   second owner   listen() on a claimed name fails while the owner lives
+//   stale socket   a socket file left by a crashed owner is taken over
+//   busy owner     an owner whose backlog is full is not taken for stale
+//   claim lock     a launch waits while another holds the claim lock, then
+//                  finds that one's socket live instead of replacing it
+//   simultaneous   --racers instances claim a stale name at the same moment,
+//                  --rounds times: exactly one owns it, and its socket answers
+//   release        close() removes the socket; a later send() fails at once
+//   other user     (as root) a peer of another uid is refused both ways
+//
+//   g++ -std=c++17 -O2 -pthread -I. tools/instance_channel_test.cpp -o instance_channel_test
+//   ./instance_channel_test [--racers 8] [--rounds 200]
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "instance_channel.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (!ok) {
+        printf("  FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+struct Options {
+    int racers = 8;
+    int rounds = 200;
+};
+
+// Leaves a socket file nobody listens on, as a crashed owner does
+bool plant_stale_socket(const std::string& path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+    bool ok = fd >= 0 && bind(fd, (sockaddr*)&addr, sizeof(addr)) == 0 && ::listen(fd, 1) == 0;
+    if (fd >= 0) close(fd);
+    return ok;
+}
+
+bool exists(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+void round_trip() {
+    printf("round trip\n");
+    std::mutex mutex;
+    std::vector<std::string> received;
+    InstanceChannel owner("test-app-resident");
+    bool primary = owner.listen([&](const std::string& command) {
+        std::lock_guard<std::mutex> lock(mutex);
+        received.push_back(command);
+        return command == "SHOW" ? std::string("OK") : "ERROR unknown command";
+    });
+    check(primary && owner.is_primary(), "first listen() did not claim the channel");
+    std::string reply;
+    check(InstanceChannel::send("test-app-resident", "SHOW", reply, 2000) && reply == "OK", "SHOW reply: " + reply);
+    check(InstanceChannel::send("test-app-resident", "PING", reply, 2000) && reply == "ERROR unknown command",
+          "unknown command reply: " + reply);
+    // An empty line is the close() wake-up: no handler call, no reply
+    check(InstanceChannel::send("test-app-resident", "", reply, 2000) && reply.empty(), "empty command answered");
+    // Commands stop at 4096 bytes
+    check(InstanceChannel::send("test-app-resident", std::string(10000, 'x'), reply, 2000), "long command not sent");
+    std::lock_guard<std::mutex> lock(mutex);
+    check(received.size() == 3 && received[0] == "SHOW" && received[1] == "PING" && received[2].size() == 4096,
+          "handler did not see the commands as sent");
+}
+
+void second_owner() {
+    printf("second owner\n");
+    InstanceChannel owner("test-second");
+    check(owner.listen([](const std::string&) { return std::string("first"); }), "first listen() failed");
+    InstanceChannel other("test-second");
+    check(!other.listen([](const std::string&) { return std::string("second"); }) && !other.is_primary(),
+          "a second instance claimed a live channel");
+    std::string reply;
+    check(InstanceChannel::send("test-second", "SHOW", reply, 2000) && reply == "first", "live owner lost its channel");
+}
+
+void stale_socket() {
+    printf("stale socket\n");
+    std::string path = InstanceChannel::socket_path("test-stale");
+    check(plant_stale_socket(path) && exists(path), "could not plant a stale socket");
+    std::string reply;
+    check(!InstanceChannel::send("test-stale", "SHOW", reply, 500), "stale socket answered");
+    InstanceChannel owner("test-stale");
+    check(owner.listen([](const std::string&) { return std::string("new"); }), "stale socket not taken over");
+    check(InstanceChannel::send("test-stale", "SHOW", reply, 2000) && reply == "new", "new owner does not answer");
+}
+
+// A listener with a full backlog refuses nothing, it just does not accept
+void busy_owner() {
+    printf("busy owner\n");
+    std::string path = InstanceChannel::socket_path("test-busy");
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+    bool listening = fd >= 0 && bind(fd, (sockaddr*)&addr, sizeof(addr)) == 0 && ::listen(fd, 0) == 0;
+    // Fills the backlog of 0 (one queued connection)
+    int filler = socket(AF_UNIX, SOCK_STREAM, 0);
+    listening = listening && connect(filler, (sockaddr*)&addr, sizeof(addr)) == 0;
+    check(listening, "could not set up a busy listener");
+    auto start = std::chrono::steady_clock::now();
+    InstanceChannel launch("test-busy");
+    bool claimed = launch.listen([](const std::string&) { return std::string("stolen"); });
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    check(!claimed && exists(path), "a busy owner's socket was replaced");
+    check(ms < 500, "claim waited on the busy owner");
+    close(filler);
+    close(fd);
+    unlink(path.c_str());
+}
+
+// Holds "<socket>.lock" as a launch in the middle of its claim would
+void claim_lock() {
+    printf("claim lock\n");
+    std::string path = InstanceChannel::socket_path("test-lock");
+    check(plant_stale_socket(path), "could not plant a stale socket");
+    int lock = open((path + ".lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    check(lock >= 0 && flock(lock, LOCK_EX) == 0, "could not take the claim lock");
+    InstanceChannel launch("test-lock");
+    std::atomic<int> claimed{-1};
+    std::thread thread([&] { claimed = launch.listen([](const std::string&) { return std::string("late"); }); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    check(claimed == -1, "listen() did not wait for the claim lock");
+    // The lock holder replaces the stale socket with its live one
+    unlink(path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    path.copy(addr.sun_path, sizeof(addr.sun_path) - 1);
+    check(bind(fd, (sockaddr*)&addr, sizeof(addr)) == 0 && ::listen(fd, 8) == 0, "could not bind the holder's socket");
+    close(lock);
+    thread.join();
+    check(claimed == 0, "the live socket was replaced after the lock");
+    close(fd);
+    unlink(path.c_str());
+}
+
+void simultaneous(const Options& opts) {
+    printf("simultaneous: %d instances x %d rounds\n", opts.racers, opts.rounds);
+    std::string path = InstanceChannel::socket_path("test-race");
+    int bad_rounds = 0;
+    for (int round = 0; round < opts.rounds; ++round) {
+        if (!plant_stale_socket(path)) {
+            check(false, "could not plant a stale socket");
+            return;
+        }
+        std::vector<std::unique_ptr<InstanceChannel>> instances;
+        for (int i = 0; i < opts.racers; ++i) instances.emplace_back(new InstanceChannel("test-race"));
+        std::atomic<int> ready{0};
+        std::atomic<bool> go{false};
+        std::vector<int> owned(opts.racers);
+        std::vector<std::thread> threads;
+        for (int i = 0; i < opts.racers; ++i) {
+            threads.emplace_back([&, i] {
+                ++ready;
+                while (!go) std::this_thread::yield();
+                owned[i] = instances[i]->listen([i](const std::string&) { return std::to_string(i); });
+            });
+        }
+        while (ready < opts.racers) std::this_thread::yield();
+        go = true;
+        for (auto& t : threads) t.join();
+        int owners = 0, owner = -1;
+        for (int i = 0; i < opts.racers; ++i) {
+            if (owned[i]) {
+                ++owners;
+                owner = i;
+            }
+        }
+        std::string reply;
+        bool answers = InstanceChannel::send("test-race", "SHOW", reply, 2000) && reply == std::to_string(owner);
+        if (owners != 1 || !answers) {
+            if (bad_rounds++ < 3) printf("  round %d: %d owners, socket answered \"%s\"\n", round, owners, reply.c_str());
+        }
+        instances.clear();
+        unlink(path.c_str());
+    }
+    check(bad_rounds == 0, std::to_string(bad_rounds) + " rounds without exactly one answering owner");
+}
+
+void release() {
+    printf("release\n");
+    std::string path = InstanceChannel::socket_path("test-release");
+    {
+        InstanceChannel owner("test-release");
+        check(owner.listen([](const std::string&) { return std::string("OK"); }), "listen() failed");
+        check(exists(path), "no socket while listening");
+        owner.close();
+        check(!owner.is_primary() && !exists(path), "close() left the socket");
+        // An owner that closes must not remove its successor's socket
+        InstanceChannel successor("test-release");
+        check(successor.listen([](const std::string&) { return std::string("next"); }), "successor could not claim");
+        owner.close();
+        std::string reply;
+        check(InstanceChannel::send("test-release", "SHOW", reply, 2000) && reply == "next", "successor's socket removed");
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::string reply;
+    bool sent = InstanceChannel::send("test-release", "SHOW", reply, 2000);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    check(!sent && ms < 100, "send() without an owner did not fail at once");
+}
+
+// A process of another uid connects to the owner, and owns a channel this
+// user connects to; both must be refused. Needs root to switch uid.
+void other_user() {
+    if (getuid() != 0) {
+        printf("other user: skipped (needs root)\n");
+        return;
+    }
+    printf("other user\n");
+    const uid_t NOBODY = 65534;
+    std::atomic<int> calls{0};
+    InstanceChannel owner("test-peer");
+    check(owner.listen([&](const std::string&) {
+              ++calls;
+              return std::string("OK");
+          }),
+          "listen() failed");
+    chmod(InstanceChannel::socket_path("test-peer").c_str(), 0777);
+    pid_t child = fork();
+    if (child == 0) {
+        if (setuid(NOBODY) != 0) _exit(2);
+        std::string reply;
+        bool sent = InstanceChannel::send("test-peer", "SHOW", reply, 1000);
+        _exit(sent && !reply.empty() ? 1 : 0);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    check(WIFEXITED(status) && WEXITSTATUS(status) == 0 && calls == 0, "another user's command was answered");
+
+    // A socket another user planted under this user's name
+    int ready[2];
+    if (pipe(ready) != 0) return;
+    child = fork();
+    if (child == 0) {
+        close(ready[0]);
+        if (setuid(NOBODY) != 0) _exit(2);
+        InstanceChannel planted("test-planted");
+        bool ok = planted.listen([](const std::string&) { return std::string("PLANTED"); });
+        if (ok) chmod(InstanceChannel::socket_path("test-planted").c_str(), 0777);
+        char c = ok ? '1' : '0';
+        if (write(ready[1], &c, 1) != 1) _exit(2);
+        sleep(5);
+        _exit(0);
+    }
+    close(ready[1]);
+    char c = '0';
+    bool planted = read(ready[0], &c, 1) == 1 && c == '1';
+    close(ready[0]);
+    std::string reply;
+    bool sent = planted && InstanceChannel::send("test-planted", "SHOW", reply, 1000);
+    kill(child, SIGKILL);
+    waitpid(child, &status, 0);
+    check(planted, "could not plant another user's socket");
+    check(!sent && reply.empty(), "command sent to another user's socket: " + reply);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--racers" && i + 1 < argc) opts.racers = atoi(argv[++i]);
+        else if (arg == "--rounds" && i + 1 < argc) opts.rounds = atoi(argv[++i]);
+        else {
+            std::cerr << "usage: instance_channel_test [--racers N] [--rounds N]\n";
+            return 1;
+        }
+    }
+    if (opts.racers < 2 || opts.rounds < 1) {
+        std::cerr << "need --racers >= 2 and --rounds >= 1\n";
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    char dir[] = "/tmp/instance_channel_test.XXXXXX";
+    if (!mkdtemp(dir)) {
+        std::cerr << "cannot create a runtime directory\n";
+        return 1;
+    }
+    chmod(dir, 01777);  // for the other-user checks, as /tmp is
+    setenv("XDG_RUNTIME_DIR", dir, 1);
+
+    round_trip();
+    second_owner();
+    stale_socket();
+    busy_owner();
+    claim_lock();
+    simultaneous(opts);
+    release();
+    other_user();
+
+    std::string cleanup = std::string("rm -rf ") + dir;
+    if (system(cleanup.c_str()) != 0) std::cerr << "could not remove " << dir << "\n";
+    printf("\n%s\n", failures ? "FAILED: the channel did not behave as expected" : "all channel checks passed");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,272 @@
+// The memory_policy.h state machine driven by simulated window events.
+//
+// A mock WebView applies the returned actions as main.cpp's ApplyMemoryAction
+// does (target level, TrySuspend that a playing page refuses, Resume).
+// Scripted scenarios walk every transition in the header's table, the idle
+// trim and its off switch, and a refused suspend. Then --events random
+// events check the invariants:
+//
+//   - the state changes only with an action: Suspend to Suspended,
+//     LowerTarget (from Active) to Reduced, Resume to Active, or a refused
+//     suspend (Suspended to Reduced)
+//   - off screen, the WebView is never Active and the tick never acts
+//   - the idle trim fires only after idle_after_ms without activation
+//   - on screen and activated, the WebView is Active
+//
+//   g++ -std=c++17 -O2 -I. tools/memory_policy_test.cpp -o memory_policy_test
+//   ./memory_policy_test [--events 200000] [--seed 1]
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "memory_policy.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (!ok) {
+        printf("  FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+const char* action_name(MemoryAction action) {
+    switch (action) {
+        case MemoryAction::None: return "none";
+        case MemoryAction::LowerTarget: return "lower";
+        case MemoryAction::Suspend: return "suspend";
+        case MemoryAction::Resume: return "resume";
+    }
+    return "";
+}
+
+const char* state_name(MemoryPolicy::State state) {
+    switch (state) {
+        case MemoryPolicy::State::Active: return "active";
+        case MemoryPolicy::State::Reduced: return "reduced";
+        case MemoryPolicy::State::Suspended: return "suspended";
+    }
+    return "";
+}
+
+// What ApplyMemoryAction does to the WebView; a page playing audio refuses
+// TrySuspend, which the host reports back
+struct MockWebView {
+    bool low_target = false;
+    bool suspended = false;
+    bool playing_audio = false;
+    int suspends = 0, resumes = 0;
+
+    void apply(MemoryPolicy& policy, MemoryAction action) {
+        switch (action) {
+            case MemoryAction::LowerTarget:
+                low_target = true;
+                break;
+            case MemoryAction::Suspend:
+                low_target = true;
+                ++suspends;
+                if (playing_audio) policy.on_suspend_refused();
+                else suspended = true;
+                break;
+            case MemoryAction::Resume:
+                ++resumes;
+                suspended = false;
+                low_target = false;
+                break;
+            case MemoryAction::None:
+                break;
+        }
+    }
+};
+
+enum class Event { Minimized, Hidden, Restored, Activated, Deactivated, Tick };
+
+const char* event_name(Event event) {
+    switch (event) {
+        case Event::Minimized: return "minimized";
+        case Event::Hidden: return "hidden";
+        case Event::Restored: return "restored";
+        case Event::Activated: return "activated";
+        case Event::Deactivated: return "deactivated";
+        case Event::Tick: return "tick";
+    }
+    return "";
+}
+
+MemoryAction feed(MemoryPolicy& policy, Event event, double now) {
+    switch (event) {
+        case Event::Minimized: return policy.on_minimized(now);
+        case Event::Hidden: return policy.on_hidden(now);
+        case Event::Restored: return policy.on_restored(now);
+        case Event::Activated: return policy.on_activation(true, now);
+        case Event::Deactivated: return policy.on_activation(false, now);
+        case Event::Tick: return policy.on_tick(now);
+    }
+    return MemoryAction::None;
+}
+
+struct Step {
+    double at_ms;
+    Event event;
+    MemoryAction action;
+    MemoryPolicy::State state;
+};
+
+const double IDLE_MS = 5 * 60 * 1000;
+
+void scripted(const char* name, double idle_ms, bool playing_audio, const std::vector<Step>& steps) {
+    printf("%s\n", name);
+    MemoryPolicy policy(idle_ms);
+    MockWebView webview;
+    webview.playing_audio = playing_audio;
+    for (const Step& s : steps) {
+        MemoryAction action = feed(policy, s.event, s.at_ms);
+        webview.apply(policy, action);
+        bool ok = action == s.action && policy.state() == s.state;
+        if (!ok) {
+            printf("  at %.0f ms %s: %s -> %s, expected %s -> %s\n", s.at_ms, event_name(s.event), action_name(action),
+                   state_name(policy.state()), action_name(s.action), state_name(s.state));
+        }
+        check(ok, std::string(name) + ": " + event_name(s.event));
+    }
+}
+
+void scenarios() {
+    using A = MemoryAction;
+    using S = MemoryPolicy::State;
+    scripted("minimize and restore", IDLE_MS, false, {
+        {0, Event::Activated, A::None, S::Active},
+        {1000, Event::Minimized, A::Suspend, S::Suspended},
+        {2000, Event::Minimized, A::None, S::Suspended},
+        {3000, Event::Tick, A::None, S::Suspended},
+        {4000, Event::Restored, A::Resume, S::Active},
+        {5000, Event::Restored, A::None, S::Active},
+    });
+    scripted("hide to tray and show", IDLE_MS, false, {
+        {0, Event::Hidden, A::Suspend, S::Suspended},
+        {10, Event::Activated, A::None, S::Suspended},  // activation while hidden does not wake
+        {20, Event::Restored, A::Resume, S::Active},
+    });
+    scripted("idle trim", IDLE_MS, false, {
+        {0, Event::Deactivated, A::None, S::Active},
+        {IDLE_MS - 1, Event::Tick, A::None, S::Active},
+        {IDLE_MS, Event::Tick, A::LowerTarget, S::Reduced},
+        {IDLE_MS + 1000, Event::Tick, A::None, S::Reduced},
+        {IDLE_MS + 2000, Event::Activated, A::Resume, S::Active},
+        // Deactivating again restarts the idle count
+        {IDLE_MS + 3000, Event::Deactivated, A::None, S::Active},
+        {2 * IDLE_MS, Event::Tick, A::None, S::Active},
+        {2 * IDLE_MS + 3000, Event::Tick, A::LowerTarget, S::Reduced},
+    });
+    scripted("reduced, then minimized", IDLE_MS, false, {
+        {0, Event::Deactivated, A::None, S::Active},
+        {IDLE_MS, Event::Tick, A::LowerTarget, S::Reduced},
+        {IDLE_MS + 1, Event::Minimized, A::Suspend, S::Suspended},
+        {IDLE_MS + 2, Event::Restored, A::Resume, S::Active},
+        // Restoring resets the idle count: no trim right away
+        {IDLE_MS + 3, Event::Tick, A::None, S::Active},
+    });
+    scripted("idle trim off", 0, false, {
+        {0, Event::Deactivated, A::None, S::Active},
+        {100 * IDLE_MS, Event::Tick, A::None, S::Active},
+        {100 * IDLE_MS + 1, Event::Minimized, A::Suspend, S::Suspended},
+    });
+    scripted("suspend refused (audio)", IDLE_MS, true, {
+        {0, Event::Minimized, A::Suspend, S::Reduced},
+        {1, Event::Tick, A::None, S::Reduced},
+        {2, Event::Hidden, A::Suspend, S::Reduced},  // tried again, refused again
+        {3, Event::Restored, A::Resume, S::Active},
+    });
+    scripted("activated while active", IDLE_MS, false, {
+        {0, Event::Activated, A::None, S::Active},
+        {1, Event::Activated, A::None, S::Active},
+        {2, Event::Tick, A::None, S::Active},
+    });
+}
+
+// Random events against the invariants
+void random_walk(size_t events, unsigned seed) {
+    printf("random: %zu events, seed %u\n", events, seed);
+    std::mt19937 rng(seed);
+    size_t violations = 0;
+    auto violation = [&](const std::string& what, size_t i) {
+        if (violations++ < 5) printf("  event %zu: %s\n", i, what.c_str());
+    };
+    for (double idle : {IDLE_MS, 0.0}) {
+        MemoryPolicy policy(idle);
+        MockWebView webview;
+        double now = 0;
+        bool off_screen = false;
+        double inactive_since = -1;
+        for (size_t i = 0; i < events; ++i) {
+            now += std::uniform_real_distribution<double>(0, IDLE_MS / 3)(rng);
+            Event event = (Event)std::uniform_int_distribution<int>(0, 5)(rng);
+            if (i % 1000 == 0) webview.playing_audio = !webview.playing_audio;
+            MemoryPolicy::State before = policy.state();
+            MemoryAction action = feed(policy, event, now);
+            webview.apply(policy, action);
+            MemoryPolicy::State after = policy.state();
+
+            // The model of the window
+            if (event == Event::Minimized || event == Event::Hidden) off_screen = true;
+            if (event == Event::Restored) {
+                if (off_screen) inactive_since = -1;
+                off_screen = false;
+            }
+            if (event == Event::Activated) inactive_since = -1;
+            if (event == Event::Deactivated) {
+                if (inactive_since < 0) inactive_since = now;
+            }
+
+            using S = MemoryPolicy::State;
+            bool consistent = false;
+            switch (action) {
+                case MemoryAction::None: consistent = after == before; break;
+                case MemoryAction::LowerTarget: consistent = before == S::Active && after == S::Reduced; break;
+                case MemoryAction::Suspend:
+                    consistent = before != S::Suspended &&
+                                 (after == S::Suspended || (webview.playing_audio && after == S::Reduced));
+                    break;
+                case MemoryAction::Resume: consistent = before != S::Active && after == S::Active; break;
+            }
+            if (!consistent) {
+                violation(std::string(event_name(event)) + ": " + state_name(before) + " -> " + action_name(action) + " -> " +
+                              state_name(after), i);
+            }
+            if (off_screen != policy.off_screen()) violation("off screen not tracked", i);
+            if (off_screen && after == S::Active) violation("active while off screen", i);
+            if (event == Event::Tick && off_screen && action != MemoryAction::None) violation("tick acted off screen", i);
+            if (action == MemoryAction::LowerTarget &&
+                (idle <= 0 || inactive_since < 0 || now - inactive_since < idle)) {
+                violation("trimmed before the idle time", i);
+            }
+            if (event == Event::Activated && !off_screen && after != S::Active) violation("activated but not active", i);
+            if (webview.suspended && after != S::Suspended) violation("WebView suspended in another state", i);
+        }
+    }
+    check(violations == 0, std::to_string(violations) + " invariant violations");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t events = 200000;
+    unsigned seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--events" && i + 1 < argc) events = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--seed" && i + 1 < argc) seed = (unsigned)strtoul(argv[++i], nullptr, 10);
+        else {
+            std::cerr << "usage: memory_policy_test [--events N] [--seed N]\n";
+            return 1;
+        }
+    }
+    scenarios();
+    random_walk(events, seed);
+    printf("\n%s\n", failures ? "FAILED: the policy did not behave as expected" : "all transitions as expected");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,265 @@
+// Navigation records of nav_timeline.h and the marks of timing_log.h, driven
+// by a mock WebView2 host.
+//
+// The host replays what main.cpp's event handlers forward (NavigationStarting,
+// ContentLoading, DOMContentLoaded, NavigationCompleted and the page's "perf"
+// message) on a virtual clock, and reports go to a TimingLog as they do in the
+// client. Scenarios:
+//
+//   login page     every event, the page report after completion
+//   early report   the page report before NavigationCompleted
+//   redirect       a server redirect counted on the same navigation
+//   failed         no document: reported at completion, without page metrics
+//   replaced       a second document before the first's page report
+//   stray          a page report with no document, a non-perf message
+//   finish         the window closes with a navigation still pending
+//   next login     set_origin moves the reports' origin to the new token
+//
+// Then the TimingLog itself: marks in order, nothing printed while disabled,
+// and no lost marks from several threads.
+//
+//   g++ -std=c++17 -O2 -pthread -I. tools/nav_timeline_test.cpp -o nav_timeline_test
+//   ./nav_timeline_test
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "nav_timeline.h"
+#include "timing_log.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (!ok) {
+        printf("  FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+bool contains(const std::string& text, const std::string& part) { return text.find(part) != std::string::npos; }
+
+// Forwards events to a NavigationTimeline as main.cpp's handlers do, on a
+// virtual clock; each report is marked in the log and kept
+class MockHost {
+public:
+    explicit MockHost(double token_ms)
+        : timeline_(token_ms, [this](const NavigationRecord& r) {
+              log_.mark_at(now_, timeline_.format(r));
+              reports.push_back(r);
+          }) {}
+
+    void at(double ms) { now_ = ms; }
+    void starting(uint64_t id, const std::string& uri, bool redirect = false) {
+        timeline_.on_navigation_starting(id, uri, redirect, now_);
+    }
+    void content(uint64_t id) { timeline_.on_content_loading(id, now_); }
+    void dcl(uint64_t id) { timeline_.on_dom_content_loaded(id, now_); }
+    void completed(uint64_t id, bool ok, int web_error = 0) { timeline_.on_navigation_completed(id, ok, web_error, now_); }
+    bool message(const std::string& json) { return timeline_.on_page_message(nlohmann::json::parse(json)); }
+    void new_token(double ms) { timeline_.set_origin(ms); }
+    void close() { timeline_.finish(); }
+
+    size_t pending() const { return timeline_.pending(); }
+    std::string line(size_t i) const { return i < reports.size() ? timeline_.format(reports[i]) : ""; }
+    std::vector<TimingLog::Mark> marks() const { return log_.marks(); }
+
+    std::vector<NavigationRecord> reports;
+
+private:
+    TimingLog log_;
+    double now_ = 0;
+    NavigationTimeline timeline_;
+};
+
+const char* PERF = R"({"type":"perf","fp":120,"fcp":150,"load":400,"resources":12,"bytes":34567,
+                       "slowest":{"name":"https://login.example/app.js?v=3","duration":210}})";
+
+void login_page() {
+    printf("login page\n");
+    MockHost host(1000);
+    host.at(1010);
+    host.starting(1, "https://login.example/login?token=secret#x");
+    host.at(1100);
+    host.content(1);
+    host.at(1200);
+    host.dcl(1);
+    host.at(1450);
+    host.completed(1, true);
+    check(host.reports.empty() && host.pending() == 1, "reported before the page report arrived");
+    host.at(1460);
+    check(host.message(PERF), "perf message not taken");
+    check(host.reports.size() == 1 && host.pending() == 0, "not reported once complete");
+    if (host.reports.empty()) return;
+    const NavigationRecord& r = host.reports[0];
+    check(r.uri == "https://login.example/login", "query or fragment kept: " + r.uri);
+    check(r.success && r.has_page_metrics && r.resource_count == 12 && r.resource_bytes == 34567, "record fields");
+    check(r.slowest_resource == "https://login.example/app.js" && r.slowest_resource_ms == 210, "slowest resource");
+    std::string line = host.line(0);
+    printf("  %s\n", line.c_str());
+    // fp is page-relative: starting (10 ms after the token) + 120
+    for (const char* part : {"start=10.0", "content=100.0", "dcl=200.0", "complete=450.0", "fp=130.0", "fcp=160.0",
+                             "load=410.0", "resources=12", "bytes=34567", "slowest=https://login.example/app.js(210.0ms)"}) {
+        check(contains(line, part), std::string("summary lacks ") + part);
+    }
+    check(!contains(line, "secret"), "token in the log");
+    std::vector<TimingLog::Mark> marks = host.marks();
+    check(marks.size() == 1 && marks[0].ms == 1460 && marks[0].label == line, "report not marked in the timing log");
+}
+
+void early_report() {
+    printf("early report\n");
+    MockHost host(0);
+    host.starting(1, "https://login.example/");
+    host.content(1);
+    host.at(300);
+    host.message(PERF);
+    check(host.reports.empty(), "reported before NavigationCompleted");
+    host.at(320);
+    host.completed(1, true);
+    check(host.reports.size() == 1 && host.reports[0].has_page_metrics && host.reports[0].completed_ms == 320,
+          "not reported with metrics at completion");
+}
+
+void redirect() {
+    printf("redirect\n");
+    MockHost host(0);
+    host.at(5);
+    host.starting(7, "https://login.example/start");
+    host.at(40);
+    host.starting(7, "https://login.example/landing", true);
+    host.content(7);
+    host.completed(7, true);
+    host.message(PERF);
+    check(host.reports.size() == 1, "redirect reported separately");
+    if (host.reports.empty()) return;
+    check(host.reports[0].redirects == 1 && host.reports[0].starting_ms == 5, "redirect not counted on the navigation");
+    check(contains(host.line(0), "redirects=1"), "summary lacks redirects=1");
+}
+
+void failed() {
+    printf("failed\n");
+    MockHost host(0);
+    host.starting(2, "https://login.example/");
+    host.at(30000);
+    host.completed(2, false, 7);
+    check(host.reports.size() == 1 && host.pending() == 0, "failed navigation not reported at once");
+    check(contains(host.line(0), "failed(web_error=7)") && !contains(host.line(0), "resources="), "failure summary");
+    // A late report has no document to go to
+    check(host.message(PERF) && host.reports.size() == 1, "late page report attributed");
+}
+
+void replaced() {
+    printf("replaced\n");
+    MockHost host(0);
+    host.starting(1, "https://login.example/a");
+    host.content(1);
+    host.completed(1, true);
+    host.starting(2, "https://login.example/b");
+    host.content(2);
+    check(host.reports.size() == 1 && host.reports[0].id == 1 && !host.reports[0].has_page_metrics,
+          "replaced document not reported without metrics");
+    host.completed(2, true);
+    host.message(PERF);
+    check(host.reports.size() == 2 && host.reports[1].id == 2 && host.reports[1].has_page_metrics,
+          "page report not given to the new document");
+}
+
+void stray() {
+    printf("stray\n");
+    MockHost host(0);
+    check(host.message(PERF), "perf message without a document not taken");
+    check(!host.message(R"({"type":"login","ok":true})"), "non-perf message taken");
+    check(!host.message("[1,2]"), "non-object message taken");
+    check(host.reports.empty() && host.pending() == 0, "stray messages created a record");
+}
+
+void finish() {
+    printf("finish\n");
+    MockHost host(0);
+    host.starting(1, "https://login.example/");
+    host.content(1);
+    host.dcl(1);
+    host.starting(2, "https://login.example/next");
+    check(host.pending() == 2 && host.reports.empty(), "pending navigations reported early");
+    host.close();
+    check(host.reports.size() == 2 && host.pending() == 0, "finish left navigations pending");
+    host.close();
+    check(host.reports.size() == 2, "second finish reported again");
+}
+
+void next_login() {
+    printf("next login\n");
+    MockHost host(1000);
+    host.at(1100);
+    host.starting(1, "https://login.example/");
+    host.content(1);
+    host.completed(1, false, 2);
+    host.new_token(50000);
+    host.at(50020);
+    host.starting(2, "https://login.example/");
+    host.content(2);
+    host.at(50200);
+    host.completed(2, false, 2);
+    // As logged when each was reported
+    std::vector<TimingLog::Mark> marks = host.marks();
+    check(marks.size() == 2, "both logins not reported");
+    if (marks.size() != 2) return;
+    check(contains(marks[0].label, "start=100.0"), "first login's origin");
+    check(contains(marks[1].label, "start=20.0") && contains(marks[1].label, "complete=200.0"), "origin not moved to the new token");
+}
+
+void timing_log_marks() {
+    printf("timing log\n");
+    TimingLog log;
+    double before = log.now_ms();
+    log.mark("config loaded");
+    log.mark_at(2.5, "token received");
+    log.mark("window shown");
+    std::vector<TimingLog::Mark> marks = log.marks();
+    check(marks.size() == 3 && marks[0].label == "config loaded" && marks[1].ms == 2.5 && marks[2].label == "window shown",
+          "marks not kept in order");
+    check(before >= 0 && marks[0].ms >= before && marks[2].ms >= marks[0].ms, "now_ms not monotonic");
+
+    // Printed only while enabled
+    std::ostringstream captured;
+    std::streambuf* out = std::cout.rdbuf(captured.rdbuf());
+    log.mark("quiet");
+    log.set_enabled(true);
+    log.mark_at(12.25, "loud");
+    std::cout.rdbuf(out);
+    check(!contains(captured.str(), "quiet"), "printed while disabled");
+    check(contains(captured.str(), "[timing] +12.2 ms  loud") || contains(captured.str(), "[timing] +12.3 ms  loud"),
+          "enabled mark not printed: " + captured.str());
+
+    // Offload threads mark too
+    TimingLog shared;
+    const int THREADS = 8, EACH = 2000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; ++t) {
+        threads.emplace_back([&shared, t] {
+            for (int i = 0; i < EACH; ++i) shared.mark("t" + std::to_string(t));
+        });
+    }
+    for (auto& t : threads) t.join();
+    check(shared.marks().size() == (size_t)THREADS * EACH, "marks lost across threads");
+}
+
+}  // namespace
+
+int main() {
+    login_page();
+    early_report();
+    redirect();
+    failed();
+    replaced();
+    stray();
+    finish();
+    next_login();
+    timing_log_marks();
+    printf("\n%s\n", failures ? "FAILED: a navigation was not recorded as expected" : "all navigations recorded as expected");
+    return failures ? 1 : 0;
+}
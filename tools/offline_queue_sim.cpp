@@ -0,0 +1,393 @@
+// Outage test for the client's offline queue (offline_queue.h), Linux only.
+//
+// Registers a stream of machines through request_login_token() against a
+// reference_server it starts itself, and kills and restarts that server on a
+// schedule. Registrations made while it is down go to the queue, which is
+// drained in batches through POST /batch with backoff once it is back, as
+// main.cpp does. Midway the queue is reopened from disk with a torn last
+// line, as after a crash mid-append. At the end every registration must
+// have been answered once (or pushed out for room, with --max-kb) and the
+// queue must be empty.
+//
+//   g++ -std=c++20 -O2 -pthread -I. tools/offline_queue_sim.cpp -o offline_queue_sim -lssl -lcrypto
+//   ./offline_queue_sim --server ./reference_server --key private_key.pem --pubkey public_key.pem
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "encrypt_data.h"
+#include "handshake.h"
+#include "offline_queue.h"
+
+namespace {
+
+struct Options {
+    std::string server = "./reference_server";
+    std::string key = "private_key.pem";
+    std::string pubkey = "public_key.pem";
+    std::string queue = "offline_queue_sim.dat";
+    uint16_t port = 18181;
+    size_t registrations = 400;
+    double interval_ms = 10;
+    int outages = 3;
+    double up_ms = 1000, down_ms = 1500;
+    size_t max_kb = 256;
+    size_t batch = 32;
+};
+
+// One request on a fresh connection; false unless the server answered 200
+bool http_request(uint16_t port, const std::string& method, const std::string& path, const std::string& body,
+                  std::string& reply) {
+    reply.clear();
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+    timeval timeout = {2, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return false;
+    }
+    std::string request = method + " " + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\nConnection: close\r\n" +
+                          "Content-Type: text/plain\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    for (size_t sent = 0; sent < request.size();) {
+        ssize_t n = send(fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            close(fd);
+            return false;
+        }
+        sent += (size_t)n;
+    }
+    std::string response;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) response.append(buffer, (size_t)n);
+    close(fd);
+    size_t head_end = response.find("\r\n\r\n");
+    if (head_end == std::string::npos || response.compare(0, 12, "HTTP/1.1 200") != 0) return false;
+    reply = response.substr(head_end + 4);
+    return !reply.empty();
+}
+
+class ServerProcess {
+public:
+    explicit ServerProcess(const Options& opts) : opts_(opts) {}
+    ~ServerProcess() { stop(); }
+
+    bool start() {
+        fflush(stdout);
+        pid_ = fork();
+        if (pid_ == 0) {
+            freopen("/dev/null", "w", stdout);
+            std::string port = std::to_string(opts_.port);
+            execl(opts_.server.c_str(), opts_.server.c_str(), "--key", opts_.key.c_str(), "--port", port.c_str(),
+                  "--threads", "2", "--stats", "0", "--quiet", (char*)nullptr);
+            _exit(127);
+        }
+        return pid_ > 0;
+    }
+
+    // SIGKILL: requests in flight are cut off, as when a backend host dies
+    void stop() {
+        if (pid_ <= 0) return;
+        kill(pid_, SIGKILL);
+        waitpid(pid_, nullptr, 0);
+        pid_ = -1;
+    }
+
+    bool wait_ready(double timeout_ms) {
+        for (double waited = 0; waited < timeout_ms; waited += 20) {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr = {};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(opts_.port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            bool up = connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0;
+            close(fd);
+            if (up) return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        return false;
+    }
+
+private:
+    const Options& opts_;
+    pid_t pid_ = -1;
+};
+
+Fingerprint machine(size_t n) {
+    Fingerprint fp;
+    fp.uuid = "4C4C4544-0000-1000-8000-" + std::to_string(100000000000ull + n);
+    fp.machine_guid = "1b2c3d4e-0000-4000-9000-" + std::to_string(200000000000ull + n);
+    fp.serials = {"WD-SIM" + std::to_string(n)};
+    fp.ipinfo = {{"IP", "10.0." + std::to_string(n / 250 % 250) + "." + std::to_string(n % 250 + 1)},
+                 {"CheckTimeUTC", "2026-10-19 12:00:00"}};
+    fp.ipinfo2 = {{"country", "HK"}, {"provider", "Example Telecom"}, {"organisation", "Example Org"}};
+    return fp;
+}
+
+struct Sim {
+    Options opts;
+    EventLoop loop;
+    Offload offload{loop};
+    ServerProcess server{opts};
+    HandshakeSteps steps;
+
+    OfflineQueue queue;
+    bool sync_posted = false;
+    Task<bool> drain;
+    bool drain_busy = false;
+    EventLoop::TimerId drain_timer = 0;
+    RetryBackoff backoff{50, 800};
+
+    Task<LoginToken> registration;
+    size_t next = 0;
+    bool server_up = true;
+    int outages_left = 0;
+    bool reopen_pending = true;
+
+    // Every reply's ack, from the handshake and the batches (Offload threads)
+    std::mutex acks_mutex;
+    std::map<std::string, int> answered;
+    std::set<std::string> expected;
+
+    size_t direct = 0, queued = 0, failed = 0, batches = 0, max_queue_bytes = 0, dropped_before_reopen = 0;
+    std::string reopen_result = "not reached";
+    Sim(const Options& o) : opts(o) {}
+    ~Sim() { offload.join(); }
+
+    void record(const nlohmann::json& reply) {
+        if (!reply.is_object() || !reply.contains("ack") || !reply["ack"].is_string()) return;
+        std::lock_guard<std::mutex> lock(acks_mutex);
+        ++answered[reply["ack"].get<std::string>()];
+    }
+
+    BatchSendFn batch_sender() {
+        return [this](const std::vector<std::string>& messages, std::string& reply) {
+            std::string body;
+            for (const auto& m : messages) body += m + "\n";
+            if (!http_request(opts.port, "POST", "/batch", body, reply)) return false;
+            nlohmann::json j = nlohmann::json::parse(reply, nullptr, false);
+            if (j.is_object() && j.contains("results") && j["results"].is_array()) {
+                for (const auto& r : j["results"]) record(r);
+            }
+            return true;
+        };
+    }
+
+    void schedule_drain() {
+        if (drain_timer || drain_busy || queue.empty()) return;
+        drain_timer = loop.call_later(backoff.next_ms(), [this] {
+            drain_timer = 0;
+            start_drain();
+        });
+    }
+
+    void start_drain() {
+        if (drain_busy || queue.empty()) return;
+        if (drain_timer) loop.cancel(drain_timer);
+        drain_timer = 0;
+        drain_busy = true;
+        ++batches;
+        drain = drain_offline_queue(offload, queue, batch_sender(), opts.batch, CancelToken());
+        drain.start([this] { loop.post([this] { on_drain_done(); }); });
+    }
+
+    void on_drain_done() {
+        bool emptied = drain.get();
+        drain = Task<bool>();
+        drain_busy = false;
+        if (emptied) backoff.reset();
+        else schedule_drain();
+        maybe_reopen();
+        maybe_finish();
+    }
+
+    void enqueue(const std::string& payload) {
+        if (!queue.push(payload)) {
+            std::cerr << "push failed: " << queue.path() << "\n";
+            return;
+        }
+        max_queue_bytes = std::max(max_queue_bytes, queue.bytes());
+        if (!sync_posted) {
+            sync_posted = true;
+            loop.post([this] {
+                sync_posted = false;
+                if (!queue.sync()) std::cerr << "sync failed: " << queue.path() << "\n";
+            });
+        }
+        schedule_drain();
+    }
+
+    // Once during the second outage: the process "restarts" and finds a
+    // torn append at the end of the file
+    void maybe_reopen() {
+        if (!reopen_pending || server_up || outages_left > opts.outages - 2 || drain_busy || queue.size() < 10) return;
+        reopen_pending = false;
+        queue.sync();
+        size_t before = queue.size();
+        if (FILE* f = fopen(queue.path().c_str(), "ab")) {
+            fputs("dG9ybiBhcHBlbm", f);
+            fclose(f);
+        }
+        if (drain_timer) loop.cancel(drain_timer);
+        drain_timer = 0;
+        dropped_before_reopen = queue.dropped();
+        queue.open(queue.path(), opts.max_kb * 1024);
+        reopen_result = std::to_string(queue.size()) + "/" + std::to_string(before) + " messages kept, torn line dropped";
+        if (queue.size() != before) reopen_result = "LOST " + std::to_string(before - queue.size()) + " messages";
+        schedule_drain();
+    }
+
+    void start_registration() {
+        if (next == opts.registrations) {
+            maybe_finish();
+            return;
+        }
+        Fingerprint fp = machine(next++);
+        expected.insert(payload_hash(registration_for(fp, steps.dcid, steps.version)));
+        registration = request_login_token(offload, fp, steps, CancelToken());
+        registration.start([this] { loop.post([this] { on_registration_done(); }); });
+    }
+
+    void on_registration_done() {
+        try {
+            LoginToken issued = registration.get();
+            record({{"ack", issued.ack}});
+            ++direct;
+            backoff.reset();
+            start_drain();
+        } catch (const BackendUnreachable&) {
+            ++queued;
+        } catch (const HandshakeError& e) {
+            std::cerr << "registration failed: " << e.what() << "\n";
+            ++failed;
+        }
+        registration = Task<LoginToken>();
+        maybe_reopen();
+        loop.call_later(opts.interval_ms, [this] { start_registration(); });
+    }
+
+    void outage() {
+        if (outages_left == 0) return;
+        loop.call_later(opts.up_ms, [this] {
+            server.stop();
+            server_up = false;
+            --outages_left;
+            loop.call_later(opts.down_ms, [this] {
+                server.start();
+                server_up = true;
+                outage();
+                maybe_finish();
+            });
+        });
+    }
+
+    void maybe_finish() {
+        if (next == opts.registrations && !registration.valid() && server_up && outages_left == 0 && queue.empty() &&
+            !drain_busy) {
+            loop.stop();
+        }
+    }
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&] { return i + 1 < argc ? std::string(argv[++i]) : std::string(); };
+        if (arg == "--server") opts.server = value();
+        else if (arg == "--key") opts.key = value();
+        else if (arg == "--pubkey") opts.pubkey = value();
+        else if (arg == "--queue") opts.queue = value();
+        else if (arg == "--port") opts.port = (uint16_t)atoi(value().c_str());
+        else if (arg == "--registrations") opts.registrations = strtoull(value().c_str(), nullptr, 10);
+        else if (arg == "--interval-ms") opts.interval_ms = atof(value().c_str());
+        else if (arg == "--outages") opts.outages = atoi(value().c_str());
+        else if (arg == "--up-ms") opts.up_ms = atof(value().c_str());
+        else if (arg == "--down-ms") opts.down_ms = atof(value().c_str());
+        else if (arg == "--max-kb") opts.max_kb = strtoull(value().c_str(), nullptr, 10);
+        else if (arg == "--batch") opts.batch = strtoull(value().c_str(), nullptr, 10);
+        else {
+            std::cerr << "usage: offline_queue_sim [--server PATH] [--key PEM] [--pubkey PEM] [--queue FILE] [--port N]\n"
+                      << "       [--registrations N] [--interval-ms MS] [--outages N] [--up-ms MS] [--down-ms MS]\n"
+                      << "       [--max-kb KB] [--batch N]\n";
+            return 1;
+        }
+    }
+    std::string pem = read_file(opts.pubkey);
+    if (pem.empty() || opts.registrations == 0 || opts.batch == 0) {
+        std::cerr << "need a public key, --registrations and --batch\n";
+        return 1;
+    }
+    std::remove(opts.queue.c_str());
+
+    auto sim = std::make_unique<Sim>(opts);
+    sim->steps.encrypt = [pem](const nlohmann::json& registration) { return encrypt_data_from_key_string(registration, pem); };
+    sim->steps.send = [port = opts.port](const std::string& payload, std::string& reply) {
+        return http_request(port, "POST", "/message", payload, reply);
+    };
+    Sim* s = sim.get();
+    sim->steps.queue = [s](const std::string& payload) { s->enqueue(payload); };
+    sim->steps.dcid = "123456";
+    sim->steps.version = "1.2.3";
+    sim->steps.login_base_url = "https://example.com/login";
+    sim->queue.open(opts.queue, opts.max_kb * 1024);
+
+    if (!sim->server.start() || !sim->server.wait_ready(5000)) {
+        std::cerr << "reference_server did not start: " << opts.server << "\n";
+        return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    sim->outages_left = opts.outages;
+    sim->outage();
+    sim->loop.post([s] { s->start_registration(); });
+    // Gives up if the queue never empties
+    double budget_ms = opts.registrations * opts.interval_ms + opts.outages * (opts.up_ms + opts.down_ms) + 30000;
+    sim->loop.call_later(budget_ms, [s] { s->loop.stop(); });
+    sim->loop.run();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    sim->server.stop();
+
+    size_t delivered = 0, twice = 0;
+    for (const auto& ack : sim->expected) {
+        auto it = sim->answered.find(ack);
+        if (it == sim->answered.end()) continue;
+        ++delivered;
+        twice += it->second > 1;
+    }
+    size_t dropped = sim->dropped_before_reopen + sim->queue.dropped();
+    printf("registrations %zu in %.1f s: %zu answered at once, %zu queued, %zu failed\n", opts.registrations, seconds,
+           sim->direct, sim->queued, sim->failed);
+    printf("outages %d x %.0f ms, %zu drains, queue peaked at %zu bytes (limit %zu), %zu left\n", opts.outages,
+           opts.down_ms, sim->batches, sim->max_queue_bytes, opts.max_kb * 1024, sim->queue.size());
+    printf("reopen after a torn append: %s\n", sim->reopen_result.c_str());
+    printf("delivered %zu/%zu, %zu answered twice, %zu pushed out for room\n", delivered, opts.registrations, twice,
+           dropped);
+    // A message pushed out while its batch was out may still have been delivered
+    bool ok = delivered + dropped >= opts.registrations && sim->queue.empty() && sim->failed == 0 &&
+              sim->max_queue_bytes <= opts.max_kb * 1024 && sim->reopen_result.compare(0, 4, "LOST") != 0;
+    sim.reset();
+    std::remove(opts.queue.c_str());
+    if (!ok) printf("FAILED\n");
+    return ok ? 0 : 2;
+}
@@ -0,0 +1,385 @@
+// The client side of page_bridge.h against a mock page.
+//
+// The mock stands where PostWebMessageAsJson and WebMessageReceived are in
+// main.cpp: it takes posted envelopes (or refuses them while there is no
+// page), and answers or sends messages as the injected script would.
+// Scenarios:
+//
+//   batching       at most max_batch messages per envelope, in order; no
+//                  page keeps them queued, a refused post keeps the rest
+//   correlation    responses out of order, errors, unknown and repeated ids
+//   page requests  handlers, missing and throwing handlers, one reply post
+//                  per incoming batch, malformed messages ignored
+//   expire         deadlines, late responses after a timeout
+//   reset          queued messages dropped, requests failed with the reason,
+//                  a request made from a failed reply survives
+//   envelopes      non-bridge messages and other versions refused; url_origin
+//                  and same_origin: default ports, no origin matches nothing
+//
+// Then --requests random requests, responses, expiries and resets: every
+// reply runs exactly once and with the answer to its own request.
+//
+//   g++ -std=c++17 -O2 -I. tools/page_bridge_test.cpp -o page_bridge_test
+//   ./page_bridge_test [--requests 100000] [--seed 1]
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "page_bridge.h"
+
+namespace {
+
+using json = nlohmann::json;
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (!ok) {
+        printf("  FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+// The page side of the channel
+struct MockPage {
+    bool present = true;
+    int refuse_after = -1;  // refuse posts once this many were taken
+    std::vector<json> envelopes;
+
+    PageBridge::Post post() {
+        return [this](const std::string& envelope) {
+            if (!present || (refuse_after >= 0 && (int)envelopes.size() >= refuse_after)) return false;
+            envelopes.push_back(json::parse(envelope));
+            return true;
+        };
+    }
+
+    std::vector<json> messages() const {
+        std::vector<json> out;
+        for (const json& e : envelopes) {
+            for (const json& m : e["messages"]) out.push_back(m);
+        }
+        return out;
+    }
+
+    // As WebMessageReceived delivers it: parsed from the page's JSON, so
+    // non-negative ids are unsigned
+    static json envelope(std::vector<json> messages) {
+        return json::parse(json{{"bridge", 1}, {"messages", messages}}.dump());
+    }
+};
+
+struct Replies {
+    std::map<uint64_t, std::vector<std::pair<bool, json>>> got;
+
+    PageBridge::Reply to(uint64_t* id) {
+        return [this, id](bool ok, const json& result) { got[*id].push_back({ok, result}); };
+    }
+    size_t count(uint64_t id) const {
+        auto it = got.find(id);
+        return it == got.end() ? 0 : it->second.size();
+    }
+    std::pair<bool, json> first(uint64_t id) const {
+        auto it = got.find(id);
+        return it == got.end() || it->second.empty() ? std::make_pair(false, json("(none)")) : it->second[0];
+    }
+};
+
+void batching() {
+    printf("batching\n");
+    MockPage page;
+    PageBridge bridge(page.post(), 64);
+    for (int i = 0; i < 150; ++i) bridge.push("tick", i);
+    check(bridge.queued() == 150 && page.envelopes.empty(), "sent before flush()");
+    check(bridge.flush() == 150 && bridge.queued() == 0, "not all sent");
+    check(page.envelopes.size() == 3 && page.envelopes[0]["messages"].size() == 64 &&
+              page.envelopes[2]["messages"].size() == 22,
+          "batches not capped at 64");
+    std::vector<json> messages = page.messages();
+    bool in_order = messages.size() == 150;
+    for (size_t i = 0; in_order && i < messages.size(); ++i) {
+        in_order = messages[i]["kind"] == "event" && messages[i]["type"] == "tick" && messages[i]["data"] == (int)i;
+    }
+    check(in_order, "events out of order or altered");
+    check(page.envelopes[0]["bridge"] == PageBridge::VERSION, "envelope version");
+    check(bridge.batches_posted() == 3 && bridge.messages_posted() == 150, "counters");
+
+    MockPage absent;
+    absent.present = false;
+    PageBridge waiting(absent.post(), 4);
+    for (int i = 0; i < 10; ++i) waiting.push("e", i);
+    check(waiting.flush() == 0 && waiting.queued() == 10, "messages lost while there is no page");
+    absent.present = true;
+    absent.refuse_after = 1;
+    check(waiting.flush() == 4 && waiting.queued() == 6, "refused post dropped messages");
+    absent.refuse_after = -1;
+    check(waiting.flush() == 6 && absent.messages().size() == 10 && absent.messages()[4]["data"] == 4,
+          "rest not sent in order");
+
+    MockPage one;
+    PageBridge unbatched(one.post(), 0);
+    unbatched.push("a", 1);
+    unbatched.push("b", 2);
+    unbatched.flush();
+    check(one.envelopes.size() == 2, "max_batch 0 is not 1");
+}
+
+void correlation() {
+    printf("correlation\n");
+    MockPage page;
+    PageBridge bridge(page.post());
+    Replies replies;
+    uint64_t a = 0, b = 0, c = 0, d = 0;
+    a = bridge.request("context", nullptr, replies.to(&a), 0, 1000);
+    b = bridge.request("sum", {1, 2}, replies.to(&b), 0, 1000);
+    c = bridge.request("fail", nullptr, replies.to(&c), 0, 1000);
+    d = bridge.request("odd", nullptr, replies.to(&d), 0, 1000);
+    bridge.flush();
+    std::vector<json> sent = page.messages();
+    check(sent.size() == 4 && sent[1]["kind"] == "request" && sent[1]["id"] == b && sent[1]["type"] == "sum" &&
+              sent[1]["data"] == json({1, 2}),
+          "request message");
+    check(a != b && b != c && bridge.pending() == 4, "ids not distinct");
+
+    bridge.on_message(MockPage::envelope({
+        {{"kind", "response"}, {"id", b}, {"data", 3}},
+        {{"kind", "response"}, {"id", c}, {"error", "no handler for 'fail'"}},
+        {{"kind", "response"}, {"id", d}, {"error", {{"code", 7}}}},
+        {{"kind", "response"}, {"id", 999}, {"data", "stray"}},
+        {{"kind", "response"}, {"id", a}, {"data", {{"user", "x"}}}},
+        {{"kind", "response"}, {"id", a}, {"data", "again"}},
+    }));
+    check(replies.first(a) == std::make_pair(true, json({{"user", "x"}})), "reply to a");
+    check(replies.first(b) == std::make_pair(true, json(3)), "reply to b");
+    check(replies.first(c) == std::make_pair(false, json("no handler for 'fail'")), "error reply");
+    check(replies.first(d) == std::make_pair(false, json("{\"code\":7}")), "non-string error not dumped");
+    check(replies.count(a) == 1 && bridge.pending() == 0, "repeated response ran a reply twice");
+    check(replies.got.size() == 4, "stray response ran a reply");
+    check(bridge.messages_received() == 6, "received counter");
+
+    // Ids of the other side's requests are not ours: a page request with our id
+    uint64_t e = 0;
+    e = bridge.request("wait", nullptr, replies.to(&e), 0, 1000);
+    bridge.on_message(MockPage::envelope({{{"kind", "request"}, {"id", e}, {"type", "x"}}}));
+    check(replies.count(e) == 0 && bridge.pending() == 1, "page request answered our request");
+}
+
+void page_requests() {
+    printf("page requests\n");
+    MockPage page;
+    PageBridge bridge(page.post());
+    std::vector<json> events;
+    bridge.handle("token", [](const json& data) -> json { return {{"token", "t-" + data.get<std::string>()}}; });
+    bridge.handle("boom", [](const json&) -> json { throw std::runtime_error("it broke"); });
+    bridge.handle("painted", [&](const json& data) -> json {
+        events.push_back(data);
+        return nullptr;
+    });
+    bridge.handle("noisy", [](const json&) -> json { throw std::runtime_error("ignored"); });
+
+    bool taken = bridge.on_message(MockPage::envelope({
+        {{"kind", "request"}, {"id", 1}, {"type", "token"}, {"data", "a"}},
+        {{"kind", "request"}, {"id", 2}, {"type", "missing"}},
+        {{"kind", "request"}, {"id", 3}, {"type", "boom"}},
+        {{"kind", "event"}, {"type", "painted"}, {"data", 1}},
+        {{"kind", "event"}, {"type", "noisy"}},
+        {{"kind", "event"}, {"type", "unknown"}},
+        {{"kind", "request"}, {"id", -4}, {"type", "token"}, {"data", "b"}},
+        {{"kind", "request"}, {"id", "5"}, {"type", "token"}, {"data", "c"}},
+        {{"kind", "request"}, {"type", "token"}, {"data", "d"}},
+        {{"kind", "mystery"}, {"id", 6}},
+        json("not an object"),
+        json::array(),
+    }));
+    check(taken, "bridge envelope not taken");
+    check(page.envelopes.size() == 1, "replies not sent in one post");
+    std::vector<json> replies = page.messages();
+    check(replies.size() == 3, "malformed requests answered (" + std::to_string(replies.size()) + " replies)");
+    if (replies.size() < 3) return;
+    check(replies[0] == json({{"kind", "response"}, {"id", 1}, {"data", {{"token", "t-a"}}}}), "handler reply");
+    check(replies[1]["id"] == 2 && replies[1]["error"] == "no handler for 'missing'" && !replies[1].contains("data"),
+          "missing handler");
+    check(replies[2]["id"] == 3 && replies[2]["error"] == "it broke", "throwing handler");
+    check(events == std::vector<json>{1}, "page event not delivered");
+
+    // No page to take the replies: they wait for the next flush
+    page.present = false;
+    bridge.on_message(MockPage::envelope({{{"kind", "request"}, {"id", 7}, {"type", "token"}, {"data", "e"}}}));
+    check(bridge.queued() == 1, "reply lost while there is no page");
+    page.present = true;
+    bridge.flush();
+    check(page.messages().back()["id"] == 7, "queued reply not sent");
+}
+
+void expire() {
+    printf("expire\n");
+    MockPage page;
+    PageBridge bridge(page.post());
+    Replies replies;
+    uint64_t a = 0, b = 0, c = 0;
+    a = bridge.request("a", nullptr, replies.to(&a), 100, 50);   // due at 150
+    b = bridge.request("b", nullptr, replies.to(&b), 100, 200);  // due at 300
+    c = bridge.request("c", nullptr, replies.to(&c), 120, 30);   // due at 150
+    bridge.expire(149);
+    check(bridge.pending() == 3 && replies.got.empty(), "expired early");
+    bridge.expire(150);
+    check(replies.first(a) == std::make_pair(false, json("timeout")) && replies.count(c) == 1 && bridge.pending() == 1,
+          "not expired at the deadline");
+    bridge.on_message(MockPage::envelope({{{"kind", "response"}, {"id", a}, {"data", "late"}}}));
+    check(replies.count(a) == 1, "late response ran the reply again");
+    bridge.on_message(MockPage::envelope({{{"kind", "response"}, {"id", b}, {"data", "ok"}}}));
+    bridge.expire(1e9);
+    check(replies.first(b) == std::make_pair(true, json("ok")) && replies.count(b) == 1, "answered request expired");
+    bridge.request("no reply", nullptr, nullptr, 0, 0);
+    bridge.expire(0);
+    check(bridge.pending() == 0, "request without a reply not expired");
+}
+
+void reset() {
+    printf("reset\n");
+    MockPage page;
+    page.present = false;
+    PageBridge bridge(page.post());
+    Replies replies;
+    uint64_t a = 0, b = 0, retry = 0;
+    a = bridge.request("a", nullptr, replies.to(&a), 0, 1000);
+    b = bridge.request("b", nullptr,
+                       [&](bool ok, const json& result) {
+                           replies.got[b].push_back({ok, result});
+                           // Ask again on the next page
+                           retry = bridge.request("b", nullptr, replies.to(&retry), 0, 1000);
+                       },
+                       0, 1000);
+    bridge.push("context", {{"user", "x"}});
+    bridge.reset("navigated");
+    check(replies.first(a) == std::make_pair(false, json("navigated")) && replies.count(b) == 1, "requests not failed");
+    check(retry != 0 && bridge.pending() == 1 && bridge.queued() == 1, "request from a failed reply lost");
+    page.present = true;
+    bridge.flush();
+    std::vector<json> sent = page.messages();
+    check(sent.size() == 1 && sent[0]["id"] == retry, "messages for the old page sent to the new one");
+    bridge.on_message(MockPage::envelope({{{"kind", "response"}, {"id", a}, {"data", "old page"}}}));
+    check(replies.count(a) == 1, "old page's response ran a failed reply");
+}
+
+void envelopes() {
+    printf("envelopes\n");
+    MockPage page;
+    PageBridge bridge(page.post());
+    for (const char* text : {R"({"type":"perf","fp":1})", R"({"bridge":2,"messages":[]})", R"({"bridge":"1","messages":[]})",
+                             R"({"bridge":1,"messages":{}})", R"({"bridge":1})", R"([1,2])", R"("bridge")", "null"}) {
+        check(!bridge.on_message(json::parse(text)), std::string("taken: ") + text);
+    }
+    check(bridge.on_message(json::parse(R"({"bridge":1,"messages":[]})")) && page.envelopes.empty(), "empty batch");
+    std::vector<json> decoded;
+    check(PageBridge::decode(json::parse(PageBridge::encode({json{{"kind", "event"}}})), decoded) && decoded.size() == 1,
+          "encode/decode round trip");
+
+    check(url_origin("https://Login.Example.com:8443/a/b?x=1#y") == "https://login.example.com:8443", "origin with path");
+    check(url_origin("https://example.com") == "https://example.com", "origin without path");
+    check(url_origin("https://example.com?x") == "https://example.com", "origin with query only");
+    check(url_origin("example.com/login") == "", "origin without a scheme");
+    check(url_origin("HTTPS://Example.com:443/login") == "https://example.com", "default https port");
+    check(url_origin("http://example.com:80") == "http://example.com" && url_origin("http://example.com:443") == "http://example.com:443",
+          "default http port");
+    check(url_origin("https://example.com:/x") == "https://example.com", "empty port");
+    check(url_origin("https://[::1]:443/") == "https://[::1]" && url_origin("https://[::1]:8443/") == "https://[::1]:8443",
+          "IPv6 literal");
+    check(url_origin("https://user:pw@example.com:8443/") == "https://example.com:8443", "userinfo");
+    check(url_origin("file:///C:/login.html") == "" && url_origin("https://:443/") == "", "origin without a host");
+    check(same_origin("https://login.example.com:443/a", "https://Login.Example.com/b"), "same origin across default ports");
+    check(!same_origin("http://login.example.com/", "https://login.example.com/"), "scheme ignored");
+    check(!same_origin("https://login.example.com.evil.net/", "https://login.example.com/"), "host suffix matched");
+    for (const char* url : {"about:blank", "data:text/html,<p>", "", "login.example.com", "file:///x"}) {
+        check(!same_origin(url, url), std::string("no origin matched itself: ") + url);
+        check(!same_origin(url, ""), std::string("no origin matched an empty base URL: ") + url);
+    }
+}
+
+// Random traffic: each reply runs once, with its own answer
+void random_traffic(size_t requests, unsigned seed) {
+    printf("random: %zu requests, seed %u\n", requests, seed);
+    std::mt19937 rng(seed);
+    MockPage page;
+    PageBridge bridge(page.post(), 8);
+    std::vector<uint64_t> ids(requests, 0);
+    std::vector<double> deadlines(requests, 0);
+    std::vector<int> runs(requests, 0);
+    std::vector<uint64_t> outstanding;
+    size_t wrong = 0, answered = 0, timed_out = 0, failed_by_reset = 0;
+    double now = 0;
+    for (size_t i = 0; i < requests; ++i) {
+        now += std::uniform_real_distribution<double>(0, 10)(rng);
+        deadlines[i] = now + std::uniform_real_distribution<double>(5, 200)(rng);
+        ids[i] = bridge.request("echo", (uint64_t)i,
+                                [&, i](bool ok, const json& result) {
+                                    ++runs[i];
+                                    if (ok) {
+                                        ++answered;
+                                        if (result != ids[i] * 10) ++wrong;
+                                    } else if (result == "timeout") {
+                                        ++timed_out;
+                                        if (now < deadlines[i]) ++wrong;
+                                    } else {
+                                        ++failed_by_reset;
+                                        if (result != "navigated" && result != "closed") ++wrong;
+                                    }
+                                },
+                                now, deadlines[i] - now);
+        outstanding.push_back(ids[i]);
+        int action = std::uniform_int_distribution<int>(0, 99)(rng);
+        if (action < 60) {
+            // Answer a random request that may have timed out already, sometimes twice
+            size_t k = std::uniform_int_distribution<size_t>(0, outstanding.size() - 1)(rng);
+            uint64_t target = outstanding[k];
+            std::vector<json> batch(action < 5 ? 2 : 1, {{"kind", "response"}, {"id", target}, {"data", target * 10}});
+            bridge.on_message(MockPage::envelope(batch));
+            outstanding.erase(outstanding.begin() + k);
+        } else if (action < 95) {
+            bridge.expire(now);
+        } else if (action < 96) {
+            bridge.reset("navigated");
+            outstanding.clear();
+        }
+        bridge.flush();
+        page.envelopes.clear();
+    }
+    bridge.reset("closed");
+    size_t not_once = 0;
+    for (int n : runs) {
+        if (n != 1) ++not_once;
+    }
+    printf("  %zu answered, %zu timed out, %zu failed by a reset\n", answered, timed_out, failed_by_reset);
+    check(not_once == 0, std::to_string(not_once) + " replies did not run exactly once");
+    check(wrong == 0, std::to_string(wrong) + " replies with the wrong result");
+    check(bridge.pending() == 0 && bridge.queued() == 0, "requests left after the final reset");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t requests = 100000;
+    unsigned seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--requests" && i + 1 < argc) requests = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--seed" && i + 1 < argc) seed = (unsigned)strtoul(argv[++i], nullptr, 10);
+        else {
+            std::cerr << "usage: page_bridge_test [--requests N] [--seed N]\n";
+            return 1;
+        }
+    }
+    batching();
+    correlation();
+    page_requests();
+    expire();
+    reset();
+    envelopes();
+    random_traffic(requests, seed);
+    printf("\n%s\n", failures ? "FAILED: the bridge did not behave as expected" : "all messages as expected");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,72 @@
+// The compile-time restriction script (restriction_script.h) against
+// build_restriction_script(), for every combination of the three flags.
+//
+// RESTRICTION_SCRIPT<...> is what main.cpp injects when the Config::DISABLE_*
+// flags are constants; build_restriction_script() is the runtime assembly it
+// replaced. Both must produce the same text character for character. Also
+// checks that no restriction means an empty script and that each optional
+// piece appears exactly when its flag is set.
+//
+//   g++ -std=c++17 -O2 -I. tools/restriction_script_test.cpp -o restriction_script_test
+//   ./restriction_script_test
+#include <cstdio>
+#include <cwchar>
+#include <string>
+#include "restriction_script.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const char* what) {
+    if (!ok) {
+        printf("  FAILED: %s\n", what);
+        ++failures;
+    }
+}
+
+bool contains(const std::wstring& script, const wchar_t* piece) { return script.find(piece) != std::wstring::npos; }
+
+template <bool ContextMenu, bool TextSelection, bool CopyPaste>
+void compare() {
+    constexpr auto compiled = RESTRICTION_SCRIPT<ContextMenu, TextSelection, CopyPaste>;
+    std::wstring built = build_restriction_script(ContextMenu, TextSelection, CopyPaste);
+    std::wstring from_literal(compiled.c_str(), compiled.size());
+
+    size_t mismatch = 0;
+    while (mismatch < built.size() && mismatch < from_literal.size() && built[mismatch] == from_literal[mismatch]) ++mismatch;
+    bool same = built == from_literal;
+    printf("context menu %d, text selection %d, copy/paste %d: %5zu chars, %s", ContextMenu, TextSelection, CopyPaste,
+           from_literal.size(), same ? "identical" : "DIFFERENT");
+    if (!same) printf(" from char %zu (compiled %zu, built %zu chars)", mismatch, from_literal.size(), built.size());
+    printf("\n");
+    check(same, "compiled and built scripts differ");
+    check(compiled.c_str()[compiled.size()] == L'\0', "compiled script is not NUL-terminated");
+    check(from_literal.size() == wcslen(compiled.c_str()), "compiled script has an embedded NUL");
+
+    using namespace RestrictionScript;
+    bool any = ContextMenu || TextSelection || CopyPaste;
+    check(from_literal.empty() == !any, "script empty when it should not be, or the reverse");
+    if (!any) return;
+    check(from_literal.rfind(HEADER, 0) == 0, "script does not start with the header");
+    check(contains(from_literal, KEYDOWN_BEGIN) && contains(from_literal, KEYDOWN_END), "keydown listener missing");
+    check(contains(from_literal, CONTEXT_MENU) == ContextMenu, "context menu piece does not follow its flag");
+    check(contains(from_literal, COPY_PASTE_KEYS) == CopyPaste, "copy/paste piece does not follow its flag");
+    check(contains(from_literal, SELECTION_KEYS) == TextSelection, "selection keys piece does not follow its flag");
+    check(contains(from_literal, SELECTION_MOUSE) == TextSelection, "selection mouse piece does not follow its flag");
+}
+
+}  // namespace
+
+int main() {
+    compare<false, false, false>();
+    compare<false, false, true>();
+    compare<false, true, false>();
+    compare<false, true, true>();
+    compare<true, false, false>();
+    compare<true, false, true>();
+    compare<true, true, false>();
+    compare<true, true, true>();
+    printf("\n%s\n", failures ? "FAILED: a compiled script does not match the runtime one" : "all 8 combinations identical");
+    return failures ? 1 : 0;
+}
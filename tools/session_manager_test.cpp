@@ -0,0 +1,297 @@
+// Login sessions of session_manager.h on a mock SessionEnvironment.
+//
+// The mock records every call and keeps its Done callbacks until the test
+// completes them, so environment and controller creation are asynchronous as
+// in WebView2. Scenarios:
+//
+//   first login        one environment, then the controller, default profile
+//   while creating     logins during environment creation start with it
+//   limit and reuse    acquire() returns 0 at the limit; a released session
+//                      is reused without a new controller
+//   profiles           isolated sessions get "session-N", reused after close;
+//                      without isolation all share the default profile
+//   close early        closing while the environment or controller is being
+//                      created; the late Done is ignored
+//   failures           a failed environment fails every session; a failed
+//                      controller is not reused
+//
+// Then --ops random acquire/release/close/complete operations against the
+// invariants: at most max_sessions, one environment, distinct profiles when
+// isolated, every session destroyed at most once and only once it had left
+// WaitingForEnvironment.
+//
+//   g++ -std=c++17 -O2 -I. tools/session_manager_test.cpp -o session_manager_test
+//   ./session_manager_test [--ops 100000] [--seed 1]
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "session_manager.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (!ok) {
+        printf("  FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+class MockEnvironment : public SessionEnvironment {
+public:
+    void create_environment(Done done) override {
+        ++environments;
+        environment_done = std::move(done);
+    }
+    void create_controller(uint64_t id, const std::string& profile, Done done) override {
+        requested[id] = profile;
+        controllers.push_back({id, std::move(done)});
+    }
+    void destroy_controller(uint64_t id) override { destroyed.push_back(id); }
+
+    // Completes the environment creation
+    void environment(bool ok) {
+        Done done = std::move(environment_done);
+        environment_done = nullptr;
+        if (done) done(ok);
+    }
+
+    // Completes the oldest pending controller creation; false if none
+    bool controller(bool ok) {
+        if (controllers.empty()) return false;
+        Pending p = std::move(controllers.front());
+        controllers.erase(controllers.begin());
+        p.done(ok);
+        return true;
+    }
+
+    struct Pending {
+        uint64_t id;
+        Done done;
+    };
+    int environments = 0;
+    Done environment_done;
+    std::vector<Pending> controllers;
+    std::map<uint64_t, std::string> requested;  // id -> profile
+    std::vector<uint64_t> destroyed;
+};
+
+using State = SessionManager::State;
+
+State state_of(const SessionManager& m, uint64_t id) {
+    const SessionManager::Session* s = m.find(id);
+    return s ? s->state : State::Failed;
+}
+
+std::string profile_of(const SessionManager& m, uint64_t id) {
+    const SessionManager::Session* s = m.find(id);
+    return s ? s->profile : "(none)";
+}
+
+void first_login() {
+    printf("first login\n");
+    MockEnvironment env;
+    SessionManager m(env, 3, true);
+    uint64_t a = m.acquire();
+    check(a != 0 && env.environments == 1 && env.controllers.empty(), "environment not created first");
+    check(state_of(m, a) == State::WaitingForEnvironment && !m.environment_ready(), "session not waiting");
+    env.environment(true);
+    check(m.environment_ready() && env.controllers.size() == 1 && env.requested[a] == "", "controller not requested");
+    check(state_of(m, a) == State::CreatingController, "session not creating its controller");
+    env.controller(true);
+    check(state_of(m, a) == State::Ready && m.find(a)->in_use, "session not ready");
+}
+
+void while_creating() {
+    printf("while creating\n");
+    MockEnvironment env;
+    SessionManager m(env, 3, true);
+    uint64_t a = m.acquire(), b = m.acquire();
+    check(env.environments == 1 && env.controllers.empty(), "second login created another environment");
+    env.environment(true);
+    check(env.controllers.size() == 2 && env.requested[a] == "" && env.requested[b] == "session-2",
+          "waiting logins not started with their profiles");
+    uint64_t c = m.acquire();
+    check(env.controllers.size() == 3 && env.requested[c] == "session-3", "login after the environment not started at once");
+    while (env.controller(true)) {}
+    check(state_of(m, a) == State::Ready && state_of(m, b) == State::Ready && state_of(m, c) == State::Ready,
+          "not all sessions ready");
+}
+
+void limit_and_reuse() {
+    printf("limit and reuse\n");
+    MockEnvironment env;
+    SessionManager m(env, 2, true);
+    uint64_t a = m.acquire(), b = m.acquire();
+    env.environment(true);
+    while (env.controller(true)) {}
+    check(m.acquire() == 0 && m.size() == 2, "acquire() beyond the limit");
+    m.release(b);
+    size_t requests = env.requested.size();
+    uint64_t again = m.acquire();
+    check(again == b && env.requested.size() == requests && m.find(b)->in_use, "released session not reused");
+    check(m.acquire() == 0, "reused session acquired twice");
+    m.release(a);
+    m.release(b);
+    check(m.acquire() == a, "idle sessions not reused oldest first");
+
+    MockEnvironment env1;
+    SessionManager single(env1, 0, true);
+    check(single.max_sessions() == 1 && single.acquire() != 0 && single.acquire() == 0, "a limit of 0 is not 1");
+}
+
+void profiles() {
+    printf("profiles\n");
+    MockEnvironment env;
+    SessionManager m(env, 4, true);
+    uint64_t a = m.acquire(), b = m.acquire(), c = m.acquire();
+    env.environment(true);
+    while (env.controller(true)) {}
+    check(profile_of(m, a) == "" && profile_of(m, b) == "session-2" && profile_of(m, c) == "session-3", "profile names");
+    m.close(b);
+    check(env.destroyed == std::vector<uint64_t>{b} && !m.find(b), "closed session not destroyed");
+    uint64_t d = m.acquire();
+    check(d != b && profile_of(m, d) == "session-2", "freed profile not reused: " + profile_of(m, d));
+    m.close(a);
+    uint64_t e = m.acquire();
+    check(profile_of(m, e) == "", "default profile not reused: " + profile_of(m, e));
+
+    MockEnvironment shared_env;
+    SessionManager shared(shared_env, 3, false);
+    uint64_t x = shared.acquire(), y = shared.acquire();
+    shared_env.environment(true);
+    check(shared_env.requested[x] == "" && shared_env.requested[y] == "", "profiles without isolation");
+}
+
+void close_early() {
+    printf("close early\n");
+    MockEnvironment env;
+    SessionManager m(env, 3, true);
+    uint64_t a = m.acquire();
+    m.close(a);
+    check(env.destroyed.empty() && m.size() == 0, "controller destroyed before it was requested");
+    env.environment(true);
+    check(env.controllers.empty(), "controller requested for a closed session");
+
+    uint64_t b = m.acquire();
+    check(env.controllers.size() == 1, "controller not requested");
+    m.close(b);
+    check(env.destroyed == std::vector<uint64_t>{b}, "pending controller not destroyed");
+    env.controller(true);  // arrives after the close
+    check(!m.find(b) && m.size() == 0, "late controller revived the session");
+}
+
+void failures_() {
+    printf("failures\n");
+    MockEnvironment env;
+    SessionManager m(env, 3, true);
+    uint64_t a = m.acquire(), b = m.acquire();
+    env.environment(false);
+    check(m.environment_failed() && state_of(m, a) == State::Failed && state_of(m, b) == State::Failed,
+          "failed environment left sessions waiting");
+    uint64_t c = m.acquire();
+    check(c != 0 && state_of(m, c) == State::Failed && env.environments == 1, "later login not failed at once");
+    m.release(a);
+    check(m.acquire() == 0, "failed session reused");
+
+    MockEnvironment env2;
+    SessionManager m2(env2, 2, true);
+    uint64_t x = m2.acquire();
+    env2.environment(true);
+    env2.controller(false);
+    check(state_of(m2, x) == State::Failed, "failed controller not marked");
+    m2.release(x);
+    uint64_t y = m2.acquire();
+    check(y != x && y != 0, "failed session reused instead of a new one");
+    m2.close(x);
+    check(std::count(env2.destroyed.begin(), env2.destroyed.end(), x) == 1, "failed session's controller not destroyed");
+}
+
+// Random operations against the invariants
+void random_ops(size_t ops, unsigned seed) {
+    printf("random: %zu operations, seed %u\n", ops, seed);
+    std::mt19937 rng(seed);
+    size_t violations = 0;
+    auto violation = [&](const std::string& what, size_t i) {
+        if (violations++ < 5) printf("  op %zu: %s\n", i, what.c_str());
+    };
+    for (bool isolate : {true, false}) {
+        MockEnvironment env;
+        const size_t MAX = 4;
+        SessionManager m(env, MAX, isolate);
+        std::set<uint64_t> closed, destroyed;
+        size_t destroys_seen = 0;
+        for (size_t i = 0; i < ops; ++i) {
+            std::vector<uint64_t> ids = m.ids();
+            uint64_t some = ids.empty() ? 0 : ids[std::uniform_int_distribution<size_t>(0, ids.size() - 1)(rng)];
+            switch (std::uniform_int_distribution<int>(0, 5)(rng)) {
+                case 0: {
+                    uint64_t id = m.acquire();
+                    if (id == 0 && m.size() < MAX) violation("acquire() refused below the limit", i);
+                    break;
+                }
+                case 1: if (some) m.release(some); break;
+                case 2:
+                    if (some) {
+                        bool waiting = state_of(m, some) == State::WaitingForEnvironment;
+                        size_t before = env.destroyed.size();
+                        m.close(some);
+                        closed.insert(some);
+                        if (env.destroyed.size() != before + (waiting ? 0 : 1)) violation("close() destroyed the wrong thing", i);
+                    }
+                    break;
+                case 3: if (env.environment_done) env.environment(std::uniform_int_distribution<int>(0, 19)(rng) != 0); break;
+                default: env.controller(std::uniform_int_distribution<int>(0, 9)(rng) != 0); break;
+            }
+            if (m.size() > MAX) violation("more sessions than the limit", i);
+            if (env.environments > 1) violation("environment created twice", i);
+            std::set<std::string> profiles;
+            for (uint64_t id : m.ids()) {
+                if (closed.count(id)) violation("closed session still listed", i);
+                if (isolate && !profiles.insert(profile_of(m, id)).second) violation("two sessions share a profile", i);
+                if (!isolate && profile_of(m, id) != "") violation("named profile without isolation", i);
+            }
+            for (; destroys_seen < env.destroyed.size(); ++destroys_seen) {
+                if (!destroyed.insert(env.destroyed[destroys_seen]).second) violation("session destroyed twice", i);
+            }
+            if (m.environment_failed()) {
+                for (uint64_t id : m.ids()) {
+                    if (state_of(m, id) != State::Failed) violation("session alive without an environment", i);
+                }
+            }
+        }
+    }
+    check(violations == 0, std::to_string(violations) + " invariant violations");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t ops = 100000;
+    unsigned seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--ops" && i + 1 < argc) ops = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--seed" && i + 1 < argc) seed = (unsigned)strtoul(argv[++i], nullptr, 10);
+        else {
+            std::cerr << "usage: session_manager_test [--ops N] [--seed N]\n";
+            return 1;
+        }
+    }
+    first_login();
+    while_creating();
+    limit_and_reuse();
+    profiles();
+    close_early();
+    failures_();
+    random_ops(ops, seed);
+    printf("\n%s\n", failures ? "FAILED: the sessions did not behave as expected" : "all sessions as expected");
+    return failures ? 1 : 0;
+}
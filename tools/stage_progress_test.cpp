@@ -0,0 +1,200 @@
+// The splash progress of stage_progress.h, on a made-up clock.
+//
+//   order        stages only move forward; a repeated or earlier stage is
+//                refused, and begin() says whether the label changed
+//   skipped      a stage reported past others counts those as done
+//   easing       inside a stage the bar approaches the stage's end along
+//                its expected duration, without reaching it
+//   monotonic    the bar never moves backwards, inside a stage or across one
+//   fail         a failed start holds until reset(), whatever is reported
+//
+// Then --runs random runs of stage reports on a forward clock: the bar only
+// grows and stays inside the current stage until Ready.
+//
+//   g++ -std=c++17 -O2 -I. tools/stage_progress_test.cpp -o stage_progress_test
+//   ./stage_progress_test [--runs 10000] [--seed 1]
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cwchar>
+#include <iostream>
+#include <random>
+#include <string>
+#include "stage_progress.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (!ok) {
+        printf("  FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+const int STAGES = (int)LoginStage::Ready + 1;
+
+double total_ms() {
+    double total = 0;
+    for (int s = 0; s < (int)LoginStage::Ready; ++s) total += StageProgress::expected_ms((LoginStage)s);
+    return total;
+}
+
+// Fraction of the bar at the start of `stage`
+double start_of(LoginStage stage) {
+    double done = 0;
+    for (int s = 0; s < (int)stage; ++s) done += StageProgress::expected_ms((LoginStage)s);
+    return done / total_ms();
+}
+
+double end_of(LoginStage stage) { return start_of(stage) + StageProgress::expected_ms(stage) / total_ms(); }
+
+bool near(double a, double b) { return std::fabs(a - b) < 1e-9; }
+
+void order() {
+    printf("order\n");
+    StageProgress progress;
+    progress.reset(1000);
+    check(progress.stage() == LoginStage::Starting && !progress.ready() && !progress.failed(), "initial state");
+    check(!progress.begin(LoginStage::Starting, 1000), "Starting again changed the stage");
+    check(progress.begin(LoginStage::Fingerprint, 1100), "Fingerprint refused");
+    check(!progress.begin(LoginStage::Fingerprint, 1200), "repeated stage changed the stage");
+    check(progress.begin(LoginStage::Backend, 1300), "later stage refused");
+    check(!progress.begin(LoginStage::NetworkInfo, 1400) && progress.stage() == LoginStage::Backend,
+          "earlier stage moved the bar back");
+    check(std::wcscmp(progress.label(), L"Contacting the server\x2026") == 0, "label after an earlier stage");
+    check(progress.begin(LoginStage::Ready, 1500) && progress.ready() && progress.fraction(1500) == 1.0, "Ready");
+    check(!progress.begin(LoginStage::PageLoading, 1600) && progress.ready(), "stage after Ready");
+    check(std::wcscmp(progress.label(), L"") == 0, "label when ready");
+
+    progress.reset(2000);
+    check(progress.stage() == LoginStage::Starting && progress.fraction(2000) == 0, "reset");
+    check(progress.begin(LoginStage::Fingerprint, 2000), "stage after reset");
+}
+
+void skipped() {
+    printf("skipped\n");
+    StageProgress progress;
+    progress.reset(0);
+    progress.begin(LoginStage::Encrypting, 10);
+    check(progress.fraction(10) >= start_of(LoginStage::Encrypting), "skipped stages not counted as done");
+    check(progress.fraction(10) < end_of(LoginStage::Encrypting), "skipped into the next stage");
+    progress.begin(LoginStage::PageLoading, 20);
+    check(progress.fraction(20) >= start_of(LoginStage::PageLoading), "skipped Backend not counted as done");
+}
+
+void easing() {
+    printf("easing\n");
+    for (int s = 0; s < (int)LoginStage::Ready; ++s) {
+        LoginStage stage = (LoginStage)s;
+        StageProgress progress;
+        progress.reset(0);
+        if (s > 0) progress.begin(stage, 0);
+        double expected = StageProgress::expected_ms(stage);
+        double width = end_of(stage) - start_of(stage);
+        std::string name = "stage " + std::to_string(s);
+        check(near(progress.fraction(0), start_of(stage)), name + ": not at the stage's start");
+        // 1 - 1/e of the stage after its expected duration
+        check(near(progress.fraction(expected), start_of(stage) + width * (1 - std::exp(-1.0))),
+              name + ": not eased along the expected duration");
+        check(progress.fraction(10 * expected) > end_of(stage) - width * 1e-3, name + ": stalls before the stage's end");
+        check(progress.fraction(1e9) <= end_of(stage) + 1e-12, name + ": past the stage's end before it is reported");
+        check(near(progress.fraction(-500), start_of(stage)), name + ": clock before the start");
+    }
+}
+
+void monotonic() {
+    printf("monotonic\n");
+    StageProgress progress;
+    progress.reset(0);
+    double last = 0;
+    double now = 0;
+    // Long stages early, short ones late: each report comes after the bar
+    // has eased far into the stage it ends
+    for (int s = 1; s < STAGES; ++s) {
+        for (int i = 0; i < 50; ++i) {
+            now += 100;
+            double f = progress.fraction(now);
+            check(f >= last, "bar moved back inside stage " + std::to_string(s - 1));
+            last = f;
+        }
+        progress.begin((LoginStage)s, now);
+        double f = progress.fraction(now);
+        check(f >= last, "bar moved back entering stage " + std::to_string(s));
+        last = f;
+    }
+    check(last == 1.0, "not full when ready");
+
+    // A report with a clock behind the stage's start keeps what was shown
+    progress.reset(0);
+    double shown = progress.fraction(5000);
+    progress.begin(LoginStage::Fingerprint, 5000);
+    check(progress.fraction(4000) >= shown, "earlier clock moved the bar back");
+}
+
+void fail() {
+    printf("fail\n");
+    StageProgress progress;
+    progress.reset(0);
+    progress.begin(LoginStage::NetworkInfo, 100);
+    progress.fail();
+    check(progress.failed() && std::wcscmp(progress.label(), L"Sign-in could not be started") == 0, "failed label");
+    check(!progress.begin(LoginStage::Backend, 200) && !progress.begin(LoginStage::Ready, 300), "stage after a failure");
+    check(progress.failed() && progress.stage() == LoginStage::NetworkInfo && !progress.ready(), "failure not held");
+    check(progress.fraction(1e9) <= end_of(LoginStage::NetworkInfo) + 1e-12, "failed bar moved past its stage");
+    progress.reset(400);
+    check(!progress.failed() && progress.begin(LoginStage::Fingerprint, 500), "reset kept the failure");
+}
+
+void random_runs(size_t runs, unsigned seed) {
+    printf("random: %zu runs, seed %u\n", runs, seed);
+    std::mt19937 rng(seed);
+    size_t backwards = 0, outside = 0, wrong_begin = 0;
+    for (size_t run = 0; run < runs; ++run) {
+        StageProgress progress;
+        double now = std::uniform_real_distribution<double>(0, 1e6)(rng);
+        progress.reset(now);
+        double last = progress.fraction(now);
+        for (int step = 0; step < 40; ++step) {
+            now += std::uniform_real_distribution<double>(0, 2000)(rng);
+            if (rng() % 3 == 0) {
+                LoginStage before = progress.stage();
+                LoginStage stage = (LoginStage)(rng() % STAGES);
+                bool changed = progress.begin(stage, now);
+                if (changed != (stage > before) || progress.stage() != (changed ? stage : before)) ++wrong_begin;
+            }
+            double f = progress.fraction(now);
+            if (f < last) ++backwards;
+            if (!progress.ready() && (f < start_of(progress.stage()) - 1e-12 || f > end_of(progress.stage()) + 1e-12)) ++outside;
+            last = f;
+        }
+    }
+    check(backwards == 0, std::to_string(backwards) + " steps moved the bar back");
+    check(outside == 0, std::to_string(outside) + " steps outside the current stage");
+    check(wrong_begin == 0, std::to_string(wrong_begin) + " reports answered wrongly");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t runs = 10000;
+    unsigned seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--runs" && i + 1 < argc) runs = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--seed" && i + 1 < argc) seed = (unsigned)strtoul(argv[++i], nullptr, 10);
+        else {
+            std::cerr << "usage: stage_progress_test [--runs N] [--seed N]\n";
+            return 1;
+        }
+    }
+    order();
+    skipped();
+    easing();
+    monotonic();
+    fail();
+    random_runs(runs, seed);
+    printf("\n%s\n", failures ? "FAILED: the progress did not behave as expected" : "all progress as expected");
+    return failures ? 1 : 0;
+}
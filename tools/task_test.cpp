@@ -0,0 +1,430 @@
+// Coroutines of task.h on a Linux EventLoop, with stub awaitables.
+//
+// A Gate is an awaitable the test opens by hand, so tasks suspend and resume
+// in any order without threads or timers. Scenarios:
+//
+//   lazy           a task runs only once started or awaited; results and
+//                  exceptions through get()
+//   chain          nested co_await 10000 deep, exceptions passed up
+//   when_all       both orders, immediate tasks, a failure rethrown only
+//                  after the other task finished, a shared token stopping it
+//   cancel token   callbacks once, remove(), on_cancel() after cancel(),
+//                  cancel_after() on the loop
+//   sleep_for      on time, zero delay, cancelled, destroyed mid-sleep
+//   offload        results and exceptions from a thread resumed on the loop,
+//                  cancellation while the call still runs, a task destroyed
+//                  mid-call
+//
+//   g++ -std=c++20 -O2 -pthread -I. tools/task_test.cpp -o task_test
+//   ./task_test
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "task.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (!ok) {
+        printf("  FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+// Suspends its awaiters until open()
+class Gate {
+public:
+    struct Awaiter {
+        Gate& gate;
+        bool await_ready() const noexcept { return gate.open_; }
+        void await_suspend(std::coroutine_handle<> h) { gate.waiting_ = h; }
+        int await_resume() const { return gate.value_; }
+    };
+    Awaiter operator co_await() { return Awaiter{*this}; }
+
+    void open(int value) {
+        value_ = value;
+        open_ = true;
+        if (waiting_) std::exchange(waiting_, {}).resume();
+    }
+    bool waiting() const { return (bool)waiting_; }
+
+private:
+    bool open_ = false;
+    int value_ = 0;
+    std::coroutine_handle<> waiting_;
+};
+
+// A call that blocks its thread until released
+class Latch {
+public:
+    void release() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        released_ = true;
+        cv_.notify_all();
+    }
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return released_; });
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool released_ = false;
+};
+
+Task<int> gated(Gate& gate, std::vector<std::string>& log, std::string name) {
+    log.push_back(name + " started");
+    int value = co_await gate;
+    log.push_back(name + " done");
+    co_return value;
+}
+
+Task<int> gated_throw(Gate& gate, std::vector<std::string>& log) {
+    co_await gate;
+    log.push_back("thrower done");
+    throw std::runtime_error("probe failed");
+}
+
+Task<int> immediate(int value) { co_return value; }
+
+Task<int> thrower() {
+    throw std::runtime_error("boom");
+    co_return 0;
+}
+
+void lazy() {
+    printf("lazy\n");
+    Gate gate;
+    std::vector<std::string> log;
+    Task<int> task = gated(gate, log, "a");
+    check(log.empty() && task.valid() && !task.done(), "task ran before start()");
+    bool finished = false;
+    task.start([&] { finished = true; });
+    check(log.size() == 1 && !finished && gate.waiting(), "task did not suspend at the gate");
+    gate.open(42);
+    check(finished && task.done() && task.get() == 42, "result not delivered");
+
+    Task<int> failing = thrower();
+    failing.start();
+    bool threw = false;
+    try {
+        failing.get();
+    } catch (const std::runtime_error& e) {
+        threw = std::string(e.what()) == "boom";
+    }
+    check(failing.done() && threw, "exception not rethrown by get()");
+
+    Task<int> moved = immediate(7);
+    Task<int> target = std::move(moved);
+    check(!moved.valid() && target.valid(), "move did not transfer the task");
+    target.start();
+    check(target.get() == 7, "moved task result");
+
+    // Never started: destroyed without running
+    std::vector<std::string> unused_log;
+    { Task<int> unused = gated(gate, unused_log, "unused"); }
+    check(unused_log.empty(), "unstarted task ran when destroyed");
+}
+
+Task<long> depth(int n) {
+    if (n == 0) co_return 0;
+    long below = co_await depth(n - 1);
+    co_return below + 1;
+}
+
+Task<int> rethrow_through(int n) {
+    if (n == 0) co_return co_await thrower();
+    co_return co_await rethrow_through(n - 1);
+}
+
+void chain() {
+    printf("chain\n");
+    const int DEPTH = 10000;
+    Task<long> task = depth(DEPTH);
+    task.start();
+    check(task.done() && task.get() == DEPTH, "deep chain");
+
+    Task<int> failing = rethrow_through(100);
+    failing.start();
+    bool threw = false;
+    try {
+        failing.get();
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    check(threw, "exception not passed up the chain");
+}
+
+Task<std::pair<int, int>> join_two(Task<int> a, Task<int> b, std::vector<std::string>& log) {
+    auto both = co_await when_all(std::move(a), std::move(b));
+    log.push_back("joined");
+    co_return both;
+}
+
+void when_all_() {
+    printf("when_all\n");
+    for (bool first_a : {true, false}) {
+        Gate a, b;
+        std::vector<std::string> log;
+        Task<std::pair<int, int>> task = join_two(gated(a, log, "a"), gated(b, log, "b"), log);
+        task.start();
+        check(log.size() == 2 && a.waiting() && b.waiting(), "tasks not started together");
+        if (first_a) a.open(1);
+        else b.open(2);
+        check(!task.done() && log.back() != "joined", "joined after one task");
+        if (first_a) b.open(2);
+        else a.open(1);
+        check(task.done() && task.get() == std::make_pair(1, 2) && log.back() == "joined",
+              std::string("results, ") + (first_a ? "a" : "b") + " first");
+    }
+
+    std::vector<std::string> log;
+    Task<std::pair<int, int>> ready = join_two(immediate(3), immediate(4), log);
+    ready.start();
+    check(ready.done() && ready.get() == std::make_pair(3, 4), "immediate tasks");
+
+    // The failure surfaces only once the other task has finished too
+    Gate fail_gate, slow_gate;
+    log.clear();
+    Task<std::pair<int, int>> failing = join_two(gated_throw(fail_gate, log), gated(slow_gate, log, "slow"), log);
+    failing.start();
+    fail_gate.open(0);
+    check(!failing.done(), "failure resumed before the other task finished");
+    slow_gate.open(5);
+    bool threw = false;
+    try {
+        failing.get();
+    } catch (const std::runtime_error& e) {
+        threw = std::string(e.what()) == "probe failed";
+    }
+    check(failing.done() && threw, "failure not rethrown");
+    check(log == std::vector<std::string>({"slow started", "thrower done", "slow done"}), "order of completion");
+}
+
+Task<int> sleeper(EventLoop& loop, double ms, CancelToken token, std::vector<std::string>& log, std::string name) {
+    try {
+        co_await sleep_for(loop, ms, token);
+    } catch (const TaskCancelled&) {
+        log.push_back(name + " cancelled");
+        throw;
+    }
+    log.push_back(name + " woke");
+    co_return (int)ms;
+}
+
+Task<int> fail_and_cancel(EventLoop& loop, CancelToken token) {
+    co_await sleep_for(loop, 5);
+    token.cancel();
+    throw std::runtime_error("probe failed");
+}
+
+// Runs `task` to completion on `loop`; false if it did not finish within `limit_ms`
+template <typename T>
+bool run_to_end(EventLoop& loop, Task<T>& task, double limit_ms = 5000) {
+    bool finished = false;
+    EventLoop::TimerId guard = loop.call_later(limit_ms, [&loop] { loop.stop(1); });
+    task.start([&] {
+        finished = true;
+        loop.stop();
+    });
+    if (!finished) loop.run();
+    loop.cancel(guard);
+    return finished;
+}
+
+void when_all_cancel() {
+    printf("when_all with a shared token\n");
+    EventLoop loop;
+    CancelToken token;
+    std::vector<std::string> log;
+    Task<std::pair<int, int>> task = join_two(fail_and_cancel(loop, token), sleeper(loop, 60000, token, log, "slow"), log);
+    double start = loop.now_ms();
+    check(run_to_end(loop, task), "join did not finish");
+    check(loop.now_ms() - start < 1000, "shared token did not stop the other task early");
+    check(log == std::vector<std::string>({"slow cancelled"}), "other task not cancelled");
+    bool threw = false;
+    try {
+        task.get();
+    } catch (const std::runtime_error&) {
+        threw = true;  // the first task's failure, not the cancellation
+    }
+    check(threw, "failure not rethrown");
+    check(loop.timer_count() == 0, "sleep timer left behind");
+}
+
+void cancel_token() {
+    printf("cancel token\n");
+    CancelToken token;
+    CancelToken copy = token;
+    int a = 0, b = 0, late = 0;
+    token.on_cancel([&] { ++a; });
+    uint64_t removed = token.on_cancel([&] { ++b; });
+    token.remove(removed);
+    copy.cancel();
+    token.cancel();
+    check(token.cancelled() && a == 1 && b == 0, "callbacks not run once, or a removed one ran");
+    check(token.on_cancel([&] { ++late; }) == 0 && late == 1, "callback after cancel() not run at once");
+
+    EventLoop loop;
+    CancelToken timed;
+    timed.cancel_after(loop, 20);
+    loop.call_later(200, [&loop] { loop.stop(); });
+    bool at_stop = false;
+    loop.call_later(100, [&] { at_stop = timed.cancelled(); });
+    loop.run();
+    check(at_stop, "cancel_after() did not fire");
+    {
+        CancelToken gone;
+        gone.cancel_after(loop, 1);
+    }
+    loop.call_later(20, [&loop] { loop.stop(); });
+    loop.run();  // the timer outlives its token
+}
+
+void sleep_for_() {
+    printf("sleep_for\n");
+    EventLoop loop;
+    std::vector<std::string> log;
+    Task<int> task = sleeper(loop, 30, CancelToken(), log, "a");
+    double start = loop.now_ms();
+    check(run_to_end(loop, task) && task.get() == 30, "sleep did not finish");
+    check(loop.now_ms() - start >= 29, "woke early");
+
+    Task<int> zero = sleeper(loop, 0, CancelToken(), log, "zero");
+    zero.start();
+    check(zero.done(), "zero delay suspended");
+
+    CancelToken token;
+    Task<int> cancelled = sleeper(loop, 60000, token, log, "c");
+    loop.call_later(10, [&token] { token.cancel(); });
+    start = loop.now_ms();
+    check(run_to_end(loop, cancelled) && loop.now_ms() - start < 1000, "cancel did not end the sleep");
+    bool threw = false;
+    try {
+        cancelled.get();
+    } catch (const TaskCancelled&) {
+        threw = true;
+    }
+    check(threw && loop.timer_count() == 0, "TaskCancelled not thrown or timer left behind");
+
+    CancelToken before;
+    before.cancel();
+    log.clear();
+    Task<int> already = sleeper(loop, 10, before, log, "d");
+    already.start();
+    check(already.done() && log == std::vector<std::string>({"d cancelled"}), "cancelled token did not throw at once");
+
+    // Destroyed mid-sleep: the timer goes with it and nothing resumes the frame
+    log.clear();
+    {
+        Task<int> dropped = sleeper(loop, 5, CancelToken(), log, "dropped");
+        dropped.start();
+    }
+    check(loop.timer_count() == 0, "destroyed sleep left its timer");
+    loop.call_later(30, [&loop] { loop.stop(); });
+    loop.run();
+    check(log.empty(), "destroyed task resumed");
+}
+
+Task<int> offloaded(Offload& offload, std::thread::id& resumed_on, std::thread::id& ran_on) {
+    auto read = [&ran_on] {
+        ran_on = std::this_thread::get_id();
+        return 11;
+    };
+    int value = co_await offload.call(read);
+    auto nothing = [] {};
+    co_await offload.call(nothing);
+    resumed_on = std::this_thread::get_id();
+    co_return value;
+}
+
+Task<int> offload_throws(Offload& offload) {
+    auto fail = []() -> int { throw std::runtime_error("wmi"); };
+    co_return co_await offload.call(fail);
+}
+
+Task<int> offload_blocked(Offload& offload, Latch& latch, std::atomic<bool>& returned, CancelToken token) {
+    auto slow = [&latch, &returned] {
+        latch.wait();
+        returned = true;
+        return 1;
+    };
+    co_return co_await offload.call(slow, token);
+}
+
+void offload() {
+    printf("offload\n");
+    EventLoop loop;
+    Offload offload(loop);
+    std::thread::id resumed_on, ran_on;
+    Task<int> task = offloaded(offload, resumed_on, ran_on);
+    check(run_to_end(loop, task) && task.get() == 11, "offloaded result");
+    check(ran_on != std::this_thread::get_id() && resumed_on == std::this_thread::get_id(),
+          "call not on its own thread, or task not resumed on the loop");
+
+    Task<int> failing = offload_throws(offload);
+    bool threw = false;
+    try {
+        run_to_end(loop, failing);
+        failing.get();
+    } catch (const std::runtime_error& e) {
+        threw = std::string(e.what()) == "wmi";
+    }
+    check(threw, "exception from the thread not rethrown");
+
+    // Cancelled while the call blocks: the task resumes at once
+    Latch latch;
+    std::atomic<bool> returned{false};
+    CancelToken token;
+    Task<int> blocked = offload_blocked(offload, latch, returned, token);
+    loop.call_later(10, [&token] { token.cancel(); });
+    check(run_to_end(loop, blocked), "cancelled call did not resume the task");
+    threw = false;
+    try {
+        blocked.get();
+    } catch (const TaskCancelled&) {
+        threw = true;
+    }
+    check(threw && !returned && offload.running() == 1, "task not cancelled while its call ran");
+    latch.release();
+    offload.join();
+    check(returned && offload.running() == 0, "call not joined");
+    loop.call_later(10, [&loop] { loop.stop(); });
+    loop.run();  // the dropped result's post runs against a resumed frame
+
+    // Destroyed mid-call: the thread's post must not resume the freed frame
+    Latch second;
+    std::atomic<bool> second_returned{false};
+    {
+        Task<int> dropped = offload_blocked(offload, second, second_returned, CancelToken());
+        dropped.start();
+    }
+    second.release();
+    offload.join();
+    loop.call_later(10, [&loop] { loop.stop(); });
+    loop.run();
+    check(second_returned, "dropped call did not run to its end");
+}
+
+}  // namespace
+
+int main() {
+    lazy();
+    chain();
+    when_all_();
+    when_all_cancel();
+    cancel_token();
+    sleep_for_();
+    offload();
+    printf("\n%s\n", failures ? "FAILED: a task did not behave as expected" : "all tasks as expected");
+    return failures ? 1 : 0;
+}
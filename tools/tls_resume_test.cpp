@@ -0,0 +1,358 @@
+// TLS session resumption and early data of https_client.h against a local
+// OpenSSL server, Linux only.
+//
+// Starts a TLS server in-process (self-signed certificate for localhost,
+// session tickets, up to 16 KB of early data answered at once) behind a relay
+// that delays every byte by half of --rtt-ms each way, as a satellite link
+// would. Each "launch" opens the session cache file anew and fetches one URL
+// with a new HttpsClient, as a relaunch of main.exe does. Three runs:
+//
+//   no cache    every launch does a full handshake
+//   cache       launches after the first resume the stored ticket
+//   early data  resumed, and idempotent GETs go in the first flight; the
+//               last launch POSTs, which must not use early data
+//
+// Prints each launch's handshake (full/resumed, early data), handshake time
+// and time to the complete response. The relay accepts the TCP connection
+// itself, so TCP's own round trip is not part of the figures.
+//
+//   g++ -std=c++17 -O2 -pthread -I. tools/tls_resume_test.cpp -o tls_resume_test -lssl -lcrypto
+//   ./tls_resume_test [--rtt-ms 600] [--launches 3] [--tls12]
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+#include "https_client.h"
+
+namespace {
+
+struct Options {
+    int rtt_ms = 600;
+    int launches = 3;
+    bool tls12 = false;
+    std::string dir = "/tmp";
+};
+
+int listen_loopback(int& port) {
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(s, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(s, 16) != 0) return -1;
+    socklen_t len = sizeof(addr);
+    getsockname(s, (sockaddr*)&addr, &len);
+    port = ntohs(addr.sin_port);
+    return s;
+}
+
+int connect_loopback(int port) {
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((uint16_t)port);
+    if (connect(s, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+// A self-signed P-256 certificate for localhost and 127.0.0.1
+bool make_certificate(EVP_PKEY*& key, X509*& cert) {
+    key = EVP_EC_gen("P-256");
+    cert = X509_new();
+    if (!key || !cert) return false;
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), -60);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 3600);
+    X509_set_pubkey(cert, key);
+    X509_NAME* name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)"localhost", -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+    X509V3_CTX ctx;
+    X509V3_set_ctx_nodb(&ctx);
+    X509V3_set_ctx(&ctx, cert, cert, nullptr, nullptr, 0);
+    X509_EXTENSION* san = X509V3_EXT_conf_nid(nullptr, &ctx, NID_subject_alt_name, "DNS:localhost,IP:127.0.0.1");
+    if (!san) return false;
+    X509_add_ext(cert, san, -1);
+    X509_EXTENSION_free(san);
+    return X509_sign(cert, key, EVP_sha256()) > 0;
+}
+
+// One-request-per-connection HTTPS server. A complete request in early data
+// is answered before the handshake finishes (0.5-RTT), the way a server
+// that takes early data saves the round trip.
+class TlsServer {
+public:
+    bool start(EVP_PKEY* key, X509* cert, bool tls12) {
+        ctx_ = SSL_CTX_new(TLS_server_method());
+        if (!ctx_ || SSL_CTX_use_certificate(ctx_, cert) != 1 || SSL_CTX_use_PrivateKey(ctx_, key) != 1) return false;
+        if (tls12) SSL_CTX_set_max_proto_version(ctx_, TLS1_2_VERSION);
+        SSL_CTX_set_max_early_data(ctx_, 16384);
+        SSL_CTX_set_recv_max_early_data(ctx_, 16384);
+        listener_ = listen_loopback(port_);
+        if (listener_ < 0) return false;
+        thread_ = std::thread([this] { serve(); });
+        return true;
+    }
+
+    void stop() {
+        stopping_ = true;
+        shutdown(listener_, SHUT_RDWR);
+        close(listener_);
+        if (thread_.joinable()) thread_.join();
+        SSL_CTX_free(ctx_);
+    }
+
+    int port() const { return port_; }
+
+private:
+    static bool request_complete(const std::string& raw) {
+        size_t end = raw.find("\r\n\r\n");
+        if (end == std::string::npos) return false;
+        size_t at = raw.find("Content-Length: ");
+        size_t length = at != std::string::npos && at < end ? strtoul(raw.c_str() + at + 16, nullptr, 10) : 0;
+        return raw.size() >= end + 4 + length;
+    }
+
+    static std::string reply_for(const std::string& request, bool early) {
+        std::string line = request.substr(0, request.find("\r\n"));
+        std::string body = "{\"request\":\"" + line + "\",\"early_data\":" + (early ? "true" : "false") + "}";
+        return "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) +
+               "\r\nConnection: close\r\n\r\n" + body;
+    }
+
+    void serve() {
+        while (!stopping_) {
+            int s = accept(listener_, nullptr, nullptr);
+            if (s < 0) continue;
+            SSL* ssl = SSL_new(ctx_);
+            SSL_set_fd(ssl, s);
+            std::string request;
+            bool answered = false;
+            char buf[4096];
+            for (;;) {
+                size_t n = 0;
+                int r = SSL_read_early_data(ssl, buf, sizeof(buf), &n);
+                if (r == SSL_READ_EARLY_DATA_ERROR) break;
+                if (r == SSL_READ_EARLY_DATA_FINISH) break;
+                request.append(buf, n);
+                if (!answered && request_complete(request)) {
+                    std::string reply = reply_for(request, true);
+                    size_t written = 0;
+                    answered = SSL_write_early_data(ssl, reply.data(), reply.size(), &written) == 1;
+                }
+            }
+            if (SSL_accept(ssl) == 1 && !answered) {
+                request.clear();
+                while (!request_complete(request)) {
+                    size_t n = 0;
+                    if (SSL_read_ex(ssl, buf, sizeof(buf), &n) != 1) break;
+                    request.append(buf, n);
+                }
+                std::string reply = reply_for(request, false);
+                size_t written = 0;
+                SSL_write_ex(ssl, reply.data(), reply.size(), &written);
+            }
+            SSL_shutdown(ssl);
+            SSL_free(ssl);
+            ERR_clear_error();
+            close(s);
+        }
+    }
+
+    SSL_CTX* ctx_ = nullptr;
+    int listener_ = -1;
+    int port_ = 0;
+    std::atomic<bool> stopping_{false};
+    std::thread thread_;
+};
+
+// Forwards connections to `target`, delaying each direction by `delay_ms`
+class DelayRelay {
+public:
+    bool start(int target, int delay_ms) {
+        target_ = target;
+        delay_ms_ = delay_ms;
+        listener_ = listen_loopback(port_);
+        if (listener_ < 0) return false;
+        thread_ = std::thread([this] { serve(); });
+        return true;
+    }
+
+    void stop() {
+        stopping_ = true;
+        shutdown(listener_, SHUT_RDWR);
+        close(listener_);
+        if (thread_.joinable()) thread_.join();
+    }
+
+    int port() const { return port_; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Pipe {
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::deque<std::pair<Clock::time_point, std::string>> chunks;
+        bool closed = false;
+    };
+
+    // Reads from `from` and hands each chunk to a writer that sends it to
+    // `to` once it is `delay` old
+    void pump(int from, int to) {
+        Pipe pipe;
+        std::thread writer([&] {
+            for (;;) {
+                std::unique_lock<std::mutex> lock(pipe.mutex);
+                pipe.ready.wait(lock, [&] { return pipe.closed || !pipe.chunks.empty(); });
+                if (pipe.chunks.empty()) break;
+                auto [due, data] = std::move(pipe.chunks.front());
+                pipe.chunks.pop_front();
+                lock.unlock();
+                std::this_thread::sleep_until(due);
+                send(to, data.data(), data.size(), MSG_NOSIGNAL);
+            }
+            shutdown(to, SHUT_WR);
+        });
+        char buf[16384];
+        for (;;) {
+            ssize_t n = recv(from, buf, sizeof(buf), 0);
+            std::lock_guard<std::mutex> lock(pipe.mutex);
+            if (n <= 0) {
+                pipe.closed = true;
+                pipe.ready.notify_one();
+                break;
+            }
+            pipe.chunks.emplace_back(Clock::now() + std::chrono::milliseconds(delay_ms_), std::string(buf, (size_t)n));
+            pipe.ready.notify_one();
+        }
+        writer.join();
+    }
+
+    void serve() {
+        while (!stopping_) {
+            int client = accept(listener_, nullptr, nullptr);
+            if (client < 0) continue;
+            int server = connect_loopback(target_);
+            if (server < 0) {
+                close(client);
+                continue;
+            }
+            std::thread([this, client, server] {
+                std::thread back([this, client, server] { pump(server, client); });
+                pump(client, server);
+                back.join();
+                close(client);
+                close(server);
+            }).detach();
+        }
+    }
+
+    int target_ = 0, delay_ms_ = 0, listener_ = -1, port_ = 0;
+    std::atomic<bool> stopping_{false};
+    std::thread thread_;
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options opts;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--rtt-ms" && i + 1 < argc) opts.rtt_ms = atoi(argv[++i]);
+        else if (arg == "--launches" && i + 1 < argc) opts.launches = atoi(argv[++i]);
+        else if (arg == "--tls12") opts.tls12 = true;
+        else if (arg == "--dir" && i + 1 < argc) opts.dir = argv[++i];
+        else {
+            std::cerr << "usage: tls_resume_test [--rtt-ms N] [--launches N] [--tls12] [--dir DIR]\n";
+            return 1;
+        }
+    }
+    if (opts.launches < 2 || opts.rtt_ms < 0) {
+        std::cerr << "need --launches >= 2 and --rtt-ms >= 0\n";
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    EVP_PKEY* key = nullptr;
+    X509* cert = nullptr;
+    std::string ca_file = opts.dir + "/tls_resume_test_ca.pem";
+    std::string cache_file = opts.dir + "/tls_resume_test_sessions.dat";
+    FILE* pem = make_certificate(key, cert) ? fopen(ca_file.c_str(), "w") : nullptr;
+    if (!pem || PEM_write_X509(pem, cert) != 1) {
+        std::cerr << "cannot create the test certificate in " << opts.dir << "\n";
+        return 1;
+    }
+    fclose(pem);
+
+    TlsServer server;
+    DelayRelay relay;
+    if (!server.start(key, cert, opts.tls12) || !relay.start(server.port(), opts.rtt_ms / 2)) {
+        std::cerr << "cannot listen on 127.0.0.1\n";
+        return 1;
+    }
+    std::string url = "https://localhost:" + std::to_string(relay.port()) + "/ipcheck";
+    printf("server %s, relay adds %d ms per round trip\n\n", opts.tls12 ? "TLS 1.2" : "TLS 1.3 with early data", opts.rtt_ms);
+    printf("%-11s %6s  %-7s %-16s %-24s %10s %10s\n", "run", "launch", "request", "handshake", "early data", "handshake",
+           "response");
+
+    struct Run {
+        const char* name;
+        bool cache, early_data;
+    };
+    int failures = 0;
+    for (Run run : {Run{"no cache", false, false}, Run{"cache", true, false}, Run{"early data", true, true}}) {
+        std::remove(cache_file.c_str());
+        for (int launch = 1; launch <= opts.launches; ++launch) {
+            TlsSessionCache cache;
+            cache.open(cache_file);
+            HttpsClientOptions options;
+            options.user_agent = "tls_resume_test";
+            options.timeout_ms = 10000 + 4 * opts.rtt_ms;
+            options.early_data = run.early_data;
+            options.ca_file = ca_file;
+            HttpsClient client(run.cache ? &cache : nullptr, options);
+            bool post = run.early_data && launch == opts.launches;
+            HttpsResponse r = post ? client.post(url, "{}", "application/json") : client.get(url);
+            const char* early = !r.tls.early_data_sent ? "-" : r.tls.early_data_accepted ? "sent, accepted" : "sent, rejected";
+            printf("%-11s %6d  %-7s %-16s %-24s %8.0fms %8.0fms", run.name, launch, post ? "POST" : "GET",
+                   r.tls.resumed ? "resumed" : "full", early, r.tls.handshake_ms, r.total_ms);
+            if (r.status != 200) printf("  FAILED: %s", r.error.c_str());
+            printf("\n");
+            // What each launch must show
+            bool resumable = run.cache && launch > 1;
+            bool ok = r.status == 200 && r.tls.resumed == resumable && (!post || !r.tls.early_data_sent);
+            if (run.early_data && resumable && !post && !opts.tls12) ok = ok && r.tls.early_data_accepted;
+            if (!ok) ++failures;
+        }
+    }
+
+    relay.stop();
+    server.stop();
+    std::remove(cache_file.c_str());
+    std::remove(ca_file.c_str());
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    printf("\n%s\n", failures ? "FAILED: a launch did not resume or use early data as expected" : "all launches as expected");
+    return failures ? 1 : 0;
+}
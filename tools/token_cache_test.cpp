@@ -0,0 +1,188 @@
+// The login token kept across launches: token_cache.h and the non-Win32
+// branch of protected_file.h, in a temporary directory.
+//
+//   usable         the margin boundary (now + margin_s == expires_at is too
+//                  late), another machine's digest, no URL, no digest
+//   renewal        needs_renewal() from the half-life point on
+//   round trip     store() then load() through write_protected() and
+//                  read_protected(); no ".tmp" left behind
+//   bad files      load() is false for a missing, corrupt or other-version
+//                  file, or one with fields of the wrong type, and leaves
+//                  the token as it was; clear() removes it
+//   disabled       an empty path neither loads nor stores
+//   digest         hardware_digest() ignores network info and changes with
+//                  the hardware identity, dcid and version
+//
+//   g++ -std=c++20 -O2 -pthread -I. tools/token_cache_test.cpp -o token_cache_test -lcrypto
+//   ./token_cache_test
+#include <stdlib.h>
+#include <unistd.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include "token_cache.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (!ok) {
+        printf("  FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+std::string dir;
+
+bool exists(const std::string& path) { return access(path.c_str(), F_OK) == 0; }
+
+void write_raw(const std::string& path, const std::string& data) { std::ofstream(path, std::ios::binary) << data; }
+
+CachedToken token_of(int64_t issued_at, int64_t expires_at) {
+    CachedToken token;
+    token.login_url = "https://login.example/?token=rk1";
+    token.digest = "d1";
+    token.issued_at = issued_at;
+    token.expires_at = expires_at;
+    return token;
+}
+
+void usable() {
+    printf("usable\n");
+    CachedToken token = token_of(1000, 2000);
+    check(token.usable("d1", 1969, 30), "usable one second before the margin");
+    check(!token.usable("d1", 1970, 30), "usable when now + margin_s == expires_at");
+    check(!token.usable("d1", 1971, 30) && !token.usable("d1", 2500, 0), "usable past the margin");
+    check(token.usable("d1", 1999, 0) && !token.usable("d1", 2000, 0), "boundary without a margin");
+    check(!token.usable("d2", 1100, 30), "usable on another machine");
+    check(!token.usable("", 1100, 30), "usable for an empty digest");
+    CachedToken no_url = token;
+    no_url.login_url.clear();
+    check(!no_url.usable("d1", 1100, 30), "usable without a URL");
+    CachedToken no_digest = token;
+    no_digest.digest.clear();
+    check(!no_digest.usable("", 1100, 30), "usable without a digest");
+    check(!CachedToken().usable("", 0, 0), "empty token usable");
+}
+
+void renewal() {
+    printf("renewal\n");
+    CachedToken token = token_of(1000, 2000);
+    check(!token.needs_renewal(1000) && !token.needs_renewal(1499), "renewal before the half-life");
+    check(token.needs_renewal(1500) && token.needs_renewal(1999) && token.needs_renewal(3000), "no renewal from the half-life");
+    CachedToken odd = token_of(1000, 1003);
+    check(!odd.needs_renewal(1000) && odd.needs_renewal(1001), "odd lifetime");
+}
+
+void round_trip() {
+    printf("round trip\n");
+    TokenCache cache(dir + "/token");
+    CachedToken stored = token_of(1760000000, 1760086400);
+    stored.login_url = "https://login.example/?token=rk%22\"\\n";
+    check(cache.enabled() && cache.store(stored), "store failed");
+    check(exists(cache.path()) && !exists(cache.path() + ".tmp"), "file not in place");
+    CachedToken loaded;
+    check(cache.load(loaded), "load failed");
+    check(loaded.login_url == stored.login_url && loaded.digest == stored.digest && loaded.issued_at == stored.issued_at &&
+              loaded.expires_at == stored.expires_at,
+          "token changed on the way");
+
+    CachedToken replaced = token_of(1, 2);
+    check(cache.store(replaced) && cache.load(loaded) && loaded.expires_at == 2, "store did not replace the token");
+
+    std::string data;
+    check(write_protected(dir + "/raw", std::string("a\0b", 3)) && read_protected(dir + "/raw", data) &&
+              data == std::string("a\0b", 3),
+          "protected file round trip");
+    check(!write_protected(dir + "/missing/raw", "x") && !exists(dir + "/missing/raw.tmp"), "write into a missing directory");
+}
+
+void bad_files() {
+    printf("bad files\n");
+    CachedToken before = token_of(5, 6);
+    TokenCache missing(dir + "/missing-token");
+    CachedToken token = before;
+    check(!missing.load(token) && token.login_url == before.login_url && token.expires_at == 6, "missing file loaded");
+
+    TokenCache cache(dir + "/bad-token");
+    for (const char* text : {"", "not json", "{\"v\":1,\"url\":", "[1,2]", "\"text\"", "{\"url\":\"https://x\"}",
+                             "{\"v\":2,\"url\":\"https://x\",\"digest\":\"d1\",\"issued_at\":1,\"expires_at\":9}",
+                             "{\"v\":\"1\",\"url\":\"https://x\"}", "{\"v\":1,\"url\":5}",
+                             "{\"v\":1,\"url\":\"https://x\",\"expires_at\":\"9\"}"}) {
+        write_raw(cache.path(), text);
+        token = before;
+        check(!cache.load(token) && token.login_url == before.login_url && token.digest == before.digest,
+              std::string("loaded: ") + text);
+    }
+    write_raw(cache.path(), "{\"v\":1,\"url\":\"https://x\",\"digest\":\"d1\",\"issued_at\":1,\"expires_at\":9}");
+    check(cache.load(token) && token.login_url == "https://x" && token.expires_at == 9, "current version refused");
+
+    cache.clear();
+    check(!exists(cache.path()) && !cache.load(token), "clear() left the file");
+    cache.clear();
+    check(!exists(cache.path()), "clear() of a missing file");
+}
+
+void disabled() {
+    printf("disabled\n");
+    TokenCache cache;
+    CachedToken token = token_of(1, 2);
+    check(!cache.enabled() && !cache.store(token) && !cache.load(token), "disabled cache used");
+    cache.clear();
+}
+
+Fingerprint machine(const std::string& ip) {
+    Fingerprint fp;
+    fp.uuid = "4C4C4544-0038-4810-8035-B7C04F4E4E32";
+    fp.machine_guid = "a3f1c2d4-5b6e-4f70-8192-a3b4c5d6e7f8";
+    fp.serials = {"S3Z9NB0K712345", "WD-WCC4N7XXXXXX"};
+    fp.ipinfo = {{"IP", ip}, {"CheckTimeUTC", "2026-10-19 08:00:00"}};
+    fp.ipinfo2 = {{"country", "NL"}, {"provider", "Example ISP"}, {"organisation", "Example"}};
+    return fp;
+}
+
+void digest() {
+    printf("digest\n");
+    Fingerprint fp = machine("203.0.113.7");
+    std::string reference = hardware_digest(fp, "dc-7", "2.4.0");
+    check(reference.size() == 64 && reference.find_first_not_of("0123456789abcdef") == std::string::npos,
+          "not hex SHA-256: " + reference);
+
+    Fingerprint moved = machine("198.51.100.23");
+    moved.ipinfo["CheckTimeUTC"] = "2026-10-20 09:00:00";
+    moved.ipinfo2 = {{"country", "DE"}};
+    check(hardware_digest(moved, "dc-7", "2.4.0") == reference, "network info changed the digest");
+    Fingerprint reordered = fp;
+    reordered.serials = {"wd-wcc4n7xxxxxx", " S3Z9NB0K712345"};
+    check(hardware_digest(reordered, "dc-7", "2.4.0") == reference, "disk order or case changed the digest");
+
+    check(hardware_digest(fp, "dc-8", "2.4.0") != reference, "dcid ignored");
+    check(hardware_digest(fp, "dc-7", "2.4.1") != reference, "version ignored");
+    // The separator keeps dcid and version apart
+    check(hardware_digest(fp, "dc-72.4.0", "") != hardware_digest(fp, "dc-7", "2.4.0"), "dcid and version run together");
+    Fingerprint other = fp;
+    other.uuid = "11111111-2222-3333-4444-555555555555";
+    check(hardware_digest(other, "dc-7", "2.4.0") != reference, "hardware identity ignored");
+}
+
+}  // namespace
+
+int main() {
+    char path[] = "/tmp/token_cache_test.XXXXXX";
+    if (!mkdtemp(path)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    dir = path;
+    usable();
+    renewal();
+    round_trip();
+    bad_files();
+    disabled();
+    digest();
+    for (const char* name : {"/token", "/raw", "/bad-token"}) std::remove((dir + name).c_str());
+    rmdir(dir.c_str());
+    printf("\n%s\n", failures ? "FAILED: the token cache did not behave as expected" : "all tokens as expected");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,138 @@
+// Throughput of UrlFilter (url_filter.h) as the rule list grows. A lookup
+// does the same number of trie steps with 10 or 100k rules; what grows is the
+// trie's cache footprint, which is what the larger sets end up measuring.
+//
+//   g++ -std=c++17 -O2 tools/url_filter_bench.cpp -o url_filter_bench
+//   ./url_filter_bench [--lookups N] [--rules FILE --urls FILE]
+//
+// With --rules/--urls a real rule list and a URL log (one "type url" pair per
+// line, e.g. "script https://cdn.example.com/app.js") are measured instead of
+// the synthetic sets.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../url_filter.h"
+
+struct Request {
+    std::string url;
+    uint32_t type;
+};
+
+static const char* const TLDS[] = {"com", "net", "org", "io", "co.uk"};
+static const char* const TYPES[] = {"script", "image", "font", "stylesheet", "xhr", "fetch", "media", "ping"};
+
+static std::string random_host(std::mt19937_64& rng) {
+    return "h" + std::to_string(rng() % 100000) + ".site" + std::to_string(rng() % 5000) + "." + TLDS[rng() % 5];
+}
+
+static std::string synthetic_rules(size_t count, std::mt19937_64& rng, std::vector<std::string>& hosts) {
+    std::ostringstream out;
+    for (size_t i = 0; i < count; ++i) {
+        hosts.push_back(random_host(rng));
+        out << (rng() % 8 == 0 ? "allow " : "deny ") << hosts.back();
+        if (rng() % 3 == 0) out << "/p" << rng() % 100 << "/";
+        if (rng() % 4 == 0) out << " types=" << TYPES[rng() % 8];
+        out << "\n";
+    }
+    return out.str();
+}
+
+// Half the URLs are on (subdomains of) rule hosts, half are misses
+static std::vector<Request> synthetic_requests(size_t count, const std::vector<std::string>& rule_hosts,
+                                               std::mt19937_64& rng) {
+    std::vector<Request> out;
+    for (size_t i = 0; i < count; ++i) {
+        std::string host = (i % 2 && !rule_hosts.empty()) ? "cdn." + rule_hosts[rng() % rule_hosts.size()]
+                                                          : random_host(rng);
+        out.push_back({"https://" + host + "/p" + std::to_string(rng() % 100) + "/asset" + std::to_string(i) +
+                           ".js?v=" + std::to_string(rng() % 1000),
+                       url_resource_type_from_name(TYPES[rng() % 8])});
+    }
+    return out;
+}
+
+static void run(const char* label, UrlFilter& filter, const std::vector<Request>& requests, size_t lookups) {
+    // Warm-up pass so the first measurement is not paying for page faults
+    for (const auto& r : requests) filter.check(r.url, r.type);
+    filter.reset_counters();
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < lookups; ++i) {
+        const Request& r = requests[i % requests.size()];
+        filter.check(r.url, r.type);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%-14s %8zu rules %9zu nodes  %7.1f ns/lookup  %6.2f M lookups/s  %5.1f%% blocked\n", label,
+           filter.size(), filter.node_count(), seconds * 1e9 / lookups, lookups / seconds / 1e6,
+           100.0 * filter.blocked() / filter.checked());
+}
+
+static bool read_file(const char* path, std::string& out) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    out.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+int main(int argc, char** argv) {
+    size_t lookups = 2000000;
+    const char* rules_path = nullptr;
+    const char* urls_path = nullptr;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--lookups") && i + 1 < argc) lookups = strtoull(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--rules") && i + 1 < argc) rules_path = argv[++i];
+        else if (!strcmp(argv[i], "--urls") && i + 1 < argc) urls_path = argv[++i];
+        else {
+            std::cerr << "usage: url_filter_bench [--lookups N] [--rules FILE --urls FILE]\n";
+            return 1;
+        }
+    }
+
+    if (rules_path || urls_path) {
+        std::string rules, urls, error;
+        if (!rules_path || !urls_path || !read_file(rules_path, rules) || !read_file(urls_path, urls)) {
+            std::cerr << "need readable --rules and --urls files\n";
+            return 1;
+        }
+        UrlFilter filter;
+        if (!filter.load(rules, error)) {
+            std::cerr << rules_path << ": " << error << "\n";
+            return 1;
+        }
+        std::vector<Request> requests;
+        std::istringstream in(urls);
+        std::string type, url;
+        while (in >> type >> url) {
+            uint32_t t = url_resource_type_from_name(type);
+            requests.push_back({url, t ? t : (uint32_t)URL_TYPE_OTHER});
+        }
+        if (requests.empty()) {
+            std::cerr << urls_path << ": no requests\n";
+            return 1;
+        }
+        run(rules_path, filter, requests, lookups);
+        return 0;
+    }
+
+    for (size_t count : {10, 1000, 10000, 100000}) {
+        std::mt19937_64 rng(1);
+        UrlFilter filter;
+        std::vector<std::string> hosts;
+        std::string error;
+        if (!filter.load(synthetic_rules(count, rng, hosts), error)) {
+            std::cerr << error << "\n";
+            return 1;
+        }
+        std::mt19937_64 request_rng(2);
+        std::vector<Request> requests = synthetic_requests(4096, hosts, request_rng);
+        run("synthetic", filter, requests, lookups);
+    }
+    return 0;
+}
@@ -0,0 +1,289 @@
+// Rule matching of url_filter.h: which rule decides a request, and whether it
+// is blocked.
+//
+//   labels       host rules match the host and its subdomains on a label
+//                boundary only ("example.com" is not "badexample.com")
+//   specificity  longest host, then longest path prefix; allow beats deny
+//                on a tie, in either order
+//   documents    rules without types= never block a document
+//   types        types= limits a rule to those resource types
+//   hosts        userinfo, ports, IPv6 literals, trailing dots, case
+//   load         a bad line leaves the previous rules as they were
+//   hits         check() counts hits per rule, match() does not
+//
+// Then --urls random requests against random rules, compared with a
+// rule-by-rule reference matcher.
+//
+//   g++ -std=c++17 -O2 -I. tools/url_filter_test.cpp -o url_filter_test
+//   ./url_filter_test [--urls 200000] [--seed 1]
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "url_filter.h"
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (!ok) {
+        printf("  FAILED: %s\n", what.c_str());
+        ++failures;
+    }
+}
+
+UrlFilter filter_of(const std::string& rules) {
+    UrlFilter filter;
+    std::string error;
+    if (!filter.load(rules, error)) check(false, "rules not loaded: " + error);
+    return filter;
+}
+
+// The text of the deciding rule, "" if none matched
+std::string decided_by(const UrlFilter& filter, const std::string& url, uint32_t type = URL_TYPE_SCRIPT) {
+    UrlFilter::Decision d = filter.match(url, type);
+    return d.rule < 0 ? "" : filter.rule(d.rule).text;
+}
+
+bool blocked(const UrlFilter& filter, const std::string& url, uint32_t type = URL_TYPE_SCRIPT) {
+    return filter.match(url, type).blocked;
+}
+
+void labels() {
+    printf("labels\n");
+    UrlFilter filter = filter_of("deny example.com\ndeny *.tracker.net\n");
+    for (const char* url : {"https://example.com/", "https://a.example.com/x", "https://a.b.example.com",
+                            "https://tracker.net/", "https://cdn.tracker.net/t.js"}) {
+        check(blocked(filter, url), std::string("not blocked: ") + url);
+    }
+    for (const char* url : {"https://badexample.com/", "https://xample.com/", "https://example.com.evil.net/",
+                            "https://example.co/", "https://com/", "https://atracker.net/", "https://example.org/"}) {
+        check(!blocked(filter, url), std::string("blocked: ") + url);
+    }
+}
+
+void specificity() {
+    printf("specificity\n");
+    UrlFilter filter = filter_of(
+        "deny example.com\n"
+        "allow example.com/login/\n"
+        "deny example.com/login/track\n"
+        "allow cdn.example.com\n"
+        "deny cdn.example.com/ads/\n");
+    check(decided_by(filter, "https://example.com/app.js") == "deny example.com", "host rule");
+    check(decided_by(filter, "https://example.com/login/form.js") == "allow example.com/login/", "path prefix");
+    check(decided_by(filter, "https://example.com/login/tracker.js") == "deny example.com/login/track", "longer prefix");
+    check(decided_by(filter, "https://example.com/login") == "deny example.com", "prefix longer than the path");
+    check(decided_by(filter, "https://example.com/Login/form.js") == "deny example.com", "path prefix matched without case");
+    // A longer host beats a longer path
+    check(decided_by(filter, "https://cdn.example.com/login/track.js") == "allow cdn.example.com", "longer host");
+    check(decided_by(filter, "https://cdn.example.com/ads/x.js?login/") == "deny cdn.example.com/ads/", "query as path");
+
+    for (const char* rules : {"deny x.com/a\nallow x.com/a\n", "allow x.com/a\ndeny x.com/a\n", "deny *\nallow *\n",
+                              "allow *.x.com\ndeny x.com\n"}) {
+        UrlFilter tie = filter_of(rules);
+        check(!blocked(tie, "https://x.com/abc"), std::string("deny won a tie: ") + rules);
+    }
+    UrlFilter any = filter_of("deny *\nallow example.com\n");
+    check(blocked(any, "https://other.com/") && !blocked(any, "https://example.com/"), "'*' against a host rule");
+}
+
+void documents() {
+    printf("documents\n");
+    UrlFilter filter = filter_of("deny login.example.com\ndeny *\n");
+    check(!blocked(filter, "https://login.example.com/", URL_TYPE_DOCUMENT), "host rule blocked a document");
+    check(!blocked(filter, "https://other.com/", URL_TYPE_DOCUMENT), "'*' blocked a document");
+    check(blocked(filter, "https://other.com/", URL_TYPE_IMAGE), "'*' did not block an image");
+    UrlFilter explicit_types = filter_of("deny popup.example.com types=document\ndeny ads.example.com types=all\n");
+    check(blocked(explicit_types, "https://popup.example.com/", URL_TYPE_DOCUMENT), "types=document");
+    check(!blocked(explicit_types, "https://popup.example.com/", URL_TYPE_SCRIPT), "types=document blocked a script");
+    check(blocked(explicit_types, "https://ads.example.com/", URL_TYPE_DOCUMENT), "types=all");
+}
+
+void types() {
+    printf("types\n");
+    UrlFilter filter = filter_of(
+        "deny * types=font,media\n"
+        "deny example.com/collect types=xhr,ping\n"
+        "allow example.com/collect/ok types=ping\n");
+    check(blocked(filter, "https://fonts.example.net/a.woff2", URL_TYPE_FONT), "font");
+    check(blocked(filter, "https://v.example.net/a.mp4", URL_TYPE_MEDIA), "media");
+    check(!blocked(filter, "https://fonts.example.net/a.css", URL_TYPE_STYLESHEET), "stylesheet");
+    check(blocked(filter, "https://example.com/collect", URL_TYPE_XHR), "xhr");
+    check(!blocked(filter, "https://example.com/collect", URL_TYPE_FETCH), "fetch");
+    check(!blocked(filter, "https://example.com/collect/ok", URL_TYPE_PING), "allow for one type");
+    check(blocked(filter, "https://example.com/collect/ok", URL_TYPE_XHR), "allow for another type");
+    // A rule for other types does not hide a less specific one for this type
+    check(decided_by(filter, "https://example.com/collect/x.woff", URL_TYPE_FONT) == "deny * types=font,media", "fallback");
+
+    std::string error;
+    UrlFilter bad;
+    check(!bad.add("deny x.com types=script,bogus", error) && error == "unknown resource type 'bogus'", "bad type: " + error);
+    check(!bad.add("deny x.com color=red", error) && error == "unknown option 'color=red'", "bad option: " + error);
+    check(!bad.add("block x.com", error) && !bad.add("deny", error) && bad.empty(), "bad rules added");
+}
+
+void hosts() {
+    printf("hosts\n");
+    UrlFilter filter = filter_of("deny example.com\ndeny [::1]\ndeny 10.0.0.1\n");
+    for (const char* url : {"https://user:pw@example.com/", "https://example.com:8443/x", "https://user@EXAMPLE.Com.:443",
+                            "https://a.example.com?q=1", "https://example.com#frag", "wss://example.com/socket",
+                            "http://[::1]:8080/", "http://[::1]", "http://10.0.0.1:80/x", "https://good.net@example.com/"}) {
+        check(blocked(filter, url), std::string("not blocked: ") + url);
+    }
+    for (const char* url : {"https://example.com@good.net/", "https://example.com:pw@good.net/", "https://good.net/?u=example.com",
+                            "https://good.net/example.com", "http://[::2]/", "http://110.0.0.1/", "http://10.0.0.10/",
+                            "about:blank", "data:text/html,example.com", "file:///example.com", "https://", "example.com/x"}) {
+        check(!blocked(filter, url), std::string("blocked: ") + url);
+    }
+}
+
+void load() {
+    printf("load\n");
+    UrlFilter filter;
+    std::string error;
+    check(filter.load("# rules\n\ndeny a.com   # trailing comment\n", error) && filter.size() == 1, "first load: " + error);
+    check(filter.rule(0).text == "deny a.com", "rule text: " + filter.rule(0).text);
+    check(!filter.load("deny b.com\nallow\ndeny c.com\n", error) && error == "line 2: missing host", "bad load: " + error);
+    check(filter.size() == 1 && blocked(filter, "https://a.com/") && !blocked(filter, "https://b.com/") &&
+              !blocked(filter, "https://c.com/"),
+          "failed load changed the rules");
+    check(filter.load("deny b.com\n", error) && filter.size() == 2 && blocked(filter, "https://b.com/"), "load appends");
+}
+
+void hits() {
+    printf("hits\n");
+    UrlFilter filter = filter_of("deny a.com\nallow a.com/ok/\n");
+    filter.match("https://a.com/", URL_TYPE_SCRIPT);
+    check(filter.hits(0) == 0 && filter.checked() == 0, "match() counted");
+    filter.check("https://a.com/x", URL_TYPE_SCRIPT);
+    filter.check("https://b.a.com/y", URL_TYPE_IMAGE);
+    filter.check("https://a.com/ok/z", URL_TYPE_SCRIPT);
+    filter.check("https://b.com/", URL_TYPE_SCRIPT);
+    filter.check("https://a.com/", URL_TYPE_DOCUMENT);
+    check(filter.hits(0) == 2 && filter.hits(1) == 1, "hits per rule");
+    check(filter.checked() == 5 && filter.blocked() == 2, "checked and blocked");
+    filter.reset_counters();
+    check(filter.hits(0) == 0 && filter.hits(1) == 0 && filter.checked() == 0 && filter.blocked() == 0, "reset");
+}
+
+// Rule by rule, from the UrlRule fields
+struct Reference {
+    std::vector<UrlRule> rules;
+
+    static bool split(const std::string& url, std::string& host, std::string& path) {
+        size_t scheme = url.find("://");
+        if (scheme == std::string::npos) return false;
+        size_t start = scheme + 3;
+        size_t end = url.find_first_of("/?#", start);
+        std::string authority = url.substr(start, end == std::string::npos ? end : end - start);
+        host = authority.substr(authority.rfind('@') == std::string::npos ? 0 : authority.rfind('@') + 1);
+        host = host[0] == '[' ? host.substr(0, host.find(']') + 1) : host.substr(0, host.find(':'));
+        if (!host.empty() && host.back() == '.') host.pop_back();
+        for (auto& c : host) c = (char)tolower((unsigned char)c);
+        path = end == std::string::npos ? "" : url.substr(end, url.find_first_of("?#", end) - end);
+        if (path.empty()) path = "/";
+        return !host.empty();
+    }
+
+    // (host length, path length, allow) of the deciding rule; blocked
+    bool decide(const std::string& url, uint32_t type, int& rule) const {
+        std::string host, path;
+        rule = -1;
+        if (!split(url, host, path)) return false;
+        long best[3] = {-1, -1, -1};
+        for (size_t i = 0; i < rules.size(); ++i) {
+            const UrlRule& r = rules[i];
+            if (!(r.types & type)) continue;
+            bool host_match = r.host.empty() || host == r.host ||
+                              (host.size() > r.host.size() && host.compare(host.size() - r.host.size(), r.host.size(), r.host) == 0 &&
+                               host[host.size() - r.host.size() - 1] == '.');
+            if (!host_match || path.compare(0, r.path.size(), r.path) != 0) continue;
+            long score[3] = {(long)r.host.size(), (long)r.path.size(), r.allow ? 1 : 0};
+            if (std::lexicographical_compare(best, best + 3, score, score + 3)) {
+                std::copy(score, score + 3, best);
+                rule = (int)i;
+            }
+        }
+        return rule >= 0 && !rules[rule].allow;
+    }
+};
+
+void random_urls(size_t count, unsigned seed) {
+    printf("random: %zu urls, seed %u\n", count, seed);
+    std::mt19937 rng(seed);
+    auto pick = [&](const std::vector<std::string>& from) { return from[rng() % from.size()]; };
+    const std::vector<std::string> labels = {"a", "b", "ab", "ba", "xa", "example", "badexample", "com"};
+    const std::vector<std::string> paths = {"", "/", "/a", "/a/", "/ab", "/b", "/a/b", "/A"};
+    const std::vector<std::string> type_names = {"", "", " types=script", " types=image,script", " types=document",
+                                                 " types=all"};
+    auto host = [&] {
+        std::string h = pick(labels);
+        for (size_t n = rng() % 3; n-- > 0;) h = pick(labels) + "." + h;
+        return h;
+    };
+    size_t mismatches = 0;
+    for (int round = 0; round < 20; ++round) {
+        std::string rules;
+        for (size_t n = 1 + rng() % 12; n-- > 0;) {
+            rules += rng() % 3 == 0 ? "allow " : "deny ";
+            rules += rng() % 8 == 0 ? "*" : (rng() % 4 == 0 ? "*." : "") + host();
+            rules += pick(paths) + pick(type_names) + "\n";
+        }
+        UrlFilter filter = filter_of(rules);
+        Reference reference;
+        for (size_t i = 0; i < filter.size(); ++i) reference.rules.push_back(filter.rule(i));
+        for (size_t i = 0; i < count / 20; ++i) {
+            std::string h = host();
+            if (rng() % 4 == 0) for (auto& c : h) c = (char)toupper((unsigned char)c);
+            std::string url = "https://" + std::string(rng() % 8 == 0 ? "u@" : "") + h + (rng() % 8 == 0 ? ":8443" : "") +
+                              pick(paths) + (rng() % 4 == 0 ? "?x=/a" : "");
+            uint32_t type = rng() % 4 == 0 ? URL_TYPE_DOCUMENT : rng() % 2 ? URL_TYPE_SCRIPT : URL_TYPE_IMAGE;
+            int expected_rule;
+            bool expected = reference.decide(url, type, expected_rule);
+            UrlFilter::Decision got = filter.match(url, type);
+            // Identical rules tie; compare what decided, not which copy
+            bool same_rule = (got.rule < 0) == (expected_rule < 0) &&
+                             (got.rule < 0 || (filter.rule(got.rule).host == reference.rules[expected_rule].host &&
+                                               filter.rule(got.rule).path == reference.rules[expected_rule].path &&
+                                               filter.rule(got.rule).allow == reference.rules[expected_rule].allow));
+            if (got.blocked != expected || !same_rule) {
+                if (mismatches++ < 5) {
+                    printf("  %s (type %u): %s by '%s', expected %s by '%s'\n", url.c_str(), type, got.blocked ? "blocked" : "allowed",
+                           got.rule < 0 ? "" : filter.rule(got.rule).text.c_str(), expected ? "blocked" : "allowed",
+                           expected_rule < 0 ? "" : reference.rules[expected_rule].text.c_str());
+                }
+            }
+        }
+    }
+    check(mismatches == 0, std::to_string(mismatches) + " decisions differ from the reference");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    size_t urls = 200000;
+    unsigned seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--urls" && i + 1 < argc) urls = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--seed" && i + 1 < argc) seed = (unsigned)strtoul(argv[++i], nullptr, 10);
+        else {
+            std::cerr << "usage: url_filter_test [--urls N] [--seed N]\n";
+            return 1;
+        }
+    }
+    labels();
+    specificity();
+    documents();
+    types();
+    hosts();
+    load();
+    hits();
+    random_urls(urls, seed);
+    printf("\n%s\n", failures ? "FAILED: the filter did not behave as expected" : "all decisions as expected");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,319 @@
+#pragma once
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Resource types a rule can be limited to. main.cpp maps WebView2's
+// COREWEBVIEW2_WEB_RESOURCE_CONTEXT onto these.
+enum UrlResourceType : uint32_t {
+    URL_TYPE_DOCUMENT = 1u << 0,
+    URL_TYPE_STYLESHEET = 1u << 1,
+    URL_TYPE_IMAGE = 1u << 2,
+    URL_TYPE_MEDIA = 1u << 3,
+    URL_TYPE_FONT = 1u << 4,
+    URL_TYPE_SCRIPT = 1u << 5,
+    URL_TYPE_XHR = 1u << 6,
+    URL_TYPE_FETCH = 1u << 7,
+    URL_TYPE_WEBSOCKET = 1u << 8,
+    URL_TYPE_PING = 1u << 9,
+    URL_TYPE_OTHER = 1u << 10,
+    URL_TYPE_ALL = (1u << 11) - 1,
+    // Rules without types= never block documents: a stray host rule must not
+    // be able to take out the login page itself.
+    URL_TYPE_DEFAULT = URL_TYPE_ALL & ~URL_TYPE_DOCUMENT,
+};
+
+inline uint32_t url_resource_type_from_name(const std::string& name) {
+    static const struct { const char* name; uint32_t type; } types[] = {
+        {"document", URL_TYPE_DOCUMENT}, {"stylesheet", URL_TYPE_STYLESHEET}, {"image", URL_TYPE_IMAGE},
+        {"media", URL_TYPE_MEDIA},       {"font", URL_TYPE_FONT},             {"script", URL_TYPE_SCRIPT},
+        {"xhr", URL_TYPE_XHR},           {"fetch", URL_TYPE_FETCH},           {"websocket", URL_TYPE_WEBSOCKET},
+        {"ping", URL_TYPE_PING},         {"other", URL_TYPE_OTHER},           {"all", URL_TYPE_ALL},
+    };
+    for (const auto& t : types) {
+        if (name == t.name) return t.type;
+    }
+    return 0;
+}
+
+struct UrlRule {
+    bool allow = false;
+    std::string host;  // lower case suffix on a label boundary; "" = any host
+    std::string path;  // case-sensitive prefix of the path (query excluded); "" = any
+    uint32_t types = URL_TYPE_DEFAULT;
+    std::string text;  // as written, for reports
+};
+
+// Allow/deny rules for subresource URLs, compiled into one trie so a lookup
+// costs O(length of the URL) whatever the number of rules.
+//
+//   # comment
+//   deny  fonts.googleapis.com                 host and its subdomains
+//   deny  *  types=font,media                   any host, some types
+//   allow cdn.example.com/login/                host + path prefix
+//   deny  example.com/collect types=xhr,ping
+//
+// Rules are keyed on the reversed host followed by a separator and the path,
+// so "*.example.com/js/" is one trie path ("moc.elpmaxe" SEP "/js/"). A
+// lookup walks the reversed request host and, at every label boundary, tries
+// the separator edge into the path part. The most specific matching rule
+// wins (longest host, then longest path); on a tie allow beats deny.
+// Unmatched requests are allowed.
+//
+// match() is const and safe to share; check() also bumps the hit counters and
+// must stay on one thread.
+class UrlFilter {
+public:
+    struct Decision {
+        bool blocked = false;
+        int rule = -1;  // index of the deciding rule, -1 if none matched
+    };
+
+    // Parses one rule line (see above). Blank and comment lines are accepted
+    // and ignored.
+    bool add(const std::string& line, std::string& error) {
+        std::istringstream in(line.substr(0, line.find('#')));
+        std::string action, target, option;
+        if (!(in >> action)) return true;
+        UrlRule rule;
+        if (action == "allow") rule.allow = true;
+        else if (action != "deny") {
+            error = "expected allow or deny, got '" + action + "'";
+            return false;
+        }
+        if (!(in >> target)) {
+            error = "missing host";
+            return false;
+        }
+        size_t slash = target.find('/');
+        rule.host = target.substr(0, slash);
+        if (slash != std::string::npos) rule.path = target.substr(slash);
+        if (rule.host == "*") rule.host.clear();
+        else if (rule.host.compare(0, 2, "*.") == 0) rule.host.erase(0, 2);
+        for (auto& c : rule.host) c = (char)tolower((unsigned char)c);
+        while (in >> option) {
+            if (option.compare(0, 6, "types=") != 0) {
+                error = "unknown option '" + option + "'";
+                return false;
+            }
+            rule.types = 0;
+            std::istringstream names(option.substr(6));
+            std::string name;
+            while (std::getline(names, name, ',')) {
+                uint32_t type = url_resource_type_from_name(name);
+                if (!type) {
+                    error = "unknown resource type '" + name + "'";
+                    return false;
+                }
+                rule.types |= type;
+            }
+        }
+        rule.text = line.substr(0, line.find('#'));
+        while (!rule.text.empty() && isspace((unsigned char)rule.text.back())) rule.text.pop_back();
+        add(std::move(rule));
+        return true;
+    }
+
+    // Newline-separated rules; nothing is added if any line is bad.
+    bool load(const std::string& text, std::string& error) {
+        UrlFilter staged = *this;
+        std::istringstream in(text);
+        std::string line;
+        for (int number = 1; std::getline(in, line); ++number) {
+            if (!staged.add(line, error)) {
+                error = "line " + std::to_string(number) + ": " + error;
+                return false;
+            }
+        }
+        *this = std::move(staged);
+        return true;
+    }
+
+    void add(UrlRule rule) {
+        uint32_t node = ROOT;
+        for (size_t i = rule.host.size(); i-- > 0;) node = child_or_insert(node, (unsigned char)rule.host[i]);
+        node = child_or_insert(node, SEPARATOR);
+        for (char c : rule.path) node = child_or_insert(node, (unsigned char)c);
+        // Prepended; match() looks at every rule on a node anyway
+        compiled_.push_back({rule.types, rule.allow, node_first_[node]});
+        node_first_[node] = (uint32_t)rules_.size();
+        rules_.push_back(std::move(rule));
+        hits_.push_back(0);
+    }
+
+    Decision match(const std::string& url, uint32_t type) const { return match(url.data(), url.size(), type); }
+
+    Decision match(const char* url, size_t len, uint32_t type) const {
+        Decision decision;
+        const char* host;
+        size_t host_len;
+        const char* path;
+        size_t path_len;
+        if (rules_.empty() || !split_url(url, len, host, host_len, path, path_len)) return decision;
+
+        uint64_t best_score = 0;
+        // "*" rules hang off the root
+        match_path(ROOT, 0, path, path_len, type, best_score, decision);
+        uint32_t node = ROOT;
+        for (size_t i = host_len; i-- > 0;) {
+            unsigned char c = (unsigned char)host[i];
+            node = child(node, c >= 'A' && c <= 'Z' ? c + 32 : c);
+            if (node == NONE) break;
+            if (i == 0 || host[i - 1] == '.') match_path(node, host_len - i, path, path_len, type, best_score, decision);
+        }
+        return decision;
+    }
+
+    // match() plus hit counting
+    Decision check(const std::string& url, uint32_t type) {
+        Decision decision = match(url, type);
+        ++checked_;
+        if (decision.rule >= 0) ++hits_[decision.rule];
+        if (decision.blocked) ++blocked_;
+        return decision;
+    }
+
+    bool empty() const { return rules_.empty(); }
+    size_t size() const { return rules_.size(); }
+    const UrlRule& rule(size_t i) const { return rules_[i]; }
+    uint64_t hits(size_t i) const { return hits_[i]; }
+    uint64_t checked() const { return checked_; }
+    uint64_t blocked() const { return blocked_; }
+    size_t node_count() const { return node_first_.size(); }
+
+    void reset_counters() {
+        hits_.assign(hits_.size(), 0);
+        checked_ = blocked_ = 0;
+    }
+
+private:
+    static constexpr uint32_t ROOT = 0;
+    static constexpr uint32_t NONE = UINT32_MAX;
+    static constexpr unsigned SEPARATOR = 0;  // cannot appear in a host or path
+
+    // scheme://[user@]host[:port][/path][?query][#fragment]
+    static bool split_url(const char* url, size_t len, const char*& host, size_t& host_len, const char*& path,
+                          size_t& path_len) {
+        const char* end = url + len;
+        const char* p = url;
+        while (p + 2 < end && !(p[0] == ':' && p[1] == '/' && p[2] == '/')) ++p;
+        if (p + 2 >= end) return false;
+        const char* authority = p + 3;
+        const char* authority_end = authority;
+        while (authority_end < end && *authority_end != '/' && *authority_end != '?' && *authority_end != '#') {
+            ++authority_end;
+        }
+        host = authority;
+        for (const char* q = authority; q < authority_end; ++q) {
+            if (*q == '@') host = q + 1;
+        }
+        const char* host_end = host;
+        if (host_end < authority_end && *host_end == '[') {
+            while (host_end < authority_end && *host_end != ']') ++host_end;
+            if (host_end < authority_end) ++host_end;
+        } else {
+            while (host_end < authority_end && *host_end != ':') ++host_end;
+        }
+        if (host_end > host && host_end[-1] == '.') --host_end;
+        host_len = (size_t)(host_end - host);
+
+        path = authority_end;
+        const char* path_end = path;
+        while (path_end < end && *path_end != '?' && *path_end != '#') ++path_end;
+        path_len = (size_t)(path_end - path);
+        if (path_len == 0) {
+            static const char root_path[] = "/";
+            path = root_path;
+            path_len = 1;
+        }
+        return host_len > 0;
+    }
+
+    void match_path(uint32_t host_node, size_t host_len, const char* path, size_t path_len, uint32_t type,
+                    uint64_t& best_score, Decision& decision) const {
+        uint32_t node = child(host_node, SEPARATOR);
+        for (size_t i = 0; node != NONE; ++i) {
+            for (uint32_t index = node_first_[node]; index != NONE; index = compiled_[index].next) {
+                const CompiledRule& r = compiled_[index];
+                if (!(r.types & type)) continue;
+                // +1 so that a match on the empty "*" rule still beats "no match"
+                uint64_t score = ((((uint64_t)host_len << 24) | i) << 1 | (r.allow ? 1 : 0)) + 1;
+                if (score > best_score) {
+                    best_score = score;
+                    decision.rule = (int)index;
+                    decision.blocked = !r.allow;
+                }
+            }
+            if (i == path_len) break;
+            node = child(node, (unsigned char)path[i]);
+        }
+    }
+
+    // Edges live in one open-addressing table keyed on (node, byte)
+    static uint64_t edge_key(uint32_t node, unsigned byte) { return ((uint64_t)node << 8 | byte) + 1; }
+
+    static size_t edge_slot(uint64_t key, size_t mask) {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        return (size_t)key & mask;
+    }
+
+    uint32_t child(uint32_t node, unsigned byte) const {
+        uint64_t key = edge_key(node, byte);
+        size_t mask = edge_keys_.size() - 1;
+        for (size_t slot = edge_slot(key, mask);; slot = (slot + 1) & mask) {
+            if (edge_keys_[slot] == key) return edge_values_[slot];
+            if (edge_keys_[slot] == 0) return NONE;
+        }
+    }
+
+    uint32_t child_or_insert(uint32_t node, unsigned byte) {
+        uint32_t existing = child(node, byte);
+        if (existing != NONE) return existing;
+        if ((edge_count_ + 1) * 2 > edge_keys_.size()) grow_edges();
+        uint32_t created = (uint32_t)node_first_.size();
+        node_first_.push_back(NONE);
+        insert_edge(edge_key(node, byte), created);
+        ++edge_count_;
+        return created;
+    }
+
+    void insert_edge(uint64_t key, uint32_t value) {
+        size_t mask = edge_keys_.size() - 1;
+        size_t slot = edge_slot(key, mask);
+        while (edge_keys_[slot] != 0) slot = (slot + 1) & mask;
+        edge_keys_[slot] = key;
+        edge_values_[slot] = value;
+    }
+
+    void grow_edges() {
+        std::vector<uint64_t> keys(edge_keys_.size() * 2, 0);
+        std::vector<uint32_t> values(edge_keys_.size() * 2, 0);
+        keys.swap(edge_keys_);
+        values.swap(edge_values_);
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (keys[i]) insert_edge(keys[i], values[i]);
+        }
+    }
+
+    // What match() needs of a rule, kept apart from the strings in UrlRule
+    struct CompiledRule {
+        uint32_t types;
+        bool allow;
+        uint32_t next;  // next rule on the same node
+    };
+
+    std::vector<UrlRule> rules_;
+    std::vector<CompiledRule> compiled_;
+    std::vector<uint64_t> hits_;
+    std::vector<uint32_t> node_first_ = std::vector<uint32_t>(1, NONE);  // first rule per node; [0] is the root
+    std::vector<uint64_t> edge_keys_ = std::vector<uint64_t>(16, 0);
+    std::vector<uint32_t> edge_values_ = std::vector<uint32_t>(16, 0);
+    size_t edge_count_ = 0;
+    uint64_t checked_ = 0;
+    uint64_t blocked_ = 0;
+};
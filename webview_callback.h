@@ -0,0 +1,99 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <string>
+#include <windows.h>
+#include "WebView2.h"
+
+// Generic WebView2 event/completion handler around a std::function.
+// Reference counted, starting at zero: `new XxxHandler(...)` passed to a
+// WebView2 call is owned by the references WebView2 takes, so an event
+// handler (and its captures) is freed when its WebView closes and a
+// completion handler once it has run. Hold one to reuse it in a
+// Microsoft::WRL::ComPtr.
+template <typename Interface, const IID& InterfaceId, typename... Args>
+class WebViewCallback : public Interface {
+public:
+    using Fn = std::function<HRESULT(Args...)>;
+
+    explicit WebViewCallback(Fn fn) : fn(std::move(fn)) {}
+
+    HRESULT STDMETHODCALLTYPE Invoke(Args... args) override {
+        return fn ? fn(args...) : S_OK;
+    }
+    ULONG STDMETHODCALLTYPE AddRef() override { return ++refs; }
+    ULONG STDMETHODCALLTYPE Release() override {
+        ULONG left = --refs;
+        if (left == 0) delete this;
+        return left;
+    }
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) override {
+        if (riid == InterfaceId || riid == IID_IUnknown) {
+            *ppvObject = this;
+            AddRef();
+            return S_OK;
+        }
+        *ppvObject = nullptr;
+        return E_NOINTERFACE;
+    }
+
+private:
+    virtual ~WebViewCallback() = default;
+
+    Fn fn;
+    std::atomic<ULONG> refs{0};
+};
+
+using EnvironmentCompletedHandler = WebViewCallback<
+    ICoreWebView2CreateCoreWebView2EnvironmentCompletedHandler, IID_ICoreWebView2CreateCoreWebView2EnvironmentCompletedHandler,
+    HRESULT, ICoreWebView2Environment*>;
+
+using ControllerCompletedHandler = WebViewCallback<
+    ICoreWebView2CreateCoreWebView2ControllerCompletedHandler, IID_ICoreWebView2CreateCoreWebView2ControllerCompletedHandler,
+    HRESULT, ICoreWebView2Controller*>;
+
+using NavigationStartingHandler = WebViewCallback<
+    ICoreWebView2NavigationStartingEventHandler, IID_ICoreWebView2NavigationStartingEventHandler,
+    ICoreWebView2*, ICoreWebView2NavigationStartingEventArgs*>;
+
+using ContentLoadingHandler = WebViewCallback<
+    ICoreWebView2ContentLoadingEventHandler, IID_ICoreWebView2ContentLoadingEventHandler,
+    ICoreWebView2*, ICoreWebView2ContentLoadingEventArgs*>;
+
+using DOMContentLoadedHandler = WebViewCallback<
+    ICoreWebView2DOMContentLoadedEventHandler, IID_ICoreWebView2DOMContentLoadedEventHandler,
+    ICoreWebView2*, ICoreWebView2DOMContentLoadedEventArgs*>;
+
+using NavigationCompletedHandler = WebViewCallback<
+    ICoreWebView2NavigationCompletedEventHandler, IID_ICoreWebView2NavigationCompletedEventHandler,
+    ICoreWebView2*, ICoreWebView2NavigationCompletedEventArgs*>;
+
+using WebMessageReceivedHandler = WebViewCallback<
+    ICoreWebView2WebMessageReceivedEventHandler, IID_ICoreWebView2WebMessageReceivedEventHandler,
+    ICoreWebView2*, ICoreWebView2WebMessageReceivedEventArgs*>;
+
+using WebResourceRequestedHandler = WebViewCallback<
+    ICoreWebView2WebResourceRequestedEventHandler, IID_ICoreWebView2WebResourceRequestedEventHandler,
+    ICoreWebView2*, ICoreWebView2WebResourceRequestedEventArgs*>;
+
+using TrySuspendCompletedHandler = WebViewCallback<
+    ICoreWebView2TrySuspendCompletedHandler, IID_ICoreWebView2TrySuspendCompletedHandler,
+    HRESULT, BOOL>;
+
+// Converts a CoTaskMem-allocated string returned by WebView2 to UTF-8 and frees it.
+inline std::string take_cotaskmem_string(LPWSTR value) {
+    if (!value) return "";
+    int len = WideCharToMultiByte(CP_UTF8, 0, value, -1, NULL, 0, NULL, NULL);
+    std::string str(len > 0 ? len - 1 : 0, '\0');
+    if (len > 1) WideCharToMultiByte(CP_UTF8, 0, value, -1, &str[0], len - 1, NULL, NULL);
+    CoTaskMemFree(value);
+    return str;
+}
+
+inline std::wstring utf8_to_wide(const std::string& value) {
+    if (value.empty()) return L"";
+    int len = MultiByteToWideChar(CP_UTF8, 0, value.data(), (int)value.size(), NULL, 0);
+    std::wstring str(len > 0 ? len : 0, L'\0');
+    if (len > 0) MultiByteToWideChar(CP_UTF8, 0, value.data(), (int)value.size(), &str[0], len);
+    return str;
+}
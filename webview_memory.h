@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <windows.h>
+#include <psapi.h>
+#include <wrl/client.h>
+#include "WebView2.h"
+
+struct WebViewMemoryUsage {
+    size_t processes = 0;
+    uint64_t private_bytes = 0;
+    uint64_t working_set = 0;
+};
+
+inline void add_process_memory(DWORD pid, WebViewMemoryUsage& usage) {
+    HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION | PROCESS_VM_READ, FALSE, pid);
+    if (!process) return;
+    PROCESS_MEMORY_COUNTERS_EX counters = {};
+    counters.cb = sizeof(counters);
+    if (K32GetProcessMemoryInfo(process, (PROCESS_MEMORY_COUNTERS*)&counters, sizeof(counters))) {
+        ++usage.processes;
+        usage.private_bytes += counters.PrivateUsage;
+        usage.working_set += counters.WorkingSetSize;
+    }
+    CloseHandle(process);
+}
+
+// Memory of every process the WebView2 runtime started for this environment
+// (browser, renderers, GPU, utilities). Runtimes without
+// ICoreWebView2Environment8 only report the browser process.
+inline WebViewMemoryUsage webview_memory_usage(ICoreWebView2Environment* env, ICoreWebView2* webview) {
+    WebViewMemoryUsage usage;
+    Microsoft::WRL::ComPtr<ICoreWebView2Environment8> env8;
+    Microsoft::WRL::ComPtr<ICoreWebView2ProcessInfoCollection> infos;
+    if (env && SUCCEEDED(env->QueryInterface(IID_ICoreWebView2Environment8, reinterpret_cast<void**>(env8.GetAddressOf())))
+        && SUCCEEDED(env8->GetProcessInfos(&infos))) {
+        UINT32 count = 0;
+        infos->get_Count(&count);
+        for (UINT32 i = 0; i < count; ++i) {
+            Microsoft::WRL::ComPtr<ICoreWebView2ProcessInfo> info;
+            INT32 pid = 0;
+            if (SUCCEEDED(infos->GetValueAtIndex(i, &info)) && SUCCEEDED(info->get_ProcessId(&pid))) {
+                add_process_memory((DWORD)pid, usage);
+            }
+        }
+        return usage;
+    }
+    UINT32 browser_pid = 0;
+    if (webview && SUCCEEDED(webview->get_BrowserProcessId(&browser_pid))) add_process_memory(browser_pid, usage);
+    return usage;
+}
+
+// "212.4 MB private, 180.2 MB working set (6 processes)"
+inline std::string format_memory_usage(const WebViewMemoryUsage& usage) {
+    char buf[128];
+    snprintf(buf, sizeof(buf), "%.1f MB private, %.1f MB working set (%zu processes)",
+             usage.private_bytes / (1024.0 * 1024.0), usage.working_set / (1024.0 * 1024.0), usage.processes);
+    return buf;
+}